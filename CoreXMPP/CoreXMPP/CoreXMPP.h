@@ -43,17 +43,27 @@ FOUNDATION_EXPORT const unsigned char CoreXMPPVersionString[];
 
 // In this header, you should import all the public headers of your framework using statements like #import <CoreXMPP/PublicHeader.h>
 
+#import <CoreXMPP/PXDocument+WireData.h>
 #import <CoreXMPP/XMPPAccountConnectivity.h>
 #import <CoreXMPP/XMPPAccountManager.h>
+#import <CoreXMPP/XMPPBOSHStream.h>
 #import <CoreXMPP/XMPPClient.h>
 #import <CoreXMPP/XMPPClientFactory.h>
 #import <CoreXMPP/XMPPClientStreamManagement.h>
 #import <CoreXMPP/XMPPConnection.h>
 #import <CoreXMPP/XMPPDispatcherImpl.h>
+#import <CoreXMPP/XMPPDispatcherObserver.h>
+#import <CoreXMPP/XMPPDispatcherStanzaFilter.h>
+#import <CoreXMPP/XMPPDispatcherStatistics.h>
 #import <CoreXMPP/XMPPDocumentHandler.h>
 #import <CoreXMPP/XMPPError.h>
+#import <CoreXMPP/XMPPHostMetaCache.h>
+#import <CoreXMPP/XMPPLogger.h>
 #import <CoreXMPP/XMPPReconnectStrategy.h>
 #import <CoreXMPP/XMPPRegistrationChallenge.h>
+#import <CoreXMPP/XMPPStanzaPriority.h>
 #import <CoreXMPP/XMPPStream.h>
 #import <CoreXMPP/XMPPStreamFeature.h>
+#import <CoreXMPP/XMPPStreamRecorder.h>
+#import <CoreXMPP/XMPPTCPStream.h>
 #import <CoreXMPP/XMPPWebsocketStream.h>
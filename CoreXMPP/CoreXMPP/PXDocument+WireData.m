@@ -0,0 +1,96 @@
+//
+//  PXDocument+WireData.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import <objc/runtime.h>
+
+#import "PXDocument+WireData.h"
+
+static const void *XMPPWireDataKey = &XMPPWireDataKey;
+
+@implementation PXDocument (WireData)
+
+- (NSData *)xmpp_wireData
+{
+    NSData *wireData = objc_getAssociatedObject(self, XMPPWireDataKey);
+    if (wireData == nil) {
+        wireData = [[self class] xmpp_wireDataWithData:[self data]];
+    }
+    return wireData;
+}
+
+- (void)xmpp_freezeWireData
+{
+    if (objc_getAssociatedObject(self, XMPPWireDataKey) == nil) {
+        NSData *wireData = [[self class] xmpp_wireDataWithData:[self data]];
+        objc_setAssociatedObject(self, XMPPWireDataKey, wireData, OBJC_ASSOCIATION_RETAIN);
+    }
+}
+
++ (NSData *)xmpp_wireDataWithData:(NSData *)data
+{
+    // Strip XML declaration
+
+    const char *bytes = [data bytes];
+    NSUInteger length = [data length];
+
+    if (length < 5 || strncmp(bytes, "<?xml", 5) != 0) {
+        return data;
+    }
+
+    const char *end = strnstr(bytes, "?>", length);
+    if (end == NULL) {
+        return data;
+    }
+
+    NSUInteger offset = end - bytes + 2;
+    while (offset < length && isspace(bytes[offset])) {
+        offset++;
+    }
+
+    // The trailing newline added by the serializer is stripped as well.
+    while (length > offset && isspace(bytes[length - 1])) {
+        length--;
+    }
+
+    // Reference the bytes of the serialized document instead of copying
+    // them. The deallocator keeps the serialized document alive.
+    return [[NSData alloc] initWithBytesNoCopy:(void *)(bytes + offset)
+                                        length:length - offset
+                                   deallocator:^(void *bytes, NSUInteger length) {
+                                       (void)data;
+                                   }];
+}
+
+@end
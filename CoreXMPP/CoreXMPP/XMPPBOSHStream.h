@@ -0,0 +1,64 @@
+//
+//  XMPPBOSHStream.h
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPStream.h"
+#import <Foundation/Foundation.h>
+
+// The URL of the connection manager. If not set, the URL is discovered
+// via the host metadata (XEP-0156) of the host.
+extern NSString *_Nonnull const XMPPBOSHStreamURLKey NS_SWIFT_NAME(BOSHStreamURLKey);
+
+// The XMPPHostMetaCache used to discover the URL of the connection manager.
+// Defaults to the shared cache.
+extern NSString *_Nonnull const XMPPBOSHStreamHostMetaCacheKey NS_SWIFT_NAME(BOSHStreamHostMetaCacheKey);
+
+// The longest time (NSNumber, seconds) the connection manager may wait
+// before responding to a request. Defaults to 60s.
+extern NSString *_Nonnull const XMPPBOSHStreamWaitKey NS_SWIFT_NAME(BOSHStreamWaitKey);
+
+// The maximum number of requests (NSNumber) the connection manager may
+// keep waiting at any one time. Defaults to 1.
+extern NSString *_Nonnull const XMPPBOSHStreamHoldKey NS_SWIFT_NAME(BOSHStreamHoldKey);
+
+// BOSH (XEP-0124, XEP-0206) stream. Outbound documents, which are sent while
+// all requests are pending, are batched into the body of the next request.
+// If the stream is suspended, the session is left without terminating it,
+// which keeps the stream management session on the server resumable by the
+// next stream.
+
+NS_SWIFT_NAME(BOSHStream)
+@interface XMPPBOSHStream : XMPPStream
+
+@end
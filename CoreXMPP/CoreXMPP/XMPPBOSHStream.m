@@ -0,0 +1,671 @@
+//
+//  XMPPBOSHStream.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "PXDocument+WireData.h"
+#import "XMPPBOSHStream.h"
+#import "XMPPError.h"
+#import "XMPPHostMetaCache.h"
+#import "XMPPLogger.h"
+#import "XMPPStreamOutboundQueue.h"
+#import "XMPPStreamRecorder.h"
+
+NSString *const XMPPBOSHStreamURLKey = @"XMPPBOSHStreamURLKey";
+NSString *const XMPPBOSHStreamHostMetaCacheKey = @"XMPPBOSHStreamHostMetaCacheKey";
+NSString *const XMPPBOSHStreamWaitKey = @"XMPPBOSHStreamWaitKey";
+NSString *const XMPPBOSHStreamHoldKey = @"XMPPBOSHStreamHoldKey";
+
+NSString *const XMPPBOSHStream_NS = @"http://jabber.org/protocol/httpbind";
+NSString *const XMPPBOSHStream_XBOSH_NS = @"urn:xmpp:xbosh";
+
+static const NSTimeInterval XMPPBOSHStreamDefaultWait = 60.0;
+static const NSUInteger XMPPBOSHStreamDefaultHold = 1;
+static const NSUInteger XMPPBOSHStreamMaximumNumberOfRetries = 3;
+
+@interface XMPPBOSHStreamRequest : NSObject
+@property (nonatomic, readonly) uint64_t rid;
+@property (nonatomic, readonly) NSData *body;
+@property (nonatomic, readonly) uint64_t outboundPosition;
+@property (nonatomic, readonly, getter=isRestart) BOOL restart;
+@property (nonatomic, readwrite) NSUInteger numberOfRetries;
+@property (nonatomic, readwrite) NSURLSessionDataTask *task;
+@property (nonatomic, readwrite) PXElement *responseBody;
+- (instancetype)initWithRID:(uint64_t)rid body:(NSData *)body outboundPosition:(uint64_t)outboundPosition restart:(BOOL)restart;
+@end
+
+@interface XMPPBOSHStream () {
+    XMPPStreamState _state;
+    NSUInteger _sessionGeneration;
+    NSURL *_connectionManagerURL;
+    NSURLSession *_URLSession;
+    XMPPStreamOutboundQueue *_outboundQueue;
+
+    NSString *_sid;
+    NSString *_streamId;
+    NSString *_streamHostname;
+    NSUInteger _requests;
+    NSUInteger _hold;
+    NSTimeInterval _wait;
+
+    uint64_t _nextRID;
+    uint64_t _nextResponseRID;
+    NSMutableDictionary<NSNumber *, XMPPBOSHStreamRequest *> *_pendingRequests;
+    NSMutableDictionary<NSNumber *, XMPPBOSHStreamRequest *> *_completedRequests;
+
+    NSMutableArray<NSData *> *_outgoingPayloads;
+    BOOL _restartPending;
+    BOOL _terminatePending;
+    BOOL _terminateSent;
+    uint64_t _terminateRID;
+    BOOL _sendScheduled;
+}
+
+@end
+
+@implementation XMPPBOSHStream
+
+#pragma mark Life-cycle
+
+- (instancetype)initWithHostname:(NSString *)hostname
+                         options:(NSDictionary *)options
+{
+    self = [super initWithHostname:hostname options:options];
+    if (self) {
+        _pendingRequests = [[NSMutableDictionary alloc] init];
+        _completedRequests = [[NSMutableDictionary alloc] init];
+        _outgoingPayloads = [[NSMutableArray alloc] init];
+        _outboundQueue = [[XMPPStreamOutboundQueue alloc] initWithOptions:options];
+
+        __weak typeof(self) _self = self;
+        _outboundQueue.writabilityHandler = ^(BOOL writable) {
+            typeof(self) this = _self;
+            if ([this.delegate respondsToSelector:@selector(stream:didChangeWritable:)]) {
+                [this.delegate stream:this didChangeWritable:writable];
+            }
+        };
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self xmpp_tearDownSession];
+}
+
+#pragma mark Description
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<XMPPBOSHStream %p (%@)>", self, _connectionManagerURL ?: self.options[XMPPBOSHStreamURLKey]];
+}
+
+#pragma mark State
+
+- (XMPPStreamState)state
+{
+    return _state;
+}
+
+- (BOOL)isWritable
+{
+    return _outboundQueue.writable;
+}
+
+#pragma mark Managing Stream
+
+- (void)open
+{
+    NSAssert(_state == XMPPStreamStateClosed, @"Invalid State: Can only open a closed stream.");
+
+    XMPPLogInfo(XMPPLogCategoryStream, @"Open stream to host: %@", self.hostname);
+
+    NSURL *URL = self.options[XMPPBOSHStreamURLKey];
+    if (URL) {
+        [self xmpp_createSessionWithURL:URL];
+    } else {
+        _state = XMPPStreamStateDiscovering;
+        [self xmpp_discoverConnectionManagerURL];
+    }
+}
+
+- (void)reopen
+{
+    NSAssert(_state == XMPPStreamStateOpen, @"Invalid State: Can only reopen a already opened stream.");
+
+    XMPPLogDebug(XMPPLogCategoryStream, @"Repoen stream to host: %@", self.hostname);
+
+    _state = XMPPStreamStateOpening;
+    _restartPending = YES;
+    [self xmpp_setNeedsSendRequests];
+}
+
+- (void)close
+{
+    NSAssert(_state == XMPPStreamStateOpen, @"Invalid State: Can only close an open stream.");
+
+    XMPPLogInfo(XMPPLogCategoryStream, @"Close stream to host: %@", self.hostname);
+
+    _state = XMPPStreamStateClosing;
+    _terminatePending = YES;
+    [self xmpp_setNeedsSendRequests];
+}
+
+- (void)suspend
+{
+    NSAssert(_state == XMPPStreamStateOpen, @"Invalid State: Can only suspend an open stream.");
+
+    XMPPLogInfo(XMPPLogCategoryStream, @"Suspending stream to host: %@", self.hostname);
+
+    // The session is abandoned without terminating it, which keeps the
+    // stream management session on the server resumable. It is not paused,
+    // because the next stream negotiates a new session anyway.
+    [self xmpp_tearDownSession];
+    _state = XMPPStreamStateClosed;
+
+    if ([self.delegate respondsToSelector:@selector(streamDidClose:)]) {
+        [self.delegate streamDidClose:self];
+    }
+}
+
+#pragma mark Sending Document
+
+- (void)sendDocument:(PXDocument *)document
+{
+    NSAssert(_state == XMPPStreamStateOpen, @"Invalid State: Can only send an element if the stream is open.");
+
+    NSData *data = [document xmpp_wireData];
+    [_outgoingPayloads addObject:data];
+    [_outboundQueue enqueueStanzaWithLength:[data length]];
+    [self xmpp_setNeedsSendRequests];
+}
+
+- (void)sendDocuments:(NSArray<PXDocument *> *)documents
+{
+    NSAssert(_state == XMPPStreamStateOpen, @"Invalid State: Can only send an element if the stream is open.");
+
+    for (PXDocument *document in documents) {
+        NSData *data = [document xmpp_wireData];
+        [_outgoingPayloads addObject:data];
+        [_outboundQueue enqueueStanzaWithLength:[data length]];
+    }
+    [self xmpp_setNeedsSendRequests];
+}
+
+#pragma mark -
+
+#pragma mark Discovering
+
+- (void)xmpp_discoverConnectionManagerURL
+{
+    XMPPLogDebug(XMPPLogCategoryStream, @"Discovering BOSH URL for host: %@", self.hostname);
+
+    NSUInteger generation = _sessionGeneration;
+    XMPPHostMetaCache *cache = self.options[XMPPBOSHStreamHostMetaCacheKey] ?: [XMPPHostMetaCache sharedCache];
+    [cache linksForHost:self.hostname
+             completion:^(NSDictionary<NSString *, NSArray<NSURL *> *> *links, NSError *error) {
+                 dispatch_async([self xmpp_queue], ^{
+                     if (generation != _sessionGeneration || _state != XMPPStreamStateDiscovering) {
+                         return;
+                     }
+                     NSURL *URL = [links[XMPPHostMetaLinkRelationBOSH] firstObject];
+                     if (URL) {
+                         [self xmpp_createSessionWithURL:URL];
+                     } else {
+                         [self xmpp_handleError:error ?: [NSError errorWithDomain:XMPPErrorDomain
+                                                                             code:XMPPErrorCodeDiscoveryError
+                                                                         userInfo:nil]];
+                     }
+                 });
+             }];
+}
+
+#pragma mark Session
+
+- (void)xmpp_createSessionWithURL:(NSURL *)URL
+{
+    [_outboundQueue updateWithOptions:self.options];
+
+    NSNumber *wait = self.options[XMPPBOSHStreamWaitKey];
+    NSNumber *hold = self.options[XMPPBOSHStreamHoldKey];
+
+    _connectionManagerURL = URL;
+    _wait = wait ? [wait doubleValue] : XMPPBOSHStreamDefaultWait;
+    _hold = hold ? MAX([hold unsignedIntegerValue], 1) : XMPPBOSHStreamDefaultHold;
+    _requests = _hold + 1;
+
+    // The session uses one persistent HTTP connection per request that
+    // can be pending at the same time.
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration defaultSessionConfiguration];
+    configuration.HTTPMaximumConnectionsPerHost = _requests;
+    configuration.HTTPShouldUsePipelining = YES;
+    configuration.timeoutIntervalForRequest = _wait + 10.0;
+    _URLSession = [NSURLSession sessionWithConfiguration:configuration];
+
+    // The initial request id must be large enough to not be guessed, but
+    // small enough that the request ids of the session never exceed 2^53.
+    _nextRID = ((uint64_t)arc4random() << 10) | arc4random_uniform(1024);
+    _nextResponseRID = _nextRID;
+
+    _state = XMPPStreamStateConnecting;
+
+    XMPPLogInfo(XMPPLogCategoryStream, @"Connecting to host: %@ (%@)", self.hostname, URL);
+
+    NSDictionary *attributes = @{ @"content" : @"text/xml; charset=utf-8",
+                                  @"hold" : [NSString stringWithFormat:@"%lu", (unsigned long)_hold],
+                                  @"to" : self.hostname,
+                                  @"ver" : @"1.6",
+                                  @"wait" : [NSString stringWithFormat:@"%.0f", _wait],
+                                  @"xml:lang" : @"en",
+                                  @"xmpp:version" : @"1.0",
+                                  @"xmlns:xmpp" : XMPPBOSHStream_XBOSH_NS };
+    [self xmpp_sendRequestWithAttributes:attributes payloads:nil restart:NO];
+}
+
+- (void)xmpp_tearDownSession
+{
+    _sessionGeneration++;
+
+    for (XMPPBOSHStreamRequest *request in [_pendingRequests allValues]) {
+        [request.task cancel];
+    }
+    [_URLSession invalidateAndCancel];
+    _URLSession = nil;
+
+    [_pendingRequests removeAllObjects];
+    [_completedRequests removeAllObjects];
+    [_outgoingPayloads removeAllObjects];
+    [_outboundQueue reset];
+
+    _sid = nil;
+    _streamId = nil;
+    _streamHostname = nil;
+    _restartPending = NO;
+    _terminatePending = NO;
+    _terminateSent = NO;
+    _sendScheduled = NO;
+}
+
+#pragma mark Flow Control
+
+- (void)setReadingPaused:(BOOL)readingPaused
+{
+    BOOL resume = self.readingPaused && !readingPaused;
+    [super setReadingPaused:readingPaused];
+    if (resume) {
+        [self xmpp_setNeedsSendRequests];
+    }
+}
+
+#pragma mark Sending Requests
+
+- (void)xmpp_setNeedsSendRequests
+{
+    // Documents sent in one go are batched into one request.
+    if (_sendScheduled) {
+        return;
+    }
+    _sendScheduled = YES;
+
+    NSUInteger generation = _sessionGeneration;
+    dispatch_async([self xmpp_queue], ^{
+        if (generation == _sessionGeneration) {
+            _sendScheduled = NO;
+            [self xmpp_sendPendingRequests];
+        }
+    });
+}
+
+- (void)xmpp_sendPendingRequests
+{
+    if (_sid == nil || _terminateSent) {
+        return;
+    }
+
+    while ([_pendingRequests count] < _requests) {
+        if (_restartPending) {
+            _restartPending = NO;
+            NSDictionary *attributes = @{ @"to" : self.hostname,
+                                          @"xml:lang" : @"en",
+                                          @"xmpp:restart" : @"true",
+                                          @"xmlns:xmpp" : XMPPBOSHStream_XBOSH_NS };
+            [self xmpp_sendRequestWithAttributes:attributes payloads:nil restart:YES];
+        } else if (_terminatePending) {
+            _terminatePending = NO;
+            _terminateSent = YES;
+            _terminateRID = _nextRID;
+            [self xmpp_sendRequestWithAttributes:@{ @"type" : @"terminate" } payloads:_outgoingPayloads restart:NO];
+            [_outgoingPayloads removeAllObjects];
+            return;
+        } else if ([_outgoingPayloads count] > 0) {
+            [self xmpp_sendRequestWithAttributes:nil payloads:_outgoingPayloads restart:NO];
+            [_outgoingPayloads removeAllObjects];
+        } else if ([_pendingRequests count] < _hold && !self.readingPaused) {
+            // Keep requests waiting at the connection manager, which are
+            // used to push inbound stanzas. While reading is paused, the
+            // connection manager has to hold the inbound stanzas.
+            [self xmpp_sendRequestWithAttributes:nil payloads:nil restart:NO];
+        } else {
+            return;
+        }
+    }
+}
+
+- (void)xmpp_sendRequestWithAttributes:(NSDictionary<NSString *, NSString *> *)attributes
+                              payloads:(NSArray<NSData *> *)payloads
+                               restart:(BOOL)restart
+{
+    uint64_t rid = _nextRID++;
+    NSData *body = [self xmpp_bodyWithRID:rid attributes:attributes payloads:payloads];
+
+    XMPPBOSHStreamRequest *request = [[XMPPBOSHStreamRequest alloc] initWithRID:rid
+                                                                           body:body
+                                                               outboundPosition:_outboundQueue.position
+                                                                        restart:restart];
+    _pendingRequests[@(rid)] = request;
+    [self xmpp_startRequest:request];
+}
+
+- (void)xmpp_startRequest:(XMPPBOSHStreamRequest *)request
+{
+    NSUInteger generation = _sessionGeneration;
+    __weak typeof(self) _self = self;
+    request.task = [_URLSession dataTaskWithRequest:[self xmpp_URLRequestWithBody:request.body]
+                                  completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+                                      typeof(self) this = _self;
+                                      dispatch_async([this xmpp_queue] ?: dispatch_get_main_queue(), ^{
+                                          if (this && this->_sessionGeneration == generation) {
+                                              [this xmpp_request:request didCompleteWithResponse:response data:data error:error];
+                                          }
+                                      });
+                                  }];
+    [request.task resume];
+}
+
+- (NSURLRequest *)xmpp_URLRequestWithBody:(NSData *)body
+{
+    NSMutableURLRequest *request = [[NSMutableURLRequest alloc] initWithURL:_connectionManagerURL];
+    request.HTTPMethod = @"POST";
+    request.HTTPBody = body;
+    request.HTTPShouldUsePipelining = YES;
+    [request setValue:@"text/xml; charset=utf-8" forHTTPHeaderField:@"Content-Type"];
+    return request;
+}
+
+- (NSData *)xmpp_bodyWithRID:(uint64_t)rid
+                  attributes:(NSDictionary<NSString *, NSString *> *)attributes
+                    payloads:(NSArray<NSData *> *)payloads
+{
+    // The wrapper is written by hand. This way the (already serialized)
+    // payloads are appended as they are and the namespaced attributes of
+    // XEP-0206 can be added.
+
+    NSMutableString *startTag = [NSMutableString stringWithFormat:@"<body rid='%llu' xmlns='%@'", rid, XMPPBOSHStream_NS];
+    if (_sid) {
+        [startTag appendFormat:@" sid='%@'", [[self class] xmpp_escapedAttributeValue:_sid]];
+    }
+    [attributes enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSString *value, BOOL *stop) {
+        [startTag appendFormat:@" %@='%@'", name, [[self class] xmpp_escapedAttributeValue:value]];
+    }];
+
+    NSMutableData *body = [[NSMutableData alloc] init];
+    if ([payloads count] == 0) {
+        [startTag appendString:@"/>"];
+        [body appendData:[startTag dataUsingEncoding:NSUTF8StringEncoding]];
+    } else {
+        [startTag appendString:@">"];
+        [body appendData:[startTag dataUsingEncoding:NSUTF8StringEncoding]];
+        for (NSData *payload in payloads) {
+            [body appendData:payload];
+        }
+        [body appendBytes:"</body>" length:7];
+    }
+
+    [self.recorder recordData:body direction:XMPPStreamRecordDirectionOutbound];
+
+    return body;
+}
+
+#pragma mark Handling Responses
+
+- (void)xmpp_request:(XMPPBOSHStreamRequest *)request
+    didCompleteWithResponse:(NSURLResponse *)response
+                       data:(NSData *)data
+                      error:(NSError *)error
+{
+    NSInteger statusCode = [response isKindOfClass:[NSHTTPURLResponse class]] ? [(NSHTTPURLResponse *)response statusCode] : 0;
+
+    if (error || statusCode < 200 || statusCode >= 300) {
+        if (statusCode >= 400 && statusCode < 500) {
+            // The connection manager terminated the session (bad-request,
+            // item-not-found, policy-violation).
+            NSString *errorMessage = [NSString stringWithFormat:@"BOSH session has been terminated by the connection manager (status code %ld).", (long)statusCode];
+            [self xmpp_handleError:[NSError errorWithDomain:XMPPErrorDomain
+                                                       code:XMPPErrorCodeUnknown
+                                                   userInfo:@{NSLocalizedDescriptionKey : errorMessage}]];
+        } else if (request.numberOfRetries < XMPPBOSHStreamMaximumNumberOfRetries) {
+            // Requests are retried with the same request id (XEP-0124, Section 14).
+            XMPPLogWarning(XMPPLogCategoryStream, @"Retrying BOSH request %llu: %@", request.rid, error ? [error localizedDescription] : @(statusCode));
+            request.numberOfRetries += 1;
+            [self xmpp_startRequest:request];
+        } else {
+            NSString *errorMessage = [NSString stringWithFormat:@"BOSH request failed %lu times.", (unsigned long)request.numberOfRetries + 1];
+            NSMutableDictionary *userInfo = [@{NSLocalizedDescriptionKey : errorMessage} mutableCopy];
+            if (error) {
+                userInfo[NSUnderlyingErrorKey] = error;
+            }
+            [self xmpp_handleError:[NSError errorWithDomain:XMPPErrorDomain
+                                                       code:XMPPErrorCodeUnknown
+                                                   userInfo:userInfo]];
+        }
+        return;
+    }
+
+    if (data) {
+        [self.recorder recordData:data direction:XMPPStreamRecordDirectionInbound];
+    }
+
+    PXDocument *document = data ? [PXDocument documentWithData:data] : nil;
+    if (![document.root isEqual:PXQN(XMPPBOSHStream_NS, @"body")]) {
+        NSString *errorMessage = @"Failed to parse received BOSH body.";
+        [self xmpp_handleError:[NSError errorWithDomain:XMPPErrorDomain
+                                                   code:XMPPErrorCodeParseError
+                                               userInfo:@{NSLocalizedDescriptionKey : errorMessage}]];
+        return;
+    }
+
+    [_pendingRequests removeObjectForKey:@(request.rid)];
+    [_outboundQueue dequeueBytesUpToPosition:request.outboundPosition];
+
+    request.task = nil;
+    request.responseBody = document.root;
+    _completedRequests[@(request.rid)] = request;
+
+    // Responses are handled in the order of the requests.
+
+    NSUInteger generation = _sessionGeneration;
+    XMPPBOSHStreamRequest *completedRequest = nil;
+    while ((completedRequest = _completedRequests[@(_nextResponseRID)])) {
+        [_completedRequests removeObjectForKey:@(_nextResponseRID)];
+        _nextResponseRID++;
+        [self xmpp_handleResponseBody:completedRequest.responseBody ofRequest:completedRequest];
+        if (generation != _sessionGeneration) {
+            return;
+        }
+    }
+
+    [self xmpp_sendPendingRequests];
+}
+
+- (void)xmpp_handleResponseBody:(PXElement *)body ofRequest:(XMPPBOSHStreamRequest *)request
+{
+    NSUInteger generation = _sessionGeneration;
+
+    if (_sid == nil) {
+        if (![self xmpp_handleSessionCreationResponseBody:body]) {
+            return;
+        }
+    } else if (request.restart) {
+        [self xmpp_reportOpen];
+    }
+
+    [body enumerateElementsUsingBlock:^(PXElement *element, BOOL *stop) {
+        if (_state != XMPPStreamStateOpen && _state != XMPPStreamStateClosing) {
+            XMPPLogWarning(XMPPLogCategoryStream, @"Can only handle elements if the stream is open. Dropping received element. Current state is %lu and the received element is: %@", (unsigned long)_state, element);
+        } else if ([self.delegate respondsToSelector:@selector(stream:didReceiveDocument:)]) {
+            [self.delegate stream:self didReceiveDocument:[[PXDocument alloc] initWithElement:element]];
+        }
+        *stop = generation != _sessionGeneration;
+    }];
+
+    if (generation != _sessionGeneration) {
+        return;
+    }
+
+    if ([[body valueForAttribute:@"type"] isEqualToString:@"terminate"] ||
+        (_terminateSent && request.rid == _terminateRID)) {
+        [self xmpp_handleTerminateWithCondition:[body valueForAttribute:@"condition"]];
+    }
+}
+
+- (BOOL)xmpp_handleSessionCreationResponseBody:(PXElement *)body
+{
+    NSString *sid = [body valueForAttribute:@"sid"];
+    if (sid == nil) {
+        NSString *condition = [body valueForAttribute:@"condition"];
+        NSString *errorMessage = [NSString stringWithFormat:@"Failed to create BOSH session (%@).", condition ?: @"missing sid"];
+        [self xmpp_handleError:[NSError errorWithDomain:XMPPErrorDomain
+                                                   code:XMPPErrorCodeUnknown
+                                               userInfo:@{NSLocalizedDescriptionKey : errorMessage}]];
+        return NO;
+    }
+
+    NSString *requests = [body valueForAttribute:@"requests"];
+    NSString *hold = [body valueForAttribute:@"hold"];
+    NSString *wait = [body valueForAttribute:@"wait"];
+
+    _sid = sid;
+    _streamId = [body valueForAttribute:@"authid"] ?: sid;
+    _streamHostname = [body valueForAttribute:@"from"] ?: self.hostname;
+    _hold = hold ? MIN((NSUInteger)MAX([hold integerValue], 1), _hold) : _hold;
+    _requests = requests ? (NSUInteger)MAX([requests integerValue], 1) : _hold + 1;
+    _wait = wait ? [wait doubleValue] : _wait;
+
+    XMPPLogDebug(XMPPLogCategoryStream, @"Created BOSH session %@ (requests: %lu, hold: %lu, wait: %.0f)", _sid, (unsigned long)_requests, (unsigned long)_hold, _wait);
+
+    [self xmpp_reportOpen];
+    return YES;
+}
+
+- (void)xmpp_reportOpen
+{
+    _state = XMPPStreamStateOpen;
+
+    if ([self.delegate respondsToSelector:@selector(stream:didOpenToHost:withStreamId:)]) {
+        [self.delegate stream:self didOpenToHost:_streamHostname withStreamId:_streamId];
+    }
+}
+
+- (void)xmpp_handleTerminateWithCondition:(NSString *)condition
+{
+    XMPPLogDebug(XMPPLogCategoryStream, @"BOSH session terminated%@.", condition ? [NSString stringWithFormat:@" (%@)", condition] : @"");
+
+    BOOL expected = _terminateSent || _state == XMPPStreamStateClosing || condition == nil || [condition isEqualToString:@"remote-stream-error"];
+
+    if (expected) {
+        [self xmpp_tearDownSession];
+        _state = XMPPStreamStateClosed;
+
+        if ([self.delegate respondsToSelector:@selector(streamDidClose:)]) {
+            [self.delegate streamDidClose:self];
+        }
+    } else {
+        NSString *errorMessage = [NSString stringWithFormat:@"BOSH session has been terminated by the connection manager (%@).", condition];
+        [self xmpp_handleError:[NSError errorWithDomain:XMPPErrorDomain
+                                                   code:XMPPErrorCodeUnknown
+                                               userInfo:@{NSLocalizedDescriptionKey : errorMessage}]];
+    }
+}
+
+#pragma mark Error Handling
+
+- (void)xmpp_handleError:(NSError *)error
+{
+    XMPPLogError(XMPPLogCategoryStream, @"Stream to host '%@' did fail with error: %@", self.hostname, [error localizedDescription]);
+
+    [self xmpp_tearDownSession];
+    _state = XMPPStreamStateClosed;
+
+    if ([self.delegate respondsToSelector:@selector(stream:didFailWithError:)]) {
+        [self.delegate stream:self didFailWithError:error];
+    }
+}
+
+#pragma mark Operation Queue
+
+- (dispatch_queue_t)xmpp_queue
+{
+    return self.queue ?: dispatch_get_main_queue();
+}
+
+#pragma mark Helper
+
++ (NSString *)xmpp_escapedAttributeValue:(NSString *)value
+{
+    NSMutableString *escaped = [value mutableCopy];
+    [escaped replaceOccurrencesOfString:@"&" withString:@"&amp;" options:0 range:NSMakeRange(0, [escaped length])];
+    [escaped replaceOccurrencesOfString:@"<" withString:@"&lt;" options:0 range:NSMakeRange(0, [escaped length])];
+    [escaped replaceOccurrencesOfString:@"'" withString:@"&apos;" options:0 range:NSMakeRange(0, [escaped length])];
+    [escaped replaceOccurrencesOfString:@"\"" withString:@"&quot;" options:0 range:NSMakeRange(0, [escaped length])];
+    return escaped;
+}
+
+@end
+
+#pragma mark -
+
+@implementation XMPPBOSHStreamRequest
+
+- (instancetype)initWithRID:(uint64_t)rid body:(NSData *)body outboundPosition:(uint64_t)outboundPosition restart:(BOOL)restart
+{
+    self = [super init];
+    if (self) {
+        _rid = rid;
+        _body = body;
+        _outboundPosition = outboundPosition;
+        _restart = restart;
+    }
+    return self;
+}
+
+@end
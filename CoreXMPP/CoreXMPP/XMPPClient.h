@@ -47,6 +47,22 @@
 extern NSString *_Nonnull const XMPPClientOptionsPreferedSASLMechanismsKey NS_SWIFT_NAME(ClientOptionsPreferedSASLMechanismsKey);
 extern NSString *_Nonnull const XMPPClientOptionsResourceKey NS_SWIFT_NAME(ClientOptionsResourceKey);
 
+// Subclass of XMPPStream used if no stream is passed to the client.
+// Defaults to XMPPWebsocketStream.
+extern NSString *_Nonnull const XMPPClientOptionsStreamClassKey NS_SWIFT_NAME(ClientOptionsStreamClassKey);
+
+// Water marks of the received stanzas, which have not been handled by the
+// connection delegate yet (NSNumber). The client pauses reading from the
+// stream, if more stanzas than the high-water mark are pending, and resumes
+// reading, if the pending stanzas dropped below the low-water mark.
+// Streams, which continue to deliver stanzas while reading is paused
+// (websocket streams), are suspended, if twice as many stanzas as the
+// high-water mark are pending. The client fails with an error and the
+// server keeps the stanzas, which have not been acknowledged, for the
+// resumption of the stream. Defaults are 1000 and 250 stanzas.
+extern NSString *_Nonnull const XMPPClientOptionsInboundHighWaterMarkKey NS_SWIFT_NAME(ClientOptionsInboundHighWaterMarkKey);
+extern NSString *_Nonnull const XMPPClientOptionsInboundLowWaterMarkKey NS_SWIFT_NAME(ClientOptionsInboundLowWaterMarkKey);
+
 extern NSString *_Nonnull const XMPPClientDidConnectNotification NS_SWIFT_NAME(ClientDidConnectNotification);
 extern NSString *_Nonnull const XMPPClientDidDisconnectNotification NS_SWIFT_NAME(ClientDidDisconnectNotification);
 extern NSString *_Nonnull const XMPPClientErrorKey NS_SWIFT_NAME(ClientErrorKey);
@@ -37,8 +37,11 @@
 
 #import "XMPPError.h"
 #import "XMPPInBandRegistration.h"
+#import "XMPPLogger.h"
+#import "XMPPStanzaScheduler.h"
 #import "XMPPStreamFeature.h"
 #import "XMPPStreamFeatureBind.h"
+#import "XMPPStreamFeatureCompression.h"
 #import "XMPPStreamFeatureSASL.h"
 #import "XMPPStreamFeatureStreamManagement.h"
 #import "XMPPWebsocketStream.h"
@@ -47,13 +50,26 @@
 
 NSString *const XMPPClientOptionsPreferedSASLMechanismsKey = @"XMPPClientOptionsPreferedSASLMechanismsKey";
 NSString *const XMPPClientOptionsResourceKey = @"XMPPClientOptionsResourceKey";
+NSString *const XMPPClientOptionsStreamClassKey = @"XMPPClientOptionsStreamClassKey";
+NSString *const XMPPClientOptionsInboundHighWaterMarkKey = @"XMPPClientOptionsInboundHighWaterMarkKey";
+NSString *const XMPPClientOptionsInboundLowWaterMarkKey = @"XMPPClientOptionsInboundLowWaterMarkKey";
+
+static const NSUInteger XMPPClientDefaultInboundHighWaterMark = 1000;
+static const NSUInteger XMPPClientDefaultInboundLowWaterMark = 250;
+static const NSUInteger XMPPClientOutboundBatchSize = 100;
 
 NSString *const XMPPClientDidConnectNotification = @"XMPPClientDidConnectNotification";
 NSString *const XMPPClientDidDisconnectNotification = @"XMPPClientDidDisconnectNotification";
 NSString *const XMPPClientErrorKey = @"XMPPClientErrorKey";
 NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
 
-@interface XMPPClient () <XMPPStreamDelegate, XMPPStreamFeatureDelegate, XMPPStreamFeatureDelegateSASL, XMPPStreamFeatureDelegateBind, XMPPStreamFeatureDelegateInBandRegistration> {
+@interface XMPPClientOutboundDocument : NSObject
+@property (nonatomic, readonly) PXDocument *document;
+@property (nonatomic, readonly) void (^completion)(NSError *);
+- (instancetype)initWithDocument:(PXDocument *)document completion:(void (^)(NSError *))completion;
+@end
+
+@interface XMPPClient () <XMPPStreamDelegate, XMPPStreamFeatureDelegate, XMPPStreamFeatureDelegateSASL, XMPPStreamFeatureDelegateBind, XMPPStreamFeatureDelegateCompression, XMPPStreamFeatureDelegateInBandRegistration> {
     dispatch_queue_t _operationQueue;
     XMPPClientState _state;
     XMPPStream *_stream;
@@ -64,6 +80,9 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
     id<XMPPDocumentHandler> _streamFeatureStanzaHandler;
     XMPPStreamFeature<XMPPClientStreamManagement> *_streamManagement;
     XMPPJID *_JID;
+    NSUInteger _numberOfPendingInboundDocuments;
+    NSUInteger _inboundGeneration;
+    XMPPStanzaScheduler *_outboundScheduler;
 }
 
 @end
@@ -92,7 +111,9 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
         _options = options;
         _state = XMPPClientStateDisconnected;
         _operationQueue = dispatch_queue_create("XMPPClient", DISPATCH_QUEUE_SERIAL);
-        _stream = stream ?: [[XMPPWebsocketStream alloc] initWithHostname:hostname options:options];
+        _outboundScheduler = [[XMPPStanzaScheduler alloc] init];
+        Class streamClass = options[XMPPClientOptionsStreamClassKey] ?: [XMPPWebsocketStream class];
+        _stream = stream ?: [[streamClass alloc] initWithHostname:hostname options:options];
         _stream.queue = _operationQueue;
         _stream.delegate = self;
     }
@@ -121,6 +142,7 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
 {
     if (_state != state) {
         _state = state;
+        [self xmpp_sendPendingDocuments];
         dispatch_queue_t delegateQueue = self.delegateQueue ?: dispatch_get_main_queue();
         dispatch_async(delegateQueue, ^{
             if ([self.delegate respondsToSelector:@selector(client:didChangeState:)]) {
@@ -136,14 +158,15 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
 {
     dispatch_async(_operationQueue, ^{
         if (self.state != XMPPClientStateDisconnected) {
-            NSLog(@"Invalid State: Can only connect a disconnected client: %@", self);
+            XMPPLogWarning(XMPPLogCategoryClient, @"Invalid State: Can only connect a disconnected client: %@", self);
         } else {
-            NSLog(@"Connecting: '%@'.", self.hostname);
+            XMPPLogInfo(XMPPLogCategoryClient, @"Connecting: '%@'.", self.hostname);
 
             self.state = XMPPClientStateConnecting;
             _negotiatedFeatures = @[];
             _currentFeature = nil;
             _featureConfigurations = nil;
+            [self xmpp_resetInboundFlowControl];
             _stream.options = self.options;
             [_stream open];
         }
@@ -155,9 +178,9 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
     dispatch_async(_operationQueue, ^{
 
         if (self.state != XMPPClientStateConnected) {
-            NSLog(@"Invalid State: Can only disconnect a connected client: %@", self);
+            XMPPLogWarning(XMPPLogCategoryClient, @"Invalid State: Can only disconnect a connected client: %@", self);
         } else {
-            NSLog(@"Disconnecting: '%@'.", self.hostname);
+            XMPPLogInfo(XMPPLogCategoryClient, @"Disconnecting: '%@'.", self.hostname);
 
             self.state = XMPPClientStateDisconnecting;
 
@@ -174,9 +197,9 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
 {
     dispatch_async(_operationQueue, ^{
         if (self.state != XMPPClientStateConnected) {
-            NSLog(@"Invalid State: Can only suspend a connected client: %@", self);
+            XMPPLogWarning(XMPPLogCategoryClient, @"Invalid State: Can only suspend a connected client: %@", self);
         } else {
-            NSLog(@"Suspending: %@", self);
+            XMPPLogInfo(XMPPLogCategoryClient, @"Suspending: %@", self);
 
             self.state = XMPPClientStateDisconnecting;
 
@@ -195,7 +218,7 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
 {
     dispatch_async(_operationQueue, ^{
         if (self.state != XMPPClientStateConnected) {
-            NSLog(@"Invalid State: Could not exchange acknowledgement, because the client is not connected: %@", self);
+            XMPPLogWarning(XMPPLogCategoryClient, @"Invalid State: Could not exchange acknowledgement, because the client is not connected: %@", self);
         } else {
             [_streamManagement sendAcknowledgement];
             [_streamManagement requestAcknowledgement];
@@ -216,17 +239,11 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
             // The stanza can be handled if the connection to the server is established
             // or if the client supports stream management (and can resend the stanza later).
 
-            if (self.state == XMPPClientStateConnected) {
-                [_stream sendDocument:document];
-            } else {
-                NSLog(@"Stanza can not be sended by client directly, because there is no stream to the host. Will be send later if the connection has been resumed.");
-            }
-
-            if (_streamManagement.enabled) {
-                [_streamManagement didSentDocument:document acknowledgement:completion];
-            } else if (completion) {
-                completion(nil);
-            }
+            XMPPClientOutboundDocument *outboundDocument = [[XMPPClientOutboundDocument alloc] initWithDocument:document completion:completion];
+            [_outboundScheduler enqueueObject:outboundDocument
+                                 withPriority:XMPPStanzaPriorityOfElement(document.root)
+                                  orderingKey:XMPPStanzaOrderingKeyOfElement(document.root)];
+            [self xmpp_sendPendingDocuments];
 
         } else {
             NSError *error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
@@ -239,6 +256,38 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
     });
 }
 
+- (void)handleDocuments:(NSArray<PXDocument *> *)documents completion:(void (^)(NSUInteger, NSError *))completion
+{
+    dispatch_async(_operationQueue, ^{
+
+        if (self.state == XMPPClientStateConnected ||
+            _streamManagement.enabled) {
+
+            [documents enumerateObjectsUsingBlock:^(PXDocument *document, NSUInteger index, BOOL *stop) {
+                void (^documentCompletion)(NSError *) = nil;
+                if (completion) {
+                    documentCompletion = ^(NSError *error) {
+                        completion(index, error);
+                    };
+                }
+                XMPPClientOutboundDocument *outboundDocument = [[XMPPClientOutboundDocument alloc] initWithDocument:document completion:documentCompletion];
+                [_outboundScheduler enqueueObject:outboundDocument
+                                     withPriority:XMPPStanzaPriorityOfElement(document.root)
+                                      orderingKey:XMPPStanzaOrderingKeyOfElement(document.root)];
+            }];
+            [self xmpp_sendPendingDocuments];
+
+        } else if (completion) {
+            NSError *error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
+                                                 code:XMPPDispatcherErrorCodeNoRoute
+                                             userInfo:nil];
+            for (NSUInteger index = 0; index < [documents count]; index++) {
+                completion(index, error);
+            }
+        }
+    });
+}
+
 - (void)processPendingDocuments:(void (^)(NSError *))completion
 {
     dispatch_async(_operationQueue, ^{
@@ -248,6 +297,147 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
     });
 }
 
+#pragma mark -
+#pragma mark Outbound Scheduling
+
+- (void)xmpp_sendPendingDocuments
+{
+    // The documents are passed to the stream by priority, as long as the
+    // stream is writable. Stream management records the documents in the
+    // same order. This way, the acknowledgements match the order on the
+    // wire, while the documents of one priority keep their order.
+    //
+    // The documents of one pass are sent to the stream together and only
+    // one acknowledgement is requested for them.
+
+    NSMutableArray<PXDocument *> *documents = [[NSMutableArray alloc] init];
+    BOOL needsAcknowledgement = NO;
+
+    while (_outboundScheduler.count > 0) {
+
+        if (self.state == XMPPClientStateConnected) {
+            if (!_stream.writable) {
+                break;
+            }
+            XMPPClientOutboundDocument *outboundDocument = [_outboundScheduler dequeueObject];
+            [documents addObject:outboundDocument.document];
+            if (_streamManagement.enabled) {
+                [_streamManagement didSentDocument:outboundDocument.document
+                                   acknowledgement:outboundDocument.completion
+                            requestAcknowledgement:NO];
+                needsAcknowledgement = needsAcknowledgement || outboundDocument.completion != nil;
+            } else if (outboundDocument.completion) {
+                outboundDocument.completion(nil);
+            }
+
+            // The writability of the stream only changes, after the
+            // documents have been passed to the stream. Therefore the
+            // batches are limited.
+            if ([documents count] >= XMPPClientOutboundBatchSize) {
+                [_stream sendDocuments:[documents copy]];
+                [documents removeAllObjects];
+            }
+
+        } else if (_streamManagement.enabled) {
+            XMPPLogDebug(XMPPLogCategoryClient, @"Stanza can not be sended by client directly, because there is no stream to the host. Will be send later if the connection has been resumed.");
+            XMPPClientOutboundDocument *outboundDocument = [_outboundScheduler dequeueObject];
+            [_streamManagement didSentDocument:outboundDocument.document
+                               acknowledgement:outboundDocument.completion
+                        requestAcknowledgement:NO];
+            needsAcknowledgement = needsAcknowledgement || outboundDocument.completion != nil;
+
+        } else {
+            NSError *error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
+                                                 code:XMPPDispatcherErrorCodeNoRoute
+                                             userInfo:nil];
+            for (XMPPClientOutboundDocument *outboundDocument in [_outboundScheduler removeAllObjects]) {
+                if (outboundDocument.completion) {
+                    outboundDocument.completion(error);
+                }
+            }
+        }
+    }
+
+    if ([documents count] > 0) {
+        [_stream sendDocuments:[documents copy]];
+    }
+
+    if (needsAcknowledgement) {
+        [_streamManagement requestAcknowledgement];
+    }
+}
+
+#pragma mark -
+#pragma mark Inbound Flow Control
+
+- (void)xmpp_resetInboundFlowControl
+{
+    // Documents received on a previous stream are not acknowledged on the
+    // next stream, but still count as pending until they are handled.
+    _inboundGeneration += 1;
+    _stream.readingPaused = NO;
+}
+
+- (BOOL)xmpp_didReceiveInboundDocument
+{
+    NSNumber *highWaterMark = self.options[XMPPClientOptionsInboundHighWaterMarkKey];
+    NSUInteger limit = highWaterMark ? [highWaterMark unsignedIntegerValue] : XMPPClientDefaultInboundHighWaterMark;
+
+    if (_stream.readingPaused && _numberOfPendingInboundDocuments >= 2 * limit) {
+        [self xmpp_suspendOverflowingStream];
+        return NO;
+    }
+
+    _numberOfPendingInboundDocuments += 1;
+
+    if (!_stream.readingPaused && _numberOfPendingInboundDocuments > limit) {
+        XMPPLogDebug(XMPPLogCategoryClient, @"Pausing to read from host '%@' with %lu pending stanzas.", self.hostname, (unsigned long)_numberOfPendingInboundDocuments);
+        _stream.readingPaused = YES;
+    }
+
+    return YES;
+}
+
+- (void)xmpp_suspendOverflowingStream
+{
+    // The stream continues to deliver documents while reading is paused.
+    // Instead of buffering the documents without a limit, the stream is
+    // suspended. The documents, which have been handled, are acknowledged
+    // and the server keeps the other ones for the resumption of the stream.
+
+    XMPPLogWarning(XMPPLogCategoryClient, @"Suspending stream to host '%@' with %lu pending stanzas.", self.hostname, (unsigned long)_numberOfPendingInboundDocuments);
+
+    XMPPStream *stream = _stream;
+    [_streamManagement sendAcknowledgement];
+    _inboundGeneration += 1;
+
+    NSString *errorMessage = @"Too many received stanzas are pending.";
+    NSError *error = [NSError errorWithDomain:XMPPErrorDomain
+                                         code:XMPPErrorCodeInvalidState
+                                     userInfo:@{NSLocalizedDescriptionKey : errorMessage}];
+    [self stream:stream didFailWithError:error];
+
+    [stream suspend];
+    if (_streamManagement.resumable == NO) {
+        _streamManagement = nil;
+    }
+}
+
+- (void)xmpp_didHandleInboundDocument
+{
+    if (_numberOfPendingInboundDocuments > 0) {
+        _numberOfPendingInboundDocuments -= 1;
+    }
+
+    NSNumber *lowWaterMark = self.options[XMPPClientOptionsInboundLowWaterMarkKey];
+    NSUInteger limit = lowWaterMark ? [lowWaterMark unsignedIntegerValue] : XMPPClientDefaultInboundLowWaterMark;
+
+    if (_stream.readingPaused && _numberOfPendingInboundDocuments < limit) {
+        XMPPLogDebug(XMPPLogCategoryClient, @"Resuming to read from host '%@'.", self.hostname);
+        _stream.readingPaused = NO;
+    }
+}
+
 #pragma mark -
 #pragma mark Feature Negotiation
 
@@ -255,18 +445,30 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
 {
     _preferredFeatures = [[NSMutableArray alloc] init];
 
+    // Stream compression (XEP-0138) is negotiated after authentication and
+    // before the resource is bound (or the stream is resumed), because it
+    // requires a restart of the stream.
+    BOOL compression = [_stream.compressionMethods count] > 0;
+
     if (_streamManagement.resumable) {
         [_preferredFeatures addObject:PXQN(@"urn:ietf:params:xml:ns:xmpp-sasl", @"mechanisms")];
+        if (compression) {
+            [_preferredFeatures addObject:PXQN(@"http://jabber.org/features/compress", @"compression")];
+        }
         [_preferredFeatures addObject:PXQN(@"urn:xmpp:sm:3", @"sm")];
     } else {
         if (_needsRegistration) {
             [_preferredFeatures addObject:PXQN(@"http://jabber.org/features/iq-register", @"register")];
         }
         [_preferredFeatures addObject:PXQN(@"urn:ietf:params:xml:ns:xmpp-sasl", @"mechanisms")];
+        if (compression) {
+            [_preferredFeatures addObject:PXQN(@"http://jabber.org/features/compress", @"compression")];
+        }
         [_preferredFeatures addObject:PXQN(@"urn:ietf:params:xml:ns:xmpp-bind", @"bind")];
         [_preferredFeatures addObject:PXQN(@"urn:ietf:params:xml:ns:xmpp-session", @"session")];
         [_featureConfigurations enumerateKeysAndObjectsUsingBlock:^(PXQName *name, PXDocument *configuration, BOOL *stop) {
             if (![name isEqual:PXQN(@"urn:xmpp:sm:3", @"sm")] &&
+                ![name isEqual:PXQN(@"http://jabber.org/features/compress", @"compression")] &&
                 ![_preferredFeatures containsObject:name]) {
                 [_preferredFeatures addObject:name];
             }
@@ -277,7 +479,7 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
 
 - (void)xmpp_updateSupportedFeaturesWithElement:(PXElement *)features
 {
-    NSLog(@"Client '%@' updating features: %@", self, features.document);
+    XMPPLogDebug(XMPPLogCategoryClient, @"Client '%@' updating features: %@", self, features.document);
 
     NSMutableDictionary *featureConfigurations = [[NSMutableDictionary alloc] init];
 
@@ -349,14 +551,14 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
             _currentFeature.queue = _operationQueue;
             _currentFeature.delegate = self;
 
-            NSLog(@"Client '%@' begin negotiation of feature: (%@, %@)", self, configuration.root.namespace, configuration.root.name);
+            XMPPLogDebug(XMPPLogCategoryClient, @"Client '%@' begin negotiation of feature: (%@, %@)", self, configuration.root.namespace, configuration.root.name);
 
             [_currentFeature beginNegotiationWithHostname:self.hostname
                                                   options:nil];
 
         } else {
 
-            NSLog(@"Client '%@' does not support feature: (%@, %@)", self, configuration.root.namespace, configuration.root.name);
+            XMPPLogDebug(XMPPLogCategoryClient, @"Client '%@' does not support feature: (%@, %@)", self, configuration.root.namespace, configuration.root.name);
 
             [self xmpp_negotiateNextFeature];
         }
@@ -457,7 +659,7 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
             BOOL success = [_currentFeature handleDocument:document error:&error];
 
             if (!success) {
-                NSLog(@"Stream feature %@ failed to handle element with error: %@",
+                XMPPLogError(XMPPLogCategoryClient, @"Stream feature %@ failed to handle element with error: %@",
                       _currentFeature,
                       [error localizedDescription]);
             }
@@ -469,12 +671,17 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
             if ([document.root.namespace isEqual:@"jabber:client"] && ([document.root.name isEqual:@"message"] ||
                                                                        [document.root.name isEqual:@"presence"] ||
                                                                        [document.root.name isEqual:@"iq"])) {
+                if (![self xmpp_didReceiveInboundDocument]) {
+                    break;
+                }
+                NSUInteger generation = _inboundGeneration;
                 [_connectionDelegate handleDocument:document
                                          completion:^(NSError *error) {
                                              dispatch_async(_operationQueue, ^{
+                                                 [self xmpp_didHandleInboundDocument];
                                                  if (error) {
-                                                     NSLog(@"Failed to handle stanza with error: %@", [error localizedDescription]);
-                                                 } else {
+                                                     XMPPLogError(XMPPLogCategoryClient, @"Failed to handle stanza with error: %@", [error localizedDescription]);
+                                                 } else if (generation == _inboundGeneration) {
                                                      [_streamManagement didHandleReceviedDocument:document];
                                                  }
                                              });
@@ -483,7 +690,7 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
                 [_connectionDelegate processPendingDocuments:^(NSError *error) {
                     dispatch_async(_operationQueue, ^{
                         if (error) {
-                            NSLog(@"Failed to process pending stanzas with error: %@", [error localizedDescription]);
+                            XMPPLogError(XMPPLogCategoryClient, @"Failed to process pending stanzas with error: %@", [error localizedDescription]);
                         } else {
                             BOOL handled = NO;
                             for (XMPPStreamFeature *feature in _negotiatedFeatures) {
@@ -491,7 +698,7 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
                                     NSError *error = nil;
                                     BOOL success = [feature handleDocument:document error:&error];
                                     if (!success) {
-                                        NSLog(@"Stream feature %@ failed to handle element with error: %@",
+                                        XMPPLogError(XMPPLogCategoryClient, @"Stream feature %@ failed to handle element with error: %@",
                                                    feature,
                                                    [error localizedDescription]);
                                     }
@@ -571,6 +778,61 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
     }
 }
 
+- (void)stream:(XMPPStream *)stream didChangeWritable:(BOOL)writable
+{
+    XMPPLogDebug(XMPPLogCategoryClient, @"Stream to host '%@' did become %@.", self.hostname, writable ? @"writable" : @"unwritable");
+
+    if (writable) {
+        [self xmpp_sendPendingDocuments];
+    }
+
+    id<XMPPConnectionDelegate> connectionDelegate = _connectionDelegate;
+    if (_JID && [connectionDelegate respondsToSelector:@selector(connection:didChangeWritable:forJID:)]) {
+        [connectionDelegate connection:self didChangeWritable:writable forJID:_JID];
+    }
+}
+
+- (void)streamDidReceiveAcknowledgementRequest:(XMPPStream *)stream
+{
+    if (self.state == XMPPClientStateConnected && _streamManagement.enabled) {
+        [_connectionDelegate processPendingDocuments:^(NSError *error) {
+            dispatch_async(_operationQueue, ^{
+                if (error) {
+                    XMPPLogError(XMPPLogCategoryClient, @"Failed to process pending stanzas with error: %@", [error localizedDescription]);
+                } else {
+                    [_streamManagement sendAcknowledgement];
+                }
+            });
+        }];
+    } else {
+        PXDocument *document = [[PXDocument alloc] initWithElementName:@"r"
+                                                             namespace:XMPPStreamFeatureStreamManagementNamespace
+                                                                prefix:nil];
+        [self stream:stream didReceiveDocument:document];
+    }
+}
+
+- (void)stream:(XMPPStream *)stream didReceiveAcknowledgement:(NSUInteger)numberOfAcknowledgedDocuments
+{
+    if (self.state == XMPPClientStateConnected && _streamManagement.enabled) {
+        [_connectionDelegate processPendingDocuments:^(NSError *error) {
+            dispatch_async(_operationQueue, ^{
+                if (error) {
+                    XMPPLogError(XMPPLogCategoryClient, @"Failed to process pending stanzas with error: %@", [error localizedDescription]);
+                } else {
+                    [_streamManagement didReceiveAcknowledgement:numberOfAcknowledgedDocuments];
+                }
+            });
+        }];
+    } else {
+        PXDocument *document = [[PXDocument alloc] initWithElementName:@"a"
+                                                             namespace:XMPPStreamFeatureStreamManagementNamespace
+                                                                prefix:nil];
+        [document.root setValue:[@(numberOfAcknowledgedDocuments) stringValue] forAttribute:@"h"];
+        [self stream:stream didReceiveDocument:document];
+    }
+}
+
 #pragma mark XMPPStreamFeatureDelegate  (called on operation queue)
 
 - (void)streamFeature:(XMPPStreamFeature *)streamFeature handleDocument:(PXDocument *)document
@@ -584,7 +846,7 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
 {
     if (streamFeature == _currentFeature) {
 
-        NSLog(@"Client '%@' succeed negotiation of feature: (%@, %@)", self, [[streamFeature class] namespace], [[streamFeature class] name]);
+        XMPPLogDebug(XMPPLogCategoryClient, @"Client '%@' succeed negotiation of feature: (%@, %@)", self, [[streamFeature class] namespace], [[streamFeature class] name]);
 
         _negotiatedFeatures = [_negotiatedFeatures arrayByAddingObject:streamFeature];
         _currentFeature = nil;
@@ -603,7 +865,7 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
 
         if (streamFeature.needsRestart) {
             self.state = XMPPClientStateConnecting;
-            NSLog(@"Client '%@' resetting stream.", self);
+            XMPPLogDebug(XMPPLogCategoryClient, @"Client '%@' resetting stream.", self);
             [_stream reopen];
         } else {
             [self xmpp_negotiateNextFeature];
@@ -615,7 +877,7 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
 {
     if (streamFeature == _currentFeature) {
 
-        NSLog(@"Client '%@' failed negotiation of feature: (%@, %@) error: %@", self, [[streamFeature class] namespace], [[streamFeature class] name], [error localizedDescription]);
+        XMPPLogError(XMPPLogCategoryClient, @"Client '%@' failed negotiation of feature: (%@, %@) error: %@", self, [[streamFeature class] namespace], [[streamFeature class] name], [error localizedDescription]);
 
         _currentFeature.delegate = nil;
         _currentFeature = nil;
@@ -701,6 +963,18 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
     _JID = JID;
 }
 
+#pragma mark XMPPStreamFeatureDelegateCompression (called on operation queue)
+
+- (NSArray<NSString *> *)compressionMethodsForStreamFeature:(XMPPStreamFeature *)streamFeature
+{
+    return _stream.compressionMethods;
+}
+
+- (void)streamFeature:(XMPPStreamFeature *)streamFeature didNegotiateCompressionMethod:(NSString *)method
+{
+    [_stream startCompressionWithMethod:method];
+}
+
 #pragma mark XMPPStreamFeatureDelegateInBandRegistration (called on operation queue)
 
 - (void)streamFeature:(XMPPStreamFeature *)streamFeature didReceiveRegistrationChallenge:(id<XMPPRegistrationChallenge>)challenge
@@ -728,3 +1002,15 @@ NSString *const XMPPClientResumedKey = @"XMPPClientResumedKey";
 }
 
 @end
+
+@implementation XMPPClientOutboundDocument
+- (instancetype)initWithDocument:(PXDocument *)document completion:(void (^)(NSError *))completion
+{
+    self = [super init];
+    if (self) {
+        _document = document;
+        _completion = completion;
+    }
+    return self;
+}
+@end
@@ -45,13 +45,26 @@ NS_SWIFT_NAME(ClientStreamManagement)
 @property (nonatomic, readonly) NSUInteger numberOfReceivedDocuments;
 @property (nonatomic, readonly) NSUInteger numberOfSentDocuments;
 @property (nonatomic, readonly) NSUInteger numberOfAcknowledgedDocuments;
+@property (nonatomic, readonly) NSUInteger numberOfUnacknowledgedDocuments;
+
+// Returns a copy of the unacknowledged documents. Use the count or the
+// enumeration below to inspect a long queue without copying it.
 @property (nonatomic, readonly) NSArray *_Nonnull unacknowledgedDocuments;
+- (void)enumerateUnacknowledgedDocumentsUsingBlock:(nonnull void (^)(PXDocument *_Nonnull document, BOOL *_Nonnull stop))block NS_SWIFT_NAME(enumerateUnacknowledgedDocuments(_:));
 
 - (void)didSentDocument:(nonnull PXDocument *)document acknowledgement:(nonnull void (^)(NSError *_Nullable error))acknowledgement NS_SWIFT_NAME(didSent(_:acknowledgement:));
+
+// If NO, the sender requests an acknowledgement itself (e.g., once for a
+// batch of documents). -didSentDocument:acknowledgement: requests an
+// acknowledgement for each document with an acknowledgement handler.
+- (void)didSentDocument:(nonnull PXDocument *)document
+          acknowledgement:(nullable void (^)(NSError *_Nullable error))acknowledgement
+    requestAcknowledgement:(BOOL)requestAcknowledgement NS_SWIFT_NAME(didSent(_:acknowledgement:requestAcknowledgement:));
 - (void)didHandleReceviedDocument:(nonnull PXDocument *)document NS_SWIFT_NAME(didReceive(_:));
 
 - (void)requestAcknowledgement;
 - (void)sendAcknowledgement;
+- (void)didReceiveAcknowledgement:(NSUInteger)numberOfAcknowledgedDocuments NS_SWIFT_NAME(didReceiveAcknowledgement(_:));
 
 - (void)cancelUnacknowledgedDocuments;
 
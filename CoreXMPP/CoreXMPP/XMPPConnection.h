@@ -42,6 +42,10 @@ NS_SWIFT_NAME(ConnectionDelegate)
 @protocol XMPPConnectionDelegate <XMPPDocumentHandler>
 - (void)connection:(nonnull id<XMPPConnection>)connection didConnectTo:(nonnull XMPPJID *)JID resumed:(BOOL)resumed NS_SWIFT_NAME(connection(_:didConnect:resumed:));
 - (void)connection:(nonnull id<XMPPConnection>)connection didDisconnectFrom:(nonnull XMPPJID *)JID NS_SWIFT_NAME(connection(_:didDisconnect:));
+@optional
+// Backpressure of the underlying stream. While the connection is not
+// writable, the delegate should hold back documents.
+- (void)connection:(nonnull id<XMPPConnection>)connection didChangeWritable:(BOOL)writable forJID:(nonnull XMPPJID *)JID NS_SWIFT_NAME(connection(_:didChangeWritable:for:));
 @end
 
 NS_SWIFT_NAME(Connection)
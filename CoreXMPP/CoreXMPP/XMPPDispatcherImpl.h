@@ -37,6 +37,9 @@
 @import XMPPFoundation;
 
 #import "XMPPConnection.h"
+#import "XMPPDispatcherObserver.h"
+#import "XMPPDispatcherStanzaFilter.h"
+#import "XMPPDispatcherStatistics.h"
 #import "XMPPDocumentHandler.h"
 
 @class PXQName;
@@ -46,22 +49,133 @@
 - (void)dispatcher:(nonnull id<XMPPDispatcher>)dispatcher willSendDocument:(nonnull PXDocument *)document;
 @end
 
+// The documents of an account (bare JID) are processed in order on the
+// queue of one shard, while the documents of different accounts are
+// processed in parallel on the queues of the other shards. Therefore
+// handlers can be called concurrently for different accounts.
+
 @interface XMPPDispatcherImpl : NSObject <XMPPConnectionDelegate, XMPPDispatcher>
 
+#pragma mark Life-cycle
+
+// Uses one shard per active processor (at most 16).
+- (nonnull instancetype)init;
+- (nonnull instancetype)initWithNumberOfShards:(NSUInteger)numberOfShards NS_DESIGNATED_INITIALIZER;
+
+@property (nonatomic, readonly) NSUInteger numberOfShards;
+
 @property (nonatomic, readwrite, weak, nullable) id<XMPPDispatcherDelegate> delegate;
 
 #pragma mark Manage Connections
+
+// The connections and the handlers are published as immutable snapshots,
+// which are replaced if they change. Therefore the accessors do not block
+// and can be called from any thread (including the handlers).
 @property (nonatomic, readonly) NSDictionary *_Nonnull connectionsByJID;
 - (void)setConnection:(nonnull id<XMPPConnection>)connection forJID:(nonnull XMPPJID *)JID;
 - (void)removeConnectionForJID:(nonnull XMPPJID *)JID;
 - (void)removeConnection:(nonnull id<XMPPConnection>)connection;
 
+#pragma mark Pending Submissions
+
+// Documents are held back, if the connection of the sending account is
+// not established. The timeouts (NSNumber, seconds) are keyed by the name
+// of the stanza element ('message', 'presence' or 'iq'). Defaults to 120
+// seconds for each type.
+@property (atomic, copy) NSDictionary<NSString *, NSNumber *> *_Nonnull pendingSubmissionTimeouts;
+
+// If set, the documents held back while an account is not connected are
+// written to an outbox (one file per account) in this directory, instead
+// of keeping them in memory. Documents held back by backpressure are kept
+// in memory. The documents of an outbox are submitted after the account
+// has been connected, even if they were held back before a restart of the
+// process. Must be set before the connections are added.
+@property (atomic, copy) NSURL *_Nullable outboxDirectoryURL;
+
+#pragma mark IQ Requests
+
+// If set, identical 'get' requests (same sender, recipient and payload),
+// which are pending at the same time, are only sent once. Each request
+// receives a copy of the response with its own ID and keeps its own
+// timeout. A request with a later timeout than the pending one is sent
+// again. Defaults to NO.
+@property (atomic, readwrite) BOOL coalescesIQRequests;
+
+// The results of 'get' requests are cached for the time to live (NSNumber,
+// seconds), keyed by the namespace of the payload (e.g.,
+// 'http://jabber.org/protocol/disco#info'). Results of other namespaces
+// are not cached. Each request receives a copy of the cached response.
+@property (atomic, copy) NSDictionary<NSString *, NSNumber *> *_Nonnull IQResultTimeToLives;
+
+// The least recently used results are removed, if the cache of a shard
+// exceeds this number. Defaults to 128.
+@property (atomic, readwrite) NSUInteger maximumNumberOfCachedIQResults;
+
+#pragma mark Sending Stanzas
+
+// Sends the stanzas like -handleMessage:completion: (and the other
+// handler methods), but passes the stanzas of one account in a batch to
+// the connection (see -[XMPPDocumentHandler handleDocuments:completion:]).
+// The completion is called once per stanza with its index. IQ requests
+// should be sent with -handleIQRequest:timeout:completion: instead, to
+// receive their responses.
+- (void)sendStanzas:(nonnull NSArray<XMPPStanza *> *)stanzas
+         completion:(nullable void (^)(NSUInteger index, NSError *_Nullable error))completion;
+
 #pragma mark Manage Handlers
+
+// Message and presence handlers only receive the stanzas matching their
+// filter. Handlers added without a filter (or with a nil filter) receive
+// all messages (or presence stanzas).
+- (void)addHandler:(nonnull id)handler
+    withMessageFilter:(nullable XMPPDispatcherStanzaFilter *)messageFilter
+       presenceFilter:(nullable XMPPDispatcherStanzaFilter *)presenceFilter;
+
 @property (nonatomic, readonly) NSArray<id<XMPPConnectionHandler>> *_Nonnull dispatcherHandlers;
 @property (nonatomic, readonly) NSArray<id<XMPPMessageHandler>> *_Nonnull messageHandlers;
 @property (nonatomic, readonly) NSArray<id<XMPPPresenceHandler>> *_Nonnull presenceHandlers;
 @property (nonatomic, readonly) NSDictionary<PXQName *, id<XMPPIQHandler>> *_Nonnull IQHandlersByQuery;
 
+#pragma mark Flow Control
+
+// Limits the number of messages and presence stanzas a handler has not
+// completed yet. Further stanzas are held back (in order) until the
+// handler completes an earlier one. The stanzas are only reported as
+// handled to the connection (and acknowledged to the server), after all
+// handlers with a limit have completed them and all stanzas received
+// earlier from the same connection. Therefore the connection stops
+// reading from the stream, if the handlers fall behind. The first error a
+// handler with a limit completes a stanza with is reported to the
+// connection. A handler with a limit must call the completion exactly
+// once. Zero removes the limit.
+- (void)setMaximumNumberOfOutstandingStanzas:(NSUInteger)maximumNumberOfOutstandingStanzas forHandler:(nonnull id)handler;
+- (NSUInteger)numberOfOutstandingStanzasForHandler:(nonnull id)handler;
+
+#pragma mark Observers
+
+// Observers are called with batches of the stanzas received and sent by
+// the dispatcher, filtered by direction, kind and payload namespaces (nil
+// for all stanzas). The block is called on the queue (main queue, if nil)
+// at most once per interval. Stanzas are only wrapped for observation, if
+// they match the filter of an observer.
+- (nonnull XMPPDispatcherObserver *)addObserverForDirections:(XMPPDispatcherObservationDirection)directions
+                                                 stanzaKinds:(XMPPDispatcherObservationStanzaKind)stanzaKinds
+                                                  namespaces:(nullable NSSet<NSString *> *)namespaces
+                                                    interval:(NSTimeInterval)interval
+                                                       queue:(nullable dispatch_queue_t)queue
+                                                       block:(nonnull void (^)(NSArray<XMPPDispatcherObservation *> *_Nonnull observations))block;
+
+// The observations collected so far are still passed to the block.
+- (void)removeObserver:(nonnull XMPPDispatcherObserver *)observer;
+
+#pragma mark Statistics
+
+// Returns the counters and latency histograms collected since the
+// dispatcher has been created, together with the current number of pending
+// requests and submissions. The statistics are collected without blocking
+// the queues of the shards and can be taken from any thread.
+- (nonnull XMPPDispatcherStatistics *)statistics;
+
 #pragma mark Processing
 - (NSUInteger)numberOfPendingIQResponses;
 
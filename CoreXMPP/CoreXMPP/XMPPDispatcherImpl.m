@@ -36,35 +36,190 @@
 @import Foundation;
 @import XMPPFoundation;
 
+#include <pthread.h>
+
 #import <PureXML/PureXML.h>
 
+#import "PXDocument+WireData.h"
 #import "XMPPDispatcherImpl.h"
+#import "XMPPDispatcherMetrics.h"
+#import "XMPPDispatcherOutbox.h"
 #import "XMPPError.h"
+#import "XMPPIQCorrelationTable.h"
+#import "XMPPIQRequestCoalescer.h"
+#import "XMPPLogger.h"
+#import "XMPPStanzaScheduler.h"
+#import "XMPPTimerWheel.h"
 
 NSString *_Nonnull const XMPPDispatcherErrorDomain = @"XMPPDispatcherErrorDomain";
 
+static const NSUInteger XMPPDispatcherMaximumNumberOfShards = 16;
+static const NSTimeInterval XMPPDispatcherDefaultPendingSubmissionTimeout = 120.0;
+static const NSUInteger XMPPDispatcherPendingSubmissionBatchSize = 100;
+static const NSUInteger XMPPDispatcherDefaultMaximumNumberOfCachedIQResults = 128;
+
+// Not a bare JID, therefore distinct from the ordering keys of stanzas.
+static NSString *const XMPPDispatcherRestoredSubmissionOrderingKey = @"/outbox";
+
+@class XMPPDispatcherShard;
+
+// A pending submission either keeps the document in memory or the token
+// of the document in the outbox of the connection.
 @interface XMPPDispatcherImplPendingSubmission : NSObject
-@property (nonatomic, readonly) NSDate *timeout;
 @property (nonatomic, readonly) PXDocument *document;
+@property (nonatomic, readonly) uint64_t token;
+@property (nonatomic, readonly) XMPPStanzaPriority priority;
+@property (nonatomic, readonly) NSString *orderingKey;
+@property (nonatomic, readonly) void (^completion)(NSError *);
+@property (nonatomic, readwrite) XMPPTimerWheelEntry *timer;
+@property (nonatomic, readwrite, getter=isExpired) BOOL expired;
+- (instancetype)initWithDocument:(PXDocument *)document
+                           token:(uint64_t)token
+                        priority:(XMPPStanzaPriority)priority
+                     orderingKey:(NSString *)orderingKey
+                      completion:(void (^)(NSError *))completion;
+@end
+
+// Documents, which are passed together to a connection.
+@interface XMPPDispatcherSubmissionBatch : NSObject
+@property (nonatomic, readonly) NSMutableArray<PXDocument *> *documents;
+@property (nonatomic, readonly) NSMutableArray *completions;
+- (void)addDocument:(PXDocument *)document completion:(void (^)(NSError *))completion;
+@end
+
+// Completion of a received document. The connection acknowledges the
+// number of handled documents to the server. Therefore the completions of
+// the documents received from one connection are released in the order
+// of the documents, even if a later document has been handled first.
+@interface XMPPDispatcherInboundCompletion : NSObject
 @property (nonatomic, readonly) void (^completion)(NSError *);
-- (instancetype)initWithDocument:(PXDocument *)document timeout:(NSDate *)timeout completion:(void (^)(NSError *))completion;
+@property (nonatomic, readwrite) NSError *error;
+@property (nonatomic, readwrite, getter=isFinished) BOOL finished;
+- (instancetype)initWithCompletion:(void (^)(NSError *))completion;
+@end
+
+// Credits of a handler with a limited number of outstanding stanzas. The
+// stanzas exceeding the limit are kept in a backlog (in order) and are
+// scheduled on the queue of their shard, after the handler completed an
+// earlier stanza. A credit is shared by all shards. The backlog is bounded
+// by the connections, which stop reading (or suspend the stream), if too
+// many received stanzas have not been completed.
+@interface XMPPDispatcherHandlerCredit : NSObject {
+    pthread_mutex_t _mutex;
+    NSUInteger _maximumNumberOfOutstandingStanzas;
+    NSUInteger _numberOfOutstandingStanzas;
+    NSUInteger _numberOfScheduledStanzas;
+    NSMutableArray<NSArray *> *_backlog;
+}
+- (instancetype)initWithMaximumNumberOfOutstandingStanzas:(NSUInteger)maximumNumberOfOutstandingStanzas;
+@property (nonatomic, readwrite) NSUInteger maximumNumberOfOutstandingStanzas;
+@property (nonatomic, readonly) NSUInteger numberOfOutstandingStanzas;
+- (void)performOnQueue:(dispatch_queue_t)queue block:(dispatch_block_t)block;
+- (void)complete;
+@end
+
+@interface XMPPDispatcherHandlerReference : NSObject
+@property (nonatomic, readonly, weak) id handler;
+@property (nonatomic, readonly) XMPPDispatcherHandlerCredit *credit;
+- (instancetype)initWithHandler:(id)handler credit:(XMPPDispatcherHandlerCredit *)credit;
+@end
+
+// Index of the message or presence handlers. The handlers with a filter
+// are indexed by the qualified names of the payload. Only the handlers
+// indexed by the children of a stanza have to be checked.
+@interface XMPPDispatcherStanzaIndex : NSObject {
+    NSArray<XMPPDispatcherHandlerReference *> *_catchAllReferences;
+    NSArray<XMPPDispatcherHandlerReference *> *_typeFilteredReferences;
+    NSDictionary<PXQName *, NSArray<XMPPDispatcherHandlerReference *> *> *_referencesByPayload;
+    NSMapTable<XMPPDispatcherHandlerReference *, XMPPDispatcherStanzaFilter *> *_filtersByReference;
+}
+- (instancetype)initWithReferences:(NSArray<XMPPDispatcherHandlerReference *> *)references filters:(NSMapTable *)filters;
+- (NSArray<XMPPDispatcherHandlerReference *> *)referencesForStanza:(PXElement *)stanza;
+@end
+
+// Immutable snapshot of the registered handlers (per protocol). A new
+// snapshot is published, if the handlers change or if a (weak) handler
+// has been deallocated.
+@interface XMPPDispatcherHandlerSnapshot : NSObject
+@property (nonatomic, readonly) NSArray<XMPPDispatcherHandlerReference *> *connectionHandlers;
+@property (nonatomic, readonly) NSArray<XMPPDispatcherHandlerReference *> *messageHandlers;
+@property (nonatomic, readonly) NSArray<XMPPDispatcherHandlerReference *> *presenceHandlers;
+@property (nonatomic, readonly) NSDictionary<PXQName *, XMPPDispatcherHandlerReference *> *IQHandlersByQuery;
+@property (nonatomic, readonly) XMPPDispatcherStanzaIndex *messageIndex;
+@property (nonatomic, readonly) XMPPDispatcherStanzaIndex *presenceIndex;
+- (instancetype)initWithHandlers:(NSHashTable *)handlers
+                 handlersByQuery:(NSMapTable *)handlersByQuery
+                  messageFilters:(NSMapTable *)messageFilters
+                 presenceFilters:(NSMapTable *)presenceFilters
+                         credits:(NSMapTable *)credits;
+@end
+
+// The routing state of the accounts is partitioned into shards. Each shard
+// has its own serial queue. All documents of an account are processed on
+// the queue of the same shard (in order), while different accounts can be
+// processed in parallel. The timeouts of the IQ requests and the pending
+// submissions of a shard are managed by one timer wheel. The handles are
+// additionally published as an immutable dictionary, which can be read
+// from any thread without blocking the queue of the shard.
+@interface XMPPDispatcherShard : NSObject
+@property (nonatomic, readonly) dispatch_queue_t queue;
+@property (nonatomic, readonly) NSMapTable<XMPPJID *, id> *connectionsByJID;
+@property (atomic, readonly, copy) NSDictionary<XMPPJID *, id> *handlesByJID;
+@property (nonatomic, readonly) XMPPTimerWheel *timerWheel;
+@property (nonatomic, readonly) XMPPDispatcherMetrics *metrics;
+@property (nonatomic, readonly) XMPPIQRequestCoalescer *coalescer;
+@property (nonatomic, readonly) NSMutableArray<XMPPDispatcherInboundCompletion *> *inboundCompletions;
+- (instancetype)initWithIndex:(NSUInteger)index;
+- (void)setHandle:(id)handle forJID:(XMPPJID *)JID;
+- (void)removeHandleForJID:(XMPPJID *)JID;
 @end
 
-@interface XMPPDispatcherConnectionHandle : NSObject
+// Connections use the handle as their delegate. This way, the documents
+// and events of a connection are passed directly to its shard. The IQ
+// requests sent by the account are correlated in the table of the handle.
+// The held back submissions are submitted by the priority of the stanzas.
+@interface XMPPDispatcherConnectionHandle : NSObject <XMPPConnectionDelegate>
+@property (nonatomic, readonly, weak) XMPPDispatcherImpl *dispatcher;
+@property (nonatomic, readonly) XMPPDispatcherShard *shard;
 @property (nonatomic, readonly) id<XMPPConnection> connection;
 @property (nonatomic, readwrite) BOOL connected;
-@property (nonatomic, readonly) NSMutableArray<XMPPDispatcherImplPendingSubmission *> *pendingSubmissions;
-- (instancetype)initWithConnection:(id<XMPPConnection>)connection;
+@property (nonatomic, readwrite) BOOL writable;
+@property (nonatomic, readonly) XMPPStanzaScheduler *pendingSubmissions;
+@property (nonatomic, readonly) XMPPIQCorrelationTable *pendingRequests;
+@property (nonatomic, readonly) XMPPDispatcherOutbox *outbox;
+@property (nonatomic, readonly) NSMutableArray<XMPPDispatcherInboundCompletion *> *inboundCompletions;
+- (instancetype)initWithConnection:(id<XMPPConnection>)connection
+                             shard:(XMPPDispatcherShard *)shard
+                        dispatcher:(XMPPDispatcherImpl *)dispatcher
+                   pendingRequests:(XMPPIQCorrelationTable *)pendingRequests
+                            outbox:(XMPPDispatcherOutbox *)outbox;
 @end
 
 @interface XMPPDispatcherImpl () {
-    dispatch_queue_t _operationQueue;
-    NSMapTable<XMPPJID *, XMPPDispatcherConnectionHandle *> *_connectionsByJID;
+    NSArray<XMPPDispatcherShard *> *_shards;
+
+    dispatch_queue_t _handlerQueue;
     NSHashTable *_handlers;
     NSMapTable *_handlersByQuery;
-    NSMapTable *_responseHandlers;
+    NSMapTable *_messageFilters;
+    NSMapTable *_presenceFilters;
+    NSMapTable *_credits;
+    pthread_mutex_t _connectionsMutex;
 }
-
+@property (atomic, strong) XMPPDispatcherHandlerSnapshot *handlerSnapshot;
+@property (atomic, copy) NSDictionary<XMPPJID *, id<XMPPConnection>> *connectionSnapshot;
+@property (atomic, copy) NSArray<XMPPDispatcherObserver *> *observers;
+- (void)xmpp_connection:(id<XMPPConnection>)connection didConnectTo:(XMPPJID *)JID resumed:(BOOL)resumed onShard:(XMPPDispatcherShard *)shard;
+- (void)xmpp_connection:(id<XMPPConnection>)connection didDisconnectFrom:(XMPPJID *)JID onShard:(XMPPDispatcherShard *)shard;
+- (void)xmpp_connection:(id<XMPPConnection>)connection didChangeWritable:(BOOL)writable forJID:(XMPPJID *)JID onShard:(XMPPDispatcherShard *)shard;
+- (void)xmpp_handleDocument:(PXDocument *)document
+                 completion:(void (^)(NSError *))completion
+                    onShard:(XMPPDispatcherShard *)shard
+                     handle:(XMPPDispatcherConnectionHandle *)handle;
+- (void)xmpp_handleDocuments:(NSArray<PXDocument *> *)documents
+                  completion:(void (^)(NSUInteger, NSError *))completion
+                     onShard:(XMPPDispatcherShard *)shard
+                      handle:(XMPPDispatcherConnectionHandle *)handle;
 @end
 
 @implementation XMPPDispatcherImpl
@@ -72,108 +227,163 @@ NSString *_Nonnull const XMPPDispatcherErrorDomain = @"XMPPDispatcherErrorDomain
 #pragma mark Life-cycle
 
 - (instancetype)init
+{
+    NSUInteger numberOfShards = MIN([[NSProcessInfo processInfo] activeProcessorCount], XMPPDispatcherMaximumNumberOfShards);
+    return [self initWithNumberOfShards:numberOfShards];
+}
+
+- (instancetype)initWithNumberOfShards:(NSUInteger)numberOfShards
 {
     self = [super init];
     if (self) {
-        _operationQueue = dispatch_queue_create("XMPPDispatcher", DISPATCH_QUEUE_SERIAL);
-        _connectionsByJID = [NSMapTable strongToStrongObjectsMapTable];
+        NSMutableArray *shards = [[NSMutableArray alloc] init];
+        for (NSUInteger index = 0; index < MAX(numberOfShards, 1); index++) {
+            [shards addObject:[[XMPPDispatcherShard alloc] initWithIndex:index]];
+        }
+        _shards = [shards copy];
+
+        _handlerQueue = dispatch_queue_create("XMPPDispatcher.handlers", DISPATCH_QUEUE_SERIAL);
         _handlers = [NSHashTable weakObjectsHashTable];
         _handlersByQuery = [NSMapTable strongToWeakObjectsMapTable];
-        _responseHandlers = [NSMapTable strongToStrongObjectsMapTable];
+        _messageFilters = [NSMapTable weakToStrongObjectsMapTable];
+        _presenceFilters = [NSMapTable weakToStrongObjectsMapTable];
+        _credits = [NSMapTable weakToStrongObjectsMapTable];
+        _handlerSnapshot = [[XMPPDispatcherHandlerSnapshot alloc] initWithHandlers:_handlers
+                                                                   handlersByQuery:_handlersByQuery
+                                                                    messageFilters:_messageFilters
+                                                                   presenceFilters:_presenceFilters
+                                                                           credits:_credits];
+        _pendingSubmissionTimeouts = @{};
+        _observers = @[];
+        pthread_mutex_init(&_connectionsMutex, NULL);
+        _connectionSnapshot = @{};
+        _IQResultTimeToLives = @{};
+        _maximumNumberOfCachedIQResults = XMPPDispatcherDefaultMaximumNumberOfCachedIQResults;
     }
     return self;
 }
 
+- (void)dealloc
+{
+    pthread_mutex_destroy(&_connectionsMutex);
+}
+
+#pragma mark Shards
+
+- (NSUInteger)numberOfShards
+{
+    return [_shards count];
+}
+
+- (XMPPDispatcherShard *)xmpp_shardForJID:(XMPPJID *)JID
+{
+    if (JID == nil || [_shards count] == 1) {
+        return [_shards firstObject];
+    }
+    return _shards[[[JID bareJID] hash] % [_shards count]];
+}
+
 #pragma mark Manage Connections
 
 - (NSDictionary *)connectionsByJID
 {
-    __block NSMutableDictionary *connectionsByJID = [[NSMutableDictionary alloc] init];
-    dispatch_sync(_operationQueue, ^{
-        [[_connectionsByJID dictionaryRepresentation] enumerateKeysAndObjectsUsingBlock:^(XMPPJID *jid,
-                                                                                          XMPPDispatcherConnectionHandle *handle,
-                                                                                          BOOL *stop) {
-            [connectionsByJID setObject:handle.connection forKey:jid];
-        }];
-    });
-    return connectionsByJID;
+    return self.connectionSnapshot;
+}
+
+- (void)xmpp_publishConnection:(id<XMPPConnection>)connection forJID:(XMPPJID *)JID
+{
+    // The snapshot is only copied, if the connections change. Connections
+    // of different shards can change concurrently. Therefore the update of
+    // the snapshot is serialized by the mutex, while the readers just load
+    // the current snapshot.
+    pthread_mutex_lock(&_connectionsMutex);
+    NSMutableDictionary *connectionsByJID = [self.connectionSnapshot mutableCopy];
+    if (connection) {
+        connectionsByJID[JID] = connection;
+    } else {
+        [connectionsByJID removeObjectForKey:JID];
+    }
+    self.connectionSnapshot = connectionsByJID;
+    pthread_mutex_unlock(&_connectionsMutex);
 }
 
 - (void)setConnection:(id<XMPPConnection>)connection forJID:(XMPPJID *)JID
 {
-    dispatch_sync(_operationQueue, ^{
-        XMPPDispatcherConnectionHandle *handle = [_connectionsByJID objectForKey:[JID bareJID]];
+    XMPPDispatcherShard *shard = [self xmpp_shardForJID:JID];
+    dispatch_sync(shard.queue, ^{
+        XMPPDispatcherConnectionHandle *handle = [shard.connectionsByJID objectForKey:[JID bareJID]];
         if (handle) {
-            NSError *error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
-                                                 code:XMPPDispatcherErrorCodeNoRoute
-                                             userInfo:nil];
-            for (XMPPDispatcherImplPendingSubmission *pending in handle.pendingSubmissions) {
-                if (pending.completion) {
-                    pending.completion(error);
-                }
-            }
+            [self xmpp_failPendingSubmissionsOfConnection:handle];
         }
 
         if (connection) {
-            connection.connectionDelegate = self;
-            XMPPDispatcherConnectionHandle *handle = [[XMPPDispatcherConnectionHandle alloc] initWithConnection:connection];
-            [_connectionsByJID setObject:handle forKey:[JID bareJID]];
+            // The responses to requests, which have already been sent, can
+            // still be received by the new connection of the account.
+            XMPPDispatcherOutbox *outbox = handle ? handle.outbox : [self xmpp_openOutboxForJID:JID];
+            XMPPDispatcherConnectionHandle *newHandle = [[XMPPDispatcherConnectionHandle alloc] initWithConnection:connection
+                                                                                                             shard:shard
+                                                                                                        dispatcher:self
+                                                                                                   pendingRequests:handle.pendingRequests
+                                                                                                            outbox:outbox];
+            connection.connectionDelegate = newHandle;
+            [shard setHandle:newHandle forJID:[JID bareJID]];
+            [self xmpp_publishConnection:connection forJID:[JID bareJID]];
+            [self xmpp_restorePendingSubmissionsOfConnection:newHandle];
+        } else if (handle) {
+            [self xmpp_failPendingRequestsOfConnection:handle];
         }
     });
 }
 
 - (void)removeConnectionForJID:(XMPPJID *)JID
 {
-    dispatch_sync(_operationQueue, ^{
-        XMPPDispatcherConnectionHandle *handle = [_connectionsByJID objectForKey:[JID bareJID]];
+    XMPPDispatcherShard *shard = [self xmpp_shardForJID:JID];
+    dispatch_sync(shard.queue, ^{
+        XMPPDispatcherConnectionHandle *handle = [shard.connectionsByJID objectForKey:[JID bareJID]];
         if (handle) {
-            NSError *error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
-                                                 code:XMPPDispatcherErrorCodeNoRoute
-                                             userInfo:nil];
-            for (XMPPDispatcherImplPendingSubmission *pending in handle.pendingSubmissions) {
-                if (pending.completion) {
-                    pending.completion(error);
-                }
-            }
-
-            [_connectionsByJID removeObjectForKey:[JID bareJID]];
-
-            dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-                for (id<XMPPConnectionHandler> handler in [self xmpp_handlersConformingToProtocol:@protocol(XMPPConnectionHandler)]) {
-                    [handler didDisconnect:[JID bareJID]];
-                }
-            });
+            [self xmpp_removeConnectionHandle:handle forJID:JID];
         }
     });
 }
 
 - (void)removeConnection:(id<XMPPConnection>)connection
 {
-    dispatch_sync(_operationQueue, ^{
-
-        [[_connectionsByJID dictionaryRepresentation] enumerateKeysAndObjectsUsingBlock:^(XMPPJID *JID,
-                                                                                          XMPPDispatcherConnectionHandle *handle, BOOL *stop) {
-
+    for (XMPPDispatcherShard *shard in _shards) {
+        // Only the shards managing the connection are blocked.
+        BOOL found = NO;
+        for (XMPPDispatcherConnectionHandle *handle in [shard.handlesByJID objectEnumerator]) {
             if (handle.connection == connection) {
-                NSError *error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
-                                                     code:XMPPDispatcherErrorCodeNoRoute
-                                                 userInfo:nil];
-                for (XMPPDispatcherImplPendingSubmission *pending in handle.pendingSubmissions) {
-                    if (pending.completion) {
-                        pending.completion(error);
-                    }
+                found = YES;
+                break;
+            }
+        }
+        if (!found) {
+            continue;
+        }
+        dispatch_sync(shard.queue, ^{
+            [[shard.connectionsByJID dictionaryRepresentation] enumerateKeysAndObjectsUsingBlock:^(XMPPJID *JID,
+                                                                                                   XMPPDispatcherConnectionHandle *handle, BOOL *stop) {
+                if (handle.connection == connection) {
+                    [self xmpp_removeConnectionHandle:handle forJID:JID];
                 }
+            }];
+        });
+    }
+}
 
-                [_connectionsByJID removeObjectForKey:[JID bareJID]];
+- (void)xmpp_removeConnectionHandle:(XMPPDispatcherConnectionHandle *)handle forJID:(XMPPJID *)JID
+{
+    [self xmpp_failPendingSubmissionsOfConnection:handle];
+    [self xmpp_failPendingRequestsOfConnection:handle];
 
-                dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-                    for (id<XMPPConnectionHandler> handler in [self xmpp_handlersConformingToProtocol:@protocol(XMPPConnectionHandler)]) {
-                        [handler didDisconnect:[JID bareJID]];
-                    }
-                });
-            }
+    [handle.shard removeHandleForJID:[JID bareJID]];
+    [self xmpp_publishConnection:nil forJID:[JID bareJID]];
 
-        }];
+    NSArray *handlers = [self xmpp_handlersInTable:self.handlerSnapshot.connectionHandlers];
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        for (id<XMPPConnectionHandler> handler in handlers) {
+            [handler didDisconnect:[JID bareJID]];
+        }
     });
 }
 
@@ -186,7 +396,7 @@ NSString *_Nonnull const XMPPDispatcherErrorDomain = @"XMPPDispatcherErrorDomain
 
 - (void)addHandler:(id)handler withIQQueryQNames:(NSArray *)queryQNames features:(nullable NSArray<XMPPFeature *> *)features
 {
-    dispatch_sync(_operationQueue, ^{
+    dispatch_sync(_handlerQueue, ^{
         if ([handler conformsToProtocol:@protocol(XMPPHandler)]) {
             [_handlers addObject:handler];
             if ([queryQNames count] > 0 && [handler conformsToProtocol:@protocol(XMPPIQHandler)]) {
@@ -194,14 +404,38 @@ NSString *_Nonnull const XMPPDispatcherErrorDomain = @"XMPPDispatcherErrorDomain
                     [_handlersByQuery setObject:handler forKey:queryQName];
                 }
             }
+            [self xmpp_updateHandlerSnapshot];
+        }
+    });
+}
+
+- (void)addHandler:(id)handler withMessageFilter:(XMPPDispatcherStanzaFilter *)messageFilter presenceFilter:(XMPPDispatcherStanzaFilter *)presenceFilter
+{
+    dispatch_sync(_handlerQueue, ^{
+        if ([handler conformsToProtocol:@protocol(XMPPHandler)]) {
+            [_handlers addObject:handler];
+            if (messageFilter) {
+                [_messageFilters setObject:messageFilter forKey:handler];
+            } else {
+                [_messageFilters removeObjectForKey:handler];
+            }
+            if (presenceFilter) {
+                [_presenceFilters setObject:presenceFilter forKey:handler];
+            } else {
+                [_presenceFilters removeObjectForKey:handler];
+            }
+            [self xmpp_updateHandlerSnapshot];
         }
     });
 }
 
 - (void)removeHandler:(id)handler
 {
-    dispatch_sync(_operationQueue, ^{
+    dispatch_sync(_handlerQueue, ^{
         [_handlers removeObject:handler];
+        [_messageFilters removeObjectForKey:handler];
+        [_presenceFilters removeObjectForKey:handler];
+        [self xmpp_removeCreditForHandler:handler];
 
         NSMutableArray *keys = [[NSMutableArray alloc] init];
         for (PXQName *query in [_handlersByQuery keyEnumerator]) {
@@ -212,278 +446,723 @@ NSString *_Nonnull const XMPPDispatcherErrorDomain = @"XMPPDispatcherErrorDomain
         for (PXQName *query in keys) {
             [_handlersByQuery removeObjectForKey:query];
         }
+
+        [self xmpp_updateHandlerSnapshot];
     });
 }
 
 - (NSArray *)dispatcherHandlers
 {
-    __block NSArray *dispatcherHandlers = nil;
-    dispatch_sync(_operationQueue, ^{
-        dispatcherHandlers = [self xmpp_handlersConformingToProtocol:@protocol(XMPPConnectionHandler)];
-    });
-    return dispatcherHandlers;
+    return [self xmpp_handlersInTable:self.handlerSnapshot.connectionHandlers];
 }
 
 - (NSArray *)messageHandlers
 {
-    __block NSArray *messageHandlers = nil;
-    dispatch_sync(_operationQueue, ^{
-        messageHandlers = [self xmpp_handlersConformingToProtocol:@protocol(XMPPMessageHandler)];
-    });
-    return messageHandlers;
+    return [self xmpp_handlersInTable:self.handlerSnapshot.messageHandlers];
 }
 
 - (NSArray *)presenceHandlers
 {
-    __block NSArray *presenceHandlers = nil;
-    dispatch_sync(_operationQueue, ^{
-        presenceHandlers = [self xmpp_handlersConformingToProtocol:@protocol(XMPPPresenceHandler)];
-    });
-    return presenceHandlers;
+    return [self xmpp_handlersInTable:self.handlerSnapshot.presenceHandlers];
 }
 
 - (NSDictionary *)IQHandlersByQuery
 {
-    __block NSDictionary *IQHandlerByQuery = nil;
-    dispatch_sync(_operationQueue, ^{
-        IQHandlerByQuery = [_handlersByQuery dictionaryRepresentation];
-    });
-    return IQHandlerByQuery;
+    NSMutableDictionary *IQHandlersByQuery = [[NSMutableDictionary alloc] init];
+    [self.handlerSnapshot.IQHandlersByQuery enumerateKeysAndObjectsUsingBlock:^(PXQName *query, XMPPDispatcherHandlerReference *reference, BOOL *stop) {
+        id handler = reference.handler;
+        if (handler) {
+            IQHandlersByQuery[query] = handler;
+        }
+    }];
+    return IQHandlersByQuery;
 }
 
-- (NSArray *)xmpp_handlersConformingToProtocol:(Protocol *)protocol
+- (void)xmpp_updateHandlerSnapshot
 {
-    __block NSArray *handlers = nil;
-    handlers = [[_handlers allObjects] filteredArrayUsingPredicate:[NSPredicate predicateWithBlock:^BOOL(id _Nonnull evaluatedObject, NSDictionary<NSString *, id> *_Nullable bindings) {
-                                           return [evaluatedObject conformsToProtocol:protocol];
-                                       }]];
-    return handlers;
+    self.handlerSnapshot = [[XMPPDispatcherHandlerSnapshot alloc] initWithHandlers:_handlers
+                                                                   handlersByQuery:_handlersByQuery
+                                                                    messageFilters:_messageFilters
+                                                                   presenceFilters:_presenceFilters
+                                                                           credits:_credits];
 }
 
-#pragma mark Processing
-
-- (NSUInteger)numberOfPendingIQResponses
+- (void)xmpp_setNeedsUpdateHandlerSnapshot
 {
-    __block NSUInteger numberOfPendingIQResponses = 0;
-    dispatch_sync(_operationQueue, ^{
-        // Use the dictionary representation of the map table to
-        // make sure, that nil objects are not counted.
-        numberOfPendingIQResponses = [[_responseHandlers dictionaryRepresentation] count];
+    // Multiple shards may find the same deallocated handler. The snapshot
+    // is only updated once.
+    XMPPDispatcherHandlerSnapshot *snapshot = self.handlerSnapshot;
+    dispatch_async(_handlerQueue, ^{
+        if (self.handlerSnapshot == snapshot) {
+            [self xmpp_updateHandlerSnapshot];
+        }
     });
-    return numberOfPendingIQResponses;
 }
 
-#pragma mark XMPPConnectionDelegate
+- (NSArray *)xmpp_handlersInTable:(NSArray<XMPPDispatcherHandlerReference *> *)table
+{
+    NSMutableArray *handlers = [[NSMutableArray alloc] initWithCapacity:[table count]];
+    [self xmpp_enumerateHandlersInTable:table
+                             usingBlock:^(id handler) {
+                                 [handlers addObject:handler];
+                             }];
+    return handlers;
+}
 
-- (void)connection:(id<XMPPConnection>)connection didConnectTo:(XMPPJID *)JID resumed:(BOOL)resumed
+- (void)xmpp_enumerateHandlersInTable:(NSArray<XMPPDispatcherHandlerReference *> *)table usingBlock:(void (^)(id handler))block
 {
-    dispatch_async(_operationQueue, ^{
-        XMPPDispatcherConnectionHandle *handle = [_connectionsByJID objectForKey:[JID bareJID]];
-        if (handle && handle.connection == connection) {
-            handle.connected = YES;
-            for (XMPPDispatcherImplPendingSubmission *pending in handle.pendingSubmissions) {
-                [connection handleDocument:pending.document completion:pending.completion];
-            }
-            [handle.pendingSubmissions removeAllObjects];
-            for (id<XMPPConnectionHandler> handler in [self xmpp_handlersConformingToProtocol:@protocol(XMPPConnectionHandler)]) {
-                [handler didConnect:[JID bareJID] resumed:resumed features:nil];
-            }
+    BOOL needsUpdate = NO;
+    for (XMPPDispatcherHandlerReference *reference in table) {
+        id handler = reference.handler;
+        if (handler) {
+            block(handler);
+        } else {
+            needsUpdate = YES;
         }
-    });
+    }
+    if (needsUpdate) {
+        [self xmpp_setNeedsUpdateHandlerSnapshot];
+    }
 }
 
-- (void)connection:(id<XMPPConnection>)connection didDisconnectFrom:(XMPPJID *)JID
+#pragma mark Flow Control
+
+- (void)setMaximumNumberOfOutstandingStanzas:(NSUInteger)maximumNumberOfOutstandingStanzas forHandler:(id)handler
 {
-    dispatch_async(_operationQueue, ^{
-        XMPPDispatcherConnectionHandle *handle = [_connectionsByJID objectForKey:[JID bareJID]];
-        if (handle && handle.connection == connection) {
-            handle.connected = NO;
-            for (id<XMPPConnectionHandler> handler in [self xmpp_handlersConformingToProtocol:@protocol(XMPPConnectionHandler)]) {
-                [handler didDisconnect:[JID bareJID]];
+    dispatch_sync(_handlerQueue, ^{
+        if (maximumNumberOfOutstandingStanzas == 0) {
+            [self xmpp_removeCreditForHandler:handler];
+        } else {
+            XMPPDispatcherHandlerCredit *credit = [_credits objectForKey:handler];
+            if (credit) {
+                credit.maximumNumberOfOutstandingStanzas = maximumNumberOfOutstandingStanzas;
+            } else {
+                credit = [[XMPPDispatcherHandlerCredit alloc] initWithMaximumNumberOfOutstandingStanzas:maximumNumberOfOutstandingStanzas];
+                [_credits setObject:credit forKey:handler];
             }
         }
+        [self xmpp_updateHandlerSnapshot];
     });
 }
 
-#pragma mark XMPPDocumentHandler
+- (NSUInteger)numberOfOutstandingStanzasForHandler:(id)handler
+{
+    __block XMPPDispatcherHandlerCredit *credit = nil;
+    dispatch_sync(_handlerQueue, ^{
+        credit = [_credits objectForKey:handler];
+    });
+    return credit.numberOfOutstandingStanzas;
+}
 
-- (void)handleDocument:(PXDocument *)document completion:(void (^)(NSError *))completion
+- (void)xmpp_removeCreditForHandler:(id)handler
 {
-    dispatch_async(_operationQueue, ^{
+    // Stanzas in the backlog of the credit are still passed to the
+    // handler, because the older snapshots can still reference the credit.
+    XMPPDispatcherHandlerCredit *credit = [_credits objectForKey:handler];
+    credit.maximumNumberOfOutstandingStanzas = NSUIntegerMax;
+    [_credits removeObjectForKey:handler];
+}
 
-        if (self.delegate) {
-            id<XMPPDispatcherDelegate> delegate = self.delegate;
-            dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-                [delegate dispatcher:self didReceiveDocument:document];
-            });
+- (BOOL)xmpp_enumerateHandlersInTable:(NSArray<XMPPDispatcherHandlerReference *> *)table
+                              onShard:(XMPPDispatcherShard *)shard
+                                group:(dispatch_group_t)group
+                    inboundCompletion:(XMPPDispatcherInboundCompletion *)inboundCompletion
+                           usingBlock:(void (^)(id handler, void (^completion)(NSError *)))block
+{
+    // Handlers without a credit are called directly without a completion.
+    // Handlers with a credit are called, if they have a credit left, and
+    // the group is left after they completed the stanza. The first error
+    // of those handlers is passed to the completion of the document.
+    // Returns YES, if the group has been entered.
+    BOOL needsUpdate = NO;
+    BOOL entered = NO;
+    for (XMPPDispatcherHandlerReference *reference in table) {
+        id handler = reference.handler;
+        if (handler == nil) {
+            needsUpdate = YES;
+            continue;
         }
+        XMPPDispatcherHandlerCredit *credit = reference.credit;
+        if (credit == nil) {
+            block(handler, nil);
+        } else {
+            entered = YES;
+            dispatch_group_enter(group);
+            [credit performOnQueue:shard.queue
+                             block:^{
+                                 block(handler, ^(NSError *error) {
+                                     if (error) {
+                                         XMPPLogWarning(XMPPLogCategoryDispatcher, @"Handler %@ failed to handle stanza with error: %@", handler, [error localizedDescription]);
+                                     }
+                                     [credit complete];
+                                     dispatch_async(shard.queue, ^{
+                                         if (inboundCompletion.error == nil) {
+                                             inboundCompletion.error = error;
+                                         }
+                                         dispatch_group_leave(group);
+                                     });
+                                 });
+                             }];
+        }
+    }
+    if (needsUpdate) {
+        [self xmpp_setNeedsUpdateHandlerSnapshot];
+    }
+    return entered;
+}
+
+#pragma mark Observers
 
-        NSError *error = nil;
+- (XMPPDispatcherObserver *)addObserverForDirections:(XMPPDispatcherObservationDirection)directions
+                                         stanzaKinds:(XMPPDispatcherObservationStanzaKind)stanzaKinds
+                                          namespaces:(NSSet<NSString *> *)namespaces
+                                            interval:(NSTimeInterval)interval
+                                               queue:(dispatch_queue_t)queue
+                                               block:(void (^)(NSArray<XMPPDispatcherObservation *> *))block
+{
+    XMPPDispatcherObserver *observer = [[XMPPDispatcherObserver alloc] initWithDirections:directions
+                                                                              stanzaKinds:stanzaKinds
+                                                                               namespaces:namespaces
+                                                                                 interval:interval
+                                                                                    queue:queue ?: dispatch_get_main_queue()
+                                                                                    block:block];
+    dispatch_sync(_handlerQueue, ^{
+        self.observers = [self.observers arrayByAddingObject:observer];
+    });
+    return observer;
+}
 
-        if ([document.root isKindOfClass:[XMPPMessageStanza class]]) {
+- (void)removeObserver:(XMPPDispatcherObserver *)observer
+{
+    dispatch_sync(_handlerQueue, ^{
+        NSMutableArray *observers = [self.observers mutableCopy];
+        [observers removeObjectIdenticalTo:observer];
+        self.observers = observers;
+    });
+    [observer flush];
+}
 
-            XMPPMessageStanza *stanza = (XMPPMessageStanza *)document.root;
+- (void)xmpp_observeDocument:(PXDocument *)document direction:(XMPPDispatcherObservationDirection)direction
+{
+    NSArray<XMPPDispatcherObserver *> *observers = [self xmpp_observersMatchingStanza:document.root direction:direction];
+    if (observers) {
+        [self xmpp_addObservationOfDocument:document direction:direction toObservers:observers];
+    }
+}
 
-            for (id<XMPPMessageHandler> handler in [self xmpp_handlersConformingToProtocol:@protocol(XMPPMessageHandler)]) {
-                [handler handleMessage:stanza completion:nil];
-            }
+- (NSArray<XMPPDispatcherObserver *> *)xmpp_observersMatchingStanza:(PXElement *)stanza direction:(XMPPDispatcherObservationDirection)direction
+{
+    // Returns nil, if no observer matches. This way the document of an
+    // outbound stanza is only created, if it is observed.
+
+    NSArray<XMPPDispatcherObserver *> *observers = self.observers;
+    if ([observers count] == 0) {
+        return nil;
+    }
+
+    XMPPDispatcherObservationStanzaKind kind;
+    if ([stanza isKindOfClass:[XMPPMessageStanza class]]) {
+        kind = XMPPDispatcherObservationStanzaKindMessage;
+    } else if ([stanza isKindOfClass:[XMPPPresenceStanza class]]) {
+        kind = XMPPDispatcherObservationStanzaKindPresence;
+    } else if ([stanza isKindOfClass:[XMPPIQStanza class]]) {
+        kind = XMPPDispatcherObservationStanzaKindIQ;
+    } else {
+        return nil;
+    }
+
+    NSMutableArray<XMPPDispatcherObserver *> *matchingObservers = nil;
+    for (XMPPDispatcherObserver *observer in observers) {
+        if ([observer matchesStanza:stanza ofKind:kind direction:direction]) {
+            matchingObservers = matchingObservers ?: [[NSMutableArray alloc] init];
+            [matchingObservers addObject:observer];
+        }
+    }
+    return matchingObservers;
+}
 
-        } else if ([document.root isKindOfClass:[XMPPPresenceStanza class]]) {
+- (void)xmpp_addObservationOfDocument:(PXDocument *)document
+                            direction:(XMPPDispatcherObservationDirection)direction
+                          toObservers:(NSArray<XMPPDispatcherObserver *> *)observers
+{
+    // The observation is shared by all matching observers.
+    XMPPDispatcherObservation *observation = [[XMPPDispatcherObservation alloc] initWithDocument:document direction:direction];
+    for (XMPPDispatcherObserver *observer in observers) {
+        [observer addObservation:observation];
+    }
+}
 
-            XMPPPresenceStanza *stanza = (XMPPPresenceStanza *)document.root;
+#pragma mark Statistics
 
-            for (id<XMPPPresenceHandler> handler in [self xmpp_handlersConformingToProtocol:@protocol(XMPPPresenceHandler)]) {
-                [handler handlePresence:stanza completion:nil];
+- (XMPPDispatcherStatistics *)statistics
+{
+    uint64_t counters[XMPP_DISPATCHER_METRICS_NUMBER_OF_COUNTERS] = {0};
+    uint64_t handlerTimeBuckets[XMPP_DISPATCHER_METRICS_NUMBER_OF_BUCKETS] = {0};
+    uint64_t queueWaitTimeBuckets[XMPP_DISPATCHER_METRICS_NUMBER_OF_BUCKETS] = {0};
+    uint64_t handlerTimeSum = 0;
+    uint64_t queueWaitTimeSum = 0;
+
+    NSUInteger numberOfPendingIQResponses = 0;
+    NSMutableDictionary *numberOfPendingSubmissionsByJID = [[NSMutableDictionary alloc] init];
+
+    for (XMPPDispatcherShard *shard in _shards) {
+        XMPPDispatcherMetrics *metrics = shard.metrics;
+        for (NSUInteger counter = 0; counter < XMPP_DISPATCHER_METRICS_NUMBER_OF_COUNTERS; counter++) {
+            counters[counter] += [metrics valueOfCounter:counter];
+        }
+        [metrics addBucketsOfHistogram:XMPPDispatcherMetricsHistogramHandlerTime
+                             toBuckets:handlerTimeBuckets
+                                   sum:&handlerTimeSum];
+        [metrics addBucketsOfHistogram:XMPPDispatcherMetricsHistogramQueueWaitTime
+                             toBuckets:queueWaitTimeBuckets
+                                   sum:&queueWaitTimeSum];
+
+        [shard.handlesByJID enumerateKeysAndObjectsUsingBlock:^(XMPPJID *JID, XMPPDispatcherConnectionHandle *handle, BOOL *stop) {
+            NSUInteger numberOfPendingSubmissions = handle.pendingSubmissions.count;
+            if (numberOfPendingSubmissions > 0) {
+                numberOfPendingSubmissionsByJID[JID] = @(numberOfPendingSubmissions);
             }
+        }];
+        for (XMPPDispatcherConnectionHandle *handle in [shard.handlesByJID objectEnumerator]) {
+            numberOfPendingIQResponses += handle.pendingRequests.numberOfPendingRequests;
+        }
+    }
 
-        } else if ([document.root isKindOfClass:[XMPPIQStanza class]]) {
-
-            XMPPIQStanza *stanza = (XMPPIQStanza *)document.root;
-
-            NSString *type = [document.root valueForAttribute:@"type"];
-
-            if ([type isEqualToString:@"set"] ||
-                [type isEqualToString:@"get"]) {
-
-                if (document.root.numberOfElements == 1) {
-                    PXElement *query = [document.root elementAtIndex:0];
-                    id<XMPPIQHandler> handler = [_handlersByQuery objectForKey:query.qualifiedName];
-                    if (handler) {
-                        [handler handleIQRequest:stanza
-                                         timeout:0
-                                      completion:^(XMPPIQStanza *response, NSError *error) {
-                                          dispatch_async(_operationQueue, ^{
-                                              if (error || ![document.root isEqual:PXQN(@"jabber:client", @"iq")]) {
-                                                  XMPPIQStanza *response = [stanza responseWithError:error];
-                                                  [self xmpp_routeDocument:response completion:nil];
-                                              } else {
-                                                  [self xmpp_routeDocument:response completion:nil];
-                                              }
-                                          });
-                                      }];
-                    } else {
-                        NSError *error = [NSError errorWithDomain:XMPPStanzaErrorDomain
-                                                             code:XMPPStanzaErrorCodeItemNotFound
-                                                         userInfo:nil];
-                        XMPPIQStanza *response = [stanza responseWithError:error];
-                        [self xmpp_routeDocument:response completion:nil];
-                    }
-                } else {
-                    error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
-                                                code:XMPPDispatcherErrorCodeInvalidStanza
-                                            userInfo:nil];
-                }
+    XMPPDispatcherLatencyHistogram *handlerTime = [[XMPPDispatcherLatencyHistogram alloc] initWithBuckets:handlerTimeBuckets sum:handlerTimeSum];
+    XMPPDispatcherLatencyHistogram *queueWaitTime = [[XMPPDispatcherLatencyHistogram alloc] initWithBuckets:queueWaitTimeBuckets sum:queueWaitTimeSum];
+    return [[XMPPDispatcherStatistics alloc] initWithCounters:counters
+                                                  handlerTime:handlerTime
+                                                queueWaitTime:queueWaitTime
+                                   numberOfPendingIQResponses:numberOfPendingIQResponses
+                              numberOfPendingSubmissionsByJID:numberOfPendingSubmissionsByJID];
+}
 
-            } else if ([type isEqualToString:@"result"] ||
-                       [type isEqualToString:@"error"]) {
+#pragma mark Processing
 
-                XMPPJID *from = [[XMPPJID alloc] initWithString:[document.root valueForAttribute:@"from"]];
-                XMPPJID *to = [[XMPPJID alloc] initWithString:[document.root valueForAttribute:@"to"]];
-                NSString *requestID = [document.root valueForAttribute:@"id"];
+- (NSUInteger)numberOfPendingIQResponses
+{
+    NSUInteger numberOfPendingIQResponses = 0;
+    for (XMPPDispatcherShard *shard in _shards) {
+        for (XMPPDispatcherConnectionHandle *handle in [shard.handlesByJID objectEnumerator]) {
+            numberOfPendingIQResponses += handle.pendingRequests.numberOfPendingRequests;
+        }
+    }
+    return numberOfPendingIQResponses;
+}
 
-                if (from && to && requestID) {
-                    NSArray *key = @[ from, to, requestID ];
-                    void (^completion)(PXElement *response, NSError *error) = [_responseHandlers objectForKey:key];
+#pragma mark XMPPConnectionDelegate
 
-                    if (completion == nil) {
-                        // Try bare JID
-                        key = @[ from, [to bareJID], requestID ];
-                        completion = [_responseHandlers objectForKey:key];
-                    }
+- (void)connection:(id<XMPPConnection>)connection didConnectTo:(XMPPJID *)JID resumed:(BOOL)resumed
+{
+    [self xmpp_connection:connection didConnectTo:JID resumed:resumed onShard:[self xmpp_shardForJID:JID]];
+}
 
-                    if (completion) {
-                        [_responseHandlers removeObjectForKey:key];
-                        completion(document.root, nil);
-                    }
-                }
+- (void)connection:(id<XMPPConnection>)connection didDisconnectFrom:(XMPPJID *)JID
+{
+    [self xmpp_connection:connection didDisconnectFrom:JID onShard:[self xmpp_shardForJID:JID]];
+}
 
-            } else {
-                error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
-                                            code:XMPPDispatcherErrorCodeInvalidStanza
-                                        userInfo:nil];
-            }
-        } else {
-            error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
-                                        code:XMPPDispatcherErrorCodeInvalidStanza
-                                    userInfo:nil];
+- (void)connection:(id<XMPPConnection>)connection didChangeWritable:(BOOL)writable forJID:(XMPPJID *)JID
+{
+    [self xmpp_connection:connection didChangeWritable:writable forJID:JID onShard:[self xmpp_shardForJID:JID]];
+}
+
+- (void)xmpp_connection:(id<XMPPConnection>)connection didConnectTo:(XMPPJID *)JID resumed:(BOOL)resumed onShard:(XMPPDispatcherShard *)shard
+{
+    dispatch_async(shard.queue, ^{
+        XMPPDispatcherConnectionHandle *handle = [shard.connectionsByJID objectForKey:[JID bareJID]];
+        if (handle && handle.connection == connection) {
+            handle.connected = YES;
+            [self xmpp_submitPendingDocumentsOfConnection:handle];
+            [self xmpp_enumerateHandlersInTable:self.handlerSnapshot.connectionHandlers
+                                     usingBlock:^(id<XMPPConnectionHandler> handler) {
+                                         [handler didConnect:[JID bareJID] resumed:resumed features:nil];
+                                     }];
         }
+    });
+}
 
-        if (completion) {
-            completion(error);
+- (void)xmpp_connection:(id<XMPPConnection>)connection didDisconnectFrom:(XMPPJID *)JID onShard:(XMPPDispatcherShard *)shard
+{
+    dispatch_async(shard.queue, ^{
+        XMPPDispatcherConnectionHandle *handle = [shard.connectionsByJID objectForKey:[JID bareJID]];
+        if (handle && handle.connection == connection) {
+            handle.connected = NO;
+            [self xmpp_enumerateHandlersInTable:self.handlerSnapshot.connectionHandlers
+                                     usingBlock:^(id<XMPPConnectionHandler> handler) {
+                                         [handler didDisconnect:[JID bareJID]];
+                                     }];
+        }
+    });
+}
+
+- (void)xmpp_connection:(id<XMPPConnection>)connection didChangeWritable:(BOOL)writable forJID:(XMPPJID *)JID onShard:(XMPPDispatcherShard *)shard
+{
+    dispatch_async(shard.queue, ^{
+        XMPPDispatcherConnectionHandle *handle = [shard.connectionsByJID objectForKey:[JID bareJID]];
+        if (handle && handle.connection == connection) {
+            handle.writable = writable;
+            [self xmpp_submitPendingDocumentsOfConnection:handle];
         }
     });
 }
 
+#pragma mark XMPPDocumentHandler
+
+- (void)handleDocument:(PXDocument *)document completion:(void (^)(NSError *))completion
+{
+    // Documents, which are not passed by a connection (see
+    // XMPPDispatcherConnectionHandle) are processed on the shard of the
+    // receiving account.
+    XMPPJID *to = [[XMPPJID alloc] initWithString:[document.root valueForAttribute:@"to"]];
+    [self xmpp_handleDocument:document completion:completion onShard:[self xmpp_shardForJID:to] handle:nil];
+}
+
+- (void)handleDocuments:(NSArray<PXDocument *> *)documents completion:(void (^)(NSUInteger, NSError *))completion
+{
+    // The documents are grouped by the shard of the receiving account. The
+    // documents of each shard are passed in one batch.
+    NSMapTable<XMPPDispatcherShard *, NSMutableIndexSet *> *indexesByShard = [NSMapTable strongToStrongObjectsMapTable];
+    [documents enumerateObjectsUsingBlock:^(PXDocument *document, NSUInteger index, BOOL *stop) {
+        XMPPJID *to = [[XMPPJID alloc] initWithString:[document.root valueForAttribute:@"to"]];
+        XMPPDispatcherShard *shard = [self xmpp_shardForJID:to];
+        NSMutableIndexSet *indexes = [indexesByShard objectForKey:shard];
+        if (indexes == nil) {
+            indexes = [[NSMutableIndexSet alloc] init];
+            [indexesByShard setObject:indexes forKey:shard];
+        }
+        [indexes addIndex:index];
+    }];
+
+    for (XMPPDispatcherShard *shard in indexesByShard) {
+        NSIndexSet *indexes = [indexesByShard objectForKey:shard];
+        NSMutableArray *shardIndexes = [[NSMutableArray alloc] initWithCapacity:[indexes count]];
+        [indexes enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop) {
+            [shardIndexes addObject:@(index)];
+        }];
+        [self xmpp_handleDocuments:[documents objectsAtIndexes:indexes]
+                        completion:^(NSUInteger index, NSError *error) {
+                            if (completion) {
+                                completion([shardIndexes[index] unsignedIntegerValue], error);
+                            }
+                        }
+                           onShard:shard
+                            handle:nil];
+    }
+}
+
 - (void)processPendingDocuments:(void (^)(NSError *))completion
 {
-    dispatch_async(_operationQueue, ^{
+    dispatch_group_t group = dispatch_group_create();
+    for (XMPPDispatcherShard *shard in _shards) {
+        dispatch_group_async(group, shard.queue, ^{
+        });
+    }
+    dispatch_group_notify(group, [[_shards firstObject] queue], ^{
         if (completion) {
             completion(nil);
         }
     });
 }
 
-#pragma mark XMPPMessageHandler
-
-- (void)handleMessage:(XMPPMessageStanza *)stanza completion:(void (^)(NSError *))completion
+- (void)xmpp_handleDocument:(PXDocument *)document
+                 completion:(void (^)(NSError *))completion
+                    onShard:(XMPPDispatcherShard *)shard
+                     handle:(XMPPDispatcherConnectionHandle *)handle
 {
-    dispatch_async(_operationQueue, ^{
-        [self xmpp_routeDocument:stanza completion:completion];
+    uint64_t timestamp = XMPPDispatcherMetricsTimestamp();
+    dispatch_async(shard.queue, ^{
+        [shard.metrics recordDurationSinceTimestamp:timestamp inHistogram:XMPPDispatcherMetricsHistogramQueueWaitTime];
+        [self xmpp_processDocument:document completion:completion onShard:shard handle:handle];
     });
 }
 
-#pragma mark XMPPPresenceHandler
-
-- (void)handlePresence:(XMPPPresenceStanza *)stanza completion:(void (^)(NSError *))completion
+- (void)xmpp_handleDocuments:(NSArray<PXDocument *> *)documents
+                  completion:(void (^)(NSUInteger, NSError *))completion
+                     onShard:(XMPPDispatcherShard *)shard
+                      handle:(XMPPDispatcherConnectionHandle *)handle
 {
-    dispatch_async(_operationQueue, ^{
-        [self xmpp_routeDocument:stanza completion:completion];
+    // The documents are processed in order with one switch to the queue of
+    // the shard.
+    uint64_t timestamp = XMPPDispatcherMetricsTimestamp();
+    dispatch_async(shard.queue, ^{
+        [shard.metrics recordDurationSinceTimestamp:timestamp inHistogram:XMPPDispatcherMetricsHistogramQueueWaitTime];
+        [documents enumerateObjectsUsingBlock:^(PXDocument *document, NSUInteger index, BOOL *stop) {
+            [self xmpp_processDocument:document
+                            completion:^(NSError *error) {
+                                if (completion) {
+                                    completion(index, error);
+                                }
+                            }
+                               onShard:shard
+                                handle:handle];
+        }];
     });
 }
 
-#pragma mark XMPPIQHandler
-
-- (void)handleIQRequest:(XMPPIQStanza *)request
-                timeout:(NSTimeInterval)timeout
-             completion:(void (^)(XMPPIQStanza *, NSError *))completion
+- (void)xmpp_processDocument:(PXDocument *)document
+                  completion:(void (^)(NSError *))completion
+                     onShard:(XMPPDispatcherShard *)shard
+                      handle:(XMPPDispatcherConnectionHandle *)handle
 {
-    dispatch_async(_operationQueue, ^{
+    XMPPDispatcherMetrics *metrics = shard.metrics;
+    [metrics incrementCounterForStanza:document.root received:YES];
 
-        if (request.type == XMPPIQStanzaTypeSet || request.type == XMPPIQStanzaTypeGet) {
+    if (self.delegate) {
+        id<XMPPDispatcherDelegate> delegate = self.delegate;
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            [delegate dispatcher:self didReceiveDocument:document];
+        });
+    }
 
-            NSString *requestId = request.identifier;
-            if (requestId == nil) {
-                requestId = [[NSUUID UUID] UUIDString];
-                request.identifier = requestId;
-            }
+    [self xmpp_observeDocument:document direction:XMPPDispatcherObservationDirectionInbound];
 
-            XMPPJID *from = request.from;
-            XMPPJID *to = request.to ?: [from bareJID];
-            NSArray *key = @[ to ?: [NSNull null], from ?: [NSNull null], requestId ];
+    NSError *error = nil;
 
-            if (completion) {
-                [_responseHandlers setObject:completion forKey:key];
-            }
+    // The completion is deferred until the handlers with a credit have
+    // completed the stanza and all earlier stanzas of the connection have
+    // been completed. This way the connection only acknowledges stanzas,
+    // which have been handled.
+    XMPPDispatcherInboundCompletion *inboundCompletion = [[XMPPDispatcherInboundCompletion alloc] initWithCompletion:completion];
+    NSMutableArray<XMPPDispatcherInboundCompletion *> *inboundCompletions = handle ? handle.inboundCompletions : shard.inboundCompletions;
+    [inboundCompletions addObject:inboundCompletion];
 
-            NSTimeInterval defaultTimeout = 60.0;
-            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)((timeout ?: defaultTimeout) * NSEC_PER_SEC)), _operationQueue, ^{
-                void (^completion)(PXElement *response, NSError *error) = [_responseHandlers objectForKey:key];
-                if (completion) {
-                    [_responseHandlers removeObjectForKey:key];
-                    NSError *error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
-                                                         code:XMPPDispatcherErrorCodeTimeout
+    dispatch_group_t group = dispatch_group_create();
+    BOOL deferred = NO;
+
+    // Only the time the handlers block the queue of the shard is
+    // recorded, not the time until they complete a stanza.
+    uint64_t handlerTimestamp = XMPPDispatcherMetricsTimestamp();
+
+    if ([document.root isKindOfClass:[XMPPMessageStanza class]]) {
+
+        XMPPMessageStanza *stanza = (XMPPMessageStanza *)document.root;
+
+        deferred = [self xmpp_enumerateHandlersInTable:[self.handlerSnapshot.messageIndex referencesForStanza:stanza]
+                                               onShard:shard
+                                                 group:group
+                                     inboundCompletion:inboundCompletion
+                                            usingBlock:^(id<XMPPMessageHandler> handler, void (^completion)(NSError *)) {
+                                                [handler handleMessage:stanza completion:completion];
+                                            }];
+
+    } else if ([document.root isKindOfClass:[XMPPPresenceStanza class]]) {
+
+        XMPPPresenceStanza *stanza = (XMPPPresenceStanza *)document.root;
+
+        deferred = [self xmpp_enumerateHandlersInTable:[self.handlerSnapshot.presenceIndex referencesForStanza:stanza]
+                                               onShard:shard
+                                                 group:group
+                                     inboundCompletion:inboundCompletion
+                                            usingBlock:^(id<XMPPPresenceHandler> handler, void (^completion)(NSError *)) {
+                                                [handler handlePresence:stanza completion:completion];
+                                            }];
+
+    } else if ([document.root isKindOfClass:[XMPPIQStanza class]]) {
+
+        XMPPIQStanza *stanza = (XMPPIQStanza *)document.root;
+
+        NSString *type = [document.root valueForAttribute:@"type"];
+
+        if ([type isEqualToString:@"set"] ||
+            [type isEqualToString:@"get"]) {
+
+            if (document.root.numberOfElements == 1) {
+                PXElement *query = [document.root elementAtIndex:0];
+                XMPPDispatcherHandlerReference *reference = [self.handlerSnapshot.IQHandlersByQuery objectForKey:query.qualifiedName];
+                id<XMPPIQHandler> handler = reference.handler;
+                if (handler) {
+                    [handler handleIQRequest:stanza
+                                     timeout:0
+                                  completion:^(XMPPIQStanza *response, NSError *error) {
+                                      if (error || ![document.root isEqual:PXQN(@"jabber:client", @"iq")]) {
+                                          XMPPIQStanza *response = [stanza responseWithError:error];
+                                          [self xmpp_routeDocument:response completion:nil];
+                                      } else {
+                                          [self xmpp_routeDocument:response completion:nil];
+                                      }
+                                  }];
+                } else {
+                    if (reference) {
+                        [self xmpp_setNeedsUpdateHandlerSnapshot];
+                    }
+                    NSError *error = [NSError errorWithDomain:XMPPStanzaErrorDomain
+                                                         code:XMPPStanzaErrorCodeItemNotFound
                                                      userInfo:nil];
-                    completion(nil, error);
+                    XMPPIQStanza *response = [stanza responseWithError:error];
+                    [self xmpp_routeDocument:response completion:nil];
                 }
-            });
+            } else {
+                error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
+                                            code:XMPPDispatcherErrorCodeInvalidStanza
+                                        userInfo:nil];
+            }
+
+        } else if ([type isEqualToString:@"result"] ||
+                   [type isEqualToString:@"error"]) {
+
+            NSString *requestID = [document.root valueForAttribute:@"id"];
+
+            XMPPDispatcherConnectionHandle *receiver = handle;
+            if (receiver == nil) {
+                XMPPJID *to = [[XMPPJID alloc] initWithString:[document.root valueForAttribute:@"to"]];
+                receiver = to ? [shard.connectionsByJID objectForKey:[to bareJID]] : nil;
+            }
+
+            if (receiver && requestID) {
+                XMPPIQCorrelationCompletion completion = [receiver.pendingRequests removeRequestForResponseWithID:requestID
+                                                                                                             from:[document.root valueForAttribute:@"from"]];
+                if (completion) {
+                    completion(stanza, nil);
+                }
+            }
+
+        } else {
+            error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
+                                        code:XMPPDispatcherErrorCodeInvalidStanza
+                                    userInfo:nil];
+        }
+    } else {
+        error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
+                                    code:XMPPDispatcherErrorCodeInvalidStanza
+                                userInfo:nil];
+    }
+
+    [metrics recordDurationSinceTimestamp:handlerTimestamp inHistogram:XMPPDispatcherMetricsHistogramHandlerTime];
+
+    if (deferred) {
+        dispatch_group_notify(group, shard.queue, ^{
+            [self xmpp_finishInboundCompletion:inboundCompletion withError:nil inCompletions:inboundCompletions];
+        });
+    } else {
+        [self xmpp_finishInboundCompletion:inboundCompletion withError:error inCompletions:inboundCompletions];
+    }
+}
+
+- (void)xmpp_finishInboundCompletion:(XMPPDispatcherInboundCompletion *)inboundCompletion
+                           withError:(NSError *)error
+                       inCompletions:(NSMutableArray<XMPPDispatcherInboundCompletion *> *)inboundCompletions
+{
+    if (inboundCompletion.error == nil) {
+        inboundCompletion.error = error;
+    }
+    inboundCompletion.finished = YES;
+
+    while ([inboundCompletions count] > 0 && [[inboundCompletions firstObject] isFinished]) {
+        XMPPDispatcherInboundCompletion *finishedCompletion = [inboundCompletions firstObject];
+        [inboundCompletions removeObjectAtIndex:0];
+        if (finishedCompletion.completion) {
+            finishedCompletion.completion(finishedCompletion.error);
+        }
+    }
+}
+
+#pragma mark XMPPMessageHandler
+
+- (void)handleMessage:(XMPPMessageStanza *)stanza completion:(void (^)(NSError *))completion
+{
+    [self xmpp_routeDocument:stanza completion:completion];
+}
+
+#pragma mark XMPPPresenceHandler
+
+- (void)handlePresence:(XMPPPresenceStanza *)stanza completion:(void (^)(NSError *))completion
+{
+    [self xmpp_routeDocument:stanza completion:completion];
+}
+
+#pragma mark XMPPIQHandler
+
+- (void)handleIQRequest:(XMPPIQStanza *)request
+                timeout:(NSTimeInterval)timeout
+             completion:(void (^)(XMPPIQStanza *, NSError *))completion
+{
+    // The response is received by the account sending the request.
+    // Therefore the response handler is kept on the shard of the sender.
+    XMPPDispatcherShard *shard = [self xmpp_shardForJID:request.from];
+    uint64_t timestamp = XMPPDispatcherMetricsTimestamp();
+    dispatch_async(shard.queue, ^{
+
+        [shard.metrics recordDurationSinceTimestamp:timestamp inHistogram:XMPPDispatcherMetricsHistogramQueueWaitTime];
+
+        if (request.type == XMPPIQStanzaTypeSet || request.type == XMPPIQStanzaTypeGet) {
+
+            XMPPJID *from = request.from;
+            XMPPDispatcherConnectionHandle *handle = from ? [shard.connectionsByJID objectForKey:[from bareJID]] : nil;
+            if (handle == nil) {
+                // Routing fails with the appropriate error.
+                [self xmpp_routeDocument:request
+                                 onShard:shard
+                              completion:^(NSError *error) {
+                                  if (completion) {
+                                      completion(nil, error);
+                                  }
+                              }];
+                return;
+            }
+
+            XMPPIQCorrelationTable *pendingRequests = handle.pendingRequests;
+
+            NSString *requestId = request.identifier;
+            if (requestId == nil) {
+                requestId = [pendingRequests nextRequestID];
+                request.identifier = requestId;
+            }
+
+            NSTimeInterval defaultTimeout = 60.0;
+            NSTimeInterval requestTimeout = timeout ?: defaultTimeout;
+
+            void (^requestCompletion)(XMPPIQStanza *, NSError *) = [self xmpp_coalesceRequest:request
+                                                                                      timeout:requestTimeout
+                                                                                      onShard:shard
+                                                                                   completion:completion];
+            if (completion && requestCompletion == nil) {
+                // The request has been answered from the cache or joined
+                // an identical pending request.
+                return;
+            }
+
+            // Requests without a recipient are handled by the account
+            // itself. The server may respond without a 'from' attribute.
+            XMPPJID *to = request.to ?: [from bareJID];
+            // The ID may be used by other pending requests of the account.
+            // Therefore the timer and the routing only remove this request.
+            // The timer references the request weakly, because the request
+            // references the timer.
+            id pendingRequest = nil;
+            if (requestCompletion) {
+                XMPPTimerWheel *timerWheel = shard.timerWheel;
+                __block __weak id weakPendingRequest = nil;
+                XMPPTimerWheelEntry *timer = [timerWheel scheduleTimerWithTimeout:requestTimeout
+                                                                          handler:^{
+                                                                              XMPPIQCorrelationCompletion completion = [pendingRequests removeRequest:weakPendingRequest];
+                                                                              if (completion) {
+                                                                                  [shard.metrics incrementCounter:XMPPDispatcherMetricsCounterTimeoutErrors];
+                                                                                  NSError *error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
+                                                                                                                       code:XMPPDispatcherErrorCodeTimeout
+                                                                                                                   userInfo:nil];
+                                                                                  completion(nil, error);
+                                                                              }
+                                                                          }];
+
+                // The timer is cancelled, as soon as the request completes.
+                pendingRequest = [pendingRequests addRequestWithID:requestId
+                                                                to:to
+                                              acceptsMissingSender:[to isEqual:[from bareJID]]
+                                                        completion:^(XMPPIQStanza *response, NSError *error) {
+                                                            [timerWheel cancelTimer:timer];
+                                                            requestCompletion(response, error);
+                                                        }];
+                weakPendingRequest = pendingRequest;
+            }
 
             [self xmpp_routeDocument:request
+                             onShard:shard
                           completion:^(NSError *error) {
                               if (error) {
-                                  dispatch_async(_operationQueue, ^{
-                                      void (^completion)(PXElement *response, NSError *error) = [_responseHandlers objectForKey:key];
+                                  dispatch_async(shard.queue, ^{
+                                      XMPPIQCorrelationCompletion completion = [pendingRequests removeRequest:pendingRequest];
                                       if (completion) {
-                                          [_responseHandlers removeObjectForKey:key];
                                           completion(nil, error);
                                       }
                                   });
@@ -501,45 +1180,272 @@ NSString *_Nonnull const XMPPDispatcherErrorDomain = @"XMPPDispatcherErrorDomain
     });
 }
 
+- (void (^)(XMPPIQStanza *, NSError *))xmpp_coalesceRequest:(XMPPIQStanza *)request
+                                                     timeout:(NSTimeInterval)timeout
+                                                     onShard:(XMPPDispatcherShard *)shard
+                                                  completion:(void (^)(XMPPIQStanza *, NSError *))completion
+{
+    // Returns the completion for the request, which is sent. Returns nil,
+    // if the request must not be sent.
+
+    if (completion == nil) {
+        return nil;
+    }
+
+    BOOL coalescesIQRequests = self.coalescesIQRequests;
+    NSTimeInterval timeToLive = 0;
+    if (request.numberOfElements == 1) {
+        NSString *namespace = [request elementAtIndex:0].namespace;
+        timeToLive = namespace ? [self.IQResultTimeToLives[namespace] doubleValue] : 0;
+    }
+
+    if (!coalescesIQRequests && timeToLive <= 0) {
+        return completion;
+    }
+
+    NSData *key = [XMPPIQRequestCoalescer keyForRequest:request];
+    if (key == nil) {
+        return completion;
+    }
+
+    XMPPIQRequestCoalescer *coalescer = shard.coalescer;
+    coalescer.maximumNumberOfCachedResults = self.maximumNumberOfCachedIQResults;
+
+    // Requests answered from the cache or by the response of another
+    // request receive their own copy of the response with their own ID.
+    NSString *requestID = request.identifier;
+
+    XMPPIQStanza *result = [coalescer cachedResultForKey:key];
+    if (result) {
+        completion([self xmpp_copyOfResponse:result withRequestID:requestID], nil);
+        return nil;
+    }
+
+    void (^cachingCompletion)(XMPPIQStanza *, NSError *) = completion;
+    if (timeToLive > 0) {
+        cachingCompletion = ^(XMPPIQStanza *response, NSError *error) {
+            if (response && error == nil && response.type == XMPPIQStanzaTypeResult) {
+                [coalescer cacheResult:[self xmpp_copyOfResponse:response withRequestID:requestID] forKey:key timeToLive:timeToLive];
+            }
+            completion(response, error);
+        };
+    }
+
+    if (!coalescesIQRequests) {
+        return cachingCompletion;
+    }
+
+    // A request joining a pending request keeps its own timeout. It only
+    // joins, if the pending request does not time out earlier.
+    NSTimeInterval deadline = [[NSProcessInfo processInfo] systemUptime] + timeout;
+    XMPPTimerWheel *timerWheel = shard.timerWheel;
+    __block XMPPTimerWheelEntry *timer = nil;
+    XMPPIQCorrelationCompletion waiter = [^(XMPPIQStanza *response, NSError *error) {
+        [timerWheel cancelTimer:timer];
+        completion([self xmpp_copyOfResponse:response withRequestID:requestID], error);
+    } copy];
+
+    id pendingRequest = [coalescer joinRequestForKey:key deadline:deadline completion:waiter];
+    if (pendingRequest) {
+        XMPPDispatcherMetrics *metrics = shard.metrics;
+        timer = [timerWheel scheduleTimerWithTimeout:timeout
+                                             handler:^{
+                                                 if ([coalescer removeCompletion:waiter fromRequest:pendingRequest]) {
+                                                     [metrics incrementCounter:XMPPDispatcherMetricsCounterTimeoutErrors];
+                                                     NSError *error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
+                                                                                          code:XMPPDispatcherErrorCodeTimeout
+                                                                                      userInfo:nil];
+                                                     completion(nil, error);
+                                                 }
+                                             }];
+        return nil;
+    }
+
+    id sentRequest = [coalescer beginRequestForKey:key deadline:deadline];
+    return ^(XMPPIQStanza *response, NSError *error) {
+        NSArray<XMPPIQCorrelationCompletion> *waiters = [coalescer finishRequest:sentRequest];
+        cachingCompletion(response, error);
+        for (XMPPIQCorrelationCompletion waiter in waiters) {
+            waiter(response, error);
+        }
+    };
+}
+
+- (XMPPIQStanza *)xmpp_copyOfResponse:(XMPPIQStanza *)response withRequestID:(NSString *)requestID
+{
+    if (response == nil) {
+        return nil;
+    }
+    PXDocument *document = [[PXDocument alloc] initWithElement:response];
+    XMPPIQStanza *copy = (XMPPIQStanza *)document.root;
+    copy.identifier = requestID;
+    return copy;
+}
+
+#pragma mark Sending Stanzas
+
+- (void)sendStanzas:(NSArray<XMPPStanza *> *)stanzas completion:(void (^)(NSUInteger, NSError *))completion
+{
+    // The stanzas are grouped by the shard of the sending account and each
+    // group is routed with one switch to the queue of the shard. The
+    // documents for the same connection are passed in one batch.
+    NSMapTable<XMPPDispatcherShard *, NSMutableIndexSet *> *indexesByShard = [NSMapTable strongToStrongObjectsMapTable];
+    [stanzas enumerateObjectsUsingBlock:^(XMPPStanza *stanza, NSUInteger index, BOOL *stop) {
+        XMPPDispatcherShard *shard = [self xmpp_shardForJID:stanza.from];
+        NSMutableIndexSet *indexes = [indexesByShard objectForKey:shard];
+        if (indexes == nil) {
+            indexes = [[NSMutableIndexSet alloc] init];
+            [indexesByShard setObject:indexes forKey:shard];
+        }
+        [indexes addIndex:index];
+    }];
+
+    for (XMPPDispatcherShard *shard in indexesByShard) {
+        NSIndexSet *indexes = [indexesByShard objectForKey:shard];
+        uint64_t timestamp = XMPPDispatcherMetricsTimestamp();
+        dispatch_async(shard.queue, ^{
+            [shard.metrics recordDurationSinceTimestamp:timestamp inHistogram:XMPPDispatcherMetricsHistogramQueueWaitTime];
+
+            NSMapTable *batches = [NSMapTable strongToStrongObjectsMapTable];
+            [indexes enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop) {
+                [self xmpp_routeDocument:stanzas[index]
+                                 onShard:shard
+                                 batches:batches
+                              completion:^(NSError *error) {
+                                  if (completion) {
+                                      completion(index, error);
+                                  }
+                              }];
+            }];
+
+            for (XMPPDispatcherConnectionHandle *handle in batches) {
+                [self xmpp_submitBatch:[batches objectForKey:handle] toConnection:handle];
+            }
+        });
+    }
+}
+
+- (void)xmpp_submitBatch:(XMPPDispatcherSubmissionBatch *)batch toConnection:(XMPPDispatcherConnectionHandle *)handle
+{
+    NSArray *completions = [batch.completions copy];
+    if ([completions count] == 0) {
+        return;
+    }
+
+    id<XMPPConnection> connection = handle.connection;
+    if ([completions count] > 1 && [connection respondsToSelector:@selector(handleDocuments:completion:)]) {
+        [connection handleDocuments:[batch.documents copy]
+                         completion:^(NSUInteger index, NSError *error) {
+                             void (^completion)(NSError *) = completions[index];
+                             if (completion != (id)[NSNull null]) {
+                                 completion(error);
+                             }
+                         }];
+    } else {
+        [batch.documents enumerateObjectsUsingBlock:^(PXDocument *document, NSUInteger index, BOOL *stop) {
+            void (^completion)(NSError *) = completions[index];
+            [connection handleDocument:document completion:(completion != (id)[NSNull null] ? completion : nil)];
+        }];
+    }
+}
+
 #pragma mark -
 
 - (void)xmpp_routeDocument:(XMPPStanza *)stanza completion:(void (^)(NSError *))completion
 {
+    XMPPDispatcherShard *shard = [self xmpp_shardForJID:stanza.from];
+    uint64_t timestamp = XMPPDispatcherMetricsTimestamp();
+    dispatch_async(shard.queue, ^{
+        [shard.metrics recordDurationSinceTimestamp:timestamp inHistogram:XMPPDispatcherMetricsHistogramQueueWaitTime];
+        [self xmpp_routeDocument:stanza onShard:shard completion:completion];
+    });
+}
+
+- (void)xmpp_routeDocument:(XMPPStanza *)stanza onShard:(XMPPDispatcherShard *)shard completion:(void (^)(NSError *))completion
+{
+    [self xmpp_routeDocument:stanza onShard:shard batches:nil completion:completion];
+}
+
+- (void)xmpp_routeDocument:(XMPPStanza *)stanza
+                   onShard:(XMPPDispatcherShard *)shard
+                   batches:(NSMapTable<XMPPDispatcherConnectionHandle *, XMPPDispatcherSubmissionBatch *> *)batches
+                completion:(void (^)(NSError *))completion
+{
+    // If batches are passed, the documents, which can be submitted
+    // directly, are collected per connection instead.
+
+    // The document is created only once and shared by the delegate, the
+    // observers and the connection.
+    PXDocument *document = nil;
 
     if (self.delegate) {
-        PXDocument *document = [[PXDocument alloc] initWithElement:stanza];
+        document = [[PXDocument alloc] initWithElement:stanza];
         id<XMPPDispatcherDelegate> delegate = self.delegate;
         dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
             [delegate dispatcher:self willSendDocument:document];
         });
     }
 
+    NSArray<XMPPDispatcherObserver *> *observers = [self xmpp_observersMatchingStanza:stanza
+                                                                             direction:XMPPDispatcherObservationDirectionOutbound];
+    if (observers) {
+        document = document ?: [[PXDocument alloc] initWithElement:stanza];
+        // The document is shared with the observers and is not modified
+        // anymore. Serialize it only once for the observers and the stream.
+        [document xmpp_freezeWireData];
+        [self xmpp_addObservationOfDocument:document
+                                  direction:XMPPDispatcherObservationDirectionOutbound
+                                toObservers:observers];
+    }
+
     XMPPJID *from = stanza.from;
     if (from) {
 
         XMPPJID *bareJID = [from bareJID];
 
-        XMPPDispatcherConnectionHandle *handle = [_connectionsByJID objectForKey:bareJID];
+        XMPPDispatcherConnectionHandle *handle = [shard.connectionsByJID objectForKey:bareJID];
         if (handle) {
-            PXDocument *document = [[PXDocument alloc] initWithElement:stanza];
-            if (handle.connected) {
-
-                [handle.connection handleDocument:document completion:completion];
+            [shard.metrics incrementCounterForStanza:stanza received:NO];
+            document = document ?: [[PXDocument alloc] initWithElement:stanza];
+            if (handle.connected && handle.writable && handle.pendingSubmissions.count == 0) {
+
+                if (batches) {
+                    XMPPDispatcherSubmissionBatch *batch = [batches objectForKey:handle];
+                    if (batch == nil) {
+                        batch = [[XMPPDispatcherSubmissionBatch alloc] init];
+                        [batches setObject:batch forKey:handle];
+                    }
+                    [batch addDocument:document completion:completion];
+                } else {
+                    [handle.connection handleDocument:document completion:completion];
+                }
             } else {
-                NSTimeInterval timeout = 120.0;
-                NSDate *date = [NSDate dateWithTimeIntervalSinceNow:timeout];
-                XMPPDispatcherImplPendingSubmission *pending = [[XMPPDispatcherImplPendingSubmission alloc] initWithDocument:document
-                                                                                                                     timeout:date
-                                                                                                                  completion:completion];
-                [handle.pendingSubmissions addObject:pending];
 
-                __weak typeof(self) _self = self;
-                dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(timeout * NSEC_PER_SEC)), _operationQueue, ^{
-                    typeof(self) this = _self;
-                    [this xmpp_clearPendingSubmissions];
-                });
+                // The document is held back, if the connection is not established
+                // or if the stream of the connection is not writable (backpressure).
+                // Only documents held back while the connection is down are
+                // written to the outbox. Backpressure is usually resolved soon,
+                // and writing each document would block the shard.
+
+                NSNumber *timeout = self.pendingSubmissionTimeouts[stanza.name];
+                NSTimeInterval interval = timeout ? [timeout doubleValue] : XMPPDispatcherDefaultPendingSubmissionTimeout;
+                XMPPStanzaPriority priority = XMPPStanzaPriorityOfElement(stanza);
+
+                uint64_t token = 0;
+                if (!handle.connected) {
+                    token = [handle.outbox appendDocument:document
+                                                 deadline:[NSDate dateWithTimeIntervalSinceNow:interval]
+                                                 priority:priority];
+                }
+                XMPPDispatcherImplPendingSubmission *pending = [[XMPPDispatcherImplPendingSubmission alloc] initWithDocument:(token ? nil : document)
+                                                                                                                       token:token
+                                                                                                                    priority:priority
+                                                                                                                 orderingKey:XMPPStanzaOrderingKeyOfElement(stanza)
+                                                                                                                  completion:completion];
+                [self xmpp_addPendingSubmission:pending toConnection:handle timeout:interval];
             }
         } else {
+            [shard.metrics incrementCounter:XMPPDispatcherMetricsCounterNoRouteErrors];
             if (completion) {
                 NSError *error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
                                                      code:XMPPDispatcherErrorCodeNoRoute
@@ -559,46 +1465,567 @@ NSString *_Nonnull const XMPPDispatcherErrorDomain = @"XMPPDispatcherErrorDomain
     }
 }
 
-- (void)xmpp_clearPendingSubmissions
+- (void)xmpp_addPendingSubmission:(XMPPDispatcherImplPendingSubmission *)pending
+                     toConnection:(XMPPDispatcherConnectionHandle *)handle
+                          timeout:(NSTimeInterval)timeout
+{
+    [handle.pendingSubmissions enqueueObject:pending withPriority:pending.priority orderingKey:pending.orderingKey];
+
+    __weak typeof(self) _self = self;
+    pending.timer = [handle.shard.timerWheel scheduleTimerWithTimeout:timeout
+                                                              handler:^{
+                                                                  typeof(self) this = _self;
+                                                                  [this xmpp_expirePendingSubmission:pending ofConnection:handle];
+                                                              }];
+}
+
+- (void)xmpp_restorePendingSubmissionsOfConnection:(XMPPDispatcherConnectionHandle *)handle
+{
+    // Documents held back before the process has been restarted. The
+    // completion handlers of these documents are gone.
+
+    XMPPDispatcherOutbox *outbox = handle.outbox;
+    NSMutableArray *expiredTokens = [[NSMutableArray alloc] init];
+    NSMutableArray *restored = [[NSMutableArray alloc] init];
+    [outbox enumerateDocumentsUsingBlock:^(uint64_t token, NSDate *deadline, XMPPStanzaPriority priority, BOOL *stop) {
+        if ([deadline timeIntervalSinceNow] > 0) {
+            [restored addObject:@[ @(token), deadline, @(priority) ]];
+        } else {
+            [expiredTokens addObject:@(token)];
+        }
+    }];
+
+    for (NSNumber *token in expiredTokens) {
+        [outbox removeDocumentWithToken:[token unsignedLongLongValue]];
+    }
+
+    // The recipients of the restored documents are not known without
+    // reading the documents. Therefore all restored documents share one
+    // ordering key and are submitted in the order of the outbox.
+    for (NSArray *item in restored) {
+        XMPPDispatcherImplPendingSubmission *pending = [[XMPPDispatcherImplPendingSubmission alloc] initWithDocument:nil
+                                                                                                               token:[item[0] unsignedLongLongValue]
+                                                                                                            priority:[item[2] unsignedIntegerValue]
+                                                                                                         orderingKey:XMPPDispatcherRestoredSubmissionOrderingKey
+                                                                                                          completion:nil];
+        [self xmpp_addPendingSubmission:pending toConnection:handle timeout:[item[1] timeIntervalSinceNow]];
+    }
+}
+
+- (void)xmpp_submitPendingDocumentsOfConnection:(XMPPDispatcherConnectionHandle *)handle
+{
+    if (handle.connected && handle.writable) {
+
+        // The pending documents are submitted in batches. This way, the
+        // other accounts of the shard are not blocked by a large outbox.
+        // The scheduler picks the documents by priority.
+
+        XMPPStanzaScheduler *pendingSubmissions = handle.pendingSubmissions;
+        NSUInteger count = MIN(pendingSubmissions.count, XMPPDispatcherPendingSubmissionBatchSize);
+        XMPPDispatcherSubmissionBatch *batch = [[XMPPDispatcherSubmissionBatch alloc] init];
+
+        for (NSUInteger index = 0; index < count; index++) {
+            XMPPDispatcherImplPendingSubmission *pending = [pendingSubmissions dequeueObject];
+            if (pending.expired) {
+                continue;
+            }
+
+            [handle.shard.timerWheel cancelTimer:pending.timer];
+
+            if (pending.document) {
+                [batch addDocument:pending.document completion:pending.completion];
+            } else {
+                uint64_t token = pending.token;
+                PXDocument *document = [handle.outbox documentWithToken:token];
+                void (^completion)(NSError *) = pending.completion;
+                if (document) {
+                    // The document is removed from the outbox, as soon as
+                    // the connection has handled (acknowledged) it.
+                    [batch addDocument:document
+                            completion:^(NSError *error) {
+                                dispatch_async(handle.shard.queue, ^{
+                                    [handle.outbox removeDocumentWithToken:token];
+                                });
+                                if (completion) {
+                                    completion(error);
+                                }
+                            }];
+                } else {
+                    [handle.outbox removeDocumentWithToken:token];
+                    if (completion) {
+                        completion([NSError errorWithDomain:XMPPDispatcherErrorDomain
+                                                       code:XMPPDispatcherErrorCodeInvalidStanza
+                                                   userInfo:nil]);
+                    }
+                }
+            }
+        }
+
+        [self xmpp_submitBatch:batch toConnection:handle];
+
+        if (pendingSubmissions.count > 0) {
+            dispatch_async(handle.shard.queue, ^{
+                [self xmpp_submitPendingDocumentsOfConnection:handle];
+            });
+        }
+    }
+}
+
+- (void)xmpp_failPendingSubmissionsOfConnection:(XMPPDispatcherConnectionHandle *)handle
 {
     NSError *error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
                                          code:XMPPDispatcherErrorCodeNoRoute
                                      userInfo:nil];
+    for (XMPPDispatcherImplPendingSubmission *pending in [handle.pendingSubmissions removeAllObjects]) {
+        if (!pending.expired) {
+            [handle.shard.metrics incrementCounter:XMPPDispatcherMetricsCounterNoRouteErrors];
+            [handle.shard.timerWheel cancelTimer:pending.timer];
+            [handle.outbox removeDocumentWithToken:pending.token];
+            if (pending.completion) {
+                pending.completion(error);
+            }
+        }
+    }
+}
+
+- (XMPPDispatcherOutbox *)xmpp_openOutboxForJID:(XMPPJID *)JID
+{
+    NSURL *directoryURL = self.outboxDirectoryURL;
+    if (directoryURL == nil) {
+        return nil;
+    }
+
+    NSString *name = [[[JID bareJID] stringValue] stringByAddingPercentEncodingWithAllowedCharacters:[NSCharacterSet alphanumericCharacterSet]];
+    NSURL *URL = [directoryURL URLByAppendingPathComponent:[name stringByAppendingPathExtension:@"outbox"]];
+
+    NSError *error = nil;
+    XMPPDispatcherOutbox *outbox = [[XMPPDispatcherOutbox alloc] initWithURL:URL error:&error];
+    if (outbox == nil) {
+        XMPPLogError(XMPPLogCategoryDispatcher, @"Failed to open outbox of '%@': %@", [JID bareJID], error);
+    }
+    return outbox;
+}
+
+- (void)xmpp_failPendingRequestsOfConnection:(XMPPDispatcherConnectionHandle *)handle
+{
+    NSError *error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
+                                         code:XMPPDispatcherErrorCodeNoRoute
+                                     userInfo:nil];
+    for (XMPPIQCorrelationCompletion completion in [handle.pendingRequests removeAllRequests]) {
+        [handle.shard.metrics incrementCounter:XMPPDispatcherMetricsCounterNoRouteErrors];
+        completion(nil, error);
+    }
+}
+
+- (void)xmpp_expirePendingSubmission:(XMPPDispatcherImplPendingSubmission *)pending ofConnection:(XMPPDispatcherConnectionHandle *)handle
+{
+    pending.expired = YES;
+    pending.timer = nil;
+    [handle.shard.metrics incrementCounter:XMPPDispatcherMetricsCounterNoRouteErrors];
+    [handle.outbox removeDocumentWithToken:pending.token];
+    if (pending.completion) {
+        NSError *error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
+                                             code:XMPPDispatcherErrorCodeNoRoute
+                                         userInfo:nil];
+        pending.completion(error);
+    }
+
+    // The expired submission is discarded lazily. It is skipped, when it is
+    // dequeued. This way, expiring a batch of submissions does not search
+    // the lanes for each of them.
+    [handle.pendingSubmissions discardObject:pending];
+}
+
+@end
 
-    [[_connectionsByJID dictionaryRepresentation] enumerateKeysAndObjectsUsingBlock:^(XMPPJID *jid, XMPPDispatcherConnectionHandle *handle, BOOL *_Nonnull stop) {
-        for (XMPPDispatcherImplPendingSubmission *pending in [handle.pendingSubmissions copy]) {
-            if ([pending.timeout timeIntervalSinceNow] <= 0) {
-                if (pending.completion) {
-                    pending.completion(error);
+@implementation XMPPDispatcherInboundCompletion
+
+- (instancetype)initWithCompletion:(void (^)(NSError *))completion
+{
+    self = [super init];
+    if (self) {
+        _completion = [completion copy];
+    }
+    return self;
+}
+
+@end
+
+@implementation XMPPDispatcherHandlerCredit
+
+- (instancetype)initWithMaximumNumberOfOutstandingStanzas:(NSUInteger)maximumNumberOfOutstandingStanzas
+{
+    self = [super init];
+    if (self) {
+        pthread_mutex_init(&_mutex, NULL);
+        _maximumNumberOfOutstandingStanzas = maximumNumberOfOutstandingStanzas;
+        _backlog = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    pthread_mutex_destroy(&_mutex);
+}
+
+- (NSUInteger)maximumNumberOfOutstandingStanzas
+{
+    pthread_mutex_lock(&_mutex);
+    NSUInteger maximumNumberOfOutstandingStanzas = _maximumNumberOfOutstandingStanzas;
+    pthread_mutex_unlock(&_mutex);
+    return maximumNumberOfOutstandingStanzas;
+}
+
+- (void)setMaximumNumberOfOutstandingStanzas:(NSUInteger)maximumNumberOfOutstandingStanzas
+{
+    pthread_mutex_lock(&_mutex);
+    _maximumNumberOfOutstandingStanzas = maximumNumberOfOutstandingStanzas;
+    NSArray *entries = [self xmpp_dequeueEntries];
+    pthread_mutex_unlock(&_mutex);
+    [self xmpp_scheduleEntries:entries];
+}
+
+- (NSUInteger)numberOfOutstandingStanzas
+{
+    pthread_mutex_lock(&_mutex);
+    NSUInteger numberOfOutstandingStanzas = _numberOfOutstandingStanzas;
+    pthread_mutex_unlock(&_mutex);
+    return numberOfOutstandingStanzas;
+}
+
+- (void)performOnQueue:(dispatch_queue_t)queue block:(dispatch_block_t)block
+{
+    // The block is only performed directly, if no earlier stanza is waiting
+    // in the backlog or has been scheduled. Otherwise the stanzas could be
+    // passed out of order.
+    pthread_mutex_lock(&_mutex);
+    if (_numberOfOutstandingStanzas < _maximumNumberOfOutstandingStanzas &&
+        _numberOfScheduledStanzas == 0 &&
+        [_backlog count] == 0) {
+        _numberOfOutstandingStanzas += 1;
+        pthread_mutex_unlock(&_mutex);
+        block();
+    } else {
+        [_backlog addObject:@[ queue, [block copy] ]];
+        pthread_mutex_unlock(&_mutex);
+    }
+}
+
+- (void)complete
+{
+    pthread_mutex_lock(&_mutex);
+    if (_numberOfOutstandingStanzas > 0) {
+        _numberOfOutstandingStanzas -= 1;
+    }
+    NSArray *entries = [self xmpp_dequeueEntries];
+    pthread_mutex_unlock(&_mutex);
+    [self xmpp_scheduleEntries:entries];
+}
+
+- (NSArray *)xmpp_dequeueEntries
+{
+    NSUInteger count = 0;
+    while (count < [_backlog count] && _numberOfOutstandingStanzas + count < _maximumNumberOfOutstandingStanzas) {
+        count += 1;
+    }
+    NSRange range = NSMakeRange(0, count);
+    NSArray *entries = [_backlog subarrayWithRange:range];
+    [_backlog removeObjectsInRange:range];
+    _numberOfOutstandingStanzas += count;
+    _numberOfScheduledStanzas += count;
+    return entries;
+}
+
+- (void)xmpp_scheduleEntries:(NSArray *)entries
+{
+    for (NSArray *entry in entries) {
+        dispatch_queue_t queue = entry[0];
+        dispatch_block_t block = entry[1];
+        dispatch_async(queue, ^{
+            pthread_mutex_lock(&_mutex);
+            _numberOfScheduledStanzas -= 1;
+            NSArray *entries = [self xmpp_dequeueEntries];
+            pthread_mutex_unlock(&_mutex);
+            [self xmpp_scheduleEntries:entries];
+            block();
+        });
+    }
+}
+
+@end
+
+@implementation XMPPDispatcherHandlerReference
+- (instancetype)initWithHandler:(id)handler credit:(XMPPDispatcherHandlerCredit *)credit
+{
+    self = [super init];
+    if (self) {
+        _handler = handler;
+        _credit = credit;
+    }
+    return self;
+}
+@end
+
+@implementation XMPPDispatcherStanzaIndex
+
+- (instancetype)initWithReferences:(NSArray<XMPPDispatcherHandlerReference *> *)references filters:(NSMapTable *)filters
+{
+    self = [super init];
+    if (self) {
+        NSMutableArray *catchAllReferences = [[NSMutableArray alloc] init];
+        NSMutableArray *typeFilteredReferences = [[NSMutableArray alloc] init];
+        NSMutableDictionary *referencesByPayload = [[NSMutableDictionary alloc] init];
+        NSMapTable *filtersByReference = [NSMapTable strongToStrongObjectsMapTable];
+
+        for (XMPPDispatcherHandlerReference *reference in references) {
+            id handler = reference.handler;
+            XMPPDispatcherStanzaFilter *filter = handler ? [filters objectForKey:handler] : nil;
+            if (filter == nil) {
+                [catchAllReferences addObject:reference];
+            } else {
+                [filtersByReference setObject:filter forKey:reference];
+                if (filter.payloadQNames == nil) {
+                    [typeFilteredReferences addObject:reference];
+                } else {
+                    for (PXQName *payloadQName in filter.payloadQNames) {
+                        NSMutableArray *indexedReferences = referencesByPayload[payloadQName];
+                        if (indexedReferences == nil) {
+                            indexedReferences = [[NSMutableArray alloc] init];
+                            referencesByPayload[payloadQName] = indexedReferences;
+                        }
+                        [indexedReferences addObject:reference];
+                    }
                 }
-                [handle.pendingSubmissions removeObject:pending];
             }
         }
-    }];
+
+        _catchAllReferences = [catchAllReferences copy];
+        _typeFilteredReferences = [typeFilteredReferences copy];
+        _referencesByPayload = [referencesByPayload copy];
+        _filtersByReference = filtersByReference;
+    }
+    return self;
+}
+
+- (NSArray<XMPPDispatcherHandlerReference *> *)referencesForStanza:(PXElement *)stanza
+{
+    if ([_filtersByReference count] == 0) {
+        return _catchAllReferences;
+    }
+
+    NSMutableArray *references = [_catchAllReferences mutableCopy];
+
+    if ([_referencesByPayload count] > 0) {
+        for (NSUInteger index = 0; index < stanza.numberOfElements; index++) {
+            NSArray *indexedReferences = _referencesByPayload[[stanza elementAtIndex:index].qualifiedName];
+            for (XMPPDispatcherHandlerReference *reference in indexedReferences) {
+                // A handler may be indexed by multiple children.
+                if ([[_filtersByReference objectForKey:reference] matchesTypeOfStanza:stanza] &&
+                    [references indexOfObjectIdenticalTo:reference] == NSNotFound) {
+                    [references addObject:reference];
+                }
+            }
+        }
+    }
+
+    for (XMPPDispatcherHandlerReference *reference in _typeFilteredReferences) {
+        if ([[_filtersByReference objectForKey:reference] matchesTypeOfStanza:stanza]) {
+            [references addObject:reference];
+        }
+    }
+
+    return references;
 }
 
 @end
 
+@implementation XMPPDispatcherHandlerSnapshot
+- (instancetype)initWithHandlers:(NSHashTable *)handlers
+                 handlersByQuery:(NSMapTable *)handlersByQuery
+                  messageFilters:(NSMapTable *)messageFilters
+                 presenceFilters:(NSMapTable *)presenceFilters
+                         credits:(NSMapTable *)credits
+{
+    self = [super init];
+    if (self) {
+        NSMutableArray *connectionHandlers = [[NSMutableArray alloc] init];
+        NSMutableArray *messageHandlers = [[NSMutableArray alloc] init];
+        NSMutableArray *presenceHandlers = [[NSMutableArray alloc] init];
+        NSMapTable *references = [NSMapTable strongToStrongObjectsMapTable];
+
+        for (id handler in handlers) {
+            XMPPDispatcherHandlerReference *reference = [[XMPPDispatcherHandlerReference alloc] initWithHandler:handler
+                                                                                                          credit:[credits objectForKey:handler]];
+            [references setObject:reference forKey:handler];
+            if ([handler conformsToProtocol:@protocol(XMPPConnectionHandler)]) {
+                [connectionHandlers addObject:reference];
+            }
+            if ([handler conformsToProtocol:@protocol(XMPPMessageHandler)]) {
+                [messageHandlers addObject:reference];
+            }
+            if ([handler conformsToProtocol:@protocol(XMPPPresenceHandler)]) {
+                [presenceHandlers addObject:reference];
+            }
+        }
+
+        NSMutableDictionary *IQHandlersByQuery = [[NSMutableDictionary alloc] init];
+        for (PXQName *query in handlersByQuery) {
+            id handler = [handlersByQuery objectForKey:query];
+            XMPPDispatcherHandlerReference *reference = handler ? [references objectForKey:handler] : nil;
+            if (reference) {
+                IQHandlersByQuery[query] = reference;
+            }
+        }
+
+        _connectionHandlers = [connectionHandlers copy];
+        _messageHandlers = [messageHandlers copy];
+        _presenceHandlers = [presenceHandlers copy];
+        _IQHandlersByQuery = [IQHandlersByQuery copy];
+        _messageIndex = [[XMPPDispatcherStanzaIndex alloc] initWithReferences:_messageHandlers filters:messageFilters];
+        _presenceIndex = [[XMPPDispatcherStanzaIndex alloc] initWithReferences:_presenceHandlers filters:presenceFilters];
+    }
+    return self;
+}
+@end
+
+@implementation XMPPDispatcherShard
+- (instancetype)initWithIndex:(NSUInteger)index
+{
+    self = [super init];
+    if (self) {
+        NSString *label = [NSString stringWithFormat:@"XMPPDispatcher.%lu", (unsigned long)index];
+        _queue = dispatch_queue_create([label UTF8String], DISPATCH_QUEUE_SERIAL);
+        _connectionsByJID = [NSMapTable strongToStrongObjectsMapTable];
+        _timerWheel = [[XMPPTimerWheel alloc] initWithQueue:_queue];
+        _metrics = [[XMPPDispatcherMetrics alloc] init];
+        _coalescer = [[XMPPIQRequestCoalescer alloc] init];
+        _inboundCompletions = [[NSMutableArray alloc] init];
+        _handlesByJID = @{};
+    }
+    return self;
+}
+
+- (void)setHandle:(id)handle forJID:(XMPPJID *)JID
+{
+    [_connectionsByJID setObject:handle forKey:JID];
+    self.handlesByJID = [_connectionsByJID dictionaryRepresentation];
+}
+
+- (void)removeHandleForJID:(XMPPJID *)JID
+{
+    [_connectionsByJID removeObjectForKey:JID];
+    self.handlesByJID = [_connectionsByJID dictionaryRepresentation];
+}
+@end
+
 @implementation XMPPDispatcherConnectionHandle
 - (instancetype)initWithConnection:(id<XMPPConnection>)connection
+                             shard:(XMPPDispatcherShard *)shard
+                        dispatcher:(XMPPDispatcherImpl *)dispatcher
+                   pendingRequests:(XMPPIQCorrelationTable *)pendingRequests
+                            outbox:(XMPPDispatcherOutbox *)outbox
 {
     self = [super init];
     if (self) {
         _connection = connection;
+        _shard = shard;
+        _dispatcher = dispatcher;
         _connected = NO;
-        _pendingSubmissions = [[NSMutableArray alloc] init];
+        _writable = YES;
+        _pendingSubmissions = [[XMPPStanzaScheduler alloc] init];
+        _pendingRequests = pendingRequests ?: [[XMPPIQCorrelationTable alloc] init];
+        _outbox = outbox;
+        _inboundCompletions = [[NSMutableArray alloc] init];
     }
     return self;
 }
+
+#pragma mark XMPPConnectionDelegate
+
+- (void)connection:(id<XMPPConnection>)connection didConnectTo:(XMPPJID *)JID resumed:(BOOL)resumed
+{
+    [self.dispatcher xmpp_connection:connection didConnectTo:JID resumed:resumed onShard:self.shard];
+}
+
+- (void)connection:(id<XMPPConnection>)connection didDisconnectFrom:(XMPPJID *)JID
+{
+    [self.dispatcher xmpp_connection:connection didDisconnectFrom:JID onShard:self.shard];
+}
+
+- (void)connection:(id<XMPPConnection>)connection didChangeWritable:(BOOL)writable forJID:(XMPPJID *)JID
+{
+    [self.dispatcher xmpp_connection:connection didChangeWritable:writable forJID:JID onShard:self.shard];
+}
+
+#pragma mark XMPPDocumentHandler
+
+- (void)handleDocument:(PXDocument *)document completion:(void (^)(NSError *))completion
+{
+    XMPPDispatcherImpl *dispatcher = self.dispatcher;
+    if (dispatcher) {
+        [dispatcher xmpp_handleDocument:document completion:completion onShard:self.shard handle:self];
+    } else if (completion) {
+        completion(nil);
+    }
+}
+
+- (void)handleDocuments:(NSArray<PXDocument *> *)documents completion:(void (^)(NSUInteger, NSError *))completion
+{
+    XMPPDispatcherImpl *dispatcher = self.dispatcher;
+    if (dispatcher) {
+        [dispatcher xmpp_handleDocuments:documents completion:completion onShard:self.shard handle:self];
+    } else if (completion) {
+        for (NSUInteger index = 0; index < [documents count]; index++) {
+            completion(index, nil);
+        }
+    }
+}
+
+- (void)processPendingDocuments:(void (^)(NSError *))completion
+{
+    dispatch_async(self.shard.queue, ^{
+        if (completion) {
+            completion(nil);
+        }
+    });
+}
+
+@end
+
+@implementation XMPPDispatcherSubmissionBatch
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        _documents = [[NSMutableArray alloc] init];
+        _completions = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (void)addDocument:(PXDocument *)document completion:(void (^)(NSError *))completion
+{
+    [_documents addObject:document];
+    [_completions addObject:completion ? [completion copy] : [NSNull null]];
+}
+
 @end
 
 @implementation XMPPDispatcherImplPendingSubmission
-- (instancetype)initWithDocument:(PXDocument *)document timeout:(NSDate *)timeout completion:(void (^)(NSError *))completion
+- (instancetype)initWithDocument:(PXDocument *)document
+                           token:(uint64_t)token
+                        priority:(XMPPStanzaPriority)priority
+                     orderingKey:(NSString *)orderingKey
+                      completion:(void (^)(NSError *))completion
 {
     self = [super init];
     if (self) {
         _document = document;
-        _timeout = timeout;
+        _token = token;
+        _priority = priority;
+        _orderingKey = [orderingKey copy];
         _completion = completion;
     }
     return self;
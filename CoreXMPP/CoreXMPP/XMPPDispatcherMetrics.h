@@ -0,0 +1,103 @@
+//
+//  XMPPDispatcherMetrics.h
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+
+@import Foundation;
+@import XMPPFoundation;
+
+#import "XMPPDispatcherStatistics.h"
+
+typedef NS_ENUM(NSUInteger, XMPPDispatcherMetricsCounter) {
+    XMPPDispatcherMetricsCounterReceivedMessages = 0,
+    XMPPDispatcherMetricsCounterReceivedPresences,
+    XMPPDispatcherMetricsCounterReceivedIQs,
+    XMPPDispatcherMetricsCounterSentMessages,
+    XMPPDispatcherMetricsCounterSentPresences,
+    XMPPDispatcherMetricsCounterSentIQs,
+    XMPPDispatcherMetricsCounterNoRouteErrors,
+    XMPPDispatcherMetricsCounterTimeoutErrors
+};
+
+#define XMPP_DISPATCHER_METRICS_NUMBER_OF_COUNTERS 8
+
+typedef NS_ENUM(NSUInteger, XMPPDispatcherMetricsHistogram) {
+    XMPPDispatcherMetricsHistogramHandlerTime = 0,
+    XMPPDispatcherMetricsHistogramQueueWaitTime
+};
+
+#define XMPP_DISPATCHER_METRICS_NUMBER_OF_HISTOGRAMS 2
+
+// Buckets of a histogram (in microseconds). Values below 16 have their
+// own bucket. Larger values are grouped by their most significant bit
+// with 8 sub-buckets each (relative error below 12.5%), up to 2^40 us.
+#define XMPP_DISPATCHER_METRICS_NUMBER_OF_BUCKETS (16 + 37 * 8)
+
+FOUNDATION_EXTERN NSUInteger XMPPDispatcherMetricsBucketOfValue(uint64_t value);
+FOUNDATION_EXTERN uint64_t XMPPDispatcherMetricsLowerBoundOfBucket(NSUInteger bucket);
+FOUNDATION_EXTERN uint64_t XMPPDispatcherMetricsUpperBoundOfBucket(NSUInteger bucket);
+
+// Monotonic time in nanoseconds.
+FOUNDATION_EXTERN uint64_t XMPPDispatcherMetricsTimestamp(void);
+
+// Counters and histograms of one shard. The values are updated with
+// relaxed atomic operations (usually on the queue of the shard) and can be
+// read from any thread without blocking the shard.
+
+@interface XMPPDispatcherMetrics : NSObject
+
+- (void)incrementCounter:(XMPPDispatcherMetricsCounter)counter;
+- (void)incrementCounterForStanza:(nonnull PXElement *)stanza received:(BOOL)received;
+- (void)recordDurationSinceTimestamp:(uint64_t)timestamp inHistogram:(XMPPDispatcherMetricsHistogram)histogram;
+
+- (uint64_t)valueOfCounter:(XMPPDispatcherMetricsCounter)counter;
+
+// Adds the bucket counts (and the sum of the values) of the histogram.
+- (void)addBucketsOfHistogram:(XMPPDispatcherMetricsHistogram)histogram
+                    toBuckets:(nonnull uint64_t *)buckets
+                          sum:(nonnull uint64_t *)sum;
+
+@end
+
+@interface XMPPDispatcherLatencyHistogram ()
+- (nonnull instancetype)initWithBuckets:(nonnull const uint64_t *)buckets sum:(uint64_t)sum;
+@end
+
+@interface XMPPDispatcherStatistics ()
+- (nonnull instancetype)initWithCounters:(nonnull const uint64_t *)counters
+                            handlerTime:(nonnull XMPPDispatcherLatencyHistogram *)handlerTime
+                          queueWaitTime:(nonnull XMPPDispatcherLatencyHistogram *)queueWaitTime
+             numberOfPendingIQResponses:(NSUInteger)numberOfPendingIQResponses
+        numberOfPendingSubmissionsByJID:(nonnull NSDictionary<XMPPJID *, NSNumber *> *)numberOfPendingSubmissionsByJID;
+@end
@@ -0,0 +1,159 @@
+//
+//  XMPPDispatcherMetrics.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+
+#include <mach/mach_time.h>
+#include <stdatomic.h>
+
+#import "XMPPDispatcherMetrics.h"
+
+static const NSUInteger XMPPDispatcherMetricsMaximumExponent = 40;
+
+NSUInteger XMPPDispatcherMetricsBucketOfValue(uint64_t value)
+{
+    if (value < 16) {
+        return (NSUInteger)value;
+    }
+    NSUInteger exponent = 63 - __builtin_clzll(value);
+    if (exponent > XMPPDispatcherMetricsMaximumExponent) {
+        return XMPP_DISPATCHER_METRICS_NUMBER_OF_BUCKETS - 1;
+    }
+    NSUInteger mantissa = (NSUInteger)(value >> (exponent - 3)) & 7;
+    return 16 + (exponent - 4) * 8 + mantissa;
+}
+
+uint64_t XMPPDispatcherMetricsLowerBoundOfBucket(NSUInteger bucket)
+{
+    if (bucket < 16) {
+        return bucket;
+    }
+    NSUInteger exponent = (bucket - 16) / 8 + 4;
+    uint64_t mantissa = (bucket - 16) % 8 + 8;
+    return mantissa << (exponent - 3);
+}
+
+uint64_t XMPPDispatcherMetricsUpperBoundOfBucket(NSUInteger bucket)
+{
+    if (bucket < 16) {
+        return bucket;
+    }
+    NSUInteger exponent = (bucket - 16) / 8 + 4;
+    return XMPPDispatcherMetricsLowerBoundOfBucket(bucket) + (1ull << (exponent - 3)) - 1;
+}
+
+uint64_t XMPPDispatcherMetricsTimestamp(void)
+{
+    static mach_timebase_info_data_t timebase;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        mach_timebase_info(&timebase);
+    });
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+}
+
+typedef struct {
+    _Atomic(uint64_t) counters[XMPP_DISPATCHER_METRICS_NUMBER_OF_COUNTERS];
+    _Atomic(uint64_t) sums[XMPP_DISPATCHER_METRICS_NUMBER_OF_HISTOGRAMS];
+    _Atomic(uint64_t) buckets[XMPP_DISPATCHER_METRICS_NUMBER_OF_HISTOGRAMS][XMPP_DISPATCHER_METRICS_NUMBER_OF_BUCKETS];
+} XMPPDispatcherMetricsStorage;
+
+@interface XMPPDispatcherMetrics () {
+    XMPPDispatcherMetricsStorage *_storage;
+}
+
+@end
+
+@implementation XMPPDispatcherMetrics
+
+#pragma mark Life-cycle
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        _storage = calloc(1, sizeof(XMPPDispatcherMetricsStorage));
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    free(_storage);
+}
+
+#pragma mark Recording
+
+- (void)incrementCounter:(XMPPDispatcherMetricsCounter)counter
+{
+    atomic_fetch_add_explicit(&_storage->counters[counter], 1, memory_order_relaxed);
+}
+
+- (void)incrementCounterForStanza:(PXElement *)stanza received:(BOOL)received
+{
+    if ([stanza isKindOfClass:[XMPPMessageStanza class]]) {
+        [self incrementCounter:received ? XMPPDispatcherMetricsCounterReceivedMessages : XMPPDispatcherMetricsCounterSentMessages];
+    } else if ([stanza isKindOfClass:[XMPPPresenceStanza class]]) {
+        [self incrementCounter:received ? XMPPDispatcherMetricsCounterReceivedPresences : XMPPDispatcherMetricsCounterSentPresences];
+    } else if ([stanza isKindOfClass:[XMPPIQStanza class]]) {
+        [self incrementCounter:received ? XMPPDispatcherMetricsCounterReceivedIQs : XMPPDispatcherMetricsCounterSentIQs];
+    }
+}
+
+- (void)recordDurationSinceTimestamp:(uint64_t)timestamp inHistogram:(XMPPDispatcherMetricsHistogram)histogram
+{
+    uint64_t now = XMPPDispatcherMetricsTimestamp();
+    uint64_t value = now > timestamp ? (now - timestamp) / NSEC_PER_USEC : 0;
+    atomic_fetch_add_explicit(&_storage->buckets[histogram][XMPPDispatcherMetricsBucketOfValue(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&_storage->sums[histogram], value, memory_order_relaxed);
+}
+
+#pragma mark Reading
+
+- (uint64_t)valueOfCounter:(XMPPDispatcherMetricsCounter)counter
+{
+    return atomic_load_explicit(&_storage->counters[counter], memory_order_relaxed);
+}
+
+- (void)addBucketsOfHistogram:(XMPPDispatcherMetricsHistogram)histogram
+                    toBuckets:(uint64_t *)buckets
+                          sum:(uint64_t *)sum
+{
+    for (NSUInteger bucket = 0; bucket < XMPP_DISPATCHER_METRICS_NUMBER_OF_BUCKETS; bucket++) {
+        buckets[bucket] += atomic_load_explicit(&_storage->buckets[histogram][bucket], memory_order_relaxed);
+    }
+    *sum += atomic_load_explicit(&_storage->sums[histogram], memory_order_relaxed);
+}
+
+@end
@@ -0,0 +1,100 @@
+//
+//  XMPPDispatcherObserver.h
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+@import Foundation;
+
+#import <PureXML/PureXML.h>
+
+typedef NS_OPTIONS(NSUInteger, XMPPDispatcherObservationDirection) {
+    XMPPDispatcherObservationDirectionInbound = 1 << 0,
+    XMPPDispatcherObservationDirectionOutbound = 1 << 1,
+    XMPPDispatcherObservationDirectionAll = XMPPDispatcherObservationDirectionInbound | XMPPDispatcherObservationDirectionOutbound
+} NS_SWIFT_NAME(DispatcherObservationDirection);
+
+typedef NS_OPTIONS(NSUInteger, XMPPDispatcherObservationStanzaKind) {
+    XMPPDispatcherObservationStanzaKindMessage = 1 << 0,
+    XMPPDispatcherObservationStanzaKindPresence = 1 << 1,
+    XMPPDispatcherObservationStanzaKindIQ = 1 << 2,
+    XMPPDispatcherObservationStanzaKindAll = XMPPDispatcherObservationStanzaKindMessage | XMPPDispatcherObservationStanzaKindPresence | XMPPDispatcherObservationStanzaKindIQ
+} NS_SWIFT_NAME(DispatcherObservationStanzaKind);
+
+// A stanza received or sent by the dispatcher. The document is shared
+// with the connection (and other observers) and must not be modified.
+NS_SWIFT_NAME(DispatcherObservation)
+@interface XMPPDispatcherObservation : NSObject
+@property (nonatomic, readonly) XMPPDispatcherObservationDirection direction;
+@property (nonatomic, readonly) PXDocument *_Nonnull document;
+@property (nonatomic, readonly) NSDate *_Nonnull date;
+- (nonnull instancetype)initWithDocument:(nonnull PXDocument *)document direction:(XMPPDispatcherObservationDirection)direction;
+@end
+
+// Observer registered with -[XMPPDispatcherImpl addObserverForDirections:...].
+// The observations are collected and passed in batches to the block: at
+// most once per interval (unless the maximum batch size is reached).
+NS_SWIFT_NAME(DispatcherObserver)
+@interface XMPPDispatcherObserver : NSObject
+
+- (nonnull instancetype)initWithDirections:(XMPPDispatcherObservationDirection)directions
+                               stanzaKinds:(XMPPDispatcherObservationStanzaKind)stanzaKinds
+                                namespaces:(nullable NSSet<NSString *> *)namespaces
+                                  interval:(NSTimeInterval)interval
+                                     queue:(nonnull dispatch_queue_t)queue
+                                     block:(nonnull void (^)(NSArray<XMPPDispatcherObservation *> *_Nonnull observations))block;
+
+@property (nonatomic, readonly) XMPPDispatcherObservationDirection directions;
+@property (nonatomic, readonly) XMPPDispatcherObservationStanzaKind stanzaKinds;
+
+// If set, only stanzas with a child element (payload) in one of the
+// namespaces are observed.
+@property (nonatomic, readonly) NSSet<NSString *> *_Nullable namespaces;
+
+@property (nonatomic, readonly) NSTimeInterval interval;
+@property (nonatomic, readonly) dispatch_queue_t _Nonnull queue;
+
+// Defaults to 1000 observations.
+@property (atomic, readwrite) NSUInteger maximumBatchSize;
+
+- (BOOL)matchesStanza:(nonnull PXElement *)stanza
+               ofKind:(XMPPDispatcherObservationStanzaKind)kind
+            direction:(XMPPDispatcherObservationDirection)direction;
+
+// Can be called from any thread.
+- (void)addObservation:(nonnull XMPPDispatcherObservation *)observation;
+
+// Passes the collected observations to the block (on the queue of the
+// observer), without waiting for the end of the interval.
+- (void)flush;
+
+@end
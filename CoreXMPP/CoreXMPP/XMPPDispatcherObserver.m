@@ -0,0 +1,165 @@
+//
+//  XMPPDispatcherObserver.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#include <pthread.h>
+
+#import "XMPPDispatcherObserver.h"
+
+@implementation XMPPDispatcherObservation
+
+- (instancetype)initWithDocument:(PXDocument *)document direction:(XMPPDispatcherObservationDirection)direction
+{
+    self = [super init];
+    if (self) {
+        _document = document;
+        _direction = direction;
+        _date = [NSDate date];
+    }
+    return self;
+}
+
+@end
+
+@interface XMPPDispatcherObserver () {
+    void (^_block)(NSArray<XMPPDispatcherObservation *> *observations);
+    pthread_mutex_t _mutex;
+    NSMutableArray<XMPPDispatcherObservation *> *_observations;
+    BOOL _flushScheduled;
+}
+
+@end
+
+@implementation XMPPDispatcherObserver
+
+#pragma mark Life-cycle
+
+- (instancetype)initWithDirections:(XMPPDispatcherObservationDirection)directions
+                       stanzaKinds:(XMPPDispatcherObservationStanzaKind)stanzaKinds
+                        namespaces:(NSSet<NSString *> *)namespaces
+                          interval:(NSTimeInterval)interval
+                             queue:(dispatch_queue_t)queue
+                             block:(void (^)(NSArray<XMPPDispatcherObservation *> *))block
+{
+    self = [super init];
+    if (self) {
+        _directions = directions;
+        _stanzaKinds = stanzaKinds;
+        _namespaces = [namespaces copy];
+        _interval = MAX(interval, 0);
+        _queue = queue;
+        _block = block;
+        _maximumBatchSize = 1000;
+        _observations = [[NSMutableArray alloc] init];
+        pthread_mutex_init(&_mutex, NULL);
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    pthread_mutex_destroy(&_mutex);
+}
+
+#pragma mark Matching
+
+- (BOOL)matchesStanza:(PXElement *)stanza
+               ofKind:(XMPPDispatcherObservationStanzaKind)kind
+            direction:(XMPPDispatcherObservationDirection)direction
+{
+    if ((_directions & direction) == 0 || (_stanzaKinds & kind) == 0) {
+        return NO;
+    }
+
+    if (_namespaces == nil) {
+        return YES;
+    }
+
+    for (NSUInteger index = 0; index < stanza.numberOfElements; index++) {
+        if ([_namespaces containsObject:[stanza elementAtIndex:index].namespace]) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+#pragma mark Observations
+
+- (void)addObservation:(XMPPDispatcherObservation *)observation
+{
+    BOOL scheduleFlush = NO;
+    BOOL flushImmediately = NO;
+
+    pthread_mutex_lock(&_mutex);
+    [_observations addObject:observation];
+    if ([_observations count] >= self.maximumBatchSize) {
+        flushImmediately = YES;
+    } else if (!_flushScheduled) {
+        _flushScheduled = YES;
+        scheduleFlush = YES;
+    }
+    pthread_mutex_unlock(&_mutex);
+
+    if (flushImmediately) {
+        [self flush];
+    } else if (scheduleFlush) {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_interval * NSEC_PER_SEC)), _queue, ^{
+            [self xmpp_flush];
+        });
+    }
+}
+
+- (void)flush
+{
+    dispatch_async(_queue, ^{
+        [self xmpp_flush];
+    });
+}
+
+#pragma mark -
+
+- (void)xmpp_flush
+{
+    pthread_mutex_lock(&_mutex);
+    NSArray *observations = _observations;
+    _observations = [[NSMutableArray alloc] init];
+    _flushScheduled = NO;
+    pthread_mutex_unlock(&_mutex);
+
+    if ([observations count] > 0) {
+        _block(observations);
+    }
+}
+
+@end
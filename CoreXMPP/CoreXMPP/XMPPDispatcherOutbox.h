@@ -0,0 +1,72 @@
+//
+//  XMPPDispatcherOutbox.h
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+@import Foundation;
+
+#import <PureXML/PureXML.h>
+
+#import "XMPPStanzaPriority.h"
+
+// Append-only log of the documents, which are held back for an account
+// (see XMPPDispatcherImpl.outboxDirectoryURL). The log is a memory-mapped
+// file. Each document is identified by a token (unique in the log).
+// Removed documents are only marked in place. The log is compacted (by
+// writing the remaining documents to a new file), if more than half of
+// its size is used by removed documents.
+//
+// The outbox is not thread-safe.
+
+@interface XMPPDispatcherOutbox : NSObject
+
+- (nullable instancetype)initWithURL:(nonnull NSURL *)URL
+                               error:(NSError *__autoreleasing __nullable *__nullable)error;
+
+@property (nonatomic, readonly) NSURL *_Nonnull URL;
+@property (nonatomic, readonly) NSUInteger numberOfDocuments;
+
+// Bytes of the log, including removed documents.
+@property (nonatomic, readonly) NSUInteger size;
+
+// Returns 0, if the document could not be written.
+- (uint64_t)appendDocument:(nonnull PXDocument *)document deadline:(nonnull NSDate *)deadline priority:(XMPPStanzaPriority)priority;
+
+- (nullable PXDocument *)documentWithToken:(uint64_t)token;
+- (void)removeDocumentWithToken:(uint64_t)token;
+- (void)removeAllDocuments;
+
+// Enumerates the documents in the order they have been appended.
+- (void)enumerateDocumentsUsingBlock:(nonnull void (^)(uint64_t token, NSDate *_Nonnull deadline, XMPPStanzaPriority priority, BOOL *_Nonnull stop))block;
+
+@end
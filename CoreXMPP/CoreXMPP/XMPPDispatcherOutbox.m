@@ -0,0 +1,397 @@
+//
+//  XMPPDispatcherOutbox.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#import "XMPPDispatcherOutbox.h"
+
+static const char XMPPDispatcherOutboxMagic[8] = {'X', 'M', 'P', 'P', 'O', 'B', 'X', '2'};
+static const size_t XMPPDispatcherOutboxHeaderSize = 16;
+static const size_t XMPPDispatcherOutboxMinimumCapacity = 64 * 1024;
+
+typedef NS_ENUM(uint8_t, XMPPDispatcherOutboxRecordState) {
+    XMPPDispatcherOutboxRecordStatePending = 1,
+    XMPPDispatcherOutboxRecordStateRemoved = 2
+};
+
+// The log ends with the first record of length 0 or with an invalid
+// checksum. The bytes behind the last record are always zero.
+typedef struct {
+    uint32_t length;
+    uint32_t checksum;
+    uint64_t token;
+    double deadline;
+    uint8_t state;
+    uint8_t priority;
+    uint8_t padding[6];
+} XMPPDispatcherOutboxRecordHeader;
+
+static size_t XMPPDispatcherOutboxRecordSize(size_t length)
+{
+    return sizeof(XMPPDispatcherOutboxRecordHeader) + ((length + 7) & ~(size_t)7);
+}
+
+static uint32_t XMPPDispatcherOutboxRecordChecksum(const XMPPDispatcherOutboxRecordHeader *header)
+{
+    // The state is not covered, because it is changed in place, if the
+    // document is removed.
+    uLong checksum = crc32(0L, (const Bytef *)&header->token, sizeof(header->token));
+    checksum = crc32(checksum, (const Bytef *)&header->deadline, sizeof(header->deadline));
+    checksum = crc32(checksum, (const Bytef *)&header->priority, sizeof(header->priority));
+    checksum = crc32(checksum, (const Bytef *)header + sizeof(XMPPDispatcherOutboxRecordHeader), header->length);
+    return (uint32_t)checksum;
+}
+
+@interface XMPPDispatcherOutbox () {
+    int _fd;
+    uint8_t *_bytes;
+    size_t _capacity;
+    size_t _tail;
+    size_t _removedBytes;
+    uint64_t _nextToken;
+    NSMutableDictionary<NSNumber *, NSNumber *> *_offsetsByToken;
+}
+
+@end
+
+@implementation XMPPDispatcherOutbox
+
+#pragma mark Life-cycle
+
+- (instancetype)initWithURL:(NSURL *)URL error:(NSError **)error
+{
+    self = [super init];
+    if (self) {
+        _URL = URL;
+        _fd = -1;
+        _nextToken = 1;
+        _offsetsByToken = [[NSMutableDictionary alloc] init];
+        if (![self xmpp_openWithError:error]) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self xmpp_close];
+}
+
+#pragma mark Properties
+
+- (NSUInteger)numberOfDocuments
+{
+    return [_offsetsByToken count];
+}
+
+- (NSUInteger)size
+{
+    return _tail;
+}
+
+#pragma mark Documents
+
+- (uint64_t)appendDocument:(PXDocument *)document deadline:(NSDate *)deadline priority:(XMPPStanzaPriority)priority
+{
+    NSData *data = [document data];
+    if ([data length] == 0 || [data length] > UINT32_MAX) {
+        return 0;
+    }
+
+    size_t recordSize = XMPPDispatcherOutboxRecordSize([data length]);
+    if (_tail + recordSize > _capacity) {
+        size_t capacity = _capacity;
+        while (_tail + recordSize > capacity) {
+            capacity *= 2;
+        }
+        if (![self xmpp_resizeToCapacity:capacity]) {
+            return 0;
+        }
+    }
+
+    uint64_t token = _nextToken++;
+
+    // The pages of the record may be written in any order. A partially
+    // written record has an invalid checksum and is considered as the
+    // end of the log.
+    XMPPDispatcherOutboxRecordHeader *header = (XMPPDispatcherOutboxRecordHeader *)(_bytes + _tail);
+    memcpy(_bytes + _tail + sizeof(XMPPDispatcherOutboxRecordHeader), [data bytes], [data length]);
+    header->state = XMPPDispatcherOutboxRecordStatePending;
+    header->priority = (uint8_t)priority;
+    header->token = token;
+    header->deadline = [deadline timeIntervalSince1970];
+    header->length = (uint32_t)[data length];
+    header->checksum = XMPPDispatcherOutboxRecordChecksum(header);
+
+    [self xmpp_syncRange:NSMakeRange(_tail, recordSize)];
+
+    _offsetsByToken[@(token)] = @(_tail);
+    _tail += recordSize;
+
+    return token;
+}
+
+- (PXDocument *)documentWithToken:(uint64_t)token
+{
+    NSNumber *offset = _offsetsByToken[@(token)];
+    if (offset == nil) {
+        return nil;
+    }
+    XMPPDispatcherOutboxRecordHeader *header = (XMPPDispatcherOutboxRecordHeader *)(_bytes + [offset unsignedLongLongValue]);
+    NSData *data = [NSData dataWithBytes:(uint8_t *)header + sizeof(XMPPDispatcherOutboxRecordHeader) length:header->length];
+    return [PXDocument documentWithData:data];
+}
+
+- (void)removeDocumentWithToken:(uint64_t)token
+{
+    NSNumber *offset = _offsetsByToken[@(token)];
+    if (offset == nil) {
+        return;
+    }
+
+    XMPPDispatcherOutboxRecordHeader *header = (XMPPDispatcherOutboxRecordHeader *)(_bytes + [offset unsignedLongLongValue]);
+    header->state = XMPPDispatcherOutboxRecordStateRemoved;
+    [self xmpp_syncRange:NSMakeRange([offset unsignedLongLongValue], sizeof(XMPPDispatcherOutboxRecordHeader))];
+
+    [_offsetsByToken removeObjectForKey:@(token)];
+    _removedBytes += XMPPDispatcherOutboxRecordSize(header->length);
+
+    if ([_offsetsByToken count] == 0) {
+        [self removeAllDocuments];
+    } else if (_removedBytes > (_tail - XMPPDispatcherOutboxHeaderSize) / 2 && _tail > XMPPDispatcherOutboxMinimumCapacity) {
+        [self xmpp_compact];
+    }
+}
+
+- (void)removeAllDocuments
+{
+    memset(_bytes + XMPPDispatcherOutboxHeaderSize, 0, _tail - XMPPDispatcherOutboxHeaderSize);
+    [self xmpp_syncRange:NSMakeRange(0, _tail)];
+    _tail = XMPPDispatcherOutboxHeaderSize;
+    _removedBytes = 0;
+    [_offsetsByToken removeAllObjects];
+}
+
+- (void)enumerateDocumentsUsingBlock:(void (^)(uint64_t, NSDate *, XMPPStanzaPriority, BOOL *))block
+{
+    size_t offset = XMPPDispatcherOutboxHeaderSize;
+    BOOL stop = NO;
+    while (offset < _tail && !stop) {
+        XMPPDispatcherOutboxRecordHeader *header = (XMPPDispatcherOutboxRecordHeader *)(_bytes + offset);
+        if (header->state == XMPPDispatcherOutboxRecordStatePending) {
+            block(header->token, [NSDate dateWithTimeIntervalSince1970:header->deadline], (XMPPStanzaPriority)header->priority, &stop);
+        }
+        offset += XMPPDispatcherOutboxRecordSize(header->length);
+    }
+}
+
+#pragma mark -
+
+- (BOOL)xmpp_openWithError:(NSError **)error
+{
+    const char *path = [[_URL path] fileSystemRepresentation];
+
+    _fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (_fd < 0) {
+        return [self xmpp_failWithError:error];
+    }
+
+    off_t size = lseek(_fd, 0, SEEK_END);
+    if (size < 0) {
+        return [self xmpp_failWithError:error];
+    }
+
+    BOOL created = size == 0;
+    size_t capacity = MAX((size_t)size, XMPPDispatcherOutboxMinimumCapacity);
+    if ((size_t)size != capacity && ftruncate(_fd, capacity) != 0) {
+        return [self xmpp_failWithError:error];
+    }
+
+    _bytes = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (_bytes == MAP_FAILED) {
+        _bytes = NULL;
+        return [self xmpp_failWithError:error];
+    }
+    _capacity = capacity;
+    _tail = XMPPDispatcherOutboxHeaderSize;
+
+    if (created || memcmp(_bytes, XMPPDispatcherOutboxMagic, sizeof(XMPPDispatcherOutboxMagic)) != 0) {
+        // New (or unknown) file
+        memset(_bytes, 0, _capacity);
+        memcpy(_bytes, XMPPDispatcherOutboxMagic, sizeof(XMPPDispatcherOutboxMagic));
+        [self xmpp_syncRange:NSMakeRange(0, _capacity)];
+        return YES;
+    }
+
+    // Rebuild the index
+
+    while (_tail + sizeof(XMPPDispatcherOutboxRecordHeader) <= _capacity) {
+        XMPPDispatcherOutboxRecordHeader *header = (XMPPDispatcherOutboxRecordHeader *)(_bytes + _tail);
+        size_t recordSize = XMPPDispatcherOutboxRecordSize(header->length);
+        if (header->length == 0 || _tail + recordSize > _capacity ||
+            header->checksum != XMPPDispatcherOutboxRecordChecksum(header)) {
+            break;
+        }
+        if (header->state == XMPPDispatcherOutboxRecordStatePending) {
+            _offsetsByToken[@(header->token)] = @(_tail);
+        } else {
+            _removedBytes += recordSize;
+        }
+        _nextToken = MAX(_nextToken, header->token + 1);
+        _tail += recordSize;
+    }
+
+    // Discard a partially written record.
+    memset(_bytes + _tail, 0, _capacity - _tail);
+
+    return YES;
+}
+
+- (void)xmpp_close
+{
+    if (_bytes) {
+        munmap(_bytes, _capacity);
+        _bytes = NULL;
+    }
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+- (BOOL)xmpp_failWithError:(NSError **)error
+{
+    if (error) {
+        *error = [NSError errorWithDomain:NSPOSIXErrorDomain
+                                     code:errno
+                                 userInfo:@{NSFilePathErrorKey : [_URL path]}];
+    }
+    [self xmpp_close];
+    return NO;
+}
+
+- (BOOL)xmpp_resizeToCapacity:(size_t)capacity
+{
+    if (ftruncate(_fd, capacity) != 0) {
+        return NO;
+    }
+    uint8_t *bytes = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (bytes == MAP_FAILED) {
+        return NO;
+    }
+    munmap(_bytes, _capacity);
+    _bytes = bytes;
+    _capacity = capacity;
+    return YES;
+}
+
+- (void)xmpp_syncRange:(NSRange)range
+{
+    // The pages are written asynchronously. The data is kept by the
+    // operating system, even if the process terminates. If the device
+    // goes down, a record may be lost, but it is detected by its checksum.
+    size_t pageSize = (size_t)getpagesize();
+    size_t start = range.location & ~(pageSize - 1);
+    msync(_bytes + start, NSMaxRange(range) - start, MS_ASYNC);
+}
+
+- (void)xmpp_compact
+{
+    // The remaining records are written to a new file, which replaces
+    // the log. The log stays consistent, if the process terminates
+    // during compaction.
+
+    size_t size = XMPPDispatcherOutboxHeaderSize + (_tail - XMPPDispatcherOutboxHeaderSize - _removedBytes);
+    size_t capacity = XMPPDispatcherOutboxMinimumCapacity;
+    while (capacity < size * 2) {
+        capacity *= 2;
+    }
+
+    NSString *path = [[_URL path] stringByAppendingString:@".compact"];
+    int fd = open([path fileSystemRepresentation], O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        return;
+    }
+    if (ftruncate(fd, capacity) != 0) {
+        close(fd);
+        unlink([path fileSystemRepresentation]);
+        return;
+    }
+    uint8_t *bytes = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (bytes == MAP_FAILED) {
+        close(fd);
+        unlink([path fileSystemRepresentation]);
+        return;
+    }
+
+    memcpy(bytes, XMPPDispatcherOutboxMagic, sizeof(XMPPDispatcherOutboxMagic));
+
+    NSMutableDictionary *offsetsByToken = [[NSMutableDictionary alloc] initWithCapacity:[_offsetsByToken count]];
+    size_t tail = XMPPDispatcherOutboxHeaderSize;
+    size_t offset = XMPPDispatcherOutboxHeaderSize;
+    while (offset < _tail) {
+        XMPPDispatcherOutboxRecordHeader *header = (XMPPDispatcherOutboxRecordHeader *)(_bytes + offset);
+        size_t recordSize = XMPPDispatcherOutboxRecordSize(header->length);
+        if (header->state == XMPPDispatcherOutboxRecordStatePending) {
+            memcpy(bytes + tail, header, recordSize);
+            offsetsByToken[@(header->token)] = @(tail);
+            tail += recordSize;
+        }
+        offset += recordSize;
+    }
+
+    if (msync(bytes, tail, MS_SYNC) != 0 ||
+        rename([path fileSystemRepresentation], [[_URL path] fileSystemRepresentation]) != 0) {
+        munmap(bytes, capacity);
+        close(fd);
+        unlink([path fileSystemRepresentation]);
+        return;
+    }
+
+    [self xmpp_close];
+
+    _fd = fd;
+    _bytes = bytes;
+    _capacity = capacity;
+    _tail = tail;
+    _removedBytes = 0;
+    _offsetsByToken = offsetsByToken;
+}
+
+@end
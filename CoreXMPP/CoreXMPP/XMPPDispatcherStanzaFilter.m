@@ -0,0 +1,81 @@
+//
+//  XMPPDispatcherStanzaFilter.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPDispatcherStanzaFilter.h"
+
+@implementation XMPPDispatcherStanzaFilter
+
+- (instancetype)initWithPayloadQNames:(NSArray<PXQName *> *)payloadQNames types:(NSArray<NSString *> *)types
+{
+    self = [super init];
+    if (self) {
+        _payloadQNames = payloadQNames ? [NSSet setWithArray:payloadQNames] : nil;
+        _types = types ? [NSSet setWithArray:types] : nil;
+    }
+    return self;
+}
+
+- (BOOL)matchesStanza:(PXElement *)stanza
+{
+    if (![self matchesTypeOfStanza:stanza]) {
+        return NO;
+    }
+
+    if (_payloadQNames == nil) {
+        return YES;
+    }
+
+    for (NSUInteger index = 0; index < stanza.numberOfElements; index++) {
+        if ([_payloadQNames containsObject:[stanza elementAtIndex:index].qualifiedName]) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+- (BOOL)matchesTypeOfStanza:(PXElement *)stanza
+{
+    if (_types == nil) {
+        return YES;
+    }
+
+    NSString *type = [stanza valueForAttribute:@"type"];
+    if (type == nil) {
+        type = [stanza.name isEqualToString:@"presence"] ? @"available" : @"normal";
+    }
+    return [_types containsObject:type];
+}
+
+@end
@@ -0,0 +1,88 @@
+//
+//  XMPPDispatcherStatistics.h
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+
+@import Foundation;
+@import XMPPFoundation;
+
+// Distribution of durations with a relative error below 12.5% (log-linear
+// buckets). Durations below one microsecond are counted as zero.
+
+NS_SWIFT_NAME(DispatcherLatencyHistogram)
+@interface XMPPDispatcherLatencyHistogram : NSObject
+
+@property (nonatomic, readonly) uint64_t count;
+@property (nonatomic, readonly) NSTimeInterval minimum;
+@property (nonatomic, readonly) NSTimeInterval maximum;
+@property (nonatomic, readonly) NSTimeInterval mean;
+
+// The percentile is in the range of 0 to 100. Returns 0, if the
+// histogram is empty.
+- (NSTimeInterval)valueAtPercentile:(double)percentile;
+
+@end
+
+// Snapshot of the statistics of a dispatcher (see -[XMPPDispatcherImpl
+// statistics]). The counters are totals since the dispatcher has been
+// created. Because the shards are read one after another without locking,
+// the values of a snapshot may not be consistent with each other.
+
+NS_SWIFT_NAME(DispatcherStatistics)
+@interface XMPPDispatcherStatistics : NSObject
+
+@property (nonatomic, readonly) NSDate *_Nonnull date;
+
+@property (nonatomic, readonly) uint64_t numberOfReceivedMessages;
+@property (nonatomic, readonly) uint64_t numberOfReceivedPresences;
+@property (nonatomic, readonly) uint64_t numberOfReceivedIQs;
+@property (nonatomic, readonly) uint64_t numberOfSentMessages;
+@property (nonatomic, readonly) uint64_t numberOfSentPresences;
+@property (nonatomic, readonly) uint64_t numberOfSentIQs;
+
+@property (nonatomic, readonly) uint64_t numberOfNoRouteErrors;
+@property (nonatomic, readonly) uint64_t numberOfTimeoutErrors;
+
+@property (nonatomic, readonly) NSUInteger numberOfPendingIQResponses;
+
+// Accounts (bare JIDs) with held back submissions.
+@property (nonatomic, readonly) NSDictionary<XMPPJID *, NSNumber *> *_Nonnull numberOfPendingSubmissionsByJID;
+
+// Time spent in the handlers of a received stanza.
+@property (nonatomic, readonly) XMPPDispatcherLatencyHistogram *_Nonnull handlerTime;
+
+// Time a stanza waited for the queue of its shard.
+@property (nonatomic, readonly) XMPPDispatcherLatencyHistogram *_Nonnull queueWaitTime;
+
+@end
@@ -0,0 +1,125 @@
+//
+//  XMPPDispatcherStatistics.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+
+#import "XMPPDispatcherMetrics.h"
+#import "XMPPDispatcherStatistics.h"
+
+@interface XMPPDispatcherLatencyHistogram () {
+    uint64_t _buckets[XMPP_DISPATCHER_METRICS_NUMBER_OF_BUCKETS];
+}
+
+@end
+
+@implementation XMPPDispatcherLatencyHistogram
+
+- (instancetype)initWithBuckets:(const uint64_t *)buckets sum:(uint64_t)sum
+{
+    self = [super init];
+    if (self) {
+        memcpy(_buckets, buckets, sizeof(_buckets));
+
+        NSInteger first = -1;
+        NSInteger last = -1;
+        for (NSUInteger bucket = 0; bucket < XMPP_DISPATCHER_METRICS_NUMBER_OF_BUCKETS; bucket++) {
+            if (_buckets[bucket] > 0) {
+                first = first < 0 ? bucket : first;
+                last = bucket;
+                _count += _buckets[bucket];
+            }
+        }
+
+        if (_count > 0) {
+            _minimum = XMPPDispatcherMetricsLowerBoundOfBucket(first) / (NSTimeInterval)USEC_PER_SEC;
+            _maximum = XMPPDispatcherMetricsUpperBoundOfBucket(last) / (NSTimeInterval)USEC_PER_SEC;
+            _mean = (sum / (NSTimeInterval)_count) / USEC_PER_SEC;
+        }
+    }
+    return self;
+}
+
+- (NSTimeInterval)valueAtPercentile:(double)percentile
+{
+    if (_count == 0) {
+        return 0;
+    }
+
+    double rank = MAX(MIN(percentile, 100.0), 0.0) / 100.0 * _count;
+    uint64_t cumulated = 0;
+    for (NSUInteger bucket = 0; bucket < XMPP_DISPATCHER_METRICS_NUMBER_OF_BUCKETS; bucket++) {
+        cumulated += _buckets[bucket];
+        if (cumulated > 0 && cumulated >= rank) {
+            return XMPPDispatcherMetricsUpperBoundOfBucket(bucket) / (NSTimeInterval)USEC_PER_SEC;
+        }
+    }
+    return _maximum;
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<XMPPDispatcherLatencyHistogram %p count: %llu, mean: %.6fs, p50: %.6fs, p99: %.6fs, max: %.6fs>",
+                                      self, _count, _mean, [self valueAtPercentile:50], [self valueAtPercentile:99], _maximum];
+}
+
+@end
+
+@implementation XMPPDispatcherStatistics
+
+- (instancetype)initWithCounters:(const uint64_t *)counters
+                     handlerTime:(XMPPDispatcherLatencyHistogram *)handlerTime
+                   queueWaitTime:(XMPPDispatcherLatencyHistogram *)queueWaitTime
+      numberOfPendingIQResponses:(NSUInteger)numberOfPendingIQResponses
+ numberOfPendingSubmissionsByJID:(NSDictionary<XMPPJID *, NSNumber *> *)numberOfPendingSubmissionsByJID
+{
+    self = [super init];
+    if (self) {
+        _date = [NSDate date];
+        _numberOfReceivedMessages = counters[XMPPDispatcherMetricsCounterReceivedMessages];
+        _numberOfReceivedPresences = counters[XMPPDispatcherMetricsCounterReceivedPresences];
+        _numberOfReceivedIQs = counters[XMPPDispatcherMetricsCounterReceivedIQs];
+        _numberOfSentMessages = counters[XMPPDispatcherMetricsCounterSentMessages];
+        _numberOfSentPresences = counters[XMPPDispatcherMetricsCounterSentPresences];
+        _numberOfSentIQs = counters[XMPPDispatcherMetricsCounterSentIQs];
+        _numberOfNoRouteErrors = counters[XMPPDispatcherMetricsCounterNoRouteErrors];
+        _numberOfTimeoutErrors = counters[XMPPDispatcherMetricsCounterTimeoutErrors];
+        _numberOfPendingIQResponses = numberOfPendingIQResponses;
+        _numberOfPendingSubmissionsByJID = [numberOfPendingSubmissionsByJID copy];
+        _handlerTime = handlerTime;
+        _queueWaitTime = queueWaitTime;
+    }
+    return self;
+}
+
+@end
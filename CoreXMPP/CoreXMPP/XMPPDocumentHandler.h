@@ -41,4 +41,13 @@ NS_SWIFT_NAME(DocumentHandler)
 @protocol XMPPDocumentHandler <NSObject>
 - (void)handleDocument:(nonnull PXDocument *)document completion:(nullable void (^)(NSError *_Nullable error))completion;
 - (void)processPendingDocuments:(nullable void (^)(NSError *_Nullable error))completion;
+
+@optional
+
+// Handles the documents in order, as if they were passed one after another
+// to -handleDocument:completion:, but with the overhead (e.g., switching
+// queues or requesting acknowledgements) only paid once per batch. The
+// completion is called once per document with its index in the batch.
+- (void)handleDocuments:(nonnull NSArray<PXDocument *> *)documents
+             completion:(nullable void (^)(NSUInteger index, NSError *_Nullable error))completion;
 @end
@@ -46,6 +46,7 @@ typedef NS_ENUM(NSInteger, XMPPErrorCode) {
     XMPPErrorCodeParseError,
     XMPPErrorCodeDiscoveryError,
     XMPPErrorCodeMessageFormatError,
+    XMPPErrorCodeTimeout,
 };
 
 extern NSString *const XMPPErrorXMLDocumentKey;
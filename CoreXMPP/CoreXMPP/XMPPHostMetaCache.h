@@ -0,0 +1,83 @@
+//
+//  XMPPHostMetaCache.h
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import <Foundation/Foundation.h>
+
+extern NSString *_Nonnull const XMPPHostMetaLinkRelationWebsocket NS_SWIFT_NAME(HostMetaLinkRelationWebsocket);
+extern NSString *_Nonnull const XMPPHostMetaLinkRelationBOSH NS_SWIFT_NAME(HostMetaLinkRelationBOSH);
+
+// Cache for the host metadata (XEP-0156, `/.well-known/host-meta`) of XMPP hosts.
+//
+// Entries expire according to the HTTP cache headers of the response
+// (Cache-Control max-age, Expires) or after `defaultTimeToLive`, if the
+// response does not contain any cache headers. Concurrent lookups for the
+// same host share one request. If a request fails, an expired entry is
+// used instead (if available).
+//
+// A link can be marked as preferred (e.g., the endpoint that connected
+// first). Preferred links are returned first, also after the entry has
+// been refreshed.
+//
+// If the cache has a storage URL, the entries are persisted on disk and
+// loaded again on the next launch.
+
+NS_SWIFT_NAME(HostMetaCache)
+@interface XMPPHostMetaCache : NSObject
+
+#pragma mark Shared Cache
++ (nonnull XMPPHostMetaCache *)sharedCache;
+
+#pragma mark Life-cycle
+- (nonnull instancetype)initWithStorageURL:(nullable NSURL *)storageURL;
+- (nonnull instancetype)initWithStorageURL:(nullable NSURL *)storageURL
+                                URLSession:(nullable NSURLSession *)URLSession NS_DESIGNATED_INITIALIZER;
+
+#pragma mark Properties
+@property (nonatomic, readonly) NSURL *_Nullable storageURL;
+@property (nonatomic, readwrite) NSTimeInterval defaultTimeToLive;
+
+#pragma mark Lookup
+
+// The links of the host metadata by relation (e.g., XMPPHostMetaLinkRelationWebsocket),
+// in the order of the document. The completion handler is called on an internal queue.
+- (void)linksForHost:(nonnull NSString *)hostname
+          completion:(nonnull void (^)(NSDictionary<NSString *, NSArray<NSURL *> *> *_Nullable links, NSError *_Nullable error))completion NS_SWIFT_NAME(links(for:completion:));
+
+#pragma mark Manage Entries
+- (void)setPreferredLink:(nonnull NSURL *)URL forRelation:(nonnull NSString *)relation host:(nonnull NSString *)hostname NS_SWIFT_NAME(setPreferredLink(_:for:host:));
+- (void)removeEntryForHost:(nonnull NSString *)hostname NS_SWIFT_NAME(removeEntry(for:));
+- (void)removeAllEntries;
+
+@end
@@ -0,0 +1,454 @@
+//
+//  XMPPHostMetaCache.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import <PureXML/PureXML.h>
+
+#import "XMPPError.h"
+#import "XMPPHostMetaCache.h"
+#import "XMPPLogger.h"
+
+NSString *const XMPPHostMetaLinkRelationWebsocket = @"urn:xmpp:alt-connections:websocket";
+NSString *const XMPPHostMetaLinkRelationBOSH = @"urn:xmpp:alt-connections:xbosh";
+
+static NSString *const XMPPHostMetaCacheXRDNamespace = @"http://docs.oasis-open.org/ns/xri/xrd-1.0";
+static NSString *const XMPPHostMetaCacheEntryLinksKey = @"links";
+static NSString *const XMPPHostMetaCacheEntryExpirationDateKey = @"expires";
+static NSString *const XMPPHostMetaCacheEntryPreferredLinksKey = @"preferred";
+
+typedef void (^XMPPHostMetaCacheCompletion)(NSDictionary<NSString *, NSArray<NSURL *> *> *links, NSError *error);
+
+@interface XMPPHostMetaCacheEntry : NSObject
+@property (nonatomic, readonly) NSDictionary<NSString *, NSArray<NSURL *> *> *links;
+@property (nonatomic, readonly) NSDate *expirationDate;
+@property (nonatomic, readonly, getter=isExpired) BOOL expired;
+@property (nonatomic, strong) NSDictionary<NSString *, NSURL *> *preferredLinks;
+@property (nonatomic, readonly) NSDictionary<NSString *, NSArray<NSURL *> *> *orderedLinks;
+- (instancetype)initWithLinks:(NSDictionary<NSString *, NSArray<NSURL *> *> *)links expirationDate:(NSDate *)expirationDate;
+- (instancetype)initWithPropertyList:(NSDictionary *)propertyList;
+- (NSDictionary *)propertyList;
+@end
+
+@interface XMPPHostMetaCache () {
+    dispatch_queue_t _queue;
+    NSURLSession *_URLSession;
+    NSMutableDictionary<NSString *, XMPPHostMetaCacheEntry *> *_entries;
+    NSMutableDictionary<NSString *, NSMutableArray<XMPPHostMetaCacheCompletion> *> *_pendingCompletions;
+}
+
+@end
+
+@implementation XMPPHostMetaCache
+
+#pragma mark Shared Cache
+
++ (XMPPHostMetaCache *)sharedCache
+{
+    static XMPPHostMetaCache *sharedCache;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSURL *cachesDirectoryURL = [[[NSFileManager defaultManager] URLsForDirectory:NSCachesDirectory
+                                                                            inDomains:NSUserDomainMask] firstObject];
+        NSURL *storageURL = [cachesDirectoryURL URLByAppendingPathComponent:@"XMPPHostMetaCache.plist"];
+        sharedCache = [[XMPPHostMetaCache alloc] initWithStorageURL:storageURL];
+    });
+    return sharedCache;
+}
+
+#pragma mark Life-cycle
+
+- (instancetype)init
+{
+    return [self initWithStorageURL:nil URLSession:nil];
+}
+
+- (instancetype)initWithStorageURL:(NSURL *)storageURL
+{
+    return [self initWithStorageURL:storageURL URLSession:nil];
+}
+
+- (instancetype)initWithStorageURL:(NSURL *)storageURL URLSession:(NSURLSession *)URLSession
+{
+    self = [super init];
+    if (self) {
+        _queue = dispatch_queue_create("XMPPHostMetaCache", DISPATCH_QUEUE_SERIAL);
+        _storageURL = [storageURL copy];
+        _URLSession = URLSession ?: [NSURLSession sharedSession];
+        _defaultTimeToLive = 60.0 * 60.0;
+        _entries = [[NSMutableDictionary alloc] init];
+        _pendingCompletions = [[NSMutableDictionary alloc] init];
+        [self xmpp_loadEntries];
+    }
+    return self;
+}
+
+#pragma mark Lookup
+
+- (void)linksForHost:(NSString *)hostname
+          completion:(void (^)(NSDictionary<NSString *, NSArray<NSURL *> *> *links, NSError *error))completion
+{
+    NSString *key = [hostname lowercaseString];
+    dispatch_async(_queue, ^{
+        XMPPHostMetaCacheEntry *entry = _entries[key];
+        if (entry && !entry.expired) {
+            completion(entry.orderedLinks, nil);
+            return;
+        }
+
+        NSMutableArray<XMPPHostMetaCacheCompletion> *pendingCompletions = _pendingCompletions[key];
+        if (pendingCompletions) {
+            [pendingCompletions addObject:completion];
+            return;
+        }
+
+        _pendingCompletions[key] = [NSMutableArray arrayWithObject:completion];
+        [self xmpp_fetchLinksForHost:key];
+    });
+}
+
+#pragma mark Manage Entries
+
+- (void)setPreferredLink:(NSURL *)URL forRelation:(NSString *)relation host:(NSString *)hostname
+{
+    NSString *key = [hostname lowercaseString];
+    dispatch_async(_queue, ^{
+        XMPPHostMetaCacheEntry *entry = _entries[key];
+        if (entry == nil || [entry.preferredLinks[relation] isEqual:URL]) {
+            return;
+        }
+        NSMutableDictionary *preferredLinks = [entry.preferredLinks mutableCopy] ?: [[NSMutableDictionary alloc] init];
+        preferredLinks[relation] = URL;
+        entry.preferredLinks = preferredLinks;
+        [self xmpp_storeEntries];
+    });
+}
+
+- (void)removeEntryForHost:(NSString *)hostname
+{
+    NSString *key = [hostname lowercaseString];
+    dispatch_async(_queue, ^{
+        [_entries removeObjectForKey:key];
+        [self xmpp_storeEntries];
+    });
+}
+
+- (void)removeAllEntries
+{
+    dispatch_async(_queue, ^{
+        [_entries removeAllObjects];
+        [self xmpp_storeEntries];
+    });
+}
+
+#pragma mark -
+
+#pragma mark Fetching Host Metadata
+
+- (void)xmpp_fetchLinksForHost:(NSString *)hostname
+{
+    NSURLComponents *hostMetadataURLComponents = [[NSURLComponents alloc] init];
+    hostMetadataURLComponents.scheme = @"https";
+    hostMetadataURLComponents.host = hostname;
+    hostMetadataURLComponents.path = @"/.well-known/host-meta";
+
+    NSURLRequest *request = [[NSURLRequest alloc] initWithURL:[hostMetadataURLComponents URL]];
+
+    NSURLSessionDataTask *task = [_URLSession dataTaskWithRequest:request
+                                                completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+                                                    dispatch_async(_queue, ^{
+                                                        [self xmpp_handleResponse:response
+                                                                             data:data
+                                                                            error:error
+                                                                          forHost:hostname];
+                                                    });
+                                                }];
+    [task resume];
+}
+
+- (void)xmpp_handleResponse:(NSURLResponse *)response
+                       data:(NSData *)data
+                      error:(NSError *)error
+                    forHost:(NSString *)hostname
+{
+    NSDictionary *links = nil;
+
+    if (error == nil) {
+        NSHTTPURLResponse *HTTPResponse = [response isKindOfClass:[NSHTTPURLResponse class]] ? (NSHTTPURLResponse *)response : nil;
+        if (HTTPResponse && (HTTPResponse.statusCode < 200 || HTTPResponse.statusCode >= 300)) {
+            NSString *errorMessage = [NSString stringWithFormat:@"Failed to fetch host metadata for host '%@' (status code %ld).", hostname, (long)HTTPResponse.statusCode];
+            error = [NSError errorWithDomain:XMPPErrorDomain
+                                        code:XMPPErrorCodeDiscoveryError
+                                    userInfo:@{NSLocalizedDescriptionKey : errorMessage}];
+        } else {
+            links = [[self class] xmpp_linksWithData:data];
+            if (links == nil) {
+                NSString *errorMessage = [NSString stringWithFormat:@"Invalid host metadata for host '%@'.", hostname];
+                error = [NSError errorWithDomain:XMPPErrorDomain
+                                            code:XMPPErrorCodeDiscoveryError
+                                        userInfo:@{NSLocalizedDescriptionKey : errorMessage}];
+            } else {
+                NSTimeInterval timeToLive = [self xmpp_timeToLiveWithResponse:HTTPResponse];
+                XMPPHostMetaCacheEntry *entry = [[XMPPHostMetaCacheEntry alloc] initWithLinks:links
+                                                                              expirationDate:[NSDate dateWithTimeIntervalSinceNow:timeToLive]];
+                entry.preferredLinks = _entries[hostname].preferredLinks;
+                links = entry.orderedLinks;
+                _entries[hostname] = entry;
+                [self xmpp_storeEntries];
+            }
+        }
+    }
+
+    if (error) {
+        // Fall back to the expired entry. An outdated list of
+        // connection endpoints is better than no list at all.
+        XMPPHostMetaCacheEntry *entry = _entries[hostname];
+        if (entry) {
+            XMPPLogWarning(XMPPLogCategoryStream, @"Failed to fetch host metadata for host '%@', using expired entry: %@", hostname, [error localizedDescription]);
+            links = entry.orderedLinks;
+            error = nil;
+        }
+    }
+
+    NSArray<XMPPHostMetaCacheCompletion> *pendingCompletions = _pendingCompletions[hostname];
+    [_pendingCompletions removeObjectForKey:hostname];
+
+    for (XMPPHostMetaCacheCompletion completion in pendingCompletions) {
+        completion(links, error);
+    }
+}
+
++ (NSDictionary<NSString *, NSArray<NSURL *> *> *)xmpp_linksWithData:(NSData *)data
+{
+    PXDocument *hostMetadata = data ? [PXDocument documentWithData:data] : nil;
+    if (![hostMetadata.root isEqual:PXQN(XMPPHostMetaCacheXRDNamespace, @"XRD")]) {
+        return nil;
+    }
+
+    NSMutableDictionary<NSString *, NSMutableArray<NSURL *> *> *links = [[NSMutableDictionary alloc] init];
+    [hostMetadata.root enumerateElementsUsingBlock:^(PXElement *element, BOOL *stop) {
+        if ([element isEqual:PXQN(XMPPHostMetaCacheXRDNamespace, @"Link")]) {
+            NSString *rel = [element valueForAttribute:@"rel"];
+            NSString *href = [element valueForAttribute:@"href"];
+            NSURL *URL = href ? [NSURL URLWithString:href] : nil;
+            if (rel && URL) {
+                NSMutableArray<NSURL *> *URLs = links[rel];
+                if (URLs == nil) {
+                    URLs = [[NSMutableArray alloc] init];
+                    links[rel] = URLs;
+                }
+                [URLs addObject:URL];
+            }
+        }
+    }];
+    return links;
+}
+
+#pragma mark Time to Live
+
+- (NSTimeInterval)xmpp_timeToLiveWithResponse:(NSHTTPURLResponse *)response
+{
+    NSDictionary *headers = response.allHeaderFields;
+
+    NSString *cacheControl = [self xmpp_valueForHeader:@"Cache-Control" inHeaders:headers];
+    if (cacheControl) {
+        for (NSString *directive in [cacheControl componentsSeparatedByString:@","]) {
+            NSString *trimmedDirective = [[directive stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]] lowercaseString];
+            if ([trimmedDirective isEqualToString:@"no-cache"] ||
+                [trimmedDirective isEqualToString:@"no-store"]) {
+                return 0;
+            } else if ([trimmedDirective hasPrefix:@"max-age="]) {
+                return MAX([[trimmedDirective substringFromIndex:8] doubleValue], 0);
+            }
+        }
+    }
+
+    NSString *expires = [self xmpp_valueForHeader:@"Expires" inHeaders:headers];
+    if (expires) {
+        static NSDateFormatter *dateFormatter;
+        static dispatch_once_t onceToken;
+        dispatch_once(&onceToken, ^{
+            dateFormatter = [[NSDateFormatter alloc] init];
+            dateFormatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"];
+            dateFormatter.timeZone = [NSTimeZone timeZoneForSecondsFromGMT:0];
+            dateFormatter.dateFormat = @"EEE, dd MMM yyyy HH:mm:ss zzz";
+        });
+        NSDate *expirationDate = [dateFormatter dateFromString:expires];
+        // An invalid date (e.g., "0") means already expired.
+        return expirationDate ? MAX([expirationDate timeIntervalSinceNow], 0) : 0;
+    }
+
+    return self.defaultTimeToLive;
+}
+
+- (NSString *)xmpp_valueForHeader:(NSString *)name inHeaders:(NSDictionary *)headers
+{
+    for (NSString *key in headers) {
+        if ([key caseInsensitiveCompare:name] == NSOrderedSame) {
+            return headers[key];
+        }
+    }
+    return nil;
+}
+
+#pragma mark Persistence
+
+- (void)xmpp_loadEntries
+{
+    if (self.storageURL == nil) {
+        return;
+    }
+
+    NSDictionary *propertyList = [NSDictionary dictionaryWithContentsOfURL:self.storageURL];
+    [propertyList enumerateKeysAndObjectsUsingBlock:^(NSString *hostname, NSDictionary *entryPropertyList, BOOL *stop) {
+        if ([hostname isKindOfClass:[NSString class]] && [entryPropertyList isKindOfClass:[NSDictionary class]]) {
+            XMPPHostMetaCacheEntry *entry = [[XMPPHostMetaCacheEntry alloc] initWithPropertyList:entryPropertyList];
+            if (entry) {
+                _entries[hostname] = entry;
+            }
+        }
+    }];
+}
+
+- (void)xmpp_storeEntries
+{
+    if (self.storageURL == nil) {
+        return;
+    }
+
+    NSMutableDictionary *propertyList = [[NSMutableDictionary alloc] init];
+    [_entries enumerateKeysAndObjectsUsingBlock:^(NSString *hostname, XMPPHostMetaCacheEntry *entry, BOOL *stop) {
+        propertyList[hostname] = [entry propertyList];
+    }];
+
+    if (![propertyList writeToURL:self.storageURL atomically:YES]) {
+        XMPPLogError(XMPPLogCategoryStream, @"Failed to write host metadata cache to URL: %@", self.storageURL);
+    }
+}
+
+@end
+
+#pragma mark -
+
+@implementation XMPPHostMetaCacheEntry
+
+- (instancetype)initWithLinks:(NSDictionary<NSString *, NSArray<NSURL *> *> *)links expirationDate:(NSDate *)expirationDate
+{
+    self = [super init];
+    if (self) {
+        _links = [links copy];
+        _expirationDate = expirationDate;
+    }
+    return self;
+}
+
+- (instancetype)initWithPropertyList:(NSDictionary *)propertyList
+{
+    NSDate *expirationDate = propertyList[XMPPHostMetaCacheEntryExpirationDateKey];
+    NSDictionary *linkStrings = propertyList[XMPPHostMetaCacheEntryLinksKey];
+    if (![expirationDate isKindOfClass:[NSDate class]] || ![linkStrings isKindOfClass:[NSDictionary class]]) {
+        return nil;
+    }
+
+    NSMutableDictionary<NSString *, NSArray<NSURL *> *> *links = [[NSMutableDictionary alloc] init];
+    [linkStrings enumerateKeysAndObjectsUsingBlock:^(NSString *rel, NSArray *URLStrings, BOOL *stop) {
+        if ([rel isKindOfClass:[NSString class]] && [URLStrings isKindOfClass:[NSArray class]]) {
+            NSMutableArray<NSURL *> *URLs = [[NSMutableArray alloc] init];
+            for (NSString *URLString in URLStrings) {
+                NSURL *URL = [URLString isKindOfClass:[NSString class]] ? [NSURL URLWithString:URLString] : nil;
+                if (URL) {
+                    [URLs addObject:URL];
+                }
+            }
+            links[rel] = URLs;
+        }
+    }];
+
+    self = [self initWithLinks:links expirationDate:expirationDate];
+    if (self) {
+        NSDictionary *preferredLinkStrings = propertyList[XMPPHostMetaCacheEntryPreferredLinksKey];
+        if ([preferredLinkStrings isKindOfClass:[NSDictionary class]]) {
+            NSMutableDictionary<NSString *, NSURL *> *preferredLinks = [[NSMutableDictionary alloc] init];
+            [preferredLinkStrings enumerateKeysAndObjectsUsingBlock:^(NSString *rel, NSString *URLString, BOOL *stop) {
+                NSURL *URL = [URLString isKindOfClass:[NSString class]] ? [NSURL URLWithString:URLString] : nil;
+                if ([rel isKindOfClass:[NSString class]] && URL) {
+                    preferredLinks[rel] = URL;
+                }
+            }];
+            _preferredLinks = preferredLinks;
+        }
+    }
+    return self;
+}
+
+- (NSDictionary<NSString *, NSArray<NSURL *> *> *)orderedLinks
+{
+    if ([self.preferredLinks count] == 0) {
+        return self.links;
+    }
+
+    NSMutableDictionary<NSString *, NSArray<NSURL *> *> *orderedLinks = [self.links mutableCopy];
+    [self.preferredLinks enumerateKeysAndObjectsUsingBlock:^(NSString *rel, NSURL *preferredURL, BOOL *stop) {
+        NSArray<NSURL *> *URLs = orderedLinks[rel];
+        NSUInteger index = [URLs indexOfObject:preferredURL];
+        if (index != NSNotFound && index != 0) {
+            NSMutableArray<NSURL *> *reorderedURLs = [URLs mutableCopy];
+            [reorderedURLs removeObjectAtIndex:index];
+            [reorderedURLs insertObject:preferredURL atIndex:0];
+            orderedLinks[rel] = reorderedURLs;
+        }
+    }];
+    return orderedLinks;
+}
+
+- (BOOL)isExpired
+{
+    return [self.expirationDate timeIntervalSinceNow] <= 0;
+}
+
+- (NSDictionary *)propertyList
+{
+    NSMutableDictionary *linkStrings = [[NSMutableDictionary alloc] init];
+    [self.links enumerateKeysAndObjectsUsingBlock:^(NSString *rel, NSArray<NSURL *> *URLs, BOOL *stop) {
+        linkStrings[rel] = [URLs valueForKey:@"absoluteString"];
+    }];
+    NSMutableDictionary *preferredLinkStrings = [[NSMutableDictionary alloc] init];
+    [self.preferredLinks enumerateKeysAndObjectsUsingBlock:^(NSString *rel, NSURL *URL, BOOL *stop) {
+        preferredLinkStrings[rel] = [URL absoluteString];
+    }];
+    return @{ XMPPHostMetaCacheEntryLinksKey : linkStrings,
+              XMPPHostMetaCacheEntryExpirationDateKey : self.expirationDate,
+              XMPPHostMetaCacheEntryPreferredLinksKey : preferredLinkStrings };
+}
+
+@end
@@ -0,0 +1,85 @@
+//
+//  XMPPIQCorrelationTable.h
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+@import Foundation;
+@import XMPPFoundation;
+
+typedef void (^XMPPIQCorrelationCompletion)(XMPPIQStanza *_Nullable response, NSError *_Nullable error);
+
+// Correlates pending IQ requests with their responses (by the request ID).
+//
+// Request IDs consist of a random prefix (per table) and a monotonic
+// counter. The prefix makes the IDs unguessable for other entities.
+//
+// A response is only accepted, if it has been sent by the entity the
+// request was addressed to. The check compares the (unparsed) attribute
+// values first and only falls back to comparing the JIDs, if they differ.
+//
+// Requests with an ID chosen by the caller may share the ID with other
+// pending requests (e.g., to different entities). The response is passed
+// to the oldest pending request with the ID, which matches the sender.
+
+@interface XMPPIQCorrelationTable : NSObject
+
+// Unique (in this process) and unguessable request ID.
++ (nonnull NSString *)uniqueRequestID;
+
+// Can be read from any thread (e.g., for statistics). All other methods
+// must be called on the queue of the owner.
+@property (nonatomic, readonly) NSUInteger numberOfPendingRequests;
+
+- (nonnull NSString *)nextRequestID;
+
+// The sender of the response must match `to`. If `to` is nil, any sender
+// is accepted. If `acceptsMissingSender` is YES, a response without a
+// `from` attribute is accepted too (e.g., a response by the server on
+// behalf of the account, RFC 6120, Section 10.3.3). Returns a token for
+// removing exactly this request (e.g., if it times out).
+- (nonnull id)addRequestWithID:(nonnull NSString *)requestID
+                            to:(nullable XMPPJID *)to
+          acceptsMissingSender:(BOOL)acceptsMissingSender
+                    completion:(nonnull XMPPIQCorrelationCompletion)completion;
+
+// Removes and returns the completion of the request, if the response
+// matches the pending request.
+- (nullable XMPPIQCorrelationCompletion)removeRequestForResponseWithID:(nonnull NSString *)requestID
+                                                                  from:(nullable NSString *)from;
+
+// Removes and returns the completion of the request, if it is still
+// pending. Other requests with the same ID are not affected.
+- (nullable XMPPIQCorrelationCompletion)removeRequest:(nullable id)request;
+- (nonnull NSArray<XMPPIQCorrelationCompletion> *)removeAllRequests;
+
+@end
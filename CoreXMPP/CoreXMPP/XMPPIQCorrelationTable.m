@@ -0,0 +1,238 @@
+//
+//  XMPPIQCorrelationTable.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import <stdatomic.h>
+
+#import "XMPPIQCorrelationTable.h"
+
+@interface XMPPIQCorrelationEntry : NSObject
+@property (nonatomic, readonly) NSString *requestID;
+@property (nonatomic, readonly) XMPPJID *sender;
+@property (nonatomic, readonly) NSString *senderString;
+@property (nonatomic, readonly) BOOL acceptsMissingSender;
+@property (nonatomic, readonly) XMPPIQCorrelationCompletion completion;
+// The next pending request with the same ID (usually nil).
+@property (nonatomic, strong) XMPPIQCorrelationEntry *next;
+- (instancetype)initWithRequestID:(NSString *)requestID sender:(XMPPJID *)sender acceptsMissingSender:(BOOL)acceptsMissingSender completion:(XMPPIQCorrelationCompletion)completion;
+- (BOOL)matchesSender:(NSString *)from;
+@end
+
+@interface XMPPIQCorrelationTable () {
+    NSString *_prefix;
+    uint64_t _counter;
+    NSMutableDictionary<NSString *, XMPPIQCorrelationEntry *> *_entries;
+    NSUInteger _count;
+    _Atomic(NSUInteger) _numberOfPendingRequests;
+}
+
+@end
+
+@implementation XMPPIQCorrelationTable
+
+#pragma mark Request IDs
+
++ (NSString *)xmpp_randomPrefix
+{
+    uint8_t bytes[6];
+    arc4random_buf(bytes, sizeof(bytes));
+    return [NSString stringWithFormat:@"%02x%02x%02x%02x%02x%02x-", bytes[0], bytes[1], bytes[2], bytes[3], bytes[4], bytes[5]];
+}
+
++ (NSString *)uniqueRequestID
+{
+    static NSString *prefix;
+    static _Atomic(uint64_t) counter;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        prefix = [self xmpp_randomPrefix];
+    });
+    uint64_t value = atomic_fetch_add_explicit(&counter, 1, memory_order_relaxed) + 1;
+    return [NSString stringWithFormat:@"%@%llx", prefix, value];
+}
+
+#pragma mark Life-cycle
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        _prefix = [[self class] xmpp_randomPrefix];
+        _counter = 0;
+        _entries = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
+#pragma mark Pending Requests
+
+- (NSUInteger)numberOfPendingRequests
+{
+    return atomic_load_explicit(&_numberOfPendingRequests, memory_order_relaxed);
+}
+
+- (void)xmpp_updateNumberOfPendingRequests
+{
+    atomic_store_explicit(&_numberOfPendingRequests, _count, memory_order_relaxed);
+}
+
+- (NSString *)nextRequestID
+{
+    _counter += 1;
+    return [NSString stringWithFormat:@"%@%llx", _prefix, _counter];
+}
+
+- (id)addRequestWithID:(NSString *)requestID
+                    to:(XMPPJID *)to
+  acceptsMissingSender:(BOOL)acceptsMissingSender
+            completion:(XMPPIQCorrelationCompletion)completion
+{
+    XMPPIQCorrelationEntry *entry = [[XMPPIQCorrelationEntry alloc] initWithRequestID:requestID
+                                                                              sender:to
+                                                                acceptsMissingSender:acceptsMissingSender
+                                                                          completion:completion];
+
+    // Requests with the same ID are kept in the order they have been added.
+    XMPPIQCorrelationEntry *last = _entries[requestID];
+    if (last) {
+        while (last.next) {
+            last = last.next;
+        }
+        last.next = entry;
+    } else {
+        _entries[requestID] = entry;
+    }
+
+    _count += 1;
+    [self xmpp_updateNumberOfPendingRequests];
+    return entry;
+}
+
+- (XMPPIQCorrelationCompletion)removeRequestForResponseWithID:(NSString *)requestID from:(NSString *)from
+{
+    XMPPIQCorrelationEntry *entry = _entries[requestID];
+    while (entry && ![entry matchesSender:from]) {
+        entry = entry.next;
+    }
+
+    if (entry == nil) {
+        return nil;
+    }
+
+    [self xmpp_removeEntry:entry];
+    return entry.completion;
+}
+
+- (XMPPIQCorrelationCompletion)removeRequest:(id)request
+{
+    XMPPIQCorrelationEntry *entry = request;
+    if (entry && [self xmpp_removeEntry:entry]) {
+        return entry.completion;
+    }
+    return nil;
+}
+
+- (NSArray<XMPPIQCorrelationCompletion> *)removeAllRequests
+{
+    NSMutableArray *completions = [[NSMutableArray alloc] initWithCapacity:_count];
+    for (XMPPIQCorrelationEntry *first in [_entries allValues]) {
+        for (XMPPIQCorrelationEntry *entry = first; entry; entry = entry.next) {
+            [completions addObject:entry.completion];
+        }
+    }
+    [_entries removeAllObjects];
+    _count = 0;
+    [self xmpp_updateNumberOfPendingRequests];
+    return completions;
+}
+
+- (BOOL)xmpp_removeEntry:(XMPPIQCorrelationEntry *)entry
+{
+    // Compares the identity, since the entries of other requests may have
+    // the same ID.
+    XMPPIQCorrelationEntry *first = _entries[entry.requestID];
+    if (first == entry) {
+        if (entry.next) {
+            _entries[entry.requestID] = entry.next;
+        } else {
+            [_entries removeObjectForKey:entry.requestID];
+        }
+    } else {
+        XMPPIQCorrelationEntry *previous = first;
+        while (previous && previous.next != entry) {
+            previous = previous.next;
+        }
+        if (previous == nil) {
+            return NO;
+        }
+        previous.next = entry.next;
+    }
+
+    entry.next = nil;
+    _count -= 1;
+    [self xmpp_updateNumberOfPendingRequests];
+    return YES;
+}
+
+@end
+
+@implementation XMPPIQCorrelationEntry
+- (instancetype)initWithRequestID:(NSString *)requestID sender:(XMPPJID *)sender acceptsMissingSender:(BOOL)acceptsMissingSender completion:(XMPPIQCorrelationCompletion)completion
+{
+    self = [super init];
+    if (self) {
+        _requestID = [requestID copy];
+        _sender = sender;
+        _senderString = [sender stringValue];
+        _acceptsMissingSender = acceptsMissingSender;
+        _completion = completion;
+    }
+    return self;
+}
+
+- (BOOL)matchesSender:(NSString *)from
+{
+    if (_sender == nil) {
+        return YES;
+    } else if (from == nil) {
+        return _acceptsMissingSender;
+    } else if ([from isEqualToString:_senderString]) {
+        return YES;
+    } else {
+        // The attribute may not be in the normalized form.
+        XMPPJID *fromJID = [[XMPPJID alloc] initWithString:from];
+        return [fromJID isEqual:_sender];
+    }
+}
+@end
@@ -0,0 +1,88 @@
+//
+//  XMPPIQRequestCoalescer.h
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+@import Foundation;
+@import XMPPFoundation;
+
+#import "XMPPIQCorrelationTable.h"
+
+// Coalesces identical IQ 'get' requests, which are pending at the same
+// time, and caches their results (see -[XMPPDispatcherImpl
+// coalescesIQRequests]). Requests are identical, if they are serialized
+// identically apart from their ID (same sender, recipient and payload).
+//
+// The cache evicts the least recently used result, if it exceeds the
+// maximum number of results. Expired results are removed on access.
+//
+// Must be used on the queue of the owner.
+
+@interface XMPPIQRequestCoalescer : NSObject
+
+// Returns nil, if the request is not a 'get' request with exactly one
+// payload element. The request is not modified.
++ (nullable NSData *)keyForRequest:(nonnull XMPPIQStanza *)request;
+
+#pragma mark Pending Requests
+
+// Registers a request, which is sent, and the time (system uptime) it
+// times out. Returns a token for the request. Replaces a pending request
+// with the same key for requests joining later.
+- (nonnull id)beginRequestForKey:(nonnull NSData *)key deadline:(NSTimeInterval)deadline;
+
+// Adds the completion to the pending request with the key and returns its
+// token. Returns nil, if there is no pending request or if it times out
+// before the deadline. In this case the request must be sent itself.
+- (nullable id)joinRequestForKey:(nonnull NSData *)key
+                        deadline:(NSTimeInterval)deadline
+                      completion:(nonnull XMPPIQCorrelationCompletion)completion;
+
+// Removes the completion (compared by identity), e.g., if it timed out.
+// Returns NO, if the request already finished.
+- (BOOL)removeCompletion:(nonnull XMPPIQCorrelationCompletion)completion fromRequest:(nonnull id)request;
+
+// Returns the completions, which joined the request.
+- (nonnull NSArray<XMPPIQCorrelationCompletion> *)finishRequest:(nonnull id)request;
+
+#pragma mark Result Cache
+
+// Defaults to 128 results.
+@property (nonatomic, readwrite) NSUInteger maximumNumberOfCachedResults;
+@property (nonatomic, readonly) NSUInteger numberOfCachedResults;
+
+- (nullable XMPPIQStanza *)cachedResultForKey:(nonnull NSData *)key;
+- (void)cacheResult:(nonnull XMPPIQStanza *)result forKey:(nonnull NSData *)key timeToLive:(NSTimeInterval)timeToLive;
+- (void)removeAllCachedResults;
+
+@end
@@ -0,0 +1,271 @@
+//
+//  XMPPIQRequestCoalescer.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import <PureXML/PureXML.h>
+
+#import "XMPPIQRequestCoalescer.h"
+
+static const NSUInteger XMPPIQRequestCoalescerDefaultMaximumNumberOfCachedResults = 128;
+
+// Entries of the result cache are kept in a doubly linked list, ordered by
+// their last access (most recently used first).
+@interface XMPPIQRequestCoalescerCacheEntry : NSObject
+@property (nonatomic, readonly) NSData *key;
+@property (nonatomic, readonly) XMPPIQStanza *result;
+@property (nonatomic, readonly) NSTimeInterval expirationTime;
+@property (nonatomic, readwrite, weak) XMPPIQRequestCoalescerCacheEntry *previous;
+@property (nonatomic, readwrite, strong) XMPPIQRequestCoalescerCacheEntry *next;
+- (instancetype)initWithKey:(NSData *)key result:(XMPPIQStanza *)result expirationTime:(NSTimeInterval)expirationTime;
+@end
+
+// Request, which has been sent, and the completions of the identical
+// requests, which joined it.
+@interface XMPPIQRequestCoalescerRequest : NSObject
+@property (nonatomic, readonly) NSData *key;
+@property (nonatomic, readonly) NSTimeInterval deadline;
+@property (nonatomic, readonly) NSMutableArray<XMPPIQCorrelationCompletion> *completions;
+- (instancetype)initWithKey:(NSData *)key deadline:(NSTimeInterval)deadline;
+@end
+
+@interface XMPPIQRequestCoalescer () {
+    NSMutableDictionary<NSData *, XMPPIQRequestCoalescerRequest *> *_requestsByKey;
+    NSMutableDictionary<NSData *, XMPPIQRequestCoalescerCacheEntry *> *_cacheEntriesByKey;
+    XMPPIQRequestCoalescerCacheEntry *_head;
+    XMPPIQRequestCoalescerCacheEntry *_tail;
+}
+
+@end
+
+@implementation XMPPIQRequestCoalescer
+
++ (NSData *)keyForRequest:(XMPPIQStanza *)request
+{
+    if (request.type != XMPPIQStanzaTypeGet || request.numberOfElements != 1) {
+        return nil;
+    }
+
+    // The ID is blanked in a copy of the request, which is serialized.
+    // The request itself may be used on other threads.
+    PXDocument *document = [[PXDocument alloc] initWithElement:request];
+    [document.root setValue:@"" forAttribute:@"id"];
+    return [document data];
+}
+
+#pragma mark Life-cycle
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        _requestsByKey = [[NSMutableDictionary alloc] init];
+        _cacheEntriesByKey = [[NSMutableDictionary alloc] init];
+        _maximumNumberOfCachedResults = XMPPIQRequestCoalescerDefaultMaximumNumberOfCachedResults;
+    }
+    return self;
+}
+
+#pragma mark Pending Requests
+
+- (id)beginRequestForKey:(NSData *)key deadline:(NSTimeInterval)deadline
+{
+    XMPPIQRequestCoalescerRequest *request = [[XMPPIQRequestCoalescerRequest alloc] initWithKey:key deadline:deadline];
+    _requestsByKey[key] = request;
+    return request;
+}
+
+- (id)joinRequestForKey:(NSData *)key deadline:(NSTimeInterval)deadline completion:(XMPPIQCorrelationCompletion)completion
+{
+    // A request, which times out earlier than the joining one, would
+    // shorten its timeout.
+    XMPPIQRequestCoalescerRequest *request = _requestsByKey[key];
+    if (request == nil || request.deadline < deadline) {
+        return nil;
+    }
+    [request.completions addObject:completion];
+    return request;
+}
+
+- (BOOL)removeCompletion:(XMPPIQCorrelationCompletion)completion fromRequest:(id)request
+{
+    NSMutableArray *completions = [(XMPPIQRequestCoalescerRequest *)request completions];
+    NSUInteger index = [completions indexOfObjectIdenticalTo:completion];
+    if (index == NSNotFound) {
+        return NO;
+    }
+    [completions removeObjectAtIndex:index];
+    return YES;
+}
+
+- (NSArray<XMPPIQCorrelationCompletion> *)finishRequest:(id)request
+{
+    XMPPIQRequestCoalescerRequest *pendingRequest = request;
+    if (_requestsByKey[pendingRequest.key] == pendingRequest) {
+        [_requestsByKey removeObjectForKey:pendingRequest.key];
+    }
+    NSArray *completions = [pendingRequest.completions copy];
+    [pendingRequest.completions removeAllObjects];
+    return completions;
+}
+
+#pragma mark Result Cache
+
+- (NSUInteger)numberOfCachedResults
+{
+    return [_cacheEntriesByKey count];
+}
+
+- (void)setMaximumNumberOfCachedResults:(NSUInteger)maximumNumberOfCachedResults
+{
+    _maximumNumberOfCachedResults = maximumNumberOfCachedResults;
+    [self xmpp_evictEntries];
+}
+
+- (XMPPIQStanza *)cachedResultForKey:(NSData *)key
+{
+    XMPPIQRequestCoalescerCacheEntry *entry = _cacheEntriesByKey[key];
+    if (entry == nil) {
+        return nil;
+    }
+
+    [self xmpp_unlinkEntry:entry];
+
+    if (entry.expirationTime <= [[NSProcessInfo processInfo] systemUptime]) {
+        [_cacheEntriesByKey removeObjectForKey:key];
+        return nil;
+    }
+
+    [self xmpp_linkEntry:entry];
+    return entry.result;
+}
+
+- (void)cacheResult:(XMPPIQStanza *)result forKey:(NSData *)key timeToLive:(NSTimeInterval)timeToLive
+{
+    XMPPIQRequestCoalescerCacheEntry *entry = _cacheEntriesByKey[key];
+    if (entry) {
+        [self xmpp_unlinkEntry:entry];
+        [_cacheEntriesByKey removeObjectForKey:key];
+    }
+
+    if (timeToLive <= 0 || _maximumNumberOfCachedResults == 0) {
+        return;
+    }
+
+    entry = [[XMPPIQRequestCoalescerCacheEntry alloc] initWithKey:key
+                                                           result:result
+                                                   expirationTime:[[NSProcessInfo processInfo] systemUptime] + timeToLive];
+    _cacheEntriesByKey[key] = entry;
+    [self xmpp_linkEntry:entry];
+    [self xmpp_evictEntries];
+}
+
+- (void)removeAllCachedResults
+{
+    // The list is unlinked iteratively to avoid a deep recursion, while
+    // the entries are deallocated.
+    while (_head) {
+        [self xmpp_unlinkEntry:_head];
+    }
+    [_cacheEntriesByKey removeAllObjects];
+}
+
+- (void)xmpp_evictEntries
+{
+    while ([_cacheEntriesByKey count] > _maximumNumberOfCachedResults && _tail) {
+        XMPPIQRequestCoalescerCacheEntry *entry = _tail;
+        [self xmpp_unlinkEntry:entry];
+        [_cacheEntriesByKey removeObjectForKey:entry.key];
+    }
+}
+
+- (void)xmpp_linkEntry:(XMPPIQRequestCoalescerCacheEntry *)entry
+{
+    entry.previous = nil;
+    entry.next = _head;
+    _head.previous = entry;
+    _head = entry;
+    if (_tail == nil) {
+        _tail = entry;
+    }
+}
+
+- (void)xmpp_unlinkEntry:(XMPPIQRequestCoalescerCacheEntry *)entry
+{
+    XMPPIQRequestCoalescerCacheEntry *previous = entry.previous;
+    XMPPIQRequestCoalescerCacheEntry *next = entry.next;
+    if (previous) {
+        previous.next = next;
+    } else {
+        _head = next;
+    }
+    if (next) {
+        next.previous = previous;
+    } else {
+        _tail = previous;
+    }
+    entry.previous = nil;
+    entry.next = nil;
+}
+
+@end
+
+@implementation XMPPIQRequestCoalescerRequest
+
+- (instancetype)initWithKey:(NSData *)key deadline:(NSTimeInterval)deadline
+{
+    self = [super init];
+    if (self) {
+        _key = key;
+        _deadline = deadline;
+        _completions = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+@end
+
+@implementation XMPPIQRequestCoalescerCacheEntry
+
+- (instancetype)initWithKey:(NSData *)key result:(XMPPIQStanza *)result expirationTime:(NSTimeInterval)expirationTime
+{
+    self = [super init];
+    if (self) {
+        _key = key;
+        _result = result;
+        _expirationTime = expirationTime;
+    }
+    return self;
+}
+
+@end
@@ -0,0 +1,114 @@
+//
+//  XMPPLogger.h
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef NS_ENUM(NSUInteger, XMPPLogLevel) {
+    XMPPLogLevelOff = 0,
+    XMPPLogLevelError,
+    XMPPLogLevelWarning,
+    XMPPLogLevelInfo,
+    XMPPLogLevelDebug,
+    XMPPLogLevelTrace
+} NS_SWIFT_NAME(LogLevel);
+
+typedef NS_ENUM(NSUInteger, XMPPLogCategory) {
+    XMPPLogCategoryStream = 0,
+    XMPPLogCategoryClient,
+    XMPPLogCategoryDispatcher,
+    XMPPLogCategoryStreamManagement,
+    XMPPLogCategorySASL
+} NS_SWIFT_NAME(LogCategory);
+
+#define XMPP_LOG_NUMBER_OF_CATEGORIES 5
+
+// The most verbose level that is compiled in (the numeric value of the
+// XMPPLogLevel). Debug and trace messages are removed from release builds,
+// unless XMPP_LOG_MAX_LEVEL is defined.
+#ifndef XMPP_LOG_MAX_LEVEL
+#if DEBUG
+#define XMPP_LOG_MAX_LEVEL 5
+#else
+#define XMPP_LOG_MAX_LEVEL 3
+#endif
+#endif
+
+NS_SWIFT_NAME(Logger)
+@interface XMPPLogger : NSObject
+
+// The level of the messages that are logged at runtime (per category).
+// Defaults to XMPPLogLevelInfo.
++ (XMPPLogLevel)levelForCategory:(XMPPLogCategory)category NS_SWIFT_NAME(level(for:));
++ (void)setLevel:(XMPPLogLevel)level forCategory:(XMPPLogCategory)category NS_SWIFT_NAME(setLevel(_:for:));
++ (void)setLevel:(XMPPLogLevel)level NS_SWIFT_NAME(setLevel(_:));
+
+// The handler is called on a serial background queue. If not set, the
+// messages are passed to NSLog (on that queue).
++ (void)setHandler:(nullable void (^)(XMPPLogLevel level, XMPPLogCategory category, NSString *_Nonnull message))handler;
+
+@end
+
+// Used by the macros below. Do not use directly.
+FOUNDATION_EXPORT XMPPLogLevel XMPPLogLevels[XMPP_LOG_NUMBER_OF_CATEGORIES];
+FOUNDATION_EXPORT void XMPPLogMessage(XMPPLogLevel level, XMPPLogCategory category, NSString *_Nonnull format, ...) NS_FORMAT_FUNCTION(3, 4);
+
+// The arguments are only evaluated (and the message formatted) if the
+// level is enabled for the category.
+#define XMPP_LOG(lvl, category, format, ...)                                    \
+    do {                                                                        \
+        if ((lvl) <= XMPP_LOG_MAX_LEVEL && (lvl) <= XMPPLogLevels[(category)]) { \
+            XMPPLogMessage((lvl), (category), (format), ##__VA_ARGS__);         \
+        }                                                                       \
+    } while (0)
+
+#define XMPPLogError(category, format, ...) XMPP_LOG(XMPPLogLevelError, category, format, ##__VA_ARGS__)
+#define XMPPLogWarning(category, format, ...) XMPP_LOG(XMPPLogLevelWarning, category, format, ##__VA_ARGS__)
+#define XMPPLogInfo(category, format, ...) XMPP_LOG(XMPPLogLevelInfo, category, format, ##__VA_ARGS__)
+
+#if XMPP_LOG_MAX_LEVEL >= 4
+#define XMPPLogDebug(category, format, ...) XMPP_LOG(XMPPLogLevelDebug, category, format, ##__VA_ARGS__)
+#else
+#define XMPPLogDebug(category, format, ...) \
+    do {                                    \
+    } while (0)
+#endif
+
+#if XMPP_LOG_MAX_LEVEL >= 5
+#define XMPPLogTrace(category, format, ...) XMPP_LOG(XMPPLogLevelTrace, category, format, ##__VA_ARGS__)
+#else
+#define XMPPLogTrace(category, format, ...) \
+    do {                                    \
+    } while (0)
+#endif
@@ -0,0 +1,141 @@
+//
+//  XMPPLogger.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPLogger.h"
+
+XMPPLogLevel XMPPLogLevels[XMPP_LOG_NUMBER_OF_CATEGORIES] = {
+    XMPPLogLevelInfo,
+    XMPPLogLevelInfo,
+    XMPPLogLevelInfo,
+    XMPPLogLevelInfo,
+    XMPPLogLevelInfo};
+
+static void (^XMPPLogHandler)(XMPPLogLevel level, XMPPLogCategory category, NSString *message);
+
+static dispatch_queue_t XMPPLogQueue()
+{
+    static dispatch_queue_t queue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        queue = dispatch_queue_create("XMPPLogger", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(queue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
+    });
+    return queue;
+}
+
+static NSString *XMPPLogCategoryName(XMPPLogCategory category)
+{
+    switch (category) {
+    case XMPPLogCategoryStream:
+        return @"stream";
+    case XMPPLogCategoryClient:
+        return @"client";
+    case XMPPLogCategoryDispatcher:
+        return @"dispatcher";
+    case XMPPLogCategoryStreamManagement:
+        return @"sm";
+    case XMPPLogCategorySASL:
+        return @"sasl";
+    }
+    return @"unknown";
+}
+
+static NSString *XMPPLogLevelName(XMPPLogLevel level)
+{
+    switch (level) {
+    case XMPPLogLevelOff:
+        return @"off";
+    case XMPPLogLevelError:
+        return @"error";
+    case XMPPLogLevelWarning:
+        return @"warning";
+    case XMPPLogLevelInfo:
+        return @"info";
+    case XMPPLogLevelDebug:
+        return @"debug";
+    case XMPPLogLevelTrace:
+        return @"trace";
+    }
+    return @"unknown";
+}
+
+void XMPPLogMessage(XMPPLogLevel level, XMPPLogCategory category, NSString *format, ...)
+{
+    va_list arguments;
+    va_start(arguments, format);
+    NSString *message = [[NSString alloc] initWithFormat:format arguments:arguments];
+    va_end(arguments);
+
+    // Writing the message may block. Therefore it is done on a
+    // background queue and not on the thread of the caller.
+    dispatch_async(XMPPLogQueue(), ^{
+        if (XMPPLogHandler) {
+            XMPPLogHandler(level, category, message);
+        } else {
+            NSLog(@"[%@] %@: %@", XMPPLogCategoryName(category), XMPPLogLevelName(level), message);
+        }
+    });
+}
+
+@implementation XMPPLogger
+
++ (XMPPLogLevel)levelForCategory:(XMPPLogCategory)category
+{
+    NSParameterAssert(category < XMPP_LOG_NUMBER_OF_CATEGORIES);
+    return XMPPLogLevels[category];
+}
+
++ (void)setLevel:(XMPPLogLevel)level forCategory:(XMPPLogCategory)category
+{
+    NSParameterAssert(category < XMPP_LOG_NUMBER_OF_CATEGORIES);
+    XMPPLogLevels[category] = level;
+}
+
++ (void)setLevel:(XMPPLogLevel)level
+{
+    for (NSUInteger category = 0; category < XMPP_LOG_NUMBER_OF_CATEGORIES; category++) {
+        XMPPLogLevels[category] = level;
+    }
+}
+
++ (void)setHandler:(void (^)(XMPPLogLevel, XMPPLogCategory, NSString *))handler
+{
+    void (^copiedHandler)(XMPPLogLevel, XMPPLogCategory, NSString *) = [handler copy];
+    dispatch_async(XMPPLogQueue(), ^{
+        XMPPLogHandler = copiedHandler;
+    });
+}
+
+@end
@@ -0,0 +1,70 @@
+//
+//  XMPPStanzaPriority.h
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+
+@import Foundation;
+
+#import <PureXML/PureXML.h>
+
+// Priority classes of outbound stanzas. The dispatcher (held back
+// submissions) and the client (send path) schedule the stanzas of the
+// classes by weight, while the stanzas of one class are sent in order.
+// Stanzas to the same recipient are always sent in order (RFC 6120,
+// Section 10.1), regardless of their class (see
+// XMPPStanzaOrderingKeyOfElement()).
+typedef NS_ENUM(NSUInteger, XMPPStanzaPriority) {
+    XMPPStanzaPriorityControl = 0,
+    XMPPStanzaPriorityInteractive,
+    XMPPStanzaPriorityBulk
+} NS_SWIFT_NAME(StanzaPriority);
+
+#define XMPP_STANZA_NUMBER_OF_PRIORITIES 3
+
+// Classifies an outbound element:
+//
+// - Control: IQ results and errors, IQ requests (except pubsub), error
+//   messages and all non-stanza elements (e.g., stream management).
+// - Interactive: chat and groupchat messages, messages with a body and
+//   directed presence stanzas (e.g., joining a room or subscriptions).
+// - Bulk: pubsub requests, other messages (e.g., headlines or events) and
+//   broadcast presence stanzas (without recipient).
+FOUNDATION_EXPORT XMPPStanzaPriority XMPPStanzaPriorityOfElement(PXElement *_Nonnull element);
+
+// Key of the recipient, whose stanzas are kept in order: the bare JID of
+// the recipient (lowercased) or an empty string, if the stanza has no
+// recipient (i.e., it is handled by the server of the account). Returns
+// nil for non-stanza elements (e.g., stream management), which are not
+// ordered.
+FOUNDATION_EXPORT NSString *_Nullable XMPPStanzaOrderingKeyOfElement(PXElement *_Nonnull element);
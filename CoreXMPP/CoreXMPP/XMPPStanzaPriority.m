@@ -0,0 +1,101 @@
+//
+//  XMPPStanzaPriority.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+
+#import "XMPPStanzaPriority.h"
+
+static NSString *const XMPPStanzaPriorityClientNamespace = @"jabber:client";
+static NSString *const XMPPStanzaPriorityPubSubNamespacePrefix = @"http://jabber.org/protocol/pubsub";
+
+XMPPStanzaPriority XMPPStanzaPriorityOfElement(PXElement *element)
+{
+    if (![element.namespace isEqualToString:XMPPStanzaPriorityClientNamespace]) {
+        return XMPPStanzaPriorityControl;
+    }
+
+    NSString *type = [element valueForAttribute:@"type"];
+
+    if ([element.name isEqualToString:@"iq"]) {
+        if ([type isEqualToString:@"get"] || [type isEqualToString:@"set"]) {
+            PXElement *query = element.numberOfElements > 0 ? [element elementAtIndex:0] : nil;
+            if ([query.namespace hasPrefix:XMPPStanzaPriorityPubSubNamespacePrefix]) {
+                return XMPPStanzaPriorityBulk;
+            }
+        }
+        return XMPPStanzaPriorityControl;
+
+    } else if ([element.name isEqualToString:@"message"]) {
+        if ([type isEqualToString:@"error"]) {
+            return XMPPStanzaPriorityControl;
+        } else if ([type isEqualToString:@"chat"] || [type isEqualToString:@"groupchat"]) {
+            return XMPPStanzaPriorityInteractive;
+        }
+        for (NSUInteger index = 0; index < element.numberOfElements; index++) {
+            PXElement *payload = [element elementAtIndex:index];
+            if ([payload.name isEqualToString:@"body"] && [payload.namespace isEqualToString:XMPPStanzaPriorityClientNamespace]) {
+                return XMPPStanzaPriorityInteractive;
+            }
+        }
+        return XMPPStanzaPriorityBulk;
+
+    } else if ([element.name isEqualToString:@"presence"]) {
+        if ([element valueForAttribute:@"to"] != nil) {
+            return XMPPStanzaPriorityInteractive;
+        }
+        return XMPPStanzaPriorityBulk;
+    }
+
+    return XMPPStanzaPriorityControl;
+}
+
+NSString *XMPPStanzaOrderingKeyOfElement(PXElement *element)
+{
+    if (![element.namespace isEqualToString:XMPPStanzaPriorityClientNamespace]) {
+        return nil;
+    }
+
+    NSString *to = [element valueForAttribute:@"to"];
+    if (to == nil) {
+        return @"";
+    }
+
+    // The bare JID is derived without parsing the JID. Only the case of
+    // the address is normalized.
+    NSRange range = [to rangeOfString:@"/"];
+    if (range.location != NSNotFound) {
+        to = [to substringToIndex:range.location];
+    }
+    return [to lowercaseString];
+}
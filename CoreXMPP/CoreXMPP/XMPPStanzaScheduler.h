@@ -0,0 +1,87 @@
+//
+//  XMPPStanzaScheduler.h
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+
+@import Foundation;
+
+#import "XMPPStanzaPriority.h"
+
+// Queue of outbound objects (documents or pending submissions) with one
+// lane per priority. The lanes are served by weighted round-robin: in each
+// round, a lane is served at most as often as its weight (defaults are 8,
+// 4 and 1 for control, interactive and bulk), the lanes with higher
+// priority first. If the head of a lane waited longer than the maximum
+// delay, it is served next, regardless of the weights (starvation
+// protection). The objects of one lane are dequeued in order.
+//
+// Objects with the same ordering key (e.g., stanzas to the same recipient)
+// are dequeued in order. An object is enqueued in the lane of the last
+// queued object with the same key, as long as there is one. Therefore its
+// priority only applies, if no other object with its key is queued.
+//
+// The scheduler is not thread-safe. Only the count can be read from any
+// thread (e.g., for statistics).
+
+@interface XMPPStanzaScheduler : NSObject
+
+- (nonnull instancetype)init;
+- (nonnull instancetype)initWithWeights:(nonnull NSArray<NSNumber *> *)weights
+                           maximumDelay:(NSTimeInterval)maximumDelay NS_DESIGNATED_INITIALIZER;
+
+@property (nonatomic, readonly) NSTimeInterval maximumDelay;
+- (NSUInteger)weightForPriority:(XMPPStanzaPriority)priority;
+
+@property (nonatomic, readonly) NSUInteger count;
+- (NSUInteger)countForPriority:(XMPPStanzaPriority)priority;
+
+// Objects without an ordering key are only ordered within their lane.
+- (void)enqueueObject:(nonnull id)object withPriority:(XMPPStanzaPriority)priority;
+- (void)enqueueObject:(nonnull id)object withPriority:(XMPPStanzaPriority)priority orderingKey:(nullable NSString *)orderingKey;
+
+// Returns nil, if the scheduler is empty.
+- (nullable id)dequeueObject;
+
+- (void)removeObject:(nonnull id)object;
+
+// Removes a queued object lazily: it is no longer counted and it is
+// skipped, when it reaches the head of its lane. In contrast to
+// -removeObject:, the lanes are not searched.
+- (void)discardObject:(nonnull id)object;
+
+// Returns the removed objects (ordered by priority), without the
+// discarded ones.
+- (nonnull NSArray *)removeAllObjects;
+
+@end
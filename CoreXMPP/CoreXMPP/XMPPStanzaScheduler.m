@@ -0,0 +1,288 @@
+//
+//  XMPPStanzaScheduler.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+
+#import <stdatomic.h>
+
+#import "XMPPStanzaScheduler.h"
+
+static const NSTimeInterval XMPPStanzaSchedulerDefaultMaximumDelay = 1.0;
+
+@interface XMPPStanzaSchedulerEntry : NSObject {
+  @public
+    id _object;
+    NSString *_orderingKey;
+    NSTimeInterval _enqueued;
+}
+@end
+
+// Lane and number of the queued objects with the same ordering key.
+@interface XMPPStanzaSchedulerOrdering : NSObject {
+  @public
+    NSUInteger _lane;
+    NSUInteger _count;
+}
+@end
+
+@interface XMPPStanzaScheduler () {
+    NSMutableArray<XMPPStanzaSchedulerEntry *> *_lanes[XMPP_STANZA_NUMBER_OF_PRIORITIES];
+    NSUInteger _weights[XMPP_STANZA_NUMBER_OF_PRIORITIES];
+    NSUInteger _credits[XMPP_STANZA_NUMBER_OF_PRIORITIES];
+    NSMutableDictionary<NSString *, XMPPStanzaSchedulerOrdering *> *_orderings;
+    NSHashTable *_discardedObjects;
+    _Atomic(NSUInteger) _count;
+}
+
+@end
+
+@implementation XMPPStanzaScheduler
+
+#pragma mark Life-cycle
+
+- (instancetype)init
+{
+    return [self initWithWeights:@[ @8, @4, @1 ] maximumDelay:XMPPStanzaSchedulerDefaultMaximumDelay];
+}
+
+- (instancetype)initWithWeights:(NSArray<NSNumber *> *)weights maximumDelay:(NSTimeInterval)maximumDelay
+{
+    self = [super init];
+    if (self) {
+        for (NSUInteger priority = 0; priority < XMPP_STANZA_NUMBER_OF_PRIORITIES; priority++) {
+            _lanes[priority] = [[NSMutableArray alloc] init];
+            // Each lane is served at least once per round.
+            _weights[priority] = priority < [weights count] ? MAX([weights[priority] unsignedIntegerValue], 1) : 1;
+            _credits[priority] = _weights[priority];
+        }
+        _orderings = [[NSMutableDictionary alloc] init];
+        _discardedObjects = [[NSHashTable alloc] initWithOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality
+                                                        capacity:0];
+        _maximumDelay = maximumDelay;
+    }
+    return self;
+}
+
+#pragma mark Properties
+
+- (NSUInteger)weightForPriority:(XMPPStanzaPriority)priority
+{
+    return priority < XMPP_STANZA_NUMBER_OF_PRIORITIES ? _weights[priority] : 0;
+}
+
+- (NSUInteger)count
+{
+    return atomic_load_explicit(&_count, memory_order_relaxed);
+}
+
+- (NSUInteger)countForPriority:(XMPPStanzaPriority)priority
+{
+    return priority < XMPP_STANZA_NUMBER_OF_PRIORITIES ? [_lanes[priority] count] : 0;
+}
+
+#pragma mark Scheduling
+
+- (void)enqueueObject:(id)object withPriority:(XMPPStanzaPriority)priority
+{
+    [self enqueueObject:object withPriority:priority orderingKey:nil];
+}
+
+- (void)enqueueObject:(id)object withPriority:(XMPPStanzaPriority)priority orderingKey:(NSString *)orderingKey
+{
+    NSUInteger lane = MIN(priority, XMPP_STANZA_NUMBER_OF_PRIORITIES - 1);
+
+    if (orderingKey) {
+        XMPPStanzaSchedulerOrdering *ordering = _orderings[orderingKey];
+        if (ordering) {
+            // Follows the queued objects with the same key.
+            lane = ordering->_lane;
+        } else {
+            ordering = [[XMPPStanzaSchedulerOrdering alloc] init];
+            ordering->_lane = lane;
+            _orderings[orderingKey] = ordering;
+        }
+        ordering->_count += 1;
+    }
+
+    XMPPStanzaSchedulerEntry *entry = [[XMPPStanzaSchedulerEntry alloc] init];
+    entry->_object = object;
+    entry->_orderingKey = orderingKey;
+    entry->_enqueued = [self xmpp_now];
+    [_lanes[lane] addObject:entry];
+    atomic_fetch_add_explicit(&_count, 1, memory_order_relaxed);
+}
+
+- (id)dequeueObject
+{
+    while (self.count > 0) {
+        id object = [self xmpp_dequeueNextObject];
+        if (object) {
+            return object;
+        }
+    }
+    return nil;
+}
+
+- (void)removeObject:(id)object
+{
+    // The object may have been enqueued in the lane of another object with
+    // the same ordering key. Therefore all lanes are searched.
+    for (NSUInteger priority = 0; priority < XMPP_STANZA_NUMBER_OF_PRIORITIES; priority++) {
+        NSMutableArray<XMPPStanzaSchedulerEntry *> *lane = _lanes[priority];
+        NSUInteger index = [lane indexOfObjectPassingTest:^BOOL(XMPPStanzaSchedulerEntry *entry, NSUInteger idx, BOOL *stop) {
+            return entry->_object == object;
+        }];
+        if (index != NSNotFound) {
+            [self xmpp_releaseOrderingOfEntry:lane[index]];
+            [lane removeObjectAtIndex:index];
+            if ([_discardedObjects containsObject:object]) {
+                [_discardedObjects removeObject:object];
+            } else {
+                atomic_fetch_sub_explicit(&_count, 1, memory_order_relaxed);
+            }
+            return;
+        }
+    }
+}
+
+- (void)discardObject:(id)object
+{
+    if ([_discardedObjects containsObject:object]) {
+        return;
+    }
+    [_discardedObjects addObject:object];
+    if (atomic_fetch_sub_explicit(&_count, 1, memory_order_relaxed) == 1) {
+        // Only discarded objects are left.
+        [self removeAllObjects];
+    }
+}
+
+- (NSArray *)removeAllObjects
+{
+    NSMutableArray *objects = [[NSMutableArray alloc] initWithCapacity:self.count];
+    for (NSUInteger priority = 0; priority < XMPP_STANZA_NUMBER_OF_PRIORITIES; priority++) {
+        for (XMPPStanzaSchedulerEntry *entry in _lanes[priority]) {
+            if (![_discardedObjects containsObject:entry->_object]) {
+                [objects addObject:entry->_object];
+            }
+        }
+        [_lanes[priority] removeAllObjects];
+        _credits[priority] = _weights[priority];
+    }
+    [_orderings removeAllObjects];
+    [_discardedObjects removeAllObjects];
+    atomic_store_explicit(&_count, 0, memory_order_relaxed);
+    return objects;
+}
+
+#pragma mark -
+
+- (id)xmpp_dequeueNextObject
+{
+    // Starvation protection: the head which waited longest beyond the
+    // maximum delay is served first.
+    NSTimeInterval now = [self xmpp_now];
+    NSTimeInterval longestDelay = _maximumDelay;
+    NSInteger starving = -1;
+    for (NSUInteger priority = 0; priority < XMPP_STANZA_NUMBER_OF_PRIORITIES; priority++) {
+        XMPPStanzaSchedulerEntry *head = [_lanes[priority] firstObject];
+        if (head && now - head->_enqueued > longestDelay) {
+            longestDelay = now - head->_enqueued;
+            starving = priority;
+        }
+    }
+    if (starving >= 0) {
+        if (_credits[starving] > 0) {
+            _credits[starving] -= 1;
+        }
+        return [self xmpp_dequeueObjectFromLane:starving];
+    }
+
+    while (YES) {
+        for (NSUInteger priority = 0; priority < XMPP_STANZA_NUMBER_OF_PRIORITIES; priority++) {
+            if (_credits[priority] > 0 && [_lanes[priority] count] > 0) {
+                _credits[priority] -= 1;
+                return [self xmpp_dequeueObjectFromLane:priority];
+            }
+        }
+        // All lanes with pending objects used their credits. Start the
+        // next round.
+        for (NSUInteger priority = 0; priority < XMPP_STANZA_NUMBER_OF_PRIORITIES; priority++) {
+            _credits[priority] = _weights[priority];
+        }
+    }
+}
+
+- (id)xmpp_dequeueObjectFromLane:(NSUInteger)priority
+{
+    // Returns nil, if the object has been discarded.
+    XMPPStanzaSchedulerEntry *entry = [_lanes[priority] firstObject];
+    [_lanes[priority] removeObjectAtIndex:0];
+    [self xmpp_releaseOrderingOfEntry:entry];
+    if ([_discardedObjects containsObject:entry->_object]) {
+        [_discardedObjects removeObject:entry->_object];
+        return nil;
+    }
+    if (atomic_fetch_sub_explicit(&_count, 1, memory_order_relaxed) == 1 && [_discardedObjects count] > 0) {
+        // Only discarded objects are left.
+        id object = entry->_object;
+        [self removeAllObjects];
+        return object;
+    }
+    return entry->_object;
+}
+
+- (void)xmpp_releaseOrderingOfEntry:(XMPPStanzaSchedulerEntry *)entry
+{
+    if (entry->_orderingKey == nil) {
+        return;
+    }
+    XMPPStanzaSchedulerOrdering *ordering = _orderings[entry->_orderingKey];
+    if (ordering && --ordering->_count == 0) {
+        [_orderings removeObjectForKey:entry->_orderingKey];
+    }
+}
+
+- (NSTimeInterval)xmpp_now
+{
+    return [[NSProcessInfo processInfo] systemUptime];
+}
+
+@end
+
+@implementation XMPPStanzaSchedulerEntry
+@end
+
+@implementation XMPPStanzaSchedulerOrdering
+@end
@@ -37,6 +37,26 @@
 #import <PureXML/PureXML.h>
 
 @class XMPPStream;
+@class XMPPStreamRecorder;
+
+// Water marks of the outbound queue of a stream (NSNumber). The stream
+// becomes unwritable, if more bytes or stanzas than the high-water mark
+// are pending, and writable again, if the pending bytes and stanzas
+// dropped below the low-water marks. Defaults are 1 MiB / 256 KiB and
+// 1000 / 250 stanzas.
+extern NSString *_Nonnull const XMPPStreamOutboundHighWaterMarkBytesKey NS_SWIFT_NAME(StreamOutboundHighWaterMarkBytesKey);
+extern NSString *_Nonnull const XMPPStreamOutboundLowWaterMarkBytesKey NS_SWIFT_NAME(StreamOutboundLowWaterMarkBytesKey);
+extern NSString *_Nonnull const XMPPStreamOutboundHighWaterMarkStanzasKey NS_SWIFT_NAME(StreamOutboundHighWaterMarkStanzasKey);
+extern NSString *_Nonnull const XMPPStreamOutboundLowWaterMarkStanzasKey NS_SWIFT_NAME(StreamOutboundLowWaterMarkStanzasKey);
+
+// Keepalive of streams with ping/pong semantics (NSNumber). The interval
+// (seconds) starts at XMPPStreamKeepAliveIntervalKey and adapts between the
+// minimum and maximum interval. The peer is considered dead after the given
+// number of consecutive missed pongs. Defaults are 20s (10s - 120s) and 2.
+extern NSString *_Nonnull const XMPPStreamKeepAliveIntervalKey NS_SWIFT_NAME(StreamKeepAliveIntervalKey);
+extern NSString *_Nonnull const XMPPStreamKeepAliveMinimumIntervalKey NS_SWIFT_NAME(StreamKeepAliveMinimumIntervalKey);
+extern NSString *_Nonnull const XMPPStreamKeepAliveMaximumIntervalKey NS_SWIFT_NAME(StreamKeepAliveMaximumIntervalKey);
+extern NSString *_Nonnull const XMPPStreamKeepAliveMaximumMissedPongsKey NS_SWIFT_NAME(StreamKeepAliveMaximumMissedPongsKey);
 
 typedef NS_ENUM(NSUInteger, XMPPStreamState) {
     XMPPStreamStateClosed = 0,
@@ -55,6 +75,13 @@ NS_SWIFT_NAME(StreamDelegate)
 - (void)stream:(nonnull XMPPStream *)stream didReceiveDocument:(nonnull PXDocument *)document NS_SWIFT_NAME(stream(_:didReceive:));
 - (void)stream:(nonnull XMPPStream *)stream didFailWithError:(nonnull NSError *)error NS_SWIFT_NAME(stream(_:didFail:));
 - (void)streamDidClose:(nonnull XMPPStream *)stream NS_SWIFT_NAME(streamDidClose(_:));
+
+// Stream management (XEP-0198) requests and answers. If the delegate does
+// not implement these methods, the elements are passed as documents.
+- (void)streamDidReceiveAcknowledgementRequest:(nonnull XMPPStream *)stream NS_SWIFT_NAME(streamDidReceiveAcknowledgementRequest(_:));
+- (void)stream:(nonnull XMPPStream *)stream didReceiveAcknowledgement:(NSUInteger)numberOfAcknowledgedDocuments NS_SWIFT_NAME(stream(_:didReceiveAcknowledgement:));
+
+- (void)stream:(nonnull XMPPStream *)stream didChangeWritable:(BOOL)writable NS_SWIFT_NAME(stream(_:didChangeWritable:));
 @end
 
 NS_SWIFT_NAME(Stream)
@@ -82,6 +109,32 @@ NS_SWIFT_NAME(Stream)
 #pragma mark State
 @property (nonatomic, readonly) XMPPStreamState state;
 
+// NO, if the outbound queue exceeded one of the high-water marks. Documents
+// can still be sent, but producers should pause until the stream becomes
+// writable again (see -stream:didChangeWritable:).
+@property (nonatomic, readonly, getter=isWritable) BOOL writable;
+
+// If set, the stream stops reading inbound data, until reading is resumed.
+// Used to push back on the host, if the received documents can not be
+// handled fast enough. TCP streams stop reading from the socket and BOSH
+// streams stop polling the connection manager. Websocket streams continue
+// to deliver the received documents.
+@property (nonatomic, readwrite, getter=isReadingPaused) BOOL readingPaused;
+
+#pragma mark Round-trip Time
+
+// Round-trip time of the last keepalive ping and the smoothed estimate
+// and its variation (RFC 6298). Zero, if not measured (yet).
+@property (nonatomic, readonly) NSTimeInterval roundTripTime;
+@property (nonatomic, readonly) NSTimeInterval smoothedRoundTripTime;
+@property (nonatomic, readonly) NSTimeInterval roundTripTimeVariation;
+
+#pragma mark Recording
+
+// If set, the raw frames (or bytes) the stream receives and sends are
+// recorded. A recorder must not be shared by multiple streams.
+@property (nonatomic, strong) XMPPStreamRecorder *_Nullable recorder;
+
 #pragma mark Managing Stream
 - (void)open;
 - (void)reopen;
@@ -91,4 +144,19 @@ NS_SWIFT_NAME(Stream)
 #pragma mark Sending Document
 - (void)sendDocument:(nonnull PXDocument *)document NS_SWIFT_NAME(send(_:));
 
+// Sends the documents in order. TCP streams write the documents as one
+// contiguous buffer and BOSH streams add them to the same request. The
+// default implementation sends the documents one by one.
+- (void)sendDocuments:(nonnull NSArray<PXDocument *> *)documents NS_SWIFT_NAME(send(_:));
+
+#pragma mark Compression
+
+// Stream compression methods (XEP-0138) the stream can apply. Empty, if the
+// transport does not support stream level compression.
+@property (nonatomic, readonly) NSArray<NSString *> *_Nonnull compressionMethods;
+
+// Compresses all bytes after the (already negotiated) method has been
+// accepted by the host. Must be called before the stream is reopened.
+- (void)startCompressionWithMethod:(nonnull NSString *)method NS_SWIFT_NAME(startCompression(method:));
+
 @end
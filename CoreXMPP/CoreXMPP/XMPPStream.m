@@ -35,6 +35,15 @@
 
 #import "XMPPStream.h"
 
+NSString *const XMPPStreamOutboundHighWaterMarkBytesKey = @"XMPPStreamOutboundHighWaterMarkBytesKey";
+NSString *const XMPPStreamOutboundLowWaterMarkBytesKey = @"XMPPStreamOutboundLowWaterMarkBytesKey";
+NSString *const XMPPStreamOutboundHighWaterMarkStanzasKey = @"XMPPStreamOutboundHighWaterMarkStanzasKey";
+NSString *const XMPPStreamOutboundLowWaterMarkStanzasKey = @"XMPPStreamOutboundLowWaterMarkStanzasKey";
+NSString *const XMPPStreamKeepAliveIntervalKey = @"XMPPStreamKeepAliveIntervalKey";
+NSString *const XMPPStreamKeepAliveMinimumIntervalKey = @"XMPPStreamKeepAliveMinimumIntervalKey";
+NSString *const XMPPStreamKeepAliveMaximumIntervalKey = @"XMPPStreamKeepAliveMaximumIntervalKey";
+NSString *const XMPPStreamKeepAliveMaximumMissedPongsKey = @"XMPPStreamKeepAliveMaximumMissedPongsKey";
+
 @implementation XMPPStream
 
 #pragma mark Life-cycle
@@ -57,6 +66,28 @@
     return XMPPStreamStateClosed;
 }
 
+- (BOOL)isWritable
+{
+    return YES;
+}
+
+#pragma mark Round-trip Time
+
+- (NSTimeInterval)roundTripTime
+{
+    return 0;
+}
+
+- (NSTimeInterval)smoothedRoundTripTime
+{
+    return 0;
+}
+
+- (NSTimeInterval)roundTripTimeVariation
+{
+    return 0;
+}
+
 #pragma mark Managing Stream
 
 - (void)open
@@ -79,4 +110,22 @@
 {
 }
 
+- (void)sendDocuments:(NSArray<PXDocument *> *)documents
+{
+    for (PXDocument *document in documents) {
+        [self sendDocument:document];
+    }
+}
+
+#pragma mark Compression
+
+- (NSArray<NSString *> *)compressionMethods
+{
+    return @[];
+}
+
+- (void)startCompressionWithMethod:(NSString *)method
+{
+}
+
 @end
@@ -0,0 +1,56 @@
+//
+//  XMPPStreamCompression.h
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import <Foundation/Foundation.h>
+
+// Stateful compression of a byte stream (XEP-0138). The compression and
+// decompression contexts are kept for the lifetime of the object, so that
+// the dictionary is shared across stanzas. Each call to -compressData:
+// ends with a sync flush, so the peer can decode every stanza immediately.
+
+@interface XMPPStreamCompression : NSObject
+
++ (nonnull NSArray<NSString *> *)supportedMethods;
+
+- (nullable instancetype)initWithMethod:(nonnull NSString *)method;
+
+@property (nonatomic, readonly) NSString *_Nonnull method;
+
+- (nullable NSData *)compressData:(nonnull NSData *)data;
+- (nullable NSData *)decompressBytes:(nonnull const void *)bytes
+                              length:(NSUInteger)length
+                               error:(NSError *__autoreleasing __nullable *__nullable)error;
+
+@end
@@ -0,0 +1,154 @@
+//
+//  XMPPStreamCompression.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import <zlib.h>
+
+#import "XMPPError.h"
+#import "XMPPStreamCompression.h"
+
+static const NSUInteger XMPPStreamCompressionChunkSize = 16 * 1024;
+
+@interface XMPPStreamCompression () {
+    z_stream _deflateStream;
+    z_stream _inflateStream;
+    NSMutableData *_buffer;
+}
+
+@end
+
+@implementation XMPPStreamCompression
+
++ (NSArray<NSString *> *)supportedMethods
+{
+    return @[ @"zlib" ];
+}
+
+#pragma mark Life-cycle
+
+- (instancetype)initWithMethod:(NSString *)method
+{
+    if (![[[self class] supportedMethods] containsObject:method]) {
+        return nil;
+    }
+
+    self = [super init];
+    if (self) {
+        _method = [method copy];
+
+        memset(&_deflateStream, 0, sizeof(z_stream));
+        memset(&_inflateStream, 0, sizeof(z_stream));
+
+        if (deflateInit(&_deflateStream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+            return nil;
+        }
+
+        if (inflateInit(&_inflateStream) != Z_OK) {
+            deflateEnd(&_deflateStream);
+            return nil;
+        }
+
+        _buffer = [[NSMutableData alloc] initWithLength:XMPPStreamCompressionChunkSize];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    deflateEnd(&_deflateStream);
+    inflateEnd(&_inflateStream);
+}
+
+#pragma mark Compression
+
+- (NSData *)compressData:(NSData *)data
+{
+    NSMutableData *result = [[NSMutableData alloc] initWithCapacity:[data length] / 2 + 16];
+
+    _deflateStream.next_in = (Bytef *)[data bytes];
+    _deflateStream.avail_in = (uInt)[data length];
+
+    do {
+        _deflateStream.next_out = [_buffer mutableBytes];
+        _deflateStream.avail_out = (uInt)[_buffer length];
+
+        int status = deflate(&_deflateStream, Z_SYNC_FLUSH);
+        if (status != Z_OK && status != Z_BUF_ERROR) {
+            return nil;
+        }
+
+        [result appendBytes:[_buffer bytes] length:[_buffer length] - _deflateStream.avail_out];
+
+    } while (_deflateStream.avail_out == 0);
+
+    return result;
+}
+
+- (NSData *)decompressBytes:(const void *)bytes length:(NSUInteger)length error:(NSError **)error
+{
+    NSMutableData *result = [[NSMutableData alloc] initWithCapacity:length * 4];
+
+    _inflateStream.next_in = (Bytef *)bytes;
+    _inflateStream.avail_in = (uInt)length;
+
+    do {
+        _inflateStream.next_out = [_buffer mutableBytes];
+        _inflateStream.avail_out = (uInt)[_buffer length];
+
+        int status = inflate(&_inflateStream, Z_SYNC_FLUSH);
+        if (status != Z_OK && status != Z_BUF_ERROR && status != Z_STREAM_END) {
+            if (error) {
+                NSString *errorMessage = [NSString stringWithFormat:@"Failed to decompress stream: %s", _inflateStream.msg ?: "unknown error"];
+                *error = [NSError errorWithDomain:XMPPErrorDomain
+                                             code:XMPPErrorCodeParseError
+                                         userInfo:@{NSLocalizedDescriptionKey : errorMessage}];
+            }
+            return nil;
+        }
+
+        NSUInteger produced = [_buffer length] - _inflateStream.avail_out;
+        [result appendBytes:[_buffer bytes] length:produced];
+
+        if (status == Z_STREAM_END || (status == Z_BUF_ERROR && produced == 0)) {
+            break;
+        }
+
+        // Continue while there is input left or the output buffer has been
+        // filled completely (zlib may hold back more output).
+    } while (_inflateStream.avail_in > 0 || _inflateStream.avail_out == 0);
+
+    return result;
+}
+
+@end
@@ -39,9 +39,10 @@
 #import "XMPPStreamFeature.h"
 #import "XMPPDispatcherImpl.h"
 #import "XMPPError.h"
+#import "XMPPIQCorrelationTable.h"
 
 @interface XMPPStreamFeature () {
-    NSMapTable *_responseHandlers;
+    XMPPIQCorrelationTable *_pendingRequests;
 }
 
 @end
@@ -104,7 +105,7 @@
     self = [super init];
     if (self) {
         _configuration = configuration;
-        _responseHandlers = [NSMapTable strongToStrongObjectsMapTable];
+        _pendingRequests = [[XMPPIQCorrelationTable alloc] init];
     }
     return self;
 }
@@ -138,15 +139,14 @@
             stanza.type == XMPPIQStanzaTypeError) {
             NSString *requestID = stanza.identifier;
             if (requestID) {
-                void (^completion)(PXDocument *response, NSError *error) = [_responseHandlers objectForKey:requestID];
+                XMPPIQCorrelationCompletion completion = [_pendingRequests removeRequestForResponseWithID:requestID
+                                                                                                     from:[stanza valueForAttribute:@"from"]];
                 if (completion) {
-                    [_responseHandlers removeObjectForKey:requestID];
-
                     if (stanza.type == XMPPIQStanzaTypeError) {
                         NSError *error = stanza.error;
                         completion(nil, error);
                     } else {
-                        completion(document, nil);
+                        completion(stanza, nil);
                     }
                 }
             }
@@ -166,19 +166,26 @@
 
         NSString *requestId = [document.root valueForAttribute:@"id"];
         if (requestId == nil) {
-            requestId = [[NSUUID UUID] UUIDString];
+            requestId = [_pendingRequests nextRequestID];
             [document.root setValue:requestId forAttribute:@"id"];
         }
 
+        id pendingRequest = nil;
         if (completion) {
-            [_responseHandlers setObject:completion forKey:requestId];
+            // Requests of stream features are answered by the server.
+            // Therefore the sender of the response is not checked.
+            pendingRequest = [_pendingRequests addRequestWithID:requestId
+                                                             to:nil
+                                           acceptsMissingSender:YES
+                                                     completion:^(XMPPIQStanza *response, NSError *error) {
+                                                         completion(response ? [[PXDocument alloc] initWithElement:response] : nil, error);
+                                                     }];
         }
 
         NSTimeInterval defaultTimeout = 60.0;
         dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)((timeout ?: defaultTimeout) * NSEC_PER_SEC)), self.queue ?: dispatch_get_main_queue(), ^{
-            void (^completion)(PXElement *response, NSError *error) = [_responseHandlers objectForKey:requestId];
+            XMPPIQCorrelationCompletion completion = [_pendingRequests removeRequest:pendingRequest];
             if (completion) {
-                [_responseHandlers removeObjectForKey:requestId];
                 NSError *error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
                                                      code:XMPPDispatcherErrorCodeTimeout
                                                  userInfo:nil];
@@ -34,6 +34,8 @@
 //
 
 #import "XMPPError.h"
+#import "XMPPIQCorrelationTable.h"
+#import "XMPPLogger.h"
 
 #import "XMPPStreamFeatureBind.h"
 
@@ -105,7 +107,7 @@ NSString *const XMPPStreamFeatureBindNamespace = @"urn:ietf:params:xml:ns:xmpp-b
         }
     }
 
-    _requestId = [[NSUUID UUID] UUIDString];
+    _requestId = [XMPPIQCorrelationTable uniqueRequestID];
 
     PXDocument *request = [[PXDocument alloc] initWithElementName:@"iq" namespace:@"jabber:client" prefix:nil];
 
@@ -118,7 +120,7 @@ NSString *const XMPPStreamFeatureBindNamespace = @"urn:ietf:params:xml:ns:xmpp-b
         [bind addElementWithName:@"resource" namespace:XMPPStreamFeatureBindNamespace content:preferredResourceName];
     }
 
-    NSLog(@"Requesting '%@' to bind the client to the resource: %@", _hostname, preferredResourceName);
+    XMPPLogDebug(XMPPLogCategoryClient, @"Requesting '%@' to bind the client to the resource: %@", _hostname, preferredResourceName);
 
     [self.delegate streamFeature:self handleDocument:request];
 }
@@ -161,7 +163,7 @@ NSString *const XMPPStreamFeatureBindNamespace = @"urn:ietf:params:xml:ns:xmpp-b
 
         if (JID) {
 
-            NSLog(@"Did bind to '%@'.", [JID stringValue]);
+            XMPPLogInfo(XMPPLogCategoryClient, @"Did bind to '%@'.", [JID stringValue]);
 
             if ([self.delegate conformsToProtocol:@protocol(XMPPStreamFeatureDelegateBind)]) {
                 id<XMPPStreamFeatureDelegateBind> delegate = (id<XMPPStreamFeatureDelegateBind>)self.delegate;
@@ -172,7 +174,7 @@ NSString *const XMPPStreamFeatureBindNamespace = @"urn:ietf:params:xml:ns:xmpp-b
             [self.delegate streamFeatureDidSucceedNegotiation:self];
         } else {
 
-            NSLog(@"Missing JID in response: %@", iq);
+            XMPPLogError(XMPPLogCategoryClient, @"Missing JID in response: %@", iq);
 
             NSError *error = [NSError errorWithDomain:XMPPStanzaErrorDomain
                                                  code:XMPPStanzaErrorCodeUndefinedCondition
@@ -192,7 +194,7 @@ NSString *const XMPPStreamFeatureBindNamespace = @"urn:ietf:params:xml:ns:xmpp-b
         NSString *responseId = iq.identifier;
         if (responseId && [responseId isEqualToString:_requestId]) {
             NSError *error = iq.error;
-            NSLog(@"Host '%@' did reject to bind to resource with error: %@", _hostname, [error localizedDescription]);
+            XMPPLogError(XMPPLogCategoryClient, @"Host '%@' did reject to bind to resource with error: %@", _hostname, [error localizedDescription]);
             [self.delegate streamFeature:self didFailNegotiationWithError:error];
             _requestId = nil;
         }
@@ -0,0 +1,188 @@
+//
+//  XMPPStreamFeatureCompression.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPError.h"
+#import "XMPPLogger.h"
+#import "XMPPStreamFeatureCompression.h"
+
+NSString *const XMPPStreamFeatureCompressionNamespace = @"http://jabber.org/features/compress";
+NSString *const XMPPStreamFeatureCompressionProtocolNamespace = @"http://jabber.org/protocol/compress";
+
+@interface XMPPStreamFeatureCompression () {
+    NSString *_method;
+    NSString *_hostname;
+}
+
+@end
+
+@implementation XMPPStreamFeatureCompression
+
++ (void)load
+{
+    PXQName *QName = [[PXQName alloc] initWithName:[XMPPStreamFeatureCompression name] namespace:[XMPPStreamFeatureCompression namespace]];
+    [self registerStreamFeatureClass:[XMPPStreamFeatureCompression class] forStreamFeatureQName:QName];
+}
+
+#pragma mark Feature Name & Namespace
+
++ (NSString *)name
+{
+    return @"compression";
+}
+
++ (NSString *)namespace
+{
+    return XMPPStreamFeatureCompressionNamespace;
+}
+
+#pragma mark Life-cycle
+
+- (id)initWithConfiguration:(PXDocument *)configuration
+{
+    self = [super initWithConfiguration:configuration];
+    if (self) {
+
+        NSMutableArray *methods = [[NSMutableArray alloc] init];
+
+        [configuration.root enumerateElementsUsingBlock:^(PXElement *element, BOOL *stop) {
+            if ([element.namespace isEqualToString:XMPPStreamFeatureCompressionNamespace] &&
+                [element.name isEqualToString:@"method"]) {
+                NSString *method = element.stringValue;
+                if (method) {
+                    [methods addObject:method];
+                }
+            }
+        }];
+
+        _methods = methods;
+    }
+    return self;
+}
+
+#pragma mark Feature Properties
+
+- (BOOL)isMandatory
+{
+    return NO;
+}
+
+- (BOOL)needsRestart
+{
+    return YES;
+}
+
+#pragma mark Negotiate Feature
+
+- (void)beginNegotiationWithHostname:(NSString *)hostname options:(NSDictionary *)options
+{
+    _hostname = hostname;
+    _method = nil;
+
+    NSArray *supportedMethods = @[];
+    if ([self.delegate respondsToSelector:@selector(compressionMethodsForStreamFeature:)]) {
+        id<XMPPStreamFeatureDelegateCompression> delegate = (id<XMPPStreamFeatureDelegateCompression>)self.delegate;
+        supportedMethods = [delegate compressionMethodsForStreamFeature:self];
+    }
+
+    for (NSString *method in supportedMethods) {
+        if ([self.methods containsObject:method]) {
+            _method = method;
+            break;
+        }
+    }
+
+    if (_method == nil) {
+        NSString *errorMessage = [NSString stringWithFormat:@"None of the compression methods offered by the host '%@' is supported: %@", hostname, self.methods];
+        NSError *error = [NSError errorWithDomain:XMPPErrorDomain
+                                             code:XMPPErrorCodeInvalidState
+                                         userInfo:@{NSLocalizedDescriptionKey : errorMessage}];
+        [self.delegate streamFeature:self didFailNegotiationWithError:error];
+        return;
+    }
+
+    XMPPLogDebug(XMPPLogCategoryClient, @"Requesting compression method '%@' for host '%@'.", _method, hostname);
+
+    PXDocument *request = [[PXDocument alloc] initWithElementName:@"compress"
+                                                        namespace:XMPPStreamFeatureCompressionProtocolNamespace
+                                                           prefix:nil];
+    [request.root addElementWithName:@"method"
+                           namespace:XMPPStreamFeatureCompressionProtocolNamespace
+                             content:_method];
+
+    [self.delegate streamFeature:self handleDocument:request];
+}
+
+#pragma mark Handle Document
+
+- (BOOL)handleDocument:(PXDocument *)document error:(NSError **)error
+{
+    PXElement *element = document.root;
+
+    if ([element.namespace isEqualToString:XMPPStreamFeatureCompressionProtocolNamespace]) {
+
+        if ([element.name isEqualToString:@"compressed"]) {
+
+            XMPPLogInfo(XMPPLogCategoryClient, @"Host '%@' did accept compression method '%@'.", _hostname, _method);
+
+            if ([self.delegate respondsToSelector:@selector(streamFeature:didNegotiateCompressionMethod:)]) {
+                id<XMPPStreamFeatureDelegateCompression> delegate = (id<XMPPStreamFeatureDelegateCompression>)self.delegate;
+                [delegate streamFeature:self didNegotiateCompressionMethod:_method];
+            }
+
+            [self.delegate streamFeatureDidSucceedNegotiation:self];
+
+        } else if ([element.name isEqualToString:@"failure"]) {
+
+            __block NSString *condition = nil;
+            [element enumerateElementsUsingBlock:^(PXElement *element, BOOL *stop) {
+                condition = element.name;
+                *stop = YES;
+            }];
+
+            NSString *errorMessage = [NSString stringWithFormat:@"Host '%@' did reject compression with condition: %@", _hostname, condition ?: @"undefined"];
+
+            XMPPLogError(XMPPLogCategoryClient, @"%@", errorMessage);
+
+            NSError *error = [NSError errorWithDomain:XMPPErrorDomain
+                                                 code:XMPPErrorCodeInvalidState
+                                             userInfo:@{NSLocalizedDescriptionKey : errorMessage}];
+            [self.delegate streamFeature:self didFailNegotiationWithError:error];
+        }
+    }
+
+    return YES;
+}
+
+@end
@@ -35,6 +35,7 @@
 
 #import "XMPPClient.h"
 #import "XMPPError.h"
+#import "XMPPLogger.h"
 #import "XMPPStreamFeatureSASL.h"
 
 NSString *const XMPPStreamFeatureSASLNamespace = @"urn:ietf:params:xml:ns:xmpp-sasl";
@@ -183,7 +184,7 @@ NSString *const XMPPStreamFeatureSASLNamespace = @"urn:ietf:params:xml:ns:xmpp-s
 
     if (_mechanism) {
 
-        NSLog(@"Begin SASL authentication exchange with host '%@' using mechanism '%@'.", _hostname, [[_mechanism class] name]);
+        XMPPLogDebug(XMPPLogCategorySASL, @"Begin SASL authentication exchange with host '%@' using mechanism '%@'.", _hostname, [[_mechanism class] name]);
 
         [_mechanism beginAuthenticationExchangeWithHostname:hostname
                                             responseHandler:^(NSData *initialResponse, BOOL abort) {
@@ -216,7 +217,7 @@ NSString *const XMPPStreamFeatureSASLNamespace = @"urn:ietf:params:xml:ns:xmpp-s
                                             }];
     } else {
 
-        NSLog(@"Delegate does not provide a SASL mechanism for the provided mechansims (%@).", [self.mechanisms componentsJoinedByString:@", "]);
+        XMPPLogError(XMPPLogCategorySASL, @"Delegate does not provide a SASL mechanism for the provided mechansims (%@).", [self.mechanisms componentsJoinedByString:@", "]);
 
         NSError *error = [NSError errorWithDomain:XMPPStreamFeatureSASLErrorDomain
                                              code:XMPPStreamFeatureSASLErrorCodeInvalidMechanism
@@ -237,7 +238,7 @@ NSString *const XMPPStreamFeatureSASLNamespace = @"urn:ietf:params:xml:ns:xmpp-s
 
         if ([stanza.name isEqualToString:@"success"]) {
 
-            NSLog(@"Did authenticated against host '%@'.", _hostname);
+            XMPPLogInfo(XMPPLogCategorySASL, @"Did authenticated against host '%@'.", _hostname);
 
             NSString *responseString = stanza.stringValue;
             NSData *responseData = [responseString length] > 0 ? [[NSData alloc] initWithBase64EncodedString:responseString options:0] : nil;
@@ -250,7 +251,7 @@ NSString *const XMPPStreamFeatureSASLNamespace = @"urn:ietf:params:xml:ns:xmpp-s
 
             NSError *error = [[self class] errorFromElement:stanza];
 
-            NSLog(@"Did fail to authenticated against host '%@' with error: %@", _hostname, [error localizedDescription]);
+            XMPPLogError(XMPPLogCategorySASL, @"Did fail to authenticated against host '%@' with error: %@", _hostname, [error localizedDescription]);
 
             [_mechanism failedWithError:error];
 
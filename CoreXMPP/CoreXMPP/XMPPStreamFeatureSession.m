@@ -33,6 +33,8 @@
 //  this library, you must extend this exception to your version of the library.
 //
 
+#import "XMPPIQCorrelationTable.h"
+#import "XMPPLogger.h"
 #import "XMPPStreamFeatureSession.h"
 
 NSString *const XMPPStreamFeatureSessionNamespace = @"urn:ietf:params:xml:ns:xmpp-session";
@@ -80,10 +82,10 @@ NSString *const XMPPStreamFeatureSessionNamespace = @"urn:ietf:params:xml:ns:xmp
 
 - (void)beginNegotiationWithHostname:(NSString *)hostname options:(NSDictionary *)options
 {
-    NSLog(@"Requesting new session for host '%@'.", hostname);
+    XMPPLogDebug(XMPPLogCategoryClient, @"Requesting new session for host '%@'.", hostname);
 
     _hostname = hostname;
-    _requestId = [[NSUUID UUID] UUIDString];
+    _requestId = [XMPPIQCorrelationTable uniqueRequestID];
 
     PXDocument *request = [[PXDocument alloc] initWithElementName:@"iq" namespace:@"jabber:client" prefix:nil];
 
@@ -122,7 +124,7 @@ NSString *const XMPPStreamFeatureSessionNamespace = @"urn:ietf:params:xml:ns:xmp
 
     if (responseId && [responseId isEqualToString:_requestId]) {
 
-        NSLog(@"Host '%@' did accept new session.", _hostname);
+        XMPPLogDebug(XMPPLogCategoryClient, @"Host '%@' did accept new session.", _hostname);
 
         [self.delegate streamFeatureDidSucceedNegotiation:self];
         _requestId = nil;
@@ -138,7 +140,7 @@ NSString *const XMPPStreamFeatureSessionNamespace = @"urn:ietf:params:xml:ns:xmp
     if (responseId && [responseId isEqualToString:_requestId]) {
         NSError *error = iq.error;
 
-        NSLog(@"Host '%@' did reject new session with error: %@", _hostname, [error localizedDescription]);
+        XMPPLogError(XMPPLogCategoryClient, @"Host '%@' did reject new session with error: %@", _hostname, [error localizedDescription]);
 
         [self.delegate streamFeature:self didFailNegotiationWithError:error];
         _requestId = nil;
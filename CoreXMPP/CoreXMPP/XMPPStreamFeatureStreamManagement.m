@@ -37,17 +37,12 @@
 
 #import "XMPPDispatcherImpl.h"
 #import "XMPPError.h"
+#import "XMPPLogger.h"
 #import "XMPPStreamFeatureStreamManagement.h"
+#import "XMPPUnacknowledgedDocumentQueue.h"
 
 NSString *const XMPPStreamFeatureStreamManagementNamespace = @"urn:xmpp:sm:3";
 
-@interface XMPPStreamFeatureStreamManagement_Stanza : NSObject
-@property (nonatomic, strong) PXDocument *document;
-@property (nonatomic, strong) void (^acknowledgement)(NSError *error);
-@end
-
-#pragma mark -
-
 @interface XMPPStreamFeatureStreamManagement () {
     BOOL _enabled;
     BOOL _resumable;
@@ -56,7 +51,7 @@ NSString *const XMPPStreamFeatureStreamManagementNamespace = @"urn:xmpp:sm:3";
     NSUInteger _numberOfReceivedDocuments;
     NSUInteger _numberOfSentDocuments;
     NSUInteger _numberOfAcknowledgedDocuments;
-    NSArray *_unacknowledgedDocuments;
+    XMPPUnacknowledgedDocumentQueue *_unacknowledgedDocuments;
 }
 @end
 
@@ -96,7 +91,7 @@ NSString *const XMPPStreamFeatureStreamManagementNamespace = @"urn:xmpp:sm:3";
 
 - (void)beginNegotiationWithHostname:(NSString *)hostname options:(NSDictionary *)options
 {
-    NSLog(@"Negotiating stream management for host '%@'.", hostname);
+    XMPPLogDebug(XMPPLogCategoryStreamManagement, @"Negotiating stream management for host '%@'.", hostname);
 
     if (_id && _resumable) {
         [self xmpp_resume];
@@ -114,33 +109,45 @@ NSString *const XMPPStreamFeatureStreamManagementNamespace = @"urn:xmpp:sm:3";
 @synthesize numberOfSentDocuments = _numberOfSentDocuments;
 @synthesize numberOfAcknowledgedDocuments = _numberOfAcknowledgedDocuments;
 
++ (NSSet *)keyPathsForValuesAffectingNumberOfUnacknowledgedDocuments
+{
+    return [NSSet setWithObject:@"unacknowledgedDocuments"];
+}
+
 - (NSArray *)unacknowledgedDocuments
 {
-    NSMutableArray *unacknowledgedDocuments = [[NSMutableArray alloc] init];
-    if (_unacknowledgedDocuments) {
-        for (XMPPStreamFeatureStreamManagement_Stanza *wrapper in _unacknowledgedDocuments) {
-            [unacknowledgedDocuments addObject:wrapper.document];
-        }
-    }
-    return unacknowledgedDocuments;
+    return [_unacknowledgedDocuments allDocuments] ?: @[];
+}
+
+- (NSUInteger)numberOfUnacknowledgedDocuments
+{
+    return [_unacknowledgedDocuments count];
+}
+
+- (void)enumerateUnacknowledgedDocumentsUsingBlock:(void (^)(PXDocument *document, BOOL *stop))block
+{
+    [_unacknowledgedDocuments enumerateDocumentsUsingBlock:^(PXDocument *document, NSUInteger index, BOOL *stop) {
+        block(document, stop);
+    }];
 }
 
 - (void)didSentDocument:(PXDocument *)document acknowledgement:(void (^)(NSError *error))acknowledgement;
+{
+    [self didSentDocument:document acknowledgement:acknowledgement requestAcknowledgement:YES];
+}
+
+- (void)didSentDocument:(PXDocument *)document acknowledgement:(void (^)(NSError *))acknowledgement requestAcknowledgement:(BOOL)requestAcknowledgement
 {
     [self willChangeValueForKey:@"numberOfSentDocuments"];
     [self willChangeValueForKey:@"unacknowledgedDocuments"];
 
-    XMPPStreamFeatureStreamManagement_Stanza *wrapper = [[XMPPStreamFeatureStreamManagement_Stanza alloc] init];
-    wrapper.document = document;
-    wrapper.acknowledgement = acknowledgement;
-
     _numberOfSentDocuments += 1;
-    _unacknowledgedDocuments = [_unacknowledgedDocuments arrayByAddingObject:wrapper];
+    [_unacknowledgedDocuments appendDocument:document acknowledgement:acknowledgement];
 
     [self didChangeValueForKey:@"unacknowledgedDocuments"];
     [self didChangeValueForKey:@"numberOfSentDocuments"];
 
-    if (wrapper.acknowledgement) {
+    if (acknowledgement && requestAcknowledgement) {
         [self requestAcknowledgement];
     }
 }
@@ -171,19 +178,19 @@ NSString *const XMPPStreamFeatureStreamManagementNamespace = @"urn:xmpp:sm:3";
     [self.delegate streamFeature:self handleDocument:response];
 }
 
+- (void)didReceiveAcknowledgement:(NSUInteger)numberOfAcknowledgedDocuments
+{
+    [self xmpp_updateWithNumberOfAcknowledgedStanzas:numberOfAcknowledgedDocuments];
+}
+
 - (void)cancelUnacknowledgedDocuments
 {
     if ([_unacknowledgedDocuments count] > 0) {
-        NSLog(@"Canceling (%ld) unacknowledged stanzas.", (unsigned long)[_unacknowledgedDocuments count]);
+        XMPPLogInfo(XMPPLogCategoryStreamManagement, @"Canceling (%ld) unacknowledged stanzas.", (unsigned long)[_unacknowledgedDocuments count]);
         NSError *error = [NSError errorWithDomain:XMPPDispatcherErrorDomain
                                              code:XMPPDispatcherErrorCodeNoRoute
                                          userInfo:nil];
-        for (XMPPStreamFeatureStreamManagement_Stanza *wrapper in _unacknowledgedDocuments) {
-            if (wrapper.acknowledgement) {
-                wrapper.acknowledgement(error);
-            }
-        }
-        _unacknowledgedDocuments = @[];
+        [_unacknowledgedDocuments cancelAllDocumentsWithError:error];
     }
 }
 
@@ -205,7 +212,7 @@ NSString *const XMPPStreamFeatureStreamManagementNamespace = @"urn:xmpp:sm:3";
             _numberOfSentDocuments = 0;
             _numberOfReceivedDocuments = 0;
             _numberOfAcknowledgedDocuments = 0;
-            _unacknowledgedDocuments = @[];
+            _unacknowledgedDocuments = [[XMPPUnacknowledgedDocumentQueue alloc] init];
 
             [self.delegate streamFeatureDidSucceedNegotiation:self];
 
@@ -294,7 +301,7 @@ NSString *const XMPPStreamFeatureStreamManagementNamespace = @"urn:xmpp:sm:3";
     if (_numberOfAcknowledgedDocuments > numberOfAcknowledgedStanzas ||
         _numberOfSentDocuments < numberOfAcknowledgedStanzas) {
 
-        NSLog(@"Received invalid ack (%ld). Stream has sent (%ld) stanzas and (%ld) have already been acknowledged.",
+        XMPPLogWarning(XMPPLogCategoryStreamManagement, @"Received invalid ack (%ld). Stream has sent (%ld) stanzas and (%ld) have already been acknowledged.",
                   (unsigned long)numberOfAcknowledgedStanzas,
                   (unsigned long)_numberOfSentDocuments,
                   (unsigned long)_numberOfAcknowledgedDocuments);
@@ -303,17 +310,10 @@ NSString *const XMPPStreamFeatureStreamManagementNamespace = @"urn:xmpp:sm:3";
         NSUInteger diff = numberOfAcknowledgedStanzas - _numberOfAcknowledgedDocuments;
 
         if (diff > 0) {
-            NSArray *acknowledgedStanzas = [_unacknowledgedDocuments subarrayWithRange:NSMakeRange(0, diff)];
-            for (XMPPStreamFeatureStreamManagement_Stanza *wrapper in acknowledgedStanzas) {
-                if (wrapper.acknowledgement) {
-                    wrapper.acknowledgement(nil);
-                }
-            }
-
-            _unacknowledgedDocuments = [_unacknowledgedDocuments subarrayWithRange:NSMakeRange(diff, [_unacknowledgedDocuments count] - diff)];
             _numberOfAcknowledgedDocuments = numberOfAcknowledgedStanzas;
+            [_unacknowledgedDocuments acknowledgeDocuments:diff];
 
-            NSLog(@"Acknowledged (%ld) of (%ld) stanzas.", (unsigned long)_numberOfAcknowledgedDocuments, (unsigned long)_numberOfSentDocuments);
+            XMPPLogTrace(XMPPLogCategoryStreamManagement, @"Acknowledged (%ld) of (%ld) stanzas.", (unsigned long)_numberOfAcknowledgedDocuments, (unsigned long)_numberOfSentDocuments);
         }
     }
 }
@@ -321,16 +321,11 @@ NSString *const XMPPStreamFeatureStreamManagementNamespace = @"urn:xmpp:sm:3";
 - (void)xmpp_resendPendingStanzas
 {
     if ([_unacknowledgedDocuments count] > 0) {
-        NSLog(@"Resending (%ld) unacknowledged stanzas.", (unsigned long)[_unacknowledgedDocuments count]);
-        for (XMPPStreamFeatureStreamManagement_Stanza *wrapper in _unacknowledgedDocuments) {
-            [self.delegate streamFeature:self handleDocument:wrapper.document];
-        }
+        XMPPLogInfo(XMPPLogCategoryStreamManagement, @"Resending (%ld) unacknowledged stanzas.", (unsigned long)[_unacknowledgedDocuments count]);
+        [_unacknowledgedDocuments enumerateDocumentsUsingBlock:^(PXDocument *document, NSUInteger index, BOOL *stop) {
+            [self.delegate streamFeature:self handleDocument:document];
+        }];
     }
 }
 
 @end
-
-#pragma mark -
-
-@implementation XMPPStreamFeatureStreamManagement_Stanza
-@end
@@ -0,0 +1,91 @@
+//
+//  XMPPStreamKeepAlive.h
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import <Foundation/Foundation.h>
+
+// Adaptive keepalive of a stream with ping/pong semantics.
+//
+// The stream sends a ping with the payload returned by -pingPayloadAtTime:
+// whenever -delayAtTime: elapsed and passes the payload of each pong to
+// -handlePongWithPayload:atTime:. A ping, which is not answered within
+// `pongTimeout`, counts as missed and is retried. After `maximumNumberOfMissedPongs`
+// consecutive misses the peer is considered dead.
+//
+// The round-trip time is estimated as described in RFC 6298. The interval
+// starts with the configured value and is widened step by step as long as
+// the pongs arrive. If a pong is missed after an idle interval (e.g., because
+// a NAT binding timed out), the interval is narrowed by one step and not
+// widened beyond it anymore.
+//
+// Times are seconds of a monotonic clock (e.g., -[NSProcessInfo systemUptime]).
+
+@interface XMPPStreamKeepAlive : NSObject
+
+- (nonnull instancetype)initWithOptions:(nullable NSDictionary *)options;
+
+// Reads the configuration from the options (see XMPPStream.h).
+- (void)updateWithOptions:(nullable NSDictionary *)options;
+
+@property (nonatomic, readonly) NSTimeInterval minimumInterval;
+@property (nonatomic, readonly) NSTimeInterval maximumInterval;
+@property (nonatomic, readonly) NSUInteger maximumNumberOfMissedPongs;
+
+@property (nonatomic, readonly) NSTimeInterval interval;
+@property (nonatomic, readonly) NSTimeInterval pongTimeout;
+
+#pragma mark Round-trip Time
+@property (nonatomic, readonly) NSTimeInterval roundTripTime;
+@property (nonatomic, readonly) NSTimeInterval smoothedRoundTripTime;
+@property (nonatomic, readonly) NSTimeInterval roundTripTimeVariation;
+
+#pragma mark State
+@property (nonatomic, readonly) NSUInteger numberOfMissedPongs;
+@property (nonatomic, readonly, getter=isPeerDead) BOOL peerDead;
+
+// The time until the next ping has to be sent or the pending ping timed out.
+- (NSTimeInterval)delayAtTime:(NSTimeInterval)now;
+
+// Should be called if the delay elapsed. Returns the payload of the next
+// ping or nil, if the peer is dead or the delay has not elapsed yet.
+- (nullable NSData *)pingPayloadAtTime:(NSTimeInterval)now;
+
+// Returns NO, if the payload does not belong to a ping of the keepalive.
+- (BOOL)handlePongWithPayload:(nullable NSData *)payload atTime:(NSTimeInterval)now;
+
+// Resets the state of the current connection (pending ping, missed pongs),
+// but keeps the round-trip time estimate and the learned interval.
+- (void)resetAtTime:(NSTimeInterval)now;
+
+@end
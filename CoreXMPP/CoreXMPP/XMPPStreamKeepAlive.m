@@ -0,0 +1,239 @@
+//
+//  XMPPStreamKeepAlive.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPStream.h"
+#import "XMPPStreamKeepAlive.h"
+
+static const NSTimeInterval XMPPStreamKeepAliveDefaultInterval = 20.0;
+static const NSTimeInterval XMPPStreamKeepAliveDefaultMinimumInterval = 10.0;
+static const NSTimeInterval XMPPStreamKeepAliveDefaultMaximumInterval = 120.0;
+static const NSUInteger XMPPStreamKeepAliveDefaultMaximumNumberOfMissedPongs = 2;
+
+// Timeout for pongs before the first round-trip time has been measured
+// and the bounds of the timeout derived from the estimate.
+static const NSTimeInterval XMPPStreamKeepAliveInitialPongTimeout = 10.0;
+static const NSTimeInterval XMPPStreamKeepAliveMinimumPongTimeout = 2.0;
+static const NSTimeInterval XMPPStreamKeepAliveMaximumPongTimeout = 30.0;
+
+// The interval is widened by this factor after the given number of
+// consecutive pongs at the current interval.
+static const double XMPPStreamKeepAliveWideningFactor = 1.5;
+static const NSUInteger XMPPStreamKeepAliveNumberOfPongsBeforeWidening = 3;
+
+static const uint8_t XMPPStreamKeepAlivePayloadTag[4] = {'k', 'e', 'e', 'p'};
+
+@interface XMPPStreamKeepAlive () {
+    NSTimeInterval _ceilingInterval;
+    NSTimeInterval _lastPingTime;
+    BOOL _pingPending;
+    uint64_t _pendingPingSequence;
+    NSTimeInterval _pendingPingTime;
+    NSTimeInterval _pendingPingIdleInterval;
+    uint64_t _sequence;
+    NSUInteger _numberOfPongsAtInterval;
+}
+
+@end
+
+@implementation XMPPStreamKeepAlive
+
+#pragma mark Life-cycle
+
+- (instancetype)initWithOptions:(NSDictionary *)options
+{
+    self = [super init];
+    if (self) {
+        [self updateWithOptions:options];
+        _interval = MIN(MAX([options[XMPPStreamKeepAliveIntervalKey] doubleValue] ?: XMPPStreamKeepAliveDefaultInterval, _minimumInterval), _maximumInterval);
+    }
+    return self;
+}
+
+#pragma mark Options
+
+- (void)updateWithOptions:(NSDictionary *)options
+{
+    NSNumber *minimumInterval = options[XMPPStreamKeepAliveMinimumIntervalKey];
+    NSNumber *maximumInterval = options[XMPPStreamKeepAliveMaximumIntervalKey];
+    NSNumber *maximumNumberOfMissedPongs = options[XMPPStreamKeepAliveMaximumMissedPongsKey];
+
+    _minimumInterval = minimumInterval ? [minimumInterval doubleValue] : XMPPStreamKeepAliveDefaultMinimumInterval;
+    _maximumInterval = maximumInterval ? [maximumInterval doubleValue] : MAX(XMPPStreamKeepAliveDefaultMaximumInterval, _minimumInterval);
+    _maximumNumberOfMissedPongs = maximumNumberOfMissedPongs ? MAX([maximumNumberOfMissedPongs unsignedIntegerValue], 1) : XMPPStreamKeepAliveDefaultMaximumNumberOfMissedPongs;
+
+    NSAssert(_minimumInterval > 0, @"The minimum interval must be greater than zero.");
+    NSAssert(_minimumInterval <= _maximumInterval, @"The minimum interval must not be greater than the maximum interval.");
+
+    if (_ceilingInterval == 0 || _ceilingInterval > _maximumInterval) {
+        _ceilingInterval = _maximumInterval;
+    }
+    _ceilingInterval = MAX(_ceilingInterval, _minimumInterval);
+    _interval = MIN(MAX(_interval, _minimumInterval), _ceilingInterval);
+}
+
+#pragma mark Timing
+
+- (NSTimeInterval)pongTimeout
+{
+    if (_smoothedRoundTripTime == 0) {
+        return XMPPStreamKeepAliveInitialPongTimeout;
+    }
+    NSTimeInterval timeout = _smoothedRoundTripTime + 4 * _roundTripTimeVariation;
+    return MIN(MAX(timeout, XMPPStreamKeepAliveMinimumPongTimeout), XMPPStreamKeepAliveMaximumPongTimeout);
+}
+
+- (NSTimeInterval)delayAtTime:(NSTimeInterval)now
+{
+    NSTimeInterval deadline = _pingPending ? _pendingPingTime + self.pongTimeout : _lastPingTime + _interval;
+    return MAX(deadline - now, 0);
+}
+
+#pragma mark Ping & Pong
+
+- (NSData *)pingPayloadAtTime:(NSTimeInterval)now
+{
+    if (_peerDead) {
+        return nil;
+    }
+
+    if (_pingPending) {
+        if (now < _pendingPingTime + self.pongTimeout) {
+            return nil;
+        }
+        [self xmpp_handleMissedPong];
+        if (_peerDead) {
+            return nil;
+        }
+    } else if (now < _lastPingTime + _interval) {
+        return nil;
+    }
+
+    _sequence += 1;
+
+    _pingPending = YES;
+    _pendingPingSequence = _sequence;
+    _pendingPingTime = now;
+    // A retry after a missed pong does not tell anything about the idle
+    // time the path tolerates.
+    _pendingPingIdleInterval = _numberOfMissedPongs == 0 ? now - _lastPingTime : 0;
+    _lastPingTime = now;
+
+    uint8_t payload[sizeof(XMPPStreamKeepAlivePayloadTag) + sizeof(uint64_t)];
+    uint64_t sequence = CFSwapInt64HostToBig(_sequence);
+    memcpy(payload, XMPPStreamKeepAlivePayloadTag, sizeof(XMPPStreamKeepAlivePayloadTag));
+    memcpy(payload + sizeof(XMPPStreamKeepAlivePayloadTag), &sequence, sizeof(sequence));
+    return [NSData dataWithBytes:payload length:sizeof(payload)];
+}
+
+- (BOOL)handlePongWithPayload:(NSData *)payload atTime:(NSTimeInterval)now
+{
+    if ([payload length] != sizeof(XMPPStreamKeepAlivePayloadTag) + sizeof(uint64_t) ||
+        memcmp([payload bytes], XMPPStreamKeepAlivePayloadTag, sizeof(XMPPStreamKeepAlivePayloadTag)) != 0) {
+        return NO;
+    }
+
+    uint64_t sequence = 0;
+    [payload getBytes:&sequence range:NSMakeRange(sizeof(XMPPStreamKeepAlivePayloadTag), sizeof(sequence))];
+    sequence = CFSwapInt64BigToHost(sequence);
+
+    if (sequence == 0 || sequence > _sequence || _peerDead) {
+        return YES;
+    }
+
+    // Even a late pong (of a ping that has already been counted as missed)
+    // shows that the peer is still alive.
+    _numberOfMissedPongs = 0;
+
+    if (!_pingPending || sequence != _pendingPingSequence) {
+        return YES;
+    }
+
+    _pingPending = NO;
+    [self xmpp_addRoundTripTimeSample:now - _pendingPingTime];
+
+    if (_pendingPingIdleInterval >= _interval) {
+        _numberOfPongsAtInterval += 1;
+        if (_numberOfPongsAtInterval >= XMPPStreamKeepAliveNumberOfPongsBeforeWidening && _interval < _ceilingInterval) {
+            _interval = MIN(_interval * XMPPStreamKeepAliveWideningFactor, _ceilingInterval);
+            _numberOfPongsAtInterval = 0;
+        }
+    }
+
+    return YES;
+}
+
+- (void)resetAtTime:(NSTimeInterval)now
+{
+    _pingPending = NO;
+    _peerDead = NO;
+    _numberOfMissedPongs = 0;
+    _numberOfPongsAtInterval = 0;
+    _lastPingTime = now;
+}
+
+#pragma mark -
+
+- (void)xmpp_handleMissedPong
+{
+    _pingPending = NO;
+    _numberOfMissedPongs += 1;
+    _numberOfPongsAtInterval = 0;
+
+    if (_pendingPingIdleInterval > _minimumInterval && _pendingPingIdleInterval >= _interval) {
+        // The path did not survive the idle interval. Narrow the interval by
+        // one step and do not probe beyond it anymore.
+        _ceilingInterval = MAX(_pendingPingIdleInterval / XMPPStreamKeepAliveWideningFactor, _minimumInterval);
+        _interval = MIN(_interval, _ceilingInterval);
+    }
+
+    if (_numberOfMissedPongs >= _maximumNumberOfMissedPongs) {
+        _peerDead = YES;
+    }
+}
+
+- (void)xmpp_addRoundTripTimeSample:(NSTimeInterval)roundTripTime
+{
+    // RFC 6298, Section 2
+    _roundTripTime = roundTripTime;
+    if (_smoothedRoundTripTime == 0) {
+        _smoothedRoundTripTime = roundTripTime;
+        _roundTripTimeVariation = roundTripTime / 2;
+    } else {
+        _roundTripTimeVariation = 0.75 * _roundTripTimeVariation + 0.25 * fabs(_smoothedRoundTripTime - roundTripTime);
+        _smoothedRoundTripTime = 0.875 * _smoothedRoundTripTime + 0.125 * roundTripTime;
+    }
+}
+
+@end
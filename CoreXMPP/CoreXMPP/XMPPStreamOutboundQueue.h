@@ -0,0 +1,72 @@
+//
+//  XMPPStreamOutboundQueue.h
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import <Foundation/Foundation.h>
+
+// Accounting of the bytes and stanzas which have been passed to the
+// transport, but have not been written (or confirmed) yet. The queue
+// becomes unwritable if one of the high-water marks is exceeded and
+// writable again, if both low-water marks are reached.
+//
+// Positions are the total number of bytes enqueued since the last reset.
+
+@interface XMPPStreamOutboundQueue : NSObject
+
+- (nonnull instancetype)initWithOptions:(nullable NSDictionary *)options;
+
+// Reads the water marks from the options (see XMPPStream.h).
+- (void)updateWithOptions:(nullable NSDictionary *)options;
+
+@property (nonatomic, readonly) NSUInteger highWaterMarkBytes;
+@property (nonatomic, readonly) NSUInteger lowWaterMarkBytes;
+@property (nonatomic, readonly) NSUInteger highWaterMarkStanzas;
+@property (nonatomic, readonly) NSUInteger lowWaterMarkStanzas;
+
+@property (nonatomic, readonly) NSUInteger numberOfPendingBytes;
+@property (nonatomic, readonly) NSUInteger numberOfPendingStanzas;
+@property (nonatomic, readonly) uint64_t position;
+
+@property (nonatomic, readonly, getter=isWritable) BOOL writable;
+@property (nonatomic, copy) void (^_Nullable writabilityHandler)(BOOL writable);
+
+- (void)enqueueStanzaWithLength:(NSUInteger)length;
+- (void)enqueueBytesWithLength:(NSUInteger)length;
+
+- (void)dequeueBytesWithLength:(NSUInteger)length;
+- (void)dequeueBytesUpToPosition:(uint64_t)position;
+
+- (void)reset;
+
+@end
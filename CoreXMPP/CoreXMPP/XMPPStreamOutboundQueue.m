@@ -0,0 +1,168 @@
+//
+//  XMPPStreamOutboundQueue.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPStream.h"
+#import "XMPPStreamOutboundQueue.h"
+
+static const NSUInteger XMPPStreamOutboundQueueDefaultHighWaterMarkBytes = 1024 * 1024;
+static const NSUInteger XMPPStreamOutboundQueueDefaultLowWaterMarkBytes = 256 * 1024;
+static const NSUInteger XMPPStreamOutboundQueueDefaultHighWaterMarkStanzas = 1000;
+static const NSUInteger XMPPStreamOutboundQueueDefaultLowWaterMarkStanzas = 250;
+
+@interface XMPPStreamOutboundQueue () {
+    uint64_t _dequeuedPosition;
+    NSMutableArray<NSNumber *> *_stanzaEndPositions;
+}
+
+@end
+
+@implementation XMPPStreamOutboundQueue
+
+#pragma mark Life-cycle
+
+- (instancetype)initWithOptions:(NSDictionary *)options
+{
+    self = [super init];
+    if (self) {
+        _stanzaEndPositions = [[NSMutableArray alloc] init];
+        _writable = YES;
+        [self updateWithOptions:options];
+    }
+    return self;
+}
+
+#pragma mark Options
+
+- (void)updateWithOptions:(NSDictionary *)options
+{
+    NSNumber *highWaterMarkBytes = options[XMPPStreamOutboundHighWaterMarkBytesKey];
+    NSNumber *lowWaterMarkBytes = options[XMPPStreamOutboundLowWaterMarkBytesKey];
+    NSNumber *highWaterMarkStanzas = options[XMPPStreamOutboundHighWaterMarkStanzasKey];
+    NSNumber *lowWaterMarkStanzas = options[XMPPStreamOutboundLowWaterMarkStanzasKey];
+
+    _highWaterMarkBytes = highWaterMarkBytes ? [highWaterMarkBytes unsignedIntegerValue] : XMPPStreamOutboundQueueDefaultHighWaterMarkBytes;
+    _lowWaterMarkBytes = lowWaterMarkBytes ? [lowWaterMarkBytes unsignedIntegerValue] : MIN(XMPPStreamOutboundQueueDefaultLowWaterMarkBytes, _highWaterMarkBytes);
+    _highWaterMarkStanzas = highWaterMarkStanzas ? [highWaterMarkStanzas unsignedIntegerValue] : XMPPStreamOutboundQueueDefaultHighWaterMarkStanzas;
+    _lowWaterMarkStanzas = lowWaterMarkStanzas ? [lowWaterMarkStanzas unsignedIntegerValue] : MIN(XMPPStreamOutboundQueueDefaultLowWaterMarkStanzas, _highWaterMarkStanzas);
+
+    NSAssert(_lowWaterMarkBytes <= _highWaterMarkBytes, @"The low-water mark must not be greater than the high-water mark.");
+    NSAssert(_lowWaterMarkStanzas <= _highWaterMarkStanzas, @"The low-water mark must not be greater than the high-water mark.");
+
+    [self xmpp_updateWritable];
+}
+
+#pragma mark Accounting
+
+- (NSUInteger)numberOfPendingBytes
+{
+    return (NSUInteger)(_position - _dequeuedPosition);
+}
+
+- (NSUInteger)numberOfPendingStanzas
+{
+    return [_stanzaEndPositions count];
+}
+
+- (void)enqueueStanzaWithLength:(NSUInteger)length
+{
+    _position += length;
+    [_stanzaEndPositions addObject:@(_position)];
+    [self xmpp_updateWritable];
+}
+
+- (void)enqueueBytesWithLength:(NSUInteger)length
+{
+    _position += length;
+    [self xmpp_updateWritable];
+}
+
+- (void)dequeueBytesWithLength:(NSUInteger)length
+{
+    [self dequeueBytesUpToPosition:_dequeuedPosition + length];
+}
+
+- (void)dequeueBytesUpToPosition:(uint64_t)position
+{
+    if (position <= _dequeuedPosition) {
+        return;
+    }
+
+    _dequeuedPosition = MIN(position, _position);
+
+    NSUInteger numberOfWrittenStanzas = 0;
+    for (NSNumber *endPosition in _stanzaEndPositions) {
+        if ([endPosition unsignedLongLongValue] > _dequeuedPosition) {
+            break;
+        }
+        numberOfWrittenStanzas++;
+    }
+    if (numberOfWrittenStanzas > 0) {
+        [_stanzaEndPositions removeObjectsInRange:NSMakeRange(0, numberOfWrittenStanzas)];
+    }
+
+    [self xmpp_updateWritable];
+}
+
+- (void)reset
+{
+    _position = 0;
+    _dequeuedPosition = 0;
+    [_stanzaEndPositions removeAllObjects];
+    [self xmpp_updateWritable];
+}
+
+#pragma mark -
+
+- (void)xmpp_updateWritable
+{
+    BOOL writable = _writable;
+
+    if (_writable) {
+        writable = self.numberOfPendingBytes <= _highWaterMarkBytes &&
+                   self.numberOfPendingStanzas <= _highWaterMarkStanzas;
+    } else {
+        writable = self.numberOfPendingBytes <= _lowWaterMarkBytes &&
+                   self.numberOfPendingStanzas <= _lowWaterMarkStanzas;
+    }
+
+    if (writable != _writable) {
+        _writable = writable;
+        if (self.writabilityHandler) {
+            self.writabilityHandler(writable);
+        }
+    }
+}
+
+@end
@@ -0,0 +1,65 @@
+//
+//  XMPPStreamParser.h
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import <Foundation/Foundation.h>
+#import <PureXML/PureXML.h>
+
+@class XMPPStreamParser;
+
+@protocol XMPPStreamParserDelegate <NSObject>
+- (void)parser:(nonnull XMPPStreamParser *)parser didOpenStreamWithAttributes:(nonnull NSDictionary<NSString *, NSString *> *)attributes;
+- (void)parser:(nonnull XMPPStreamParser *)parser didParseDocument:(nonnull PXDocument *)document;
+- (void)parserDidCloseStream:(nonnull XMPPStreamParser *)parser;
+- (void)parser:(nonnull XMPPStreamParser *)parser didFailWithError:(nonnull NSError *)error;
+@end
+
+// Incremental (push) parser for a long-lived `<stream:stream>` as defined in
+// RFC 6120. The bytes are passed to the parser as they arrive from the
+// transport. Each top-level element of the stream is reported as a separate
+// document as soon as its end tag has been parsed. No byte is parsed twice.
+//
+// The parser must be reset, if the stream is restarted (e.g., after STARTTLS
+// or SASL negotiation).
+
+@interface XMPPStreamParser : NSObject
+
+@property (nonatomic, weak) id<XMPPStreamParserDelegate> _Nullable delegate;
+
+- (void)parseData:(nonnull NSData *)data;
+- (void)parseBytes:(nonnull const void *)bytes length:(NSUInteger)length;
+
+- (void)reset;
+
+@end
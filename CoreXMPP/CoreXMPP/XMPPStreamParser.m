@@ -0,0 +1,550 @@
+//
+//  XMPPStreamParser.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import <libxml/parser.h>
+#import <libxml/parserInternals.h>
+
+#import "PXDocument+WireData.h"
+#import "XMPPError.h"
+#import "XMPPStreamParser.h"
+
+static NSString *const XMPPStreamParserStreamNamespace = @"http://etherx.jabber.org/streams";
+
+@interface XMPPStreamParser () {
+    xmlParserCtxtPtr _context;
+    NSUInteger _depth;
+    BOOL _failed;
+    PXDocument *_document;
+    NSMutableArray<PXElement *> *_elements;
+    NSMutableArray<NSMutableString *> *_characters;
+    NSMutableArray<NSNumber *> *_hasChildElements;
+    NSMutableData *_stanzaData;
+    BOOL _hasMixedContent;
+    BOOL _parsing;
+    BOOL _needsReset;
+}
+- (void)xmpp_didStartElement:(const xmlChar *)localname
+                      prefix:(const xmlChar *)prefix
+                         URI:(const xmlChar *)URI
+          numberOfAttributes:(int)numberOfAttributes
+                  attributes:(const xmlChar **)attributes;
+- (void)xmpp_didEndElement:(const xmlChar *)localname prefix:(const xmlChar *)prefix;
+- (void)xmpp_didFindCharacters:(const xmlChar *)characters length:(int)length;
+- (void)xmpp_failWithMessage:(NSString *)message;
+@end
+
+#pragma mark - SAX Handler
+
+static void XMPPStreamParserStartElement(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI,
+                                         int nb_namespaces, const xmlChar **namespaces,
+                                         int nb_attributes, int nb_defaulted, const xmlChar **attributes)
+{
+    XMPPStreamParser *parser = (__bridge XMPPStreamParser *)ctx;
+    [parser xmpp_didStartElement:localname prefix:prefix URI:URI numberOfAttributes:nb_attributes attributes:attributes];
+}
+
+static void XMPPStreamParserEndElement(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI)
+{
+    XMPPStreamParser *parser = (__bridge XMPPStreamParser *)ctx;
+    [parser xmpp_didEndElement:localname prefix:prefix];
+}
+
+static void XMPPStreamParserCharacters(void *ctx, const xmlChar *ch, int len)
+{
+    XMPPStreamParser *parser = (__bridge XMPPStreamParser *)ctx;
+    [parser xmpp_didFindCharacters:ch length:len];
+}
+
+static void XMPPStreamParserInternalSubset(void *ctx, const xmlChar *name, const xmlChar *ExternalID, const xmlChar *SystemID)
+{
+    // RFC 6120, Section 11.1: An XML stream MUST NOT contain a document type declaration.
+    XMPPStreamParser *parser = (__bridge XMPPStreamParser *)ctx;
+    [parser xmpp_failWithMessage:@"Received restricted XML (document type declaration)."];
+}
+
+static void XMPPStreamParserStructuredError(void *ctx, xmlErrorPtr error)
+{
+    XMPPStreamParser *parser = (__bridge XMPPStreamParser *)ctx;
+    NSString *message = error && error->message ? [[NSString alloc] initWithUTF8String:error->message] : nil;
+    [parser xmpp_failWithMessage:[message stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]] ?: @"Failed to parse XML stream."];
+}
+
+static NSString *XMPPStreamParserString(const xmlChar *string)
+{
+    return string ? [[NSString alloc] initWithUTF8String:(const char *)string] : nil;
+}
+
+static NSString *XMPPStreamParserAttributeValue(xmlParserCtxtPtr context, const xmlChar **attribute)
+{
+    // Each attribute is represented by five values: localname, prefix, URI,
+    // value begin and value end. The context does not substitute entities.
+    // Therefore references in the value are passed as character references
+    // (e.g., `&amp;` as `&#38;`) and are decoded like in xmlSAX2AttributeNs.
+    const xmlChar *begin = attribute[3];
+    const xmlChar *end = attribute[4];
+    if (memchr(begin, '&', end - begin) == NULL) {
+        return [[NSString alloc] initWithBytes:begin length:end - begin encoding:NSUTF8StringEncoding];
+    }
+    xmlChar *decoded = xmlStringLenDecodeEntities(context, begin, (int)(end - begin), XML_SUBSTITUTE_REF, 0, 0, 0);
+    NSString *value = XMPPStreamParserString(decoded);
+    xmlFree(decoded);
+    return value;
+}
+
+static NSDictionary<NSString *, NSString *> *XMPPStreamParserAttributes(xmlParserCtxtPtr context, int numberOfAttributes, const xmlChar **attributes)
+{
+    NSMutableDictionary *result = [[NSMutableDictionary alloc] initWithCapacity:numberOfAttributes];
+    for (int i = 0; i < numberOfAttributes; i++) {
+        const xmlChar **attribute = &attributes[i * 5];
+        NSString *value = XMPPStreamParserAttributeValue(context, attribute);
+        NSString *name = XMPPStreamParserString(attribute[0]);
+        if (attribute[1]) {
+            // Prefixed attributes (like `xml:lang`) are kept with their prefix.
+            name = [NSString stringWithFormat:@"%s:%@", attribute[1], name];
+        }
+        if (name && value) {
+            result[name] = value;
+        }
+    }
+    return result;
+}
+
+static void XMPPStreamParserAppendString(NSMutableData *data, const xmlChar *string)
+{
+    [data appendBytes:string length:strlen((const char *)string)];
+}
+
+static void XMPPStreamParserAppendEscaped(NSMutableData *data, const xmlChar *bytes, NSUInteger length, BOOL attribute)
+{
+    // Whitespace in attribute values is escaped, because it would be
+    // normalized to spaces by the parser.
+    NSUInteger start = 0;
+    for (NSUInteger i = 0; i < length; i++) {
+        const char *entity = NULL;
+        switch (bytes[i]) {
+        case '&':
+            entity = "&amp;";
+            break;
+        case '<':
+            entity = "&lt;";
+            break;
+        case '>':
+            entity = "&gt;";
+            break;
+        case '"':
+            entity = "&quot;";
+            break;
+        case '\r':
+            entity = "&#13;";
+            break;
+        case '\n':
+            entity = attribute ? "&#10;" : NULL;
+            break;
+        case '\t':
+            entity = attribute ? "&#9;" : NULL;
+            break;
+        default:
+            break;
+        }
+        if (entity) {
+            [data appendBytes:&bytes[start] length:i - start];
+            [data appendBytes:entity length:strlen(entity)];
+            start = i + 1;
+        }
+    }
+    [data appendBytes:&bytes[start] length:length - start];
+}
+
+static void XMPPStreamParserAppendNamespace(NSMutableData *data, const xmlChar *prefix, const xmlChar *URI)
+{
+    if (prefix) {
+        [data appendBytes:" xmlns:" length:7];
+        XMPPStreamParserAppendString(data, prefix);
+    } else {
+        [data appendBytes:" xmlns" length:6];
+    }
+    [data appendBytes:"=\"" length:2];
+    if (URI) {
+        XMPPStreamParserAppendEscaped(data, URI, strlen((const char *)URI), YES);
+    }
+    [data appendBytes:"\"" length:1];
+}
+
+static BOOL XMPPStreamParserNeedsNamespace(const xmlChar *attributePrefix, const xmlChar *prefix, const xmlChar **attributes, int index)
+{
+    // The prefix of an attribute is declared once per element, unless it
+    // is the predefined `xml` prefix or the prefix of the element.
+    if (strcmp((const char *)attributePrefix, "xml") == 0) {
+        return NO;
+    }
+    if (prefix && strcmp((const char *)attributePrefix, (const char *)prefix) == 0) {
+        return NO;
+    }
+    for (int i = 0; i < index; i++) {
+        const xmlChar *previousPrefix = attributes[i * 5 + 1];
+        if (previousPrefix && strcmp((const char *)attributePrefix, (const char *)previousPrefix) == 0) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+#pragma mark -
+
+@implementation XMPPStreamParser
+
+#pragma mark Life-cycle
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        _elements = [[NSMutableArray alloc] init];
+        _characters = [[NSMutableArray alloc] init];
+        _hasChildElements = [[NSMutableArray alloc] init];
+        _stanzaData = [[NSMutableData alloc] init];
+        [self xmpp_setUpContext];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self xmpp_tearDownContext];
+}
+
+#pragma mark Parsing
+
+- (void)parseData:(NSData *)data
+{
+    [self parseBytes:[data bytes] length:[data length]];
+}
+
+- (void)parseBytes:(const void *)bytes length:(NSUInteger)length
+{
+    if (_failed || length == 0) {
+        return;
+    }
+
+    _parsing = YES;
+
+    // The chunk size of libxml2 is an int. Larger buffers are passed in slices.
+    const char *chunk = bytes;
+    while (length > 0 && !_failed && !_needsReset) {
+        int size = (int)MIN(length, (NSUInteger)INT_MAX);
+        xmlParseChunk(_context, chunk, size, 0);
+        chunk += size;
+        length -= size;
+    }
+
+    _parsing = NO;
+
+    if (_needsReset) {
+        // The delegate did reset the parser while handling a document. The
+        // remaining bytes belong to the previous stream and are dropped.
+        [self reset];
+    }
+}
+
+- (void)reset
+{
+    if (_parsing) {
+        _needsReset = YES;
+        xmlStopParser(_context);
+    } else {
+        _needsReset = NO;
+        [self xmpp_tearDownContext];
+        [self xmpp_setUpContext];
+    }
+}
+
+#pragma mark Context
+
+- (void)xmpp_setUpContext
+{
+    xmlSAXHandler handler;
+    memset(&handler, 0, sizeof(xmlSAXHandler));
+    handler.initialized = XML_SAX2_MAGIC;
+    handler.startElementNs = XMPPStreamParserStartElement;
+    handler.endElementNs = XMPPStreamParserEndElement;
+    handler.characters = XMPPStreamParserCharacters;
+    handler.cdataBlock = XMPPStreamParserCharacters;
+    handler.internalSubset = XMPPStreamParserInternalSubset;
+    handler.serror = XMPPStreamParserStructuredError;
+
+    _context = xmlCreatePushParserCtxt(&handler, (__bridge void *)self, NULL, 0, NULL);
+    xmlCtxtUseOptions(_context, XML_PARSE_NONET | XML_PARSE_NOCDATA);
+
+    _depth = 0;
+    _failed = NO;
+    _document = nil;
+    [_elements removeAllObjects];
+    [_characters removeAllObjects];
+    [_hasChildElements removeAllObjects];
+    [_stanzaData setLength:0];
+    _hasMixedContent = NO;
+}
+
+- (void)xmpp_tearDownContext
+{
+    if (_context) {
+        xmlStopParser(_context);
+        xmlFreeParserCtxt(_context);
+        _context = NULL;
+    }
+}
+
+#pragma mark SAX Events
+
+- (void)xmpp_didStartElement:(const xmlChar *)localname
+                      prefix:(const xmlChar *)prefix
+                         URI:(const xmlChar *)URI
+          numberOfAttributes:(int)numberOfAttributes
+                  attributes:(const xmlChar **)attributes
+{
+    if (_failed || _needsReset) {
+        return;
+    }
+
+    NSString *name = XMPPStreamParserString(localname);
+    NSString *namespace = XMPPStreamParserString(URI);
+
+    if (_depth == 0) {
+
+        if (![name isEqualToString:@"stream"] || ![namespace isEqualToString:XMPPStreamParserStreamNamespace]) {
+            [self xmpp_failWithMessage:[NSString stringWithFormat:@"Expected stream header, got <%@ xmlns='%@'>.", name, namespace]];
+            return;
+        }
+
+        _depth += 1;
+        [self.delegate parser:self didOpenStreamWithAttributes:XMPPStreamParserAttributes(_context, numberOfAttributes, attributes)];
+        return;
+    }
+
+    PXElement *element = nil;
+    if (_depth == 1) {
+        _document = [[PXDocument alloc] initWithElementName:name
+                                                  namespace:namespace
+                                                     prefix:XMPPStreamParserString(prefix)];
+        element = _document.root;
+        [_stanzaData setLength:0];
+        _hasMixedContent = NO;
+    } else {
+        if (!_hasMixedContent && [[_characters lastObject] length] > 0) {
+            [self xmpp_beginMixedContent];
+        }
+        PXElement *parent = [_elements lastObject];
+        element = [parent addElementWithName:name namespace:namespace content:nil];
+        [_hasChildElements replaceObjectAtIndex:[_hasChildElements count] - 1 withObject:@YES];
+    }
+
+    if (_hasMixedContent) {
+        [self xmpp_appendStartTagWithName:localname prefix:prefix URI:URI numberOfAttributes:numberOfAttributes attributes:attributes];
+    }
+
+    [XMPPStreamParserAttributes(_context, numberOfAttributes, attributes) enumerateKeysAndObjectsUsingBlock:^(NSString *attributeName, NSString *value, BOOL *stop) {
+        [element setValue:value forAttribute:attributeName];
+    }];
+
+    [_elements addObject:element];
+    [_characters addObject:[[NSMutableString alloc] init]];
+    [_hasChildElements addObject:@NO];
+
+    _depth += 1;
+}
+
+- (void)xmpp_didEndElement:(const xmlChar *)localname prefix:(const xmlChar *)prefix
+{
+    if (_failed || _needsReset) {
+        return;
+    }
+
+    _depth -= 1;
+
+    if (_depth == 0) {
+        [self.delegate parserDidCloseStream:self];
+        return;
+    }
+
+    PXElement *element = [_elements lastObject];
+    NSMutableString *characters = [_characters lastObject];
+    BOOL hasChildElements = [[_hasChildElements lastObject] boolValue];
+
+    // Text is only applied to elements without child elements. Mixed
+    // content (e.g., XHTML-IM) can not be represented with the builder API
+    // of PureXML. Stanzas with mixed content are recorded (see below).
+    if (!hasChildElements && [characters length] > 0) {
+        [element setStringValue:characters];
+    }
+
+    if (_hasMixedContent) {
+        [_stanzaData appendBytes:"</" length:2];
+        if (prefix) {
+            XMPPStreamParserAppendString(_stanzaData, prefix);
+            [_stanzaData appendBytes:":" length:1];
+        }
+        XMPPStreamParserAppendString(_stanzaData, localname);
+        [_stanzaData appendBytes:">" length:1];
+    }
+
+    [_elements removeLastObject];
+    [_characters removeLastObject];
+    [_hasChildElements removeLastObject];
+
+    if (_depth == 1) {
+        PXDocument *document = _document;
+        if (_hasMixedContent) {
+            document = [PXDocument documentWithData:_stanzaData] ?: document;
+        }
+        _document = nil;
+        _hasMixedContent = NO;
+        [_stanzaData setLength:0];
+        [self.delegate parser:self didParseDocument:document];
+    }
+}
+
+- (void)xmpp_didFindCharacters:(const xmlChar *)characters length:(int)length
+{
+    if (_failed || _needsReset || _depth < 2) {
+        // Whitespace between top-level elements is used as keep alive and is ignored.
+        return;
+    }
+
+    NSString *string = [[NSString alloc] initWithBytes:characters
+                                                length:length
+                                              encoding:NSUTF8StringEncoding];
+    if (string) {
+        [[_characters lastObject] appendString:string];
+        if (_hasMixedContent) {
+            XMPPStreamParserAppendEscaped(_stanzaData, characters, length, NO);
+        } else if ([[_hasChildElements lastObject] boolValue]) {
+            [self xmpp_beginMixedContent];
+        }
+    }
+}
+
+#pragma mark Mixed Content
+
+- (void)xmpp_beginMixedContent
+{
+    // PureXML can not add text next to child elements. Once a stanza turns
+    // out to have mixed content, the part built so far is serialized and
+    // the rest of the stanza is recorded as a standalone document (each
+    // element declares its namespace). The recorded stanza is parsed by
+    // PureXML, after it has been completed. Stanzas without mixed content
+    // are not recorded.
+
+    _hasMixedContent = YES;
+    [_stanzaData setData:[_document xmpp_wireData]];
+
+    // The elements, which are still open, are the last ones in the
+    // serialization. Their end tags are removed. The innermost element
+    // can be an empty element tag, if it has no child elements yet.
+    for (NSUInteger i = 0; i < [_elements count]; i++) {
+        const char *bytes = [_stanzaData bytes];
+        NSUInteger length = [_stanzaData length];
+        NSUInteger tag = length;
+        while (tag > 0 && bytes[tag - 1] != '<') {
+            tag--;
+        }
+        if (tag == 0) {
+            break;
+        }
+        if (tag < length && bytes[tag] == '/') {
+            [_stanzaData setLength:tag - 1];
+        } else if (length >= 2 && bytes[length - 2] == '/') {
+            [_stanzaData replaceBytesInRange:NSMakeRange(length - 2, 2) withBytes:">" length:1];
+        }
+    }
+
+    // The text of the innermost element has not been applied yet.
+    NSData *characters = [[_characters lastObject] dataUsingEncoding:NSUTF8StringEncoding];
+    XMPPStreamParserAppendEscaped(_stanzaData, [characters bytes], [characters length], NO);
+}
+
+- (void)xmpp_appendStartTagWithName:(const xmlChar *)localname
+                             prefix:(const xmlChar *)prefix
+                                URI:(const xmlChar *)URI
+                 numberOfAttributes:(int)numberOfAttributes
+                         attributes:(const xmlChar **)attributes
+{
+    [_stanzaData appendBytes:"<" length:1];
+    if (prefix) {
+        XMPPStreamParserAppendString(_stanzaData, prefix);
+        [_stanzaData appendBytes:":" length:1];
+    }
+    XMPPStreamParserAppendString(_stanzaData, localname);
+    XMPPStreamParserAppendNamespace(_stanzaData, prefix, URI);
+
+    for (int i = 0; i < numberOfAttributes; i++) {
+        const xmlChar **attribute = &attributes[i * 5];
+        const xmlChar *attributePrefix = attribute[1];
+        if (attributePrefix && XMPPStreamParserNeedsNamespace(attributePrefix, prefix, attributes, i)) {
+            XMPPStreamParserAppendNamespace(_stanzaData, attributePrefix, attribute[2]);
+        }
+        [_stanzaData appendBytes:" " length:1];
+        if (attributePrefix) {
+            XMPPStreamParserAppendString(_stanzaData, attributePrefix);
+            [_stanzaData appendBytes:":" length:1];
+        }
+        XMPPStreamParserAppendString(_stanzaData, attribute[0]);
+        [_stanzaData appendBytes:"=\"" length:2];
+        NSData *value = [XMPPStreamParserAttributeValue(_context, attribute) dataUsingEncoding:NSUTF8StringEncoding];
+        XMPPStreamParserAppendEscaped(_stanzaData, [value bytes], [value length], YES);
+        [_stanzaData appendBytes:"\"" length:1];
+    }
+
+    [_stanzaData appendBytes:">" length:1];
+}
+
+#pragma mark Error Handling
+
+- (void)xmpp_failWithMessage:(NSString *)message
+{
+    if (_failed) {
+        return;
+    }
+
+    _failed = YES;
+    xmlStopParser(_context);
+
+    NSDictionary *userInfo = @{NSLocalizedDescriptionKey : message};
+    NSError *error = [NSError errorWithDomain:XMPPErrorDomain
+                                         code:XMPPErrorCodeParseError
+                                     userInfo:userInfo];
+    [self.delegate parser:self didFailWithError:error];
+}
+
+@end
@@ -0,0 +1,89 @@
+//
+//  XMPPStreamRecorder.h
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef NS_ENUM(uint8_t, XMPPStreamRecordDirection) {
+    XMPPStreamRecordDirectionInbound = 0,
+    XMPPStreamRecordDirectionOutbound = 1
+} NS_SWIFT_NAME(StreamRecordDirection);
+
+// Records the raw frames (or chunks of bytes) a stream receives and sends
+// into a fixed-size ring buffer. If the buffer is full, the oldest records
+// are overwritten. Records larger than the buffer are dropped.
+//
+// A recorder can be attached to any stream (see -[XMPPStream recorder]).
+// Recording is lock-free and must only be done by a single producer (the
+// queue of the stream). A capture can be taken from any thread at any time.
+//
+// Capture format (little endian): the magic "XMPPREC1", followed by the
+// wall clock time the recorder has been created (uint64, ns since 1970) and
+// the records. Each record has a header of 16 bytes (uint64 monotonic
+// timestamp in ns relative to the creation of the recorder, uint32 length,
+// uint8 direction and three bytes padding) followed by the payload.
+
+NS_SWIFT_NAME(StreamRecorder)
+@interface XMPPStreamRecorder : NSObject
+
+#pragma mark Life-cycle
+
+// Capacity of 4 MiB.
+- (nonnull instancetype)init;
+
+// The capacity (bytes) is rounded up to the next power of two.
+- (nonnull instancetype)initWithCapacity:(NSUInteger)capacity NS_DESIGNATED_INITIALIZER;
+
+#pragma mark Properties
+@property (nonatomic, readonly) NSUInteger capacity;
+
+// Number of records currently in the buffer.
+@property (nonatomic, readonly) NSUInteger numberOfRecords;
+@property (nonatomic, readonly) NSUInteger numberOfOverwrittenRecords;
+@property (nonatomic, readonly) NSUInteger numberOfDroppedRecords;
+
+#pragma mark Recording
+- (void)recordBytes:(nonnull const void *)bytes length:(NSUInteger)length direction:(XMPPStreamRecordDirection)direction NS_SWIFT_NAME(record(bytes:length:direction:));
+- (void)recordData:(nonnull NSData *)data direction:(XMPPStreamRecordDirection)direction NS_SWIFT_NAME(record(_:direction:));
+
+#pragma mark Capture
+- (nonnull NSData *)capture;
+- (BOOL)writeCaptureToURL:(nonnull NSURL *)URL error:(NSError *__autoreleasing __nullable *__nullable)error NS_SWIFT_NAME(writeCapture(to:));
+
+// Calls the block for each record of the capture (in order). Returns NO,
+// if the capture is not valid or truncated.
++ (BOOL)enumerateRecordsInCapture:(nonnull NSData *)capture
+                       usingBlock:(nonnull void (^)(XMPPStreamRecordDirection direction, uint64_t timestamp, NSData *_Nonnull payload, BOOL *_Nonnull stop))block;
+
+@end
@@ -0,0 +1,285 @@
+//
+//  XMPPStreamRecorder.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import <libkern/OSByteOrder.h>
+#import <mach/mach_time.h>
+#import <sched.h>
+#import <stdatomic.h>
+
+#import "XMPPLogger.h"
+#import "XMPPStreamRecorder.h"
+
+#define XMPPStreamRecorderDefaultCapacity (4 * 1024 * 1024)
+#define XMPPStreamRecorderMinimumCapacity 256
+#define XMPPStreamRecorderCaptureHeaderLength 16
+#define XMPPStreamRecorderRecordHeaderLength 16
+#define XMPPStreamRecorderMaximumCaptureAttempts 1000
+
+static const char XMPPStreamRecorderMagic[8] = {'X', 'M', 'P', 'P', 'R', 'E', 'C', '1'};
+
+@interface XMPPStreamRecorder () {
+    uint8_t *_buffer;
+    NSUInteger _mask;
+
+    mach_timebase_info_data_t _timebase;
+    uint64_t _startTime;
+    uint64_t _startWallClockTime;
+
+    // The positions (head and tail) are increasing byte offsets. The ring
+    // is only modified by the producer. Readers take a consistent snapshot
+    // by checking the sequence, which is odd while a record is written.
+    _Atomic(uint64_t) _sequence;
+    _Atomic(uint64_t) _head;
+    _Atomic(uint64_t) _tail;
+
+    _Atomic(NSUInteger) _numberOfRecords;
+    _Atomic(NSUInteger) _numberOfOverwrittenRecords;
+    _Atomic(NSUInteger) _numberOfDroppedRecords;
+}
+
+@end
+
+@implementation XMPPStreamRecorder
+
+#pragma mark Life-cycle
+
+- (instancetype)init
+{
+    return [self initWithCapacity:XMPPStreamRecorderDefaultCapacity];
+}
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity
+{
+    self = [super init];
+    if (self) {
+        _capacity = XMPPStreamRecorderMinimumCapacity;
+        while (_capacity < capacity) {
+            _capacity <<= 1;
+        }
+        _mask = _capacity - 1;
+        _buffer = malloc(_capacity);
+
+        mach_timebase_info(&_timebase);
+        _startTime = mach_absolute_time();
+        _startWallClockTime = (uint64_t)([[NSDate date] timeIntervalSince1970] * NSEC_PER_SEC);
+
+        atomic_init(&_sequence, 0);
+        atomic_init(&_head, 0);
+        atomic_init(&_tail, 0);
+        atomic_init(&_numberOfRecords, 0);
+        atomic_init(&_numberOfOverwrittenRecords, 0);
+        atomic_init(&_numberOfDroppedRecords, 0);
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    free(_buffer);
+}
+
+#pragma mark Properties
+
+- (NSUInteger)numberOfRecords
+{
+    return atomic_load_explicit(&_numberOfRecords, memory_order_relaxed);
+}
+
+- (NSUInteger)numberOfOverwrittenRecords
+{
+    return atomic_load_explicit(&_numberOfOverwrittenRecords, memory_order_relaxed);
+}
+
+- (NSUInteger)numberOfDroppedRecords
+{
+    return atomic_load_explicit(&_numberOfDroppedRecords, memory_order_relaxed);
+}
+
+#pragma mark Recording
+
+- (void)recordBytes:(const void *)bytes length:(NSUInteger)length direction:(XMPPStreamRecordDirection)direction
+{
+    uint64_t recordLength = XMPPStreamRecorderRecordHeaderLength + (uint64_t)length;
+    if (length > UINT32_MAX || recordLength > _capacity) {
+        atomic_fetch_add_explicit(&_numberOfDroppedRecords, 1, memory_order_relaxed);
+        return;
+    }
+
+    uint8_t header[XMPPStreamRecorderRecordHeaderLength] = {0};
+    OSWriteLittleInt64(header, 0, [self xmpp_timestamp]);
+    OSWriteLittleInt32(header, 8, (uint32_t)length);
+    header[12] = direction;
+
+    uint64_t head = atomic_load_explicit(&_head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&_tail, memory_order_relaxed);
+
+    uint64_t sequence = atomic_load_explicit(&_sequence, memory_order_relaxed);
+    atomic_store_explicit(&_sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    NSUInteger numberOfOverwrittenRecords = 0;
+    while (head + recordLength - tail > _capacity) {
+        uint8_t oldHeader[XMPPStreamRecorderRecordHeaderLength];
+        [self xmpp_copyBytesAtPosition:tail length:XMPPStreamRecorderRecordHeaderLength toBuffer:oldHeader];
+        tail += XMPPStreamRecorderRecordHeaderLength + OSReadLittleInt32(oldHeader, 8);
+        numberOfOverwrittenRecords++;
+    }
+
+    [self xmpp_writeBytes:header length:XMPPStreamRecorderRecordHeaderLength atPosition:head];
+    [self xmpp_writeBytes:bytes length:length atPosition:head + XMPPStreamRecorderRecordHeaderLength];
+    head += recordLength;
+
+    atomic_store_explicit(&_tail, tail, memory_order_relaxed);
+    atomic_store_explicit(&_head, head, memory_order_relaxed);
+    atomic_store_explicit(&_sequence, sequence + 2, memory_order_release);
+
+    atomic_fetch_add_explicit(&_numberOfRecords, 1, memory_order_relaxed);
+    if (numberOfOverwrittenRecords > 0) {
+        atomic_fetch_sub_explicit(&_numberOfRecords, numberOfOverwrittenRecords, memory_order_relaxed);
+        atomic_fetch_add_explicit(&_numberOfOverwrittenRecords, numberOfOverwrittenRecords, memory_order_relaxed);
+    }
+}
+
+- (void)recordData:(NSData *)data direction:(XMPPStreamRecordDirection)direction
+{
+    [self recordBytes:[data bytes] length:[data length] direction:direction];
+}
+
+#pragma mark Capture
+
+- (NSData *)capture
+{
+    NSMutableData *capture = [[NSMutableData alloc] initWithLength:XMPPStreamRecorderCaptureHeaderLength];
+    uint8_t *captureHeader = [capture mutableBytes];
+    memcpy(captureHeader, XMPPStreamRecorderMagic, sizeof(XMPPStreamRecorderMagic));
+    OSWriteLittleInt64(captureHeader, 8, _startWallClockTime);
+
+    for (NSUInteger attempt = 0; attempt < XMPPStreamRecorderMaximumCaptureAttempts; attempt++) {
+        uint64_t sequence = atomic_load_explicit(&_sequence, memory_order_acquire);
+        if (sequence & 1) {
+            sched_yield();
+            continue;
+        }
+
+        uint64_t head = atomic_load_explicit(&_head, memory_order_relaxed);
+        uint64_t tail = atomic_load_explicit(&_tail, memory_order_relaxed);
+
+        [capture setLength:XMPPStreamRecorderCaptureHeaderLength + (NSUInteger)(head - tail)];
+        uint8_t *records = (uint8_t *)[capture mutableBytes] + XMPPStreamRecorderCaptureHeaderLength;
+        [self xmpp_copyBytesAtPosition:tail length:(NSUInteger)(head - tail) toBuffer:records];
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&_sequence, memory_order_relaxed) == sequence) {
+            return capture;
+        }
+    }
+
+    XMPPLogWarning(XMPPLogCategoryStream, @"Failed to take a consistent capture of the recorder %p.", self);
+
+    [capture setLength:XMPPStreamRecorderCaptureHeaderLength];
+    return capture;
+}
+
+- (BOOL)writeCaptureToURL:(NSURL *)URL error:(NSError **)error
+{
+    return [[self capture] writeToURL:URL options:NSDataWritingAtomic error:error];
+}
+
++ (BOOL)enumerateRecordsInCapture:(NSData *)capture
+                       usingBlock:(void (^)(XMPPStreamRecordDirection, uint64_t, NSData *, BOOL *))block
+{
+    const uint8_t *bytes = [capture bytes];
+    NSUInteger length = [capture length];
+
+    if (length < XMPPStreamRecorderCaptureHeaderLength ||
+        memcmp(bytes, XMPPStreamRecorderMagic, sizeof(XMPPStreamRecorderMagic)) != 0) {
+        return NO;
+    }
+
+    NSUInteger offset = XMPPStreamRecorderCaptureHeaderLength;
+    while (offset < length) {
+        if (length - offset < XMPPStreamRecorderRecordHeaderLength) {
+            return NO;
+        }
+
+        uint64_t timestamp = OSReadLittleInt64(bytes, offset);
+        NSUInteger payloadLength = OSReadLittleInt32(bytes, offset + 8);
+        XMPPStreamRecordDirection direction = bytes[offset + 12];
+        offset += XMPPStreamRecorderRecordHeaderLength;
+
+        if (length - offset < payloadLength) {
+            return NO;
+        }
+
+        BOOL stop = NO;
+        block(direction, timestamp, [capture subdataWithRange:NSMakeRange(offset, payloadLength)], &stop);
+        if (stop) {
+            break;
+        }
+        offset += payloadLength;
+    }
+
+    return YES;
+}
+
+#pragma mark -
+
+- (uint64_t)xmpp_timestamp
+{
+    uint64_t elapsed = mach_absolute_time() - _startTime;
+    return elapsed * _timebase.numer / _timebase.denom;
+}
+
+- (void)xmpp_writeBytes:(const void *)bytes length:(NSUInteger)length atPosition:(uint64_t)position
+{
+    NSUInteger offset = (NSUInteger)(position & _mask);
+    NSUInteger firstLength = MIN(length, _capacity - offset);
+    memcpy(_buffer + offset, bytes, firstLength);
+    if (firstLength < length) {
+        memcpy(_buffer, (const uint8_t *)bytes + firstLength, length - firstLength);
+    }
+}
+
+- (void)xmpp_copyBytesAtPosition:(uint64_t)position length:(NSUInteger)length toBuffer:(void *)buffer
+{
+    NSUInteger offset = (NSUInteger)(position & _mask);
+    NSUInteger firstLength = MIN(length, _capacity - offset);
+    memcpy(buffer, _buffer + offset, firstLength);
+    if (firstLength < length) {
+        memcpy((uint8_t *)buffer + firstLength, _buffer, length - firstLength);
+    }
+}
+
+@end
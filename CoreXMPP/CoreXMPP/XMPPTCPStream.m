@@ -0,0 +1,793 @@
+//
+//  XMPPTCPStream.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "PXDocument+WireData.h"
+#import "XMPPError.h"
+#import "XMPPLogger.h"
+#import "XMPPStreamCompression.h"
+#import "XMPPStreamOutboundQueue.h"
+#import "XMPPStreamParser.h"
+#import "XMPPStreamRecorder.h"
+#import "XMPPTCPStream.h"
+
+NSString *const XMPPTCPStreamHostKey = @"XMPPTCPStreamHostKey";
+NSString *const XMPPTCPStreamPortKey = @"XMPPTCPStreamPortKey";
+NSString *const XMPPTCPStreamAllowsPlaintextKey = @"XMPPTCPStreamAllowsPlaintextKey";
+NSString *const XMPPTCPStreamAllowsUntrustedCertificatesKey = @"XMPPTCPStreamAllowsUntrustedCertificatesKey";
+NSString *const XMPPTCPStreamCompressionKey = @"XMPPTCPStreamCompressionKey";
+
+NSString *const XMPPTCPStream_NS = @"http://etherx.jabber.org/streams";
+NSString *const XMPPTCPStream_TLS_NS = @"urn:ietf:params:xml:ns:xmpp-tls";
+
+static const UInt32 XMPPTCPStreamDefaultPort = 5222;
+static const NSUInteger XMPPTCPStreamReadBufferSize = 16 * 1024;
+static const NSTimeInterval XMPPTCPStreamCloseTimeout = 5.0;
+
+@interface XMPPTCPStream () <NSStreamDelegate, XMPPStreamParserDelegate> {
+    XMPPStreamState _state;
+    NSInputStream *_inputStream;
+    NSOutputStream *_outputStream;
+    BOOL _inputStreamOpen;
+    BOOL _outputStreamOpen;
+    uint8_t *_readBuffer;
+    NSMutableData *_writeBuffer;
+    NSUInteger _writeBufferOffset;
+    XMPPStreamOutboundQueue *_outboundQueue;
+    XMPPStreamCompression *_compression;
+    XMPPStreamParser *_parser;
+    BOOL _secure;
+    BOOL _negotiatingTLS;
+    BOOL _didReportOpen;
+    NSString *_streamHostname;
+    NSString *_streamId;
+    NSUInteger _keepAliveGeneration;
+    BOOL _closeAfterWriting;
+    NSUInteger _closeGeneration;
+}
+
+@end
+
+@implementation XMPPTCPStream
+
+#pragma mark Life-cycle
+
+- (instancetype)initWithHostname:(NSString *)hostname
+                         options:(NSDictionary *)options
+{
+    self = [super initWithHostname:hostname options:options];
+    if (self) {
+        _readBuffer = malloc(XMPPTCPStreamReadBufferSize);
+        _writeBuffer = [[NSMutableData alloc] init];
+        _parser = [[XMPPStreamParser alloc] init];
+        _parser.delegate = self;
+        _outboundQueue = [[XMPPStreamOutboundQueue alloc] initWithOptions:options];
+
+        __weak typeof(self) _self = self;
+        _outboundQueue.writabilityHandler = ^(BOOL writable) {
+            typeof(self) this = _self;
+            if ([this.delegate respondsToSelector:@selector(stream:didChangeWritable:)]) {
+                [this.delegate stream:this didChangeWritable:writable];
+            }
+        };
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self xmpp_tearDownSocket];
+    free(_readBuffer);
+}
+
+#pragma mark Description
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<XMPPTCPStream %p (%@:%u)>", self, [self xmpp_connectHost], (unsigned int)[self xmpp_connectPort]];
+}
+
+#pragma mark State
+
+- (XMPPStreamState)state
+{
+    return _state;
+}
+
+- (BOOL)isWritable
+{
+    return _outboundQueue.writable;
+}
+
+#pragma mark Flow Control
+
+- (void)setReadingPaused:(BOOL)readingPaused
+{
+    BOOL resume = self.readingPaused && !readingPaused;
+    [super setReadingPaused:readingPaused];
+    if (resume) {
+        // The bytes which became available while reading was paused are
+        // not reported again by the input stream.
+        dispatch_async([self xmpp_queue], ^{
+            [self xmpp_readBytes];
+        });
+    }
+}
+
+#pragma mark Security
+
+- (BOOL)isSecure
+{
+    return _secure;
+}
+
+#pragma mark Compression
+
+- (NSArray<NSString *> *)compressionMethods
+{
+    if (_compression || ![self.options[XMPPTCPStreamCompressionKey] boolValue]) {
+        return @[];
+    }
+    return [XMPPStreamCompression supportedMethods];
+}
+
+- (void)startCompressionWithMethod:(NSString *)method
+{
+    NSAssert(_compression == nil, @"Invalid State: Compression has already been started.");
+
+    XMPPLogDebug(XMPPLogCategoryStream, @"Starting compression (%@) with host: %@", method, self.hostname);
+
+    _compression = [[XMPPStreamCompression alloc] initWithMethod:method];
+    if (_compression == nil) {
+        NSString *errorMessage = [NSString stringWithFormat:@"Failed to set up compression method '%@'.", method];
+        NSError *error = [NSError errorWithDomain:XMPPErrorDomain
+                                             code:XMPPErrorCodeInvalidState
+                                         userInfo:@{NSLocalizedDescriptionKey : errorMessage}];
+        [self xmpp_handleError:error];
+    }
+}
+
+#pragma mark Managing Stream
+
+- (void)open
+{
+    NSAssert(_state == XMPPStreamStateClosed, @"Invalid State: Can only open a closed stream.");
+
+    XMPPLogInfo(XMPPLogCategoryStream, @"Open stream to host: %@", self.hostname);
+
+    [self xmpp_setUpSocket];
+    _state = XMPPStreamStateConnecting;
+
+    XMPPLogInfo(XMPPLogCategoryStream, @"Connecting to host: %@ (%@:%u)", self.hostname, [self xmpp_connectHost], (unsigned int)[self xmpp_connectPort]);
+}
+
+- (void)reopen
+{
+    NSAssert(_state == XMPPStreamStateOpen, @"Invalid State: Can only reopen a already opened stream.");
+
+    XMPPLogDebug(XMPPLogCategoryStream, @"Repoen stream to host: %@", self.hostname);
+
+    [_parser reset];
+    [self xmpp_sendStreamHeader];
+    _state = XMPPStreamStateOpening;
+}
+
+- (void)close
+{
+    NSAssert(_state == XMPPStreamStateOpen, @"Invalid State: Can only close an open stream.");
+
+    XMPPLogInfo(XMPPLogCategoryStream, @"Close stream to host: %@", self.hostname);
+
+    [self xmpp_sendStreamFooter];
+    _state = XMPPStreamStateClosing;
+}
+
+- (void)suspend
+{
+    NSAssert(_state == XMPPStreamStateOpen, @"Invalid State: Can only suspend an open stream.");
+
+    XMPPLogInfo(XMPPLogCategoryStream, @"Suspending stream to host: %@", self.hostname);
+
+    [self xmpp_tearDownSocket];
+    _state = XMPPStreamStateClosed;
+
+    if ([self.delegate respondsToSelector:@selector(streamDidClose:)]) {
+        [self.delegate streamDidClose:self];
+    }
+}
+
+#pragma mark Sending Document
+
+- (void)sendDocument:(PXDocument *)document
+{
+    NSAssert(_state == XMPPStreamStateOpen, @"Invalid State: Can only send an element if the stream is open.");
+    [self xmpp_sendDocument:document];
+}
+
+- (void)sendDocuments:(NSArray<PXDocument *> *)documents
+{
+    NSAssert(_state == XMPPStreamStateOpen, @"Invalid State: Can only send an element if the stream is open.");
+    [self xmpp_sendDocuments:documents];
+}
+
+#pragma mark -
+
+#pragma mark Stream Header & Footer
+
+- (void)xmpp_sendStreamHeader
+{
+    _didReportOpen = NO;
+
+    NSString *header = [NSString stringWithFormat:@"<?xml version='1.0'?><stream:stream to='%@' version='1.0' xmlns='jabber:client' xmlns:stream='%@'>",
+                                                  [[self class] xmpp_escapedAttributeValue:self.hostname],
+                                                  XMPPTCPStream_NS];
+
+    XMPPLogTrace(XMPPLogCategoryStream, @"Send stream header.");
+
+    [self xmpp_writeData:[header dataUsingEncoding:NSUTF8StringEncoding]];
+}
+
+- (void)xmpp_sendStreamFooter
+{
+    XMPPLogTrace(XMPPLogCategoryStream, @"Send stream footer.");
+
+    [self xmpp_writeData:[@"</stream:stream>" dataUsingEncoding:NSUTF8StringEncoding]];
+}
+
+- (void)xmpp_reportOpen
+{
+    _didReportOpen = YES;
+    _state = XMPPStreamStateOpen;
+
+    if ([self.delegate respondsToSelector:@selector(stream:didOpenToHost:withStreamId:)]) {
+        [self.delegate stream:self didOpenToHost:_streamHostname withStreamId:_streamId];
+    }
+}
+
+#pragma mark STARTTLS
+
+- (BOOL)xmpp_handleFeaturesBeforeOpen:(PXDocument *)document
+{
+    // Returns YES if the features document has been consumed by the TLS negotiation.
+
+    __block BOOL offersStartTLS = NO;
+    [document.root enumerateElementsUsingBlock:^(PXElement *element, BOOL *stop) {
+        if ([element.namespace isEqualToString:XMPPTCPStream_TLS_NS] &&
+            [element.name isEqualToString:@"starttls"]) {
+            offersStartTLS = YES;
+            *stop = YES;
+        }
+    }];
+
+    if (offersStartTLS) {
+        PXDocument *request = [[PXDocument alloc] initWithElementName:@"starttls"
+                                                            namespace:XMPPTCPStream_TLS_NS
+                                                               prefix:nil];
+        XMPPLogDebug(XMPPLogCategoryStream, @"Requesting STARTTLS.");
+
+        _negotiatingTLS = YES;
+        [self xmpp_sendDocument:request];
+        return YES;
+
+    } else if ([self.options[XMPPTCPStreamAllowsPlaintextKey] boolValue]) {
+        return NO;
+
+    } else {
+        NSString *errorMessage = [NSString stringWithFormat:@"Host '%@' does not offer STARTTLS.", self.hostname];
+
+        NSDictionary *userInfo = @{NSLocalizedDescriptionKey : errorMessage};
+        NSError *error = [NSError errorWithDomain:XMPPErrorDomain
+                                             code:XMPPErrorCodeInvalidState
+                                         userInfo:userInfo];
+        [self xmpp_handleError:error];
+        return YES;
+    }
+}
+
+- (void)xmpp_handleTLSDocument:(PXDocument *)document
+{
+    _negotiatingTLS = NO;
+
+    if ([document.root.namespace isEqualToString:XMPPTCPStream_TLS_NS] &&
+        [document.root.name isEqualToString:@"proceed"]) {
+
+        XMPPLogDebug(XMPPLogCategoryStream, @"Starting TLS with host: %@", self.hostname);
+
+        NSMutableDictionary *settings = [[NSMutableDictionary alloc] init];
+        settings[(NSString *)kCFStreamSSLLevel] = (NSString *)kCFStreamSocketSecurityLevelNegotiatedSSL;
+        settings[(NSString *)kCFStreamSSLPeerName] = self.hostname;
+        if ([self.options[XMPPTCPStreamAllowsUntrustedCertificatesKey] boolValue]) {
+            settings[(NSString *)kCFStreamSSLValidatesCertificateChain] = @NO;
+        }
+
+        CFReadStreamSetProperty((__bridge CFReadStreamRef)_inputStream, kCFStreamPropertySSLSettings, (__bridge CFTypeRef)settings);
+        CFWriteStreamSetProperty((__bridge CFWriteStreamRef)_outputStream, kCFStreamPropertySSLSettings, (__bridge CFTypeRef)settings);
+
+        _secure = YES;
+
+        // RFC 6120, Section 5.4.3.3: The stream is restarted after the TLS handshake.
+        [_parser reset];
+        [self xmpp_sendStreamHeader];
+
+    } else {
+        NSString *errorMessage = @"Failed to negotiate TLS.";
+
+        NSDictionary *userInfo = @{NSLocalizedDescriptionKey : errorMessage};
+        NSError *error = [NSError errorWithDomain:XMPPErrorDomain
+                                             code:XMPPErrorCodeInvalidState
+                                         userInfo:userInfo];
+        [self xmpp_handleError:error];
+    }
+}
+
+#pragma mark Sending & Receiving Documents
+
+- (void)xmpp_sendDocument:(PXDocument *)document
+{
+    if (_outputStream == nil) {
+        return;
+    }
+
+    NSData *data = [document xmpp_wireData];
+    [self.recorder recordData:data direction:XMPPStreamRecordDirectionOutbound];
+
+    data = [self xmpp_compressData:data];
+    if (data) {
+        [_outboundQueue enqueueStanzaWithLength:[data length]];
+        [self xmpp_appendData:data];
+    }
+}
+
+- (void)xmpp_sendDocuments:(NSArray<PXDocument *> *)documents
+{
+    if (_outputStream == nil || [documents count] == 0) {
+        return;
+    }
+
+    // The documents are serialized into one buffer, which is compressed
+    // and appended to the write buffer at once.
+    NSMutableData *data = [[NSMutableData alloc] init];
+    NSMutableArray<NSNumber *> *lengths = [[NSMutableArray alloc] initWithCapacity:[documents count]];
+    for (PXDocument *document in documents) {
+        NSData *wireData = [document xmpp_wireData];
+        [data appendData:wireData];
+        [lengths addObject:@([wireData length])];
+    }
+    [self.recorder recordData:data direction:XMPPStreamRecordDirectionOutbound];
+
+    NSData *compressedData = [self xmpp_compressData:data];
+    if (compressedData == nil) {
+        return;
+    }
+
+    if (_compression == nil) {
+        for (NSNumber *length in lengths) {
+            [_outboundQueue enqueueStanzaWithLength:[length unsignedIntegerValue]];
+        }
+    } else {
+        // The compressed bytes can not be attributed to the single
+        // documents. All documents are written with the last byte.
+        for (NSUInteger index = 1; index < [documents count]; index++) {
+            [_outboundQueue enqueueStanzaWithLength:0];
+        }
+        [_outboundQueue enqueueStanzaWithLength:[compressedData length]];
+    }
+    [self xmpp_appendData:compressedData];
+}
+
+- (void)xmpp_handleDocument:(PXDocument *)document
+{
+    if (_negotiatingTLS) {
+        [self xmpp_handleTLSDocument:document];
+        return;
+    }
+
+    if (_state == XMPPStreamStateOpening && !_didReportOpen) {
+        if ([document.root.namespace isEqualToString:XMPPTCPStream_NS] &&
+            [document.root.name isEqualToString:@"features"]) {
+            if ([self xmpp_handleFeaturesBeforeOpen:document]) {
+                return;
+            }
+        }
+        [self xmpp_reportOpen];
+    }
+
+    if (_state != XMPPStreamStateOpen) {
+        XMPPLogWarning(XMPPLogCategoryStream, @"Can only handle elements if the stream is open. Dropping received element. Current state is %lu and the received document is: %@", (unsigned long)_state, document);
+    } else {
+        if ([self.delegate respondsToSelector:@selector(stream:didReceiveDocument:)]) {
+            [self.delegate stream:self didReceiveDocument:document];
+        }
+    }
+}
+
+#pragma mark Keep Alive
+
+- (void)keepAlive
+{
+    // RFC 6120, Section 4.6.1: Whitespace is used as keep alive on the stream.
+    // Only the most recently scheduled timer is handled. Rescheduling
+    // (or tearing down the socket) cancels the pending timer.
+    NSTimeInterval keepAliveInterval = 20.0;
+    NSUInteger generation = ++_keepAliveGeneration;
+    __weak typeof(self) _self = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(keepAliveInterval * NSEC_PER_SEC)), [self xmpp_queue], ^{
+        typeof(self) this = _self;
+        if (this && this->_keepAliveGeneration == generation && this->_outputStream && this->_state == XMPPStreamStateOpen) {
+            [this xmpp_writeData:[@" " dataUsingEncoding:NSUTF8StringEncoding]];
+            [this keepAlive];
+        }
+    });
+}
+
+#pragma mark Error Handling
+
+- (void)xmpp_handleError:(NSError *)error
+{
+    XMPPLogError(XMPPLogCategoryStream, @"Stream to host '%@' did fail with error: %@", self.hostname, [error localizedDescription]);
+
+    [self xmpp_tearDownSocket];
+    _state = XMPPStreamStateClosed;
+
+    if ([self.delegate respondsToSelector:@selector(stream:didFailWithError:)]) {
+        [self.delegate stream:self didFailWithError:error];
+    }
+}
+
+- (void)xmpp_closeAfterWriting
+{
+    // The socket is closed after the pending data (including the stream
+    // footer) has been written, or after a timeout, if the peer does not
+    // read anymore. Tearing down the socket cancels the timeout.
+    if (!_outputStreamOpen || _writeBufferOffset == [_writeBuffer length]) {
+        [self xmpp_handleClose];
+        return;
+    }
+
+    _closeAfterWriting = YES;
+    NSUInteger generation = ++_closeGeneration;
+    __weak typeof(self) _self = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(XMPPTCPStreamCloseTimeout * NSEC_PER_SEC)), [self xmpp_queue], ^{
+        typeof(self) this = _self;
+        if (this && this->_closeAfterWriting && this->_closeGeneration == generation) {
+            XMPPLogDebug(XMPPLogCategoryStream, @"Timeout while writing the pending data before closing the stream.");
+            [this xmpp_handleClose];
+        }
+    });
+}
+
+- (void)xmpp_handleClose
+{
+    [self xmpp_tearDownSocket];
+    _state = XMPPStreamStateClosed;
+
+    if ([self.delegate respondsToSelector:@selector(streamDidClose:)]) {
+        [self.delegate streamDidClose:self];
+    }
+}
+
+#pragma mark Manage Socket
+
+- (NSString *)xmpp_connectHost
+{
+    return self.options[XMPPTCPStreamHostKey] ?: self.hostname;
+}
+
+- (UInt32)xmpp_connectPort
+{
+    NSNumber *port = self.options[XMPPTCPStreamPortKey];
+    return port ? (UInt32)[port unsignedIntegerValue] : XMPPTCPStreamDefaultPort;
+}
+
+- (void)xmpp_setUpSocket
+{
+    NSAssert(_inputStream == nil, @"Invalid State: Socket is already set up.");
+
+    CFReadStreamRef readStream = NULL;
+    CFWriteStreamRef writeStream = NULL;
+    CFStreamCreatePairWithSocketToHost(kCFAllocatorDefault,
+                                       (__bridge CFStringRef)[self xmpp_connectHost],
+                                       [self xmpp_connectPort],
+                                       &readStream,
+                                       &writeStream);
+
+    _inputStream = (__bridge_transfer NSInputStream *)readStream;
+    _outputStream = (__bridge_transfer NSOutputStream *)writeStream;
+
+    _inputStream.delegate = self;
+    _outputStream.delegate = self;
+
+    CFReadStreamSetDispatchQueue((__bridge CFReadStreamRef)_inputStream, [self xmpp_queue]);
+    CFWriteStreamSetDispatchQueue((__bridge CFWriteStreamRef)_outputStream, [self xmpp_queue]);
+
+    _secure = NO;
+    _negotiatingTLS = NO;
+    _didReportOpen = NO;
+    _streamHostname = nil;
+    _streamId = nil;
+
+    [_parser reset];
+    [_outboundQueue updateWithOptions:self.options];
+
+    [_inputStream open];
+    [_outputStream open];
+}
+
+- (void)xmpp_tearDownSocket
+{
+    if (_inputStream) {
+        _inputStream.delegate = nil;
+        CFReadStreamSetDispatchQueue((__bridge CFReadStreamRef)_inputStream, NULL);
+        [_inputStream close];
+        _inputStream = nil;
+    }
+
+    if (_outputStream) {
+        _outputStream.delegate = nil;
+        CFWriteStreamSetDispatchQueue((__bridge CFWriteStreamRef)_outputStream, NULL);
+        [_outputStream close];
+        _outputStream = nil;
+    }
+
+    _inputStreamOpen = NO;
+    _outputStreamOpen = NO;
+    _negotiatingTLS = NO;
+    _didReportOpen = NO;
+    _compression = nil;
+    _keepAliveGeneration++;
+    _closeAfterWriting = NO;
+    _closeGeneration++;
+
+    [_writeBuffer setLength:0];
+    _writeBufferOffset = 0;
+    [_outboundQueue reset];
+
+    [_parser reset];
+}
+
+#pragma mark Reading & Writing
+
+- (void)xmpp_readBytes
+{
+    while (_inputStream && _state != XMPPStreamStateDisconnecting && !self.readingPaused && [_inputStream hasBytesAvailable]) {
+        NSInteger length = [_inputStream read:_readBuffer maxLength:XMPPTCPStreamReadBufferSize];
+        if (length < 0) {
+            [self xmpp_handleError:[_inputStream streamError]];
+            return;
+        } else if (length == 0) {
+            return;
+        }
+
+        if (_compression) {
+            NSError *error = nil;
+            NSData *data = [_compression decompressBytes:_readBuffer length:length error:&error];
+            if (data == nil) {
+                [self xmpp_handleError:error];
+                return;
+            }
+            [self.recorder recordData:data direction:XMPPStreamRecordDirectionInbound];
+            [_parser parseData:data];
+        } else {
+            [self.recorder recordBytes:_readBuffer length:length direction:XMPPStreamRecordDirectionInbound];
+            [_parser parseBytes:_readBuffer length:length];
+        }
+    }
+}
+
+- (void)xmpp_writeData:(NSData *)data
+{
+    if (_outputStream == nil) {
+        return;
+    }
+
+    [self.recorder recordData:data direction:XMPPStreamRecordDirectionOutbound];
+
+    data = [self xmpp_compressData:data];
+    if (data) {
+        [_outboundQueue enqueueBytesWithLength:[data length]];
+        [self xmpp_appendData:data];
+    }
+}
+
+- (NSData *)xmpp_compressData:(NSData *)data
+{
+    if (_compression == nil) {
+        return data;
+    }
+
+    NSData *compressedData = [_compression compressData:data];
+    if (compressedData == nil) {
+        NSString *errorMessage = @"Failed to compress data.";
+        NSError *error = [NSError errorWithDomain:XMPPErrorDomain
+                                             code:XMPPErrorCodeInvalidState
+                                         userInfo:@{NSLocalizedDescriptionKey : errorMessage}];
+        [self xmpp_handleError:error];
+    }
+    return compressedData;
+}
+
+- (void)xmpp_appendData:(NSData *)data
+{
+    [_writeBuffer appendData:data];
+    [self xmpp_writeBytes];
+}
+
+- (void)xmpp_writeBytes
+{
+    while (_outputStreamOpen && [_writeBuffer length] > _writeBufferOffset && [_outputStream hasSpaceAvailable]) {
+        const uint8_t *bytes = (const uint8_t *)[_writeBuffer bytes] + _writeBufferOffset;
+        NSInteger length = [_outputStream write:bytes maxLength:[_writeBuffer length] - _writeBufferOffset];
+        if (length < 0) {
+            [self xmpp_handleError:[_outputStream streamError]];
+            return;
+        } else if (length == 0) {
+            break;
+        }
+        _writeBufferOffset += length;
+        [_outboundQueue dequeueBytesWithLength:length];
+    }
+
+    if (_writeBufferOffset == [_writeBuffer length]) {
+        [_writeBuffer setLength:0];
+        _writeBufferOffset = 0;
+        if (_closeAfterWriting) {
+            [self xmpp_handleClose];
+        }
+    } else if (_writeBufferOffset > [_writeBuffer length] / 2) {
+        // Compact the buffer, if more than the half has been written.
+        [_writeBuffer replaceBytesInRange:NSMakeRange(0, _writeBufferOffset) withBytes:NULL length:0];
+        _writeBufferOffset = 0;
+    }
+}
+
+#pragma mark Operation Queue
+
+- (dispatch_queue_t)xmpp_queue
+{
+    return self.queue ?: dispatch_get_main_queue();
+}
+
+#pragma mark - NSStreamDelegate (called on [self xmpp_queue])
+
+- (void)stream:(NSStream *)aStream handleEvent:(NSStreamEvent)eventCode
+{
+    switch (eventCode) {
+    case NSStreamEventOpenCompleted:
+        if (aStream == _inputStream) {
+            _inputStreamOpen = YES;
+        } else if (aStream == _outputStream) {
+            _outputStreamOpen = YES;
+        }
+
+        if (_inputStreamOpen && _outputStreamOpen) {
+            if (_state != XMPPStreamStateConnecting) {
+                NSString *errorMessage = @"Expecting stream to be in state 'connection' while the connection is established.";
+                NSDictionary *userInfo = @{NSLocalizedDescriptionKey : errorMessage};
+                NSError *error = [NSError errorWithDomain:XMPPErrorDomain
+                                                     code:XMPPErrorCodeInvalidState
+                                                 userInfo:userInfo];
+                [self xmpp_handleError:error];
+            } else {
+                _state = XMPPStreamStateOpening;
+                [self xmpp_sendStreamHeader];
+                [self keepAlive];
+            }
+        }
+        break;
+
+    case NSStreamEventHasBytesAvailable:
+        [self xmpp_readBytes];
+        break;
+
+    case NSStreamEventHasSpaceAvailable:
+        [self xmpp_writeBytes];
+        break;
+
+    case NSStreamEventErrorOccurred:
+        [self xmpp_handleError:[aStream streamError]];
+        break;
+
+    case NSStreamEventEndEncountered:
+        [self xmpp_handleClose];
+        break;
+
+    default:
+        break;
+    }
+}
+
+#pragma mark - XMPPStreamParserDelegate (called on [self xmpp_queue])
+
+- (void)parser:(XMPPStreamParser *)parser didOpenStreamWithAttributes:(NSDictionary<NSString *, NSString *> *)attributes
+{
+    if (_state != XMPPStreamStateOpening) {
+
+        NSString *errorMessage = @"Received unexpected stream header.";
+
+        NSDictionary *userInfo = @{NSLocalizedDescriptionKey : errorMessage};
+        NSError *error = [NSError errorWithDomain:XMPPErrorDomain
+                                             code:XMPPErrorCodeInvalidState
+                                         userInfo:userInfo];
+        [self xmpp_handleError:error];
+
+    } else {
+
+        XMPPLogDebug(XMPPLogCategoryStream, @"Received stream header: %@", attributes);
+
+        _streamHostname = attributes[@"from"] ?: self.hostname;
+        _streamId = attributes[@"id"];
+
+        if (_secure) {
+            // If the stream is not secured yet, the stream is reported as
+            // open after the features have been checked for STARTTLS.
+            [self xmpp_reportOpen];
+        }
+    }
+}
+
+- (void)parser:(XMPPStreamParser *)parser didParseDocument:(PXDocument *)document
+{
+    [self xmpp_handleDocument:document];
+}
+
+- (void)parserDidCloseStream:(XMPPStreamParser *)parser
+{
+    XMPPLogDebug(XMPPLogCategoryStream, @"Received stream footer.");
+
+    if (_state == XMPPStreamStateOpen) {
+        [self xmpp_sendStreamFooter];
+    }
+
+    _state = XMPPStreamStateDisconnecting;
+    [self xmpp_closeAfterWriting];
+}
+
+- (void)parser:(XMPPStreamParser *)parser didFailWithError:(NSError *)error
+{
+    [self xmpp_handleError:error];
+}
+
+#pragma mark - Helpers
+
++ (NSString *)xmpp_escapedAttributeValue:(NSString *)value
+{
+    NSMutableString *escaped = [value mutableCopy];
+    [escaped replaceOccurrencesOfString:@"&" withString:@"&amp;" options:0 range:NSMakeRange(0, [escaped length])];
+    [escaped replaceOccurrencesOfString:@"<" withString:@"&lt;" options:0 range:NSMakeRange(0, [escaped length])];
+    [escaped replaceOccurrencesOfString:@"'" withString:@"&apos;" options:0 range:NSMakeRange(0, [escaped length])];
+    [escaped replaceOccurrencesOfString:@"\"" withString:@"&quot;" options:0 range:NSMakeRange(0, [escaped length])];
+    return escaped;
+}
+
+@end
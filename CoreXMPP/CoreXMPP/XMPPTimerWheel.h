@@ -0,0 +1,79 @@
+//
+//  XMPPTimerWheel.h
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+@import Foundation;
+
+// Timer handle returned by the wheel. Must only be used on the queue of the wheel.
+@interface XMPPTimerWheelEntry : NSObject
+@property (nonatomic, readonly) uint64_t deadline;
+@property (nonatomic, readonly, getter=isScheduled) BOOL scheduled;
+@end
+
+// Hashed timer wheel for a large number of timeouts (e.g., of pending IQ
+// requests). The deadlines are rounded up to the resolution of the wheel
+// and hashed into a fixed number of slots. Scheduling and cancelling a
+// timer is O(1). The expired timers of a tick are removed as one batch,
+// before their handlers are called.
+//
+// All methods must be called on the queue of the wheel. The handlers are
+// called on this queue. The wheel does not tick at its resolution. Its
+// (GCD) timer is armed for the next slot with timers and is cancelled,
+// when the wheel is empty.
+
+@interface XMPPTimerWheel : NSObject
+
+- (nonnull instancetype)initWithQueue:(nonnull dispatch_queue_t)queue;
+- (nonnull instancetype)initWithQueue:(nonnull dispatch_queue_t)queue
+                           resolution:(NSTimeInterval)resolution
+                        numberOfSlots:(NSUInteger)numberOfSlots NS_DESIGNATED_INITIALIZER;
+
+@property (nonatomic, readonly) dispatch_queue_t _Nonnull queue;
+@property (nonatomic, readonly) NSTimeInterval resolution;
+@property (nonatomic, readonly) NSUInteger numberOfSlots;
+@property (nonatomic, readonly) NSUInteger numberOfTimers;
+
+- (nonnull XMPPTimerWheelEntry *)scheduleTimerWithTimeout:(NSTimeInterval)timeout
+                                                  handler:(nonnull void (^)(void))handler;
+
+// Does nothing, if the timer already expired or has been cancelled.
+- (void)cancelTimer:(nullable XMPPTimerWheelEntry *)timer;
+
+// Calls the handlers of all timers, which expired until the given time
+// (the system uptime in seconds). Returns the number of expired timers.
+// The wheel calls this periodically, but it can also be used to advance
+// the wheel manually.
+- (NSUInteger)expireTimersUntil:(NSTimeInterval)uptime;
+
+@end
@@ -0,0 +1,282 @@
+//
+//  XMPPTimerWheel.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPTimerWheel.h"
+
+static const NSTimeInterval XMPPTimerWheelDefaultResolution = 0.1;
+static const NSUInteger XMPPTimerWheelDefaultNumberOfSlots = 1024;
+
+@interface XMPPTimerWheelEntry ()
+@property (nonatomic, readwrite) uint64_t deadline;
+@property (nonatomic, readwrite) NSUInteger slot;
+@property (nonatomic, readwrite, getter=isScheduled) BOOL scheduled;
+@property (nonatomic, readwrite, strong) XMPPTimerWheelEntry *next;
+@property (nonatomic, readwrite, unsafe_unretained) XMPPTimerWheelEntry *previous;
+@property (nonatomic, readwrite, copy) void (^handler)(void);
+@end
+
+@interface XMPPTimerWheel () {
+    __strong XMPPTimerWheelEntry **_slots;
+    NSUInteger _mask;
+    uint64_t _currentTick;
+    uint64_t _armedTick;
+    dispatch_source_t _timer;
+}
+
+@end
+
+@implementation XMPPTimerWheel
+
+#pragma mark Life-cycle
+
+- (instancetype)initWithQueue:(dispatch_queue_t)queue
+{
+    return [self initWithQueue:queue
+                    resolution:XMPPTimerWheelDefaultResolution
+                 numberOfSlots:XMPPTimerWheelDefaultNumberOfSlots];
+}
+
+- (instancetype)initWithQueue:(dispatch_queue_t)queue
+                   resolution:(NSTimeInterval)resolution
+                numberOfSlots:(NSUInteger)numberOfSlots
+{
+    self = [super init];
+    if (self) {
+        // The number of slots is rounded up to a power of two.
+        NSUInteger slots = 1;
+        while (slots < numberOfSlots) {
+            slots <<= 1;
+        }
+
+        _queue = queue;
+        _resolution = resolution > 0 ? resolution : XMPPTimerWheelDefaultResolution;
+        _numberOfSlots = slots;
+        _mask = slots - 1;
+        _slots = (__strong XMPPTimerWheelEntry **)calloc(slots, sizeof(XMPPTimerWheelEntry *));
+        _currentTick = (uint64_t)floor([self xmpp_uptime] / _resolution);
+        _armedTick = UINT64_MAX;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    if (_timer) {
+        dispatch_source_cancel(_timer);
+    }
+
+    // Release the entries one by one to avoid a deep recursion, if a
+    // slot has a long list. The handlers are released as well, because
+    // they may reference the entry.
+    for (NSUInteger index = 0; index < _numberOfSlots; index++) {
+        XMPPTimerWheelEntry *entry = _slots[index];
+        _slots[index] = nil;
+        while (entry) {
+            XMPPTimerWheelEntry *next = entry.next;
+            entry.next = nil;
+            entry.handler = nil;
+            entry.scheduled = NO;
+            entry = next;
+        }
+    }
+    free(_slots);
+}
+
+#pragma mark Timers
+
+- (XMPPTimerWheelEntry *)scheduleTimerWithTimeout:(NSTimeInterval)timeout handler:(void (^)(void))handler
+{
+    NSTimeInterval uptime = [self xmpp_uptime] + MAX(timeout, 0);
+    uint64_t deadline = MAX((uint64_t)ceil(uptime / _resolution), _currentTick + 1);
+
+    XMPPTimerWheelEntry *entry = [[XMPPTimerWheelEntry alloc] init];
+    entry.deadline = deadline;
+    entry.handler = handler;
+    [self xmpp_link:entry];
+
+    if (deadline < _armedTick) {
+        [self xmpp_armTimerForTick:deadline];
+    }
+
+    return entry;
+}
+
+- (void)cancelTimer:(XMPPTimerWheelEntry *)timer
+{
+    if (timer.scheduled) {
+        [self xmpp_unlink:timer];
+        timer.handler = nil;
+    }
+}
+
+- (NSUInteger)expireTimersUntil:(NSTimeInterval)uptime
+{
+    uint64_t tick = (uint64_t)floor(uptime / _resolution);
+    if (tick <= _currentTick) {
+        return 0;
+    }
+
+    // Each slot has to be visited only once, even if the wheel has not
+    // been advanced for more than one revolution.
+    uint64_t numberOfSteps = MIN(tick - _currentTick, (uint64_t)_numberOfSlots);
+
+    NSMutableArray<XMPPTimerWheelEntry *> *expiredTimers = [[NSMutableArray alloc] init];
+    for (uint64_t step = 1; step <= numberOfSteps; step++) {
+        NSUInteger slot = (NSUInteger)((_currentTick + step) & _mask);
+        XMPPTimerWheelEntry *entry = _slots[slot];
+        while (entry) {
+            XMPPTimerWheelEntry *next = entry.next;
+            if (entry.deadline <= tick) {
+                [self xmpp_unlink:entry];
+                [expiredTimers addObject:entry];
+            }
+            entry = next;
+        }
+    }
+    _currentTick = tick;
+
+    // The handlers are called after the batch has been removed. Therefore
+    // they can schedule and cancel other timers.
+    for (XMPPTimerWheelEntry *entry in expiredTimers) {
+        void (^handler)(void) = entry.handler;
+        entry.handler = nil;
+        if (handler) {
+            handler();
+        }
+    }
+
+    [self xmpp_armTimer];
+
+    return [expiredTimers count];
+}
+
+#pragma mark -
+
+- (NSTimeInterval)xmpp_uptime
+{
+    return [[NSProcessInfo processInfo] systemUptime];
+}
+
+- (void)xmpp_link:(XMPPTimerWheelEntry *)entry
+{
+    NSUInteger slot = (NSUInteger)(entry.deadline & _mask);
+    XMPPTimerWheelEntry *head = _slots[slot];
+    entry.slot = slot;
+    entry.next = head;
+    entry.previous = nil;
+    head.previous = entry;
+    _slots[slot] = entry;
+    entry.scheduled = YES;
+    _numberOfTimers += 1;
+}
+
+- (void)xmpp_unlink:(XMPPTimerWheelEntry *)entry
+{
+    XMPPTimerWheelEntry *next = entry.next;
+    XMPPTimerWheelEntry *previous = entry.previous;
+    next.previous = previous;
+    if (previous) {
+        previous.next = next;
+    } else {
+        _slots[entry.slot] = next;
+    }
+    entry.next = nil;
+    entry.previous = nil;
+    entry.scheduled = NO;
+    _numberOfTimers -= 1;
+}
+
+#pragma mark Timer
+
+- (void)xmpp_armTimer
+{
+    // The timer is armed for the next slot with entries. If the entries of
+    // this slot are due in a later revolution, the timer fires without
+    // expiring them and is armed again.
+    if (_numberOfTimers == 0) {
+        if (_timer) {
+            dispatch_source_cancel(_timer);
+            _timer = nil;
+        }
+        _armedTick = UINT64_MAX;
+        return;
+    }
+
+    for (uint64_t step = 1; step <= _numberOfSlots; step++) {
+        uint64_t tick = _currentTick + step;
+        if (_slots[tick & _mask]) {
+            [self xmpp_armTimerForTick:tick];
+            return;
+        }
+    }
+}
+
+- (void)xmpp_armTimerForTick:(uint64_t)tick
+{
+    if (_timer == nil) {
+        _timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+
+        __weak typeof(self) _self = self;
+        dispatch_source_set_event_handler(_timer, ^{
+            typeof(self) this = _self;
+            [this xmpp_handleTimer];
+        });
+        dispatch_resume(_timer);
+    }
+
+    // The timer fires once. The leeway is a tenth of the resolution.
+    _armedTick = tick;
+    NSTimeInterval delay = MAX(tick * _resolution - [self xmpp_uptime], 0);
+    dispatch_source_set_timer(_timer,
+                              dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)),
+                              DISPATCH_TIME_FOREVER,
+                              (uint64_t)(_resolution * NSEC_PER_SEC) / 10);
+}
+
+- (void)xmpp_handleTimer
+{
+    // If the timer fired before the wheel can be advanced, it is armed
+    // again for the same slot.
+    _armedTick = UINT64_MAX;
+    [self expireTimersUntil:[self xmpp_uptime]];
+    if (_armedTick == UINT64_MAX) {
+        [self xmpp_armTimer];
+    }
+}
+
+@end
+
+@implementation XMPPTimerWheelEntry
+@end
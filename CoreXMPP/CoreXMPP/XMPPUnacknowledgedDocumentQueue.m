@@ -0,0 +1,197 @@
+//
+//  XMPPUnacknowledgedDocumentQueue.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import <PureXML/PureXML.h>
+
+#import "PXDocument+WireData.h"
+#import "XMPPUnacknowledgedDocumentQueue.h"
+
+static const NSUInteger XMPPUnacknowledgedDocumentQueueMinimumCapacity = 16;
+
+typedef void (^XMPPUnacknowledgedDocumentQueueAcknowledgement)(NSError *error);
+
+@interface XMPPUnacknowledgedDocumentQueue () {
+    // The capacity is a power of two. The slot of the document with the
+    // index i is (_head + i) & (_capacity - 1).
+    __strong PXDocument **_documents;
+    __strong XMPPUnacknowledgedDocumentQueueAcknowledgement *_acknowledgements;
+    NSUInteger _capacity;
+    NSUInteger _head;
+    NSUInteger _count;
+}
+
+@end
+
+@implementation XMPPUnacknowledgedDocumentQueue
+
+#pragma mark Life-cycle
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        [self xmpp_resizeToCapacity:XMPPUnacknowledgedDocumentQueueMinimumCapacity];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    for (NSUInteger index = 0; index < _count; index++) {
+        NSUInteger slot = (_head + index) & (_capacity - 1);
+        _documents[slot] = nil;
+        _acknowledgements[slot] = nil;
+    }
+    free(_documents);
+    free(_acknowledgements);
+}
+
+#pragma mark Documents
+
+- (void)appendDocument:(PXDocument *)document acknowledgement:(void (^)(NSError *))acknowledgement
+{
+    if (_count == _capacity) {
+        [self xmpp_resizeToCapacity:_capacity * 2];
+    }
+    // The document is kept for resending and is not modified anymore.
+    // It is appended before it is passed to the stream, therefore the
+    // stream uses the frozen bytes as well.
+    [document xmpp_freezeWireData];
+
+    NSUInteger slot = (_head + _count) & (_capacity - 1);
+    _documents[slot] = document;
+    _acknowledgements[slot] = [acknowledgement copy];
+    _count += 1;
+}
+
+- (PXDocument *)documentAtIndex:(NSUInteger)index
+{
+    NSParameterAssert(index < _count);
+    return _documents[(_head + index) & (_capacity - 1)];
+}
+
+- (void)enumerateDocumentsUsingBlock:(void (^)(PXDocument *, NSUInteger, BOOL *))block
+{
+    BOOL stop = NO;
+    for (NSUInteger index = 0; index < _count && !stop; index++) {
+        block(_documents[(_head + index) & (_capacity - 1)], index, &stop);
+    }
+}
+
+- (NSArray<PXDocument *> *)allDocuments
+{
+    NSMutableArray *documents = [[NSMutableArray alloc] initWithCapacity:_count];
+    for (NSUInteger index = 0; index < _count; index++) {
+        [documents addObject:_documents[(_head + index) & (_capacity - 1)]];
+    }
+    return documents;
+}
+
+#pragma mark Acknowledgement
+
+- (void)acknowledgeDocuments:(NSUInteger)count
+{
+    // The document is removed, before its acknowledgement is called. This
+    // way, the acknowledgement can already send the next document.
+    for (NSUInteger index = 0; index < count && _count > 0; index++) {
+        NSUInteger slot = _head;
+        XMPPUnacknowledgedDocumentQueueAcknowledgement acknowledgement = _acknowledgements[slot];
+        _documents[slot] = nil;
+        _acknowledgements[slot] = nil;
+        _head = (_head + 1) & (_capacity - 1);
+        _count -= 1;
+        if (acknowledgement) {
+            acknowledgement(nil);
+        }
+    }
+    [self xmpp_shrinkIfNeeded];
+}
+
+- (void)cancelAllDocumentsWithError:(NSError *)error
+{
+    NSMutableArray *acknowledgements = [[NSMutableArray alloc] init];
+    for (NSUInteger index = 0; index < _count; index++) {
+        NSUInteger slot = (_head + index) & (_capacity - 1);
+        if (_acknowledgements[slot]) {
+            [acknowledgements addObject:_acknowledgements[slot]];
+        }
+        _documents[slot] = nil;
+        _acknowledgements[slot] = nil;
+    }
+    _head = 0;
+    _count = 0;
+    [self xmpp_shrinkIfNeeded];
+
+    for (XMPPUnacknowledgedDocumentQueueAcknowledgement acknowledgement in acknowledgements) {
+        acknowledgement(error);
+    }
+}
+
+#pragma mark -
+
+- (void)xmpp_shrinkIfNeeded
+{
+    NSUInteger capacity = _capacity;
+    while (capacity > XMPPUnacknowledgedDocumentQueueMinimumCapacity && _count <= capacity / 4) {
+        capacity /= 2;
+    }
+    if (capacity != _capacity) {
+        [self xmpp_resizeToCapacity:capacity];
+    }
+}
+
+- (void)xmpp_resizeToCapacity:(NSUInteger)capacity
+{
+    __strong PXDocument **documents = (__strong PXDocument **)calloc(capacity, sizeof(PXDocument *));
+    __strong XMPPUnacknowledgedDocumentQueueAcknowledgement *acknowledgements = (__strong XMPPUnacknowledgedDocumentQueueAcknowledgement *)calloc(capacity, sizeof(XMPPUnacknowledgedDocumentQueueAcknowledgement));
+
+    for (NSUInteger index = 0; index < _count; index++) {
+        NSUInteger slot = (_head + index) & (_capacity - 1);
+        documents[index] = _documents[slot];
+        acknowledgements[index] = _acknowledgements[slot];
+        _documents[slot] = nil;
+        _acknowledgements[slot] = nil;
+    }
+
+    free(_documents);
+    free(_acknowledgements);
+
+    _documents = documents;
+    _acknowledgements = acknowledgements;
+    _capacity = capacity;
+    _head = 0;
+}
+
+@end
@@ -38,6 +38,15 @@
 
 extern NSString *const XMPPWebsocketStreamURLKey NS_SWIFT_NAME(WebsocketStreamURLKey);
 
+// The XMPPHostMetaCache used to discover the websocket URL, if no URL
+// is set. Defaults to the shared cache.
+extern NSString *const XMPPWebsocketStreamHostMetaCacheKey NS_SWIFT_NAME(WebsocketStreamHostMetaCacheKey);
+
+// If the host offers several websocket endpoints, connection attempts are
+// started one after the other with this delay (NSNumber, seconds) until the
+// first handshake completes. Defaults to 0.25s.
+extern NSString *const XMPPWebsocketStreamConnectionAttemptDelayKey NS_SWIFT_NAME(WebsocketStreamConnectionAttemptDelayKey);
+
 NS_SWIFT_NAME(WebsocketStream)
 @interface XMPPWebsocketStream : XMPPStream
 
@@ -35,16 +35,59 @@
 
 #import <SocketRocket/SRWebSocket.h>
 
+#import "PXDocument+WireData.h"
 #import "XMPPError.h"
+#import "XMPPHostMetaCache.h"
+#import "XMPPLogger.h"
+#import "XMPPStreamKeepAlive.h"
+#import "XMPPStreamOutboundQueue.h"
+#import "XMPPStreamRecorder.h"
 #import "XMPPWebsocketStream.h"
 
 NSString *const XMPPWebsocketStreamURLKey = @"XMPPWebsocketStreamURLKey";
+NSString *const XMPPWebsocketStreamHostMetaCacheKey = @"XMPPWebsocketStreamHostMetaCacheKey";
+NSString *const XMPPWebsocketStreamConnectionAttemptDelayKey = @"XMPPWebsocketStreamConnectionAttemptDelayKey";
+
+static const NSTimeInterval XMPPWebsocketStreamDefaultConnectionAttemptDelay = 0.25;
 NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
 
+static const char *XMPPWebsocketStreamFramingNamespace = "urn:ietf:params:xml:ns:xmpp-framing";
+static const char *XMPPWebsocketStreamStreamManagementNamespace = "urn:xmpp:sm:3";
+
+#define XMPP_EMPTY_ELEMENT_MAX_ATTRIBUTES 8
+
+typedef struct {
+    const char *name;
+    size_t nameLength;
+    const char *value;
+    size_t valueLength;
+} XMPPEmptyElementAttribute;
+
+typedef struct {
+    const char *name;
+    size_t nameLength;
+    const char *namespace;
+    size_t namespaceLength;
+    XMPPEmptyElementAttribute attributes[XMPP_EMPTY_ELEMENT_MAX_ATTRIBUTES];
+    size_t numberOfAttributes;
+} XMPPEmptyElement;
+
+static BOOL XMPPScanEmptyElement(const char *bytes, size_t length, XMPPEmptyElement *element);
+static BOOL XMPPEmptyElementHasQName(const XMPPEmptyElement *element, const char *namespace, const char *name);
+static const XMPPEmptyElementAttribute *XMPPEmptyElementAttributeWithName(const XMPPEmptyElement *element, const char *name);
+static NSString *XMPPEmptyElementAttributeValue(const XMPPEmptyElement *element, const char *name);
+
 @interface XMPPWebsocketStream () <SRWebSocketDelegate> {
     XMPPStreamState _state;
     SRWebSocket *_websocket;
-    NSURL *_discoveredWebsocketURL;
+    NSArray<NSURL *> *_candidateWebsocketURLs;
+    NSUInteger _nextCandidateIndex;
+    NSMutableArray<SRWebSocket *> *_connectingWebsockets;
+    NSUInteger _connectionAttemptGeneration;
+    XMPPStreamOutboundQueue *_outboundQueue;
+    BOOL _drainMarkerPending;
+    XMPPStreamKeepAlive *_keepAlive;
+    NSUInteger _keepAliveGeneration;
 }
 
 @end
@@ -53,6 +96,26 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
 
 #pragma mark Life-cycle
 
+- (instancetype)initWithHostname:(NSString *)hostname
+                         options:(NSDictionary *)options
+{
+    self = [super initWithHostname:hostname options:options];
+    if (self) {
+        _connectingWebsockets = [[NSMutableArray alloc] init];
+        _outboundQueue = [[XMPPStreamOutboundQueue alloc] initWithOptions:options];
+        _keepAlive = [[XMPPStreamKeepAlive alloc] initWithOptions:options];
+
+        __weak typeof(self) _self = self;
+        _outboundQueue.writabilityHandler = ^(BOOL writable) {
+            typeof(self) this = _self;
+            if ([this.delegate respondsToSelector:@selector(stream:didChangeWritable:)]) {
+                [this.delegate stream:this didChangeWritable:writable];
+            }
+        };
+    }
+    return self;
+}
+
 - (void)dealloc
 {
     [self xmpp_tearDownWebsocket];
@@ -72,22 +135,41 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
     return _state;
 }
 
+- (BOOL)isWritable
+{
+    return _outboundQueue.writable;
+}
+
+#pragma mark Round-trip Time
+
+- (NSTimeInterval)roundTripTime
+{
+    return _keepAlive.roundTripTime;
+}
+
+- (NSTimeInterval)smoothedRoundTripTime
+{
+    return _keepAlive.smoothedRoundTripTime;
+}
+
+- (NSTimeInterval)roundTripTimeVariation
+{
+    return _keepAlive.roundTripTimeVariation;
+}
+
 #pragma mark Managing Stream
 
 - (void)open
 {
     NSAssert(_state == XMPPStreamStateClosed, @"Invalid State: Can only open a closed stream.");
 
-    NSLog(@"Open stream to host: %@", self.hostname);
+    XMPPLogInfo(XMPPLogCategoryStream, @"Open stream to host: %@", self.hostname);
 
     if ([self xmpp_needsDiscoverWebsocketURL]) {
         [self xmpp_discoverWebsocketURL];
         _state = XMPPStreamStateDiscovering;
     } else {
-        [self xmpp_setUpWebsocket];
-        [_websocket open];
-        _state = XMPPStreamStateConnecting;
-        NSLog(@"Connecting to host: %@ (%@)", self.hostname, _websocket.url);
+        [self xmpp_connectToWebsocketURLs:@[ self.options[XMPPWebsocketStreamURLKey] ]];
     }
 }
 
@@ -95,7 +177,7 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
 {
     NSAssert(_state == XMPPStreamStateOpen, @"Invalid State: Can only reopen a already opened stream.");
 
-    NSLog(@"Repoen stream to host: %@", self.hostname);
+    XMPPLogDebug(XMPPLogCategoryStream, @"Repoen stream to host: %@", self.hostname);
 
     [self xmpp_sendOpenFrame];
     _state = XMPPStreamStateOpening;
@@ -105,7 +187,7 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
 {
     NSAssert(_state == XMPPStreamStateOpen, @"Invalid State: Can only close an open stream.");
 
-    NSLog(@"Close stream to host: %@", self.hostname);
+    XMPPLogInfo(XMPPLogCategoryStream, @"Close stream to host: %@", self.hostname);
 
     [self xmpp_sendCloseFrame];
     _state = XMPPStreamStateClosing;
@@ -115,7 +197,7 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
 {
     NSAssert(_state == XMPPStreamStateOpen, @"Invalid State: Can only suspend an open stream.");
 
-    NSLog(@"Suspending stream to host: %@", self.hostname);
+    XMPPLogInfo(XMPPLogCategoryStream, @"Suspending stream to host: %@", self.hostname);
 
     [self xmpp_tearDownWebsocket];
     _state = XMPPStreamStateClosed;
@@ -145,7 +227,7 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
     [openFrameDocument.root setValue:self.hostname forAttribute:@"to"];
     [openFrameDocument.root setValue:@"1.0" forAttribute:@"version"];
 
-    NSLog(@"Send open frame.");
+    XMPPLogTrace(XMPPLogCategoryStream, @"Send open frame.");
 
     [self xmpp_sendDocument:openFrameDocument];
 }
@@ -155,7 +237,7 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
     PXDocument *closeFrameDocument = [[PXDocument alloc] initWithElementName:@"close"
                                                                    namespace:XMPPWebsocketStream_NS
                                                                       prefix:nil];
-    NSLog(@"Send close frame.");
+    XMPPLogTrace(XMPPLogCategoryStream, @"Send close frame.");
 
     [self xmpp_sendDocument:closeFrameDocument];
 }
@@ -163,9 +245,10 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
 - (void)xmpp_handleFrameDocument:(PXDocument *)document
 {
     if ([[document.root name] isEqualToString:@"open"]) {
-        [self xmpp_handleOpenFrame:document];
+        [self xmpp_handleOpenFrameFromHost:[document.root valueForAttribute:@"from"]
+                              withStreamId:[document.root valueForAttribute:@"id"]];
     } else if ([[document.root name] isEqualToString:@"close"]) {
-        [self xmpp_handleCloseFrame:document];
+        [self xmpp_handleCloseFrame];
     } else {
         NSString *errorMessage = @"Recevied unsupported framing document.";
 
@@ -177,9 +260,9 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
     }
 }
 
-- (void)xmpp_handleOpenFrame:(PXDocument *)document
+- (void)xmpp_handleOpenFrameFromHost:(NSString *)hostname withStreamId:(NSString *)streamId
 {
-    NSLog(@"Received open frame: %@", document);
+    XMPPLogDebug(XMPPLogCategoryStream, @"Received open frame from host: %@ (stream id: %@)", hostname, streamId);
 
     if (_state != XMPPStreamStateOpening) {
 
@@ -194,9 +277,6 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
 
     } else {
 
-        NSString *hostname = [document.root valueForAttribute:@"from"];
-        NSString *streamId = [document.root valueForAttribute:@"id"];
-
         _state = XMPPStreamStateOpen;
 
         if ([self.delegate respondsToSelector:@selector(stream:didOpenToHost:withStreamId:)]) {
@@ -205,9 +285,9 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
     }
 }
 
-- (void)xmpp_handleCloseFrame:(PXDocument *)document
+- (void)xmpp_handleCloseFrame
 {
-    NSLog(@"Received close frame: %@", document);
+    XMPPLogDebug(XMPPLogCategoryStream, @"Received close frame.");
 
     if (_state != XMPPStreamStateOpen && _state != XMPPStreamStateClosing) {
 
@@ -235,12 +315,58 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
 
 - (void)xmpp_sendDocument:(PXDocument *)document
 {
-    NSString *message = [[self class] stringFromDocument:document];
+    NSData *data = [document xmpp_wireData];
+    // SocketRocket only sends text frames from strings and may use
+    // the string asynchronously. Therefore the bytes must be copied here.
+    NSString *message = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
     NSError *error = nil;
     BOOL success = [_websocket sendString:message error:&error];
     if (!success) {
-        NSLog(@"Failed to send message: %@", [error localizedDescription]);
+        XMPPLogError(XMPPLogCategoryStream, @"Failed to send message: %@", [error localizedDescription]);
+    } else {
+        [self.recorder recordData:data direction:XMPPStreamRecordDirectionOutbound];
+        [_outboundQueue enqueueStanzaWithLength:[data length]];
+        [self xmpp_sendDrainMarker];
+    }
+}
+
+#pragma mark Outbound Queue
+
+- (void)xmpp_sendDrainMarker
+{
+    // SocketRocket does not report when a message has been written. Instead,
+    // a ping with the current position of the outbound queue is sent. The pong
+    // confirms that all bytes up to this position have left the buffers.
+    // Only one marker is in flight at a time.
+
+    if (_drainMarkerPending || _outboundQueue.numberOfPendingBytes == 0) {
+        return;
+    }
+
+    uint64_t position = CFSwapInt64HostToBig(_outboundQueue.position);
+    NSData *payload = [NSData dataWithBytes:&position length:sizeof(position)];
+
+    NSError *error = nil;
+    if ([_websocket sendPing:payload error:&error]) {
+        _drainMarkerPending = YES;
+    } else {
+        XMPPLogWarning(XMPPLogCategoryStream, @"Failed to send ping: %@", [error localizedDescription]);
+    }
+}
+
+- (void)xmpp_handleDrainMarker:(NSData *)payload
+{
+    if ([payload length] != sizeof(uint64_t)) {
+        return;
     }
+
+    uint64_t position = 0;
+    [payload getBytes:&position length:sizeof(position)];
+    position = CFSwapInt64BigToHost(position);
+
+    _drainMarkerPending = NO;
+    [_outboundQueue dequeueBytesUpToPosition:position];
+    [self xmpp_sendDrainMarker];
 }
 
 - (void)xmpp_handleDocument:(PXDocument *)document
@@ -249,7 +375,7 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
         [self xmpp_handleFrameDocument:document];
     } else {
         if (_state != XMPPStreamStateOpen) {
-            NSLog(@"Can only handle elements other than framing elements if the stream is open. Dropping received element. Current state is %lu and the received document is: %@", (unsigned long)_state, document);
+            XMPPLogWarning(XMPPLogCategoryStream, @"Can only handle elements other than framing elements if the stream is open. Dropping received element. Current state is %lu and the received document is: %@", (unsigned long)_state, document);
         } else {
             if ([self.delegate respondsToSelector:@selector(stream:didReceiveDocument:)]) {
                 [self.delegate stream:self didReceiveDocument:document];
@@ -258,29 +384,115 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
     }
 }
 
-#pragma Keep Alive
+- (BOOL)xmpp_handleControlElementWithBytes:(const char *)bytes length:(NSUInteger)length
+{
+    // Framing and stream management elements are empty elements with a few
+    // attributes. Those are recognized directly from the received bytes
+    // without building a DOM. If this method returns NO, the element must
+    // be handled as a regular document.
+
+    XMPPEmptyElement element;
+    if (!XMPPScanEmptyElement(bytes, length, &element)) {
+        return NO;
+    }
+
+    id<XMPPStreamDelegate> delegate = self.delegate;
+
+    if (XMPPEmptyElementHasQName(&element, XMPPWebsocketStreamFramingNamespace, "open")) {
+        [self xmpp_handleOpenFrameFromHost:XMPPEmptyElementAttributeValue(&element, "from")
+                              withStreamId:XMPPEmptyElementAttributeValue(&element, "id")];
+        return YES;
+
+    } else if (XMPPEmptyElementHasQName(&element, XMPPWebsocketStreamFramingNamespace, "close")) {
+        [self xmpp_handleCloseFrame];
+        return YES;
+
+    } else if (_state == XMPPStreamStateOpen &&
+               XMPPEmptyElementHasQName(&element, XMPPWebsocketStreamStreamManagementNamespace, "r")) {
+        if ([delegate respondsToSelector:@selector(streamDidReceiveAcknowledgementRequest:)]) {
+            [delegate streamDidReceiveAcknowledgementRequest:self];
+            return YES;
+        }
+
+    } else if (_state == XMPPStreamStateOpen &&
+               XMPPEmptyElementHasQName(&element, XMPPWebsocketStreamStreamManagementNamespace, "a")) {
+        const XMPPEmptyElementAttribute *h = XMPPEmptyElementAttributeWithName(&element, "h");
+        if (h && h->valueLength > 0 &&
+            [delegate respondsToSelector:@selector(stream:didReceiveAcknowledgement:)]) {
+            NSUInteger numberOfAcknowledgedDocuments = 0;
+            for (size_t i = 0; i < h->valueLength; i++) {
+                if (h->value[i] < '0' || h->value[i] > '9') {
+                    return NO;
+                }
+                NSUInteger digit = h->value[i] - '0';
+                if (numberOfAcknowledgedDocuments > (NSUIntegerMax - digit) / 10) {
+                    return NO;
+                }
+                numberOfAcknowledgedDocuments = numberOfAcknowledgedDocuments * 10 + digit;
+            }
+            [delegate stream:self didReceiveAcknowledgement:numberOfAcknowledgedDocuments];
+            return YES;
+        }
+    }
+
+    return NO;
+}
+
+#pragma mark Keep Alive
+
+- (void)xmpp_startKeepAlive
+{
+    [_keepAlive updateWithOptions:self.options];
+    [_keepAlive resetAtTime:[[NSProcessInfo processInfo] systemUptime]];
+    [self xmpp_scheduleKeepAlive];
+}
 
-- (void)keepAlive
+- (void)xmpp_scheduleKeepAlive
 {
-    NSTimeInterval keepAliveInterval = 20.0;
+    // Only the most recently scheduled timer is handled. Rescheduling
+    // (or tearing down the websocket) cancels the pending timer.
+    NSUInteger generation = ++_keepAliveGeneration;
+    NSTimeInterval delay = [_keepAlive delayAtTime:[[NSProcessInfo processInfo] systemUptime]];
+
     __weak typeof(self) _self = self;
-    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(keepAliveInterval * NSEC_PER_SEC)), [self xmpp_queue], ^{
-        if (_self && _websocket.readyState == SR_OPEN) {
-            NSError *error = nil;
-            BOOL success = [_websocket sendPing:nil error:&error];
-            if (!success) {
-                NSLog(@"Failed to send ping: %@", [error localizedDescription]);
-            }
-            [_self keepAlive];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), [self xmpp_queue], ^{
+        typeof(self) this = _self;
+        if (this && this->_keepAliveGeneration == generation && this->_websocket.readyState == SR_OPEN) {
+            [this xmpp_keepAliveTimerDidFire];
         }
     });
 }
 
+- (void)xmpp_keepAliveTimerDidFire
+{
+    NSData *payload = [_keepAlive pingPayloadAtTime:[[NSProcessInfo processInfo] systemUptime]];
+
+    if (_keepAlive.peerDead) {
+        NSString *errorMessage = [NSString stringWithFormat:@"Host did not answer %lu pings.", (unsigned long)_keepAlive.numberOfMissedPongs];
+        NSDictionary *userInfo = @{NSLocalizedDescriptionKey : errorMessage};
+        NSError *error = [NSError errorWithDomain:XMPPErrorDomain
+                                             code:XMPPErrorCodeTimeout
+                                         userInfo:userInfo];
+        [self xmpp_handleError:error];
+        return;
+    }
+
+    if (payload) {
+        NSError *error = nil;
+        BOOL success = [_websocket sendPing:payload error:&error];
+        if (!success) {
+            XMPPLogWarning(XMPPLogCategoryStream, @"Failed to send ping: %@", [error localizedDescription]);
+        }
+    }
+
+    [self xmpp_scheduleKeepAlive];
+}
+
 #pragma mark Error Handling
 
 - (void)xmpp_handleError:(NSError *)error
 {
-    NSLog(@"Stream to host '%@' did fail with error: %@", self.hostname, [error localizedDescription]);
+    XMPPLogError(XMPPLogCategoryStream, @"Stream to host '%@' did fail with error: %@", self.hostname, [error localizedDescription]);
 
     [self xmpp_tearDownWebsocket];
     _state = XMPPStreamStateClosed;
@@ -294,19 +506,37 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
 
 - (NSURL *)xmpp_websocketURL
 {
-    NSURL *websocketURL = self.options[XMPPWebsocketStreamURLKey];
-    if (websocketURL == nil) {
-        return _discoveredWebsocketURL;
-    }
-    return websocketURL;
+    return _websocket.url ?: self.options[XMPPWebsocketStreamURLKey];
 }
 
-- (void)xmpp_setUpWebsocket
+- (void)xmpp_connectToWebsocketURLs:(NSArray<NSURL *> *)websocketURLs
 {
     NSAssert(_websocket == nil, @"Invalid State: Websocket is already set up.");
 
-    NSURL *websocketURL = [self xmpp_websocketURL];
-    NSLog(@"Setup Websocket with URL: %@", websocketURL);
+    [_outboundQueue updateWithOptions:self.options];
+
+    _state = XMPPStreamStateConnecting;
+    _candidateWebsocketURLs = [websocketURLs copy];
+    _nextCandidateIndex = 0;
+
+    [self xmpp_startNextConnectionAttempt];
+}
+
+- (BOOL)xmpp_startNextConnectionAttempt
+{
+    // Connection attempts to the candidates are started one after the other
+    // (Happy Eyeballs, RFC 8305). A new attempt is started if the previous
+    // one failed or has not completed within the attempt delay. The first
+    // websocket which completes the handshake is used.
+
+    if (_nextCandidateIndex >= [_candidateWebsocketURLs count]) {
+        return NO;
+    }
+
+    NSURL *websocketURL = _candidateWebsocketURLs[_nextCandidateIndex];
+    _nextCandidateIndex++;
+
+    XMPPLogInfo(XMPPLogCategoryStream, @"Connecting to host: %@ (%@)", self.hostname, websocketURL);
 
     SRWebSocket *websocket = [[SRWebSocket alloc] initWithURL:websocketURL
                                                     protocols:@[ @"xmpp" ]
@@ -315,74 +545,112 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
     [websocket setDelegateDispatchQueue:[self xmpp_queue]];
     websocket.delegate = self;
 
+    [_connectingWebsockets addObject:websocket];
+    [websocket open];
+
+    if (_nextCandidateIndex < [_candidateWebsocketURLs count]) {
+        NSNumber *attemptDelay = self.options[XMPPWebsocketStreamConnectionAttemptDelayKey];
+        NSTimeInterval delay = attemptDelay ? [attemptDelay doubleValue] : XMPPWebsocketStreamDefaultConnectionAttemptDelay;
+
+        NSUInteger generation = ++_connectionAttemptGeneration;
+        __weak typeof(self) _self = self;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), [self xmpp_queue], ^{
+            typeof(self) this = _self;
+            if (this && this->_connectionAttemptGeneration == generation && this->_state == XMPPStreamStateConnecting) {
+                [this xmpp_startNextConnectionAttempt];
+            }
+        });
+    }
+
+    return YES;
+}
+
+- (void)xmpp_connectionAttemptDidSucceed:(SRWebSocket *)websocket
+{
+    [_connectingWebsockets removeObject:websocket];
+    [self xmpp_cancelConnectionAttempts];
+
     _websocket = websocket;
+
+    if ([_candidateWebsocketURLs count] > 1) {
+        XMPPHostMetaCache *cache = self.options[XMPPWebsocketStreamHostMetaCacheKey] ?: [XMPPHostMetaCache sharedCache];
+        [cache setPreferredLink:websocket.url
+                    forRelation:XMPPHostMetaLinkRelationWebsocket
+                           host:self.hostname];
+    }
+}
+
+- (void)xmpp_connectionAttempt:(SRWebSocket *)websocket didFailWithError:(NSError *)error
+{
+    XMPPLogWarning(XMPPLogCategoryStream, @"Failed to connect to host: %@ (%@): %@", self.hostname, websocket.url, [error localizedDescription]);
+
+    websocket.delegate = nil;
+    [_connectingWebsockets removeObject:websocket];
+
+    if (![self xmpp_startNextConnectionAttempt] && [_connectingWebsockets count] == 0) {
+        [self xmpp_handleError:error];
+    }
+}
+
+- (void)xmpp_cancelConnectionAttempts
+{
+    for (SRWebSocket *websocket in _connectingWebsockets) {
+        websocket.delegate = nil;
+        [websocket close];
+    }
+    [_connectingWebsockets removeAllObjects];
+    _candidateWebsocketURLs = nil;
+    _nextCandidateIndex = 0;
+    _connectionAttemptGeneration++;
 }
 
 - (void)xmpp_tearDownWebsocket
 {
+    [self xmpp_cancelConnectionAttempts];
     _websocket.delegate = nil;
     [_websocket close];
     _websocket = nil;
-    _discoveredWebsocketURL = nil;
+    _drainMarkerPending = NO;
+    _keepAliveGeneration++;
+    [_outboundQueue reset];
 }
 
 #pragma mark Discovering
 
 - (BOOL)xmpp_needsDiscoverWebsocketURL
 {
-    return _discoveredWebsocketURL == nil && self.options[XMPPWebsocketStreamURLKey] == nil;
+    return self.options[XMPPWebsocketStreamURLKey] == nil;
 }
 
 - (void)xmpp_discoverWebsocketURL
 {
-    NSLog(@"Discovering websocket URL for host: %@", self.hostname);
-
-    NSURLComponents *hostMetadataURLComponents = [[NSURLComponents alloc] init];
-    hostMetadataURLComponents.scheme = @"https";
-    hostMetadataURLComponents.host = self.hostname;
-    hostMetadataURLComponents.path = @"/.well-known/host-meta";
-
-    NSURL *hostMetadataURL = [hostMetadataURLComponents URL];
-
-    NSURLRequest *request = [[NSURLRequest alloc] initWithURL:hostMetadataURL];
-
-    NSURLSessionDataTask *task = [[NSURLSession sharedSession] dataTaskWithRequest:request
-                                                                 completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
-                                                                     dispatch_async([self xmpp_queue], ^{
-                                                                         if (error) {
-                                                                             [self xmpp_handleError:error];
-                                                                         } else {
-                                                                             [self xmpp_handleDiscoveryResponseData:data];
-                                                                         }
-                                                                     });
-                                                                 }];
-    [task resume];
+    XMPPLogDebug(XMPPLogCategoryStream, @"Discovering websocket URL for host: %@", self.hostname);
+
+    // The host metadata is cached (and persisted) across streams. A
+    // reconnect therefore does not need an extra HTTPS round-trip.
+    XMPPHostMetaCache *cache = self.options[XMPPWebsocketStreamHostMetaCacheKey] ?: [XMPPHostMetaCache sharedCache];
+    [cache linksForHost:self.hostname
+             completion:^(NSDictionary<NSString *, NSArray<NSURL *> *> *links, NSError *error) {
+                 dispatch_async([self xmpp_queue], ^{
+                     if (error) {
+                         [self xmpp_handleError:error];
+                     } else {
+                         [self xmpp_handleDiscoveredLinks:links];
+                     }
+                 });
+             }];
 }
 
-- (void)xmpp_handleDiscoveryResponseData:(NSData *)data
+- (void)xmpp_handleDiscoveredLinks:(NSDictionary<NSString *, NSArray<NSURL *> *> *)links
 {
-    __block NSURL *websocketURL = nil;
-
-    if (data) {
-        PXDocument *hostMetadata = [PXDocument documentWithData:data];
-        if ([hostMetadata.root isEqual:PXQN(@"http://docs.oasis-open.org/ns/xri/xrd-1.0", @"XRD")]) {
-            [hostMetadata.root enumerateElementsUsingBlock:^(PXElement *element, BOOL *stop) {
-                if ([element isEqual:PXQN(@"http://docs.oasis-open.org/ns/xri/xrd-1.0", @"Link")] &&
-                    [[element valueForAttribute:@"rel"] isEqual:@"urn:xmpp:alt-connections:websocket"]) {
-                    NSString *websocketURLString = [element valueForAttribute:@"href"];
-                    websocketURL = websocketURLString ? [NSURL URLWithString:websocketURLString] : nil;
-                }
-            }];
-        }
+    if (_state != XMPPStreamStateDiscovering) {
+        return;
     }
 
-    if (websocketURL) {
-        _discoveredWebsocketURL = websocketURL;
-        _state = XMPPStreamStateConnecting;
-
-        [self xmpp_setUpWebsocket];
-        [_websocket open];
+    NSArray<NSURL *> *websocketURLs = links[XMPPHostMetaLinkRelationWebsocket];
 
+    if ([websocketURLs count] > 0) {
+        [self xmpp_connectToWebsocketURLs:websocketURLs];
     } else {
         NSError *error = [NSError errorWithDomain:XMPPErrorDomain
                                              code:XMPPErrorCodeDiscoveryError
@@ -402,6 +670,12 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
 
 - (void)webSocketDidOpen:(SRWebSocket *)webSocket
 {
+    if ([_connectingWebsockets containsObject:webSocket]) {
+        [self xmpp_connectionAttemptDidSucceed:webSocket];
+    } else if (webSocket != _websocket) {
+        return;
+    }
+
     if (_state != XMPPStreamStateConnecting) {
         NSString *errorMessage = @"Expecting stream to be in state 'connection' while the connection is established.";
         NSDictionary *userInfo = @{NSLocalizedDescriptionKey : errorMessage};
@@ -412,23 +686,40 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
     } else {
         _state = XMPPStreamStateOpening;
         [self xmpp_sendOpenFrame];
-        [self keepAlive];
+        [self xmpp_startKeepAlive];
     }
 }
 
+- (BOOL)webSocketShouldConvertTextFrameToString:(SRWebSocket *)webSocket
+{
+    // Text frames are passed as the raw UTF-8 bytes and parsed directly.
+    return NO;
+}
+
 - (void)webSocket:(SRWebSocket *)webSocket didReceiveMessage:(id)message
 {
+    if (webSocket != _websocket) {
+        return;
+    }
+
     NSData *messageData = nil;
 
-    if ([message isKindOfClass:[NSString class]]) {
-        messageData = [message dataUsingEncoding:NSUTF8StringEncoding];
-    } else if ([message isKindOfClass:[NSData class]]) {
+    if ([message isKindOfClass:[NSData class]]) {
         messageData = message;
+    } else if ([message isKindOfClass:[NSString class]]) {
+        messageData = [message dataUsingEncoding:NSUTF8StringEncoding];
     }
 
-//    NSLog(@"IN <<< %@", messageData ? [[NSString alloc] initWithData:messageData encoding:NSUTF8StringEncoding] : @"<no string or data>");
+    XMPPLogTrace(XMPPLogCategoryStream, @"IN <<< %@", messageData ? [[NSString alloc] initWithData:messageData encoding:NSUTF8StringEncoding] : @"<no string or data>");
 
     if (messageData) {
+
+        [self.recorder recordData:messageData direction:XMPPStreamRecordDirectionInbound];
+
+        if ([self xmpp_handleControlElementWithBytes:[messageData bytes] length:[messageData length]]) {
+            return;
+        }
+
         PXDocument *document = [PXDocument documentWithData:messageData];
 
         if (document) {
@@ -460,6 +751,13 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
 
 - (void)webSocket:(SRWebSocket *)webSocket didFailWithError:(NSError *)error
 {
+    if ([_connectingWebsockets containsObject:webSocket]) {
+        [self xmpp_connectionAttempt:webSocket didFailWithError:error];
+        return;
+    } else if (webSocket != _websocket) {
+        return;
+    }
+
     if (_state == XMPPStreamStateDisconnecting) {
         [self xmpp_tearDownWebsocket];
         _state = XMPPStreamStateClosed;
@@ -473,6 +771,18 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
 
 - (void)webSocket:(SRWebSocket *)webSocket didCloseWithCode:(NSInteger)code reason:(NSString *)reason wasClean:(BOOL)wasClean
 {
+    if ([_connectingWebsockets containsObject:webSocket]) {
+        NSString *errorMessage = [NSString stringWithFormat:@"Websocket closed during the handshake (code: %ld, reason: %@).", (long)code, reason];
+        NSDictionary *userInfo = @{NSLocalizedDescriptionKey : errorMessage};
+        NSError *error = [NSError errorWithDomain:XMPPErrorDomain
+                                             code:XMPPErrorCodeUnknown
+                                         userInfo:userInfo];
+        [self xmpp_connectionAttempt:webSocket didFailWithError:error];
+        return;
+    } else if (webSocket != _websocket) {
+        return;
+    }
+
     [self xmpp_tearDownWebsocket];
     _state = XMPPStreamStateClosed;
 
@@ -483,23 +793,129 @@ NSString *const XMPPWebsocketStream_NS = @"urn:ietf:params:xml:ns:xmpp-framing";
 
 - (void)webSocket:(SRWebSocket *)webSocket didReceivePong:(NSData *)pongPayload
 {
+    if (webSocket != _websocket) {
+        return;
+    }
+
+    if ([_keepAlive handlePongWithPayload:pongPayload atTime:[[NSProcessInfo processInfo] systemUptime]]) {
+        [self xmpp_scheduleKeepAlive];
+    } else {
+        [self xmpp_handleDrainMarker:pongPayload];
+    }
 }
 
-#pragma mark - Helpers
+@end
 
-+ (NSString *)stringFromDocument:(PXDocument *)document
+#pragma mark - Empty Element Scanner
+
+static BOOL XMPPIsWhitespace(char c)
 {
-    NSString *documentString = [[NSString alloc] initWithData:[document data]
-                                                     encoding:NSUTF8StringEncoding];
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
 
-    if ([documentString hasPrefix:@"<?xml"]) {
-        // Strip XML decleration
-        NSRange range = [documentString rangeOfString:@"?>"];
-        documentString = [documentString substringFromIndex:NSMaxRange(range)];
-        documentString = [documentString stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+static BOOL XMPPIsNameCharacter(char c, BOOL allowColon)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '_' || c == '-' || c == '.' || (allowColon && c == ':');
+}
+
+// Scans a single empty element without a prefix (e.g., `<a xmlns='urn:xmpp:sm:3' h='1'/>`).
+// Returns NO for anything else (including entity references in attribute
+// values), in which case the bytes must be parsed by a real XML parser.
+static BOOL XMPPScanEmptyElement(const char *bytes, size_t length, XMPPEmptyElement *element)
+{
+    const char *p = bytes;
+    const char *end = bytes + length;
+
+    memset(element, 0, sizeof(XMPPEmptyElement));
+
+    while (p < end && XMPPIsWhitespace(*p)) p++;
+    if (p == end || *p != '<') return NO;
+    p++;
+
+    element->name = p;
+    while (p < end && XMPPIsNameCharacter(*p, NO)) p++;
+    element->nameLength = p - element->name;
+    if (element->nameLength == 0) return NO;
+
+    while (1) {
+        const char *attributeStart = p;
+        while (p < end && XMPPIsWhitespace(*p)) p++;
+        if (p + 1 < end && p[0] == '/' && p[1] == '>') {
+            p += 2;
+            break;
+        }
+        if (p == attributeStart) return NO; // attributes must be separated by whitespace
+
+        const char *name = p;
+        while (p < end && XMPPIsNameCharacter(*p, YES)) p++;
+        size_t nameLength = p - name;
+        if (nameLength == 0) return NO;
+
+        while (p < end && XMPPIsWhitespace(*p)) p++;
+        if (p == end || *p != '=') return NO;
+        p++;
+        while (p < end && XMPPIsWhitespace(*p)) p++;
+        if (p == end || (*p != '\'' && *p != '"')) return NO;
+        char quote = *p++;
+
+        const char *value = p;
+        while (p < end && *p != quote) {
+            if (*p == '&' || *p == '<') return NO;
+            p++;
+        }
+        if (p == end) return NO;
+        size_t valueLength = p - value;
+        p++;
+
+        if (nameLength == 5 && strncmp(name, "xmlns", 5) == 0) {
+            element->namespace = value;
+            element->namespaceLength = valueLength;
+        } else if (nameLength > 6 && strncmp(name, "xmlns:", 6) == 0) {
+            return NO;
+        } else {
+            if (element->numberOfAttributes == XMPP_EMPTY_ELEMENT_MAX_ATTRIBUTES) return NO;
+            XMPPEmptyElementAttribute *attribute = &element->attributes[element->numberOfAttributes++];
+            attribute->name = name;
+            attribute->nameLength = nameLength;
+            attribute->value = value;
+            attribute->valueLength = valueLength;
+        }
     }
 
-    return documentString;
+    while (p < end && XMPPIsWhitespace(*p)) p++;
+    return p == end && element->namespace != NULL;
 }
 
-@end
+static BOOL XMPPEmptyElementHasQName(const XMPPEmptyElement *element, const char *namespace, const char *name)
+{
+    size_t namespaceLength = strlen(namespace);
+    size_t nameLength = strlen(name);
+    return element->namespaceLength == namespaceLength &&
+           element->nameLength == nameLength &&
+           strncmp(element->namespace, namespace, namespaceLength) == 0 &&
+           strncmp(element->name, name, nameLength) == 0;
+}
+
+static const XMPPEmptyElementAttribute *XMPPEmptyElementAttributeWithName(const XMPPEmptyElement *element, const char *name)
+{
+    size_t nameLength = strlen(name);
+    for (size_t i = 0; i < element->numberOfAttributes; i++) {
+        const XMPPEmptyElementAttribute *attribute = &element->attributes[i];
+        if (attribute->nameLength == nameLength && strncmp(attribute->name, name, nameLength) == 0) {
+            return attribute;
+        }
+    }
+    return NULL;
+}
+
+static NSString *XMPPEmptyElementAttributeValue(const XMPPEmptyElement *element, const char *name)
+{
+    const XMPPEmptyElementAttribute *attribute = XMPPEmptyElementAttributeWithName(element, name);
+    if (attribute == NULL) {
+        return nil;
+    }
+    return [[NSString alloc] initWithBytes:attribute->value
+                                    length:attribute->valueLength
+                                  encoding:NSUTF8StringEncoding];
+}
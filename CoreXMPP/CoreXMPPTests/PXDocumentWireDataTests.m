@@ -0,0 +1,80 @@
+//
+//  PXDocumentWireDataTests.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPTestCase.h"
+
+@interface PXDocumentWireDataTests : XMPPTestCase
+
+@end
+
+@implementation PXDocumentWireDataTests
+
+#pragma mark Tests
+
+- (void)testWireData
+{
+    PXDocument *document = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+    [document.root setValue:@"romeo@localhost" forAttribute:@"to"];
+    [document.root addElementWithName:@"body" namespace:@"jabber:client" content:@"Hello!"];
+
+    NSData *wireData = [document xmpp_wireData];
+    NSString *string = [[NSString alloc] initWithData:wireData encoding:NSUTF8StringEncoding];
+
+    assertThat(string, startsWith(@"<message"));
+    assertThat(string, endsWith(@"</message>"));
+
+    PXDocument *parsedDocument = [PXDocument documentWithData:wireData];
+    assertThat(parsedDocument.root.name, equalTo(@"message"));
+    assertThat([parsedDocument.root valueForAttribute:@"to"], equalTo(@"romeo@localhost"));
+}
+
+- (void)testWireDataOfModifiedDocument
+{
+    PXDocument *document = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+    [document.root setValue:@"1" forAttribute:@"id"];
+    assertThat([[NSString alloc] initWithData:[document xmpp_wireData] encoding:NSUTF8StringEncoding], containsSubstring(@"id=\"1\""));
+
+    [document.root setValue:@"2" forAttribute:@"id"];
+    assertThat([[NSString alloc] initWithData:[document xmpp_wireData] encoding:NSUTF8StringEncoding], containsSubstring(@"id=\"2\""));
+}
+
+- (void)testFrozenWireData
+{
+    PXDocument *document = [[PXDocument alloc] initWithElementName:@"r" namespace:@"urn:xmpp:sm:3" prefix:nil];
+    [document xmpp_freezeWireData];
+    assertThat([document xmpp_wireData], sameInstance([document xmpp_wireData]));
+}
+
+@end
@@ -0,0 +1,257 @@
+//
+//  XMPPBOSHStreamTests.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import <OHHTTPStubs/NSURLRequest+HTTPBodyTesting.h>
+
+#import "XMPPTestCase.h"
+
+@interface XMPPBOSHStreamTests : XMPPTestCase
+
+@end
+
+@implementation XMPPBOSHStreamTests
+
+#pragma mark Tests
+
+- (void)testOpenAndCloseStream
+{
+    NSDictionary *options = @{ XMPPBOSHStreamURLKey : [NSURL URLWithString:@"http://localhost:5280/http-bind"] };
+    XMPPBOSHStream *stream = [[XMPPBOSHStream alloc] initWithHostname:@"localhost"
+                                                              options:options];
+    XCTAssertNotNil(stream);
+
+    id<XMPPStreamDelegate> delegate = mockProtocol(@protocol(XMPPStreamDelegate));
+    stream.delegate = delegate;
+
+    //
+    // Open stream and wait until the stream has opened
+    //
+
+    XCTestExpectation *waitForOpen = [self expectationWithDescription:@"Open"];
+    [givenVoid([delegate stream:stream didOpenToHost:equalTo(@"localhost") withStreamId:notNilValue()]) willDo:^id(NSInvocation *invocation) {
+        [waitForOpen fulfill];
+        return nil;
+    }];
+    [stream open];
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+
+    //
+    // Close stream and wait until the stream has closed
+    //
+
+    XCTestExpectation *waitForClose = [self expectationWithDescription:@"Close"];
+    [givenVoid([delegate streamDidClose:stream]) willDo:^id(NSInvocation *invocation) {
+        [waitForClose fulfill];
+        return nil;
+    }];
+    [stream close];
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+
+    [verifyCount(delegate, times(1)) stream:stream
+                              didOpenToHost:equalTo(@"localhost")
+                               withStreamId:notNilValue()];
+
+    [verifyCount(delegate, times(1)) streamDidClose:stream];
+}
+
+- (void)testBatchOutboundDocuments
+{
+    NSMutableArray<PXDocument *> *requestBodies = [[NSMutableArray alloc] init];
+    __block XCTestExpectation *waitForBatch = nil;
+
+    [OHHTTPStubs stubRequestsPassingTest:^BOOL(NSURLRequest *request) {
+        return [request.URL.host isEqualToString:@"bosh.example.com"];
+    }
+        withStubResponse:^OHHTTPStubsResponse *_Nonnull(NSURLRequest *_Nonnull request) {
+            PXDocument *body = [PXDocument documentWithData:[request OHHTTPStubs_HTTPBody]];
+
+            if ([body.root valueForAttribute:@"sid"] == nil) {
+                NSString *response = @"<body xmlns='http://jabber.org/protocol/httpbind' sid='123' authid='456' from='example.com' requests='2' hold='1' wait='60'>"
+                                     @"<stream:features xmlns:stream='http://etherx.jabber.org/streams'/>"
+                                     @"</body>";
+                return [OHHTTPStubsResponse responseWithData:[response dataUsingEncoding:NSUTF8StringEncoding]
+                                                  statusCode:200
+                                                     headers:@{}];
+            }
+
+            __block NSUInteger numberOfPayloads = 0;
+            [body.root enumerateElementsUsingBlock:^(PXElement *element, BOOL *stop) {
+                numberOfPayloads++;
+            }];
+
+            NSData *emptyBody = [@"<body xmlns='http://jabber.org/protocol/httpbind'/>" dataUsingEncoding:NSUTF8StringEncoding];
+            if (numberOfPayloads == 0) {
+                // Hold the request
+                return [[OHHTTPStubsResponse responseWithData:emptyBody statusCode:200 headers:@{}] responseTime:30.0];
+            } else {
+                @synchronized(requestBodies)
+                {
+                    [requestBodies addObject:body];
+                }
+                [waitForBatch fulfill];
+                return [OHHTTPStubsResponse responseWithData:emptyBody statusCode:200 headers:@{}];
+            }
+        }];
+
+    NSDictionary *options = @{ XMPPBOSHStreamURLKey : [NSURL URLWithString:@"https://bosh.example.com/http-bind"] };
+    XMPPBOSHStream *stream = [[XMPPBOSHStream alloc] initWithHostname:@"example.com"
+                                                              options:options];
+
+    id<XMPPStreamDelegate> delegate = mockProtocol(@protocol(XMPPStreamDelegate));
+    stream.delegate = delegate;
+
+    XCTestExpectation *waitForFeatures = [self expectationWithDescription:@"Features"];
+    [givenVoid([delegate stream:stream didReceiveDocument:anything()]) willDo:^id(NSInvocation *invocation) {
+        PXDocument *document = [[invocation mkt_arguments] lastObject];
+        assertThat(document.root, equalTo(PXQN(@"http://etherx.jabber.org/streams", @"features")));
+        [waitForFeatures fulfill];
+        return nil;
+    }];
+    [stream open];
+    [self waitForExpectationsWithTimeout:2.0 handler:nil];
+
+    [verify(delegate) stream:stream didOpenToHost:@"example.com" withStreamId:@"456"];
+
+    waitForBatch = [self expectationWithDescription:@"Batch"];
+    for (NSUInteger i = 0; i < 3; i++) {
+        PXDocument *message = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+        [message.root setValue:@"romeo@example.com" forAttribute:@"to"];
+        [stream sendDocument:message];
+    }
+
+    [self waitForExpectationsWithTimeout:2.0 handler:nil];
+
+    @synchronized(requestBodies)
+    {
+        assertThat(requestBodies, hasCountOf(1));
+
+        __block NSUInteger numberOfMessages = 0;
+        [[requestBodies firstObject].root enumerateElementsUsingBlock:^(PXElement *element, BOOL *stop) {
+            assertThat(element, equalTo(PXQN(@"jabber:client", @"message")));
+            numberOfMessages++;
+        }];
+        assertThatUnsignedInteger(numberOfMessages, equalToUnsignedInteger(3));
+    }
+}
+
+#pragma mark Benchmark
+
+- (void)testOpenAndClosePerformance
+{
+    // Compare with -[XMPPWebsocketStreamTests testOpenAndClosePerformance]
+
+    NSDictionary *options = @{ XMPPBOSHStreamURLKey : [NSURL URLWithString:@"http://localhost:5280/http-bind"] };
+
+    [self measureBlock:^{
+        XMPPBOSHStream *stream = [[XMPPBOSHStream alloc] initWithHostname:@"localhost"
+                                                                  options:options];
+        id<XMPPStreamDelegate> delegate = mockProtocol(@protocol(XMPPStreamDelegate));
+        stream.delegate = delegate;
+
+        XCTestExpectation *waitForOpen = [self expectationWithDescription:@"Open"];
+        [givenVoid([delegate stream:stream didOpenToHost:anything() withStreamId:anything()]) willDo:^id(NSInvocation *invocation) {
+            [waitForOpen fulfill];
+            return nil;
+        }];
+        [stream open];
+        [self waitForExpectationsWithTimeout:10.0 handler:nil];
+
+        XCTestExpectation *waitForClose = [self expectationWithDescription:@"Close"];
+        [givenVoid([delegate streamDidClose:stream]) willDo:^id(NSInvocation *invocation) {
+            [waitForClose fulfill];
+            return nil;
+        }];
+        [stream close];
+        [self waitForExpectationsWithTimeout:10.0 handler:nil];
+    }];
+}
+
+- (void)testStanzaRoundTripPerformance
+{
+    // Compare with -[XMPPWebsocketStreamTests testStanzaRoundTripPerformance]
+    //
+    // The in-band registration form can be requested before the stream is
+    // authenticated. Each request is answered by the server.
+
+    NSDictionary *options = @{ XMPPBOSHStreamURLKey : [NSURL URLWithString:@"http://localhost:5280/http-bind"] };
+    XMPPBOSHStream *stream = [[XMPPBOSHStream alloc] initWithHostname:@"localhost"
+                                                              options:options];
+    id<XMPPStreamDelegate> delegate = mockProtocol(@protocol(XMPPStreamDelegate));
+    stream.delegate = delegate;
+
+    __block XCTestExpectation *waitForResponses = nil;
+    __block NSUInteger numberOfPendingResponses = 0;
+    [givenVoid([delegate stream:stream didReceiveDocument:anything()]) willDo:^id(NSInvocation *invocation) {
+        PXDocument *document = [[invocation mkt_arguments] lastObject];
+        if ([document.root isEqual:PXQN(@"jabber:client", @"iq")] && numberOfPendingResponses > 0) {
+            numberOfPendingResponses--;
+            if (numberOfPendingResponses == 0) {
+                [waitForResponses fulfill];
+            }
+        }
+        return nil;
+    }];
+
+    XCTestExpectation *waitForOpen = [self expectationWithDescription:@"Open"];
+    [givenVoid([delegate stream:stream didOpenToHost:anything() withStreamId:anything()]) willDo:^id(NSInvocation *invocation) {
+        [waitForOpen fulfill];
+        return nil;
+    }];
+    [stream open];
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+
+    [self measureBlock:^{
+        waitForResponses = [self expectationWithDescription:@"Responses"];
+        numberOfPendingResponses = 100;
+        for (NSUInteger i = 0; i < 100; i++) {
+            PXDocument *request = [[PXDocument alloc] initWithElementName:@"iq" namespace:@"jabber:client" prefix:nil];
+            [request.root setValue:@"get" forAttribute:@"type"];
+            [request.root setValue:[NSString stringWithFormat:@"%lu", (unsigned long)i] forAttribute:@"id"];
+            [request.root addElementWithName:@"query" namespace:@"jabber:iq:register" content:nil];
+            [stream sendDocument:request];
+        }
+        [self waitForExpectationsWithTimeout:10.0 handler:nil];
+    }];
+
+    XCTestExpectation *waitForClose = [self expectationWithDescription:@"Close"];
+    [givenVoid([delegate streamDidClose:stream]) willDo:^id(NSInvocation *invocation) {
+        [waitForClose fulfill];
+        return nil;
+    }];
+    [stream close];
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+}
+
+@end
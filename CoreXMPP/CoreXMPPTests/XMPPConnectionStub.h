@@ -38,5 +38,6 @@
 @class PXElement;
 
 @interface XMPPConnectionStub : NSObject <XMPPConnection>
+@property (atomic, readonly) NSUInteger numberOfHandledBatches;
 - (void)onHandleDocument:(void (^)(PXDocument *document, void (^completion)(NSError *), id<XMPPDocumentHandler> responseHandler))callback;
 @end
@@ -75,6 +75,19 @@
     });
 }
 
+- (void)handleDocuments:(NSArray<PXDocument *> *)documents completion:(void (^)(NSUInteger, NSError *))completion
+{
+    _numberOfHandledBatches += 1;
+    [documents enumerateObjectsUsingBlock:^(PXDocument *document, NSUInteger index, BOOL *stop) {
+        [self handleDocument:document
+                  completion:^(NSError *error) {
+                      if (completion) {
+                          completion(index, error);
+                      }
+                  }];
+    }];
+}
+
 - (void)processPendingDocuments:(void (^)(NSError *))completion
 {
     dispatch_async(_operationQueue, ^{
@@ -0,0 +1,175 @@
+//
+//  XMPPDispatcherOutboxTests.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPDispatcherOutbox.h"
+#import "XMPPTestCase.h"
+
+@interface XMPPDispatcherOutboxTests : XMPPTestCase
+@property (nonatomic, strong) NSURL *URL;
+@end
+
+@implementation XMPPDispatcherOutboxTests
+
+- (void)setUp
+{
+    [super setUp];
+    NSString *name = [[[NSUUID UUID] UUIDString] stringByAppendingPathExtension:@"outbox"];
+    self.URL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:name]];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtURL:self.URL error:nil];
+    [super tearDown];
+}
+
+#pragma mark Tests
+
+- (void)testAppendAndRemoveDocuments
+{
+    NSError *error = nil;
+    XMPPDispatcherOutbox *outbox = [[XMPPDispatcherOutbox alloc] initWithURL:self.URL error:&error];
+    assertThat(outbox, notNilValue());
+    assertThat(error, nilValue());
+
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:60.0];
+    uint64_t first = [outbox appendDocument:[self messageWithBody:@"1"] deadline:deadline priority:XMPPStanzaPriorityInteractive];
+    uint64_t second = [outbox appendDocument:[self messageWithBody:@"2"] deadline:deadline priority:XMPPStanzaPriorityInteractive];
+
+    assertThatUnsignedLongLong(first, isNot(equalToUnsignedLongLong(0)));
+    assertThatUnsignedLongLong(second, isNot(equalToUnsignedLongLong(first)));
+    assertThatUnsignedInteger(outbox.numberOfDocuments, equalToUnsignedInteger(2));
+
+    PXDocument *document = [outbox documentWithToken:second];
+    assertThat(document.root, equalTo(PXQN(@"jabber:client", @"message")));
+    assertThat([document.root stringValue], equalTo(@"2"));
+
+    [outbox removeDocumentWithToken:first];
+    assertThat([outbox documentWithToken:first], nilValue());
+    assertThatUnsignedInteger(outbox.numberOfDocuments, equalToUnsignedInteger(1));
+
+    [outbox removeDocumentWithToken:second];
+    assertThatUnsignedInteger(outbox.numberOfDocuments, equalToUnsignedInteger(0));
+    assertThatUnsignedInteger(outbox.size, equalToUnsignedInteger(16));
+}
+
+- (void)testReopen
+{
+    NSDate *deadline = [NSDate dateWithTimeIntervalSince1970:floor([[NSDate date] timeIntervalSince1970]) + 60.0];
+
+    uint64_t removed = 0;
+    @autoreleasepool {
+        XMPPDispatcherOutbox *outbox = [[XMPPDispatcherOutbox alloc] initWithURL:self.URL error:nil];
+        removed = [outbox appendDocument:[self messageWithBody:@"1"] deadline:deadline priority:XMPPStanzaPriorityInteractive];
+        [outbox appendDocument:[self messageWithBody:@"2"] deadline:deadline priority:XMPPStanzaPriorityInteractive];
+        [outbox appendDocument:[self messageWithBody:@"3"] deadline:deadline priority:XMPPStanzaPriorityBulk];
+        [outbox removeDocumentWithToken:removed];
+    }
+
+    XMPPDispatcherOutbox *outbox = [[XMPPDispatcherOutbox alloc] initWithURL:self.URL error:nil];
+    assertThatUnsignedInteger(outbox.numberOfDocuments, equalToUnsignedInteger(2));
+
+    NSMutableArray *bodies = [[NSMutableArray alloc] init];
+    NSMutableArray *priorities = [[NSMutableArray alloc] init];
+    [outbox enumerateDocumentsUsingBlock:^(uint64_t token, NSDate *documentDeadline, XMPPStanzaPriority priority, BOOL *stop) {
+        assertThat(documentDeadline, equalTo(deadline));
+        [bodies addObject:[[outbox documentWithToken:token].root stringValue]];
+        [priorities addObject:@(priority)];
+    }];
+    assertThat(bodies, contains(@"2", @"3", nil));
+    assertThat(priorities, contains(@(XMPPStanzaPriorityInteractive), @(XMPPStanzaPriorityBulk), nil));
+
+    // New tokens are not reused.
+    uint64_t token = [outbox appendDocument:[self messageWithBody:@"4"] deadline:deadline priority:XMPPStanzaPriorityInteractive];
+    assertThatUnsignedLongLong(token, greaterThan(@(removed + 2)));
+}
+
+- (void)testDiscardCorruptedRecord
+{
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:60.0];
+
+    @autoreleasepool {
+        XMPPDispatcherOutbox *outbox = [[XMPPDispatcherOutbox alloc] initWithURL:self.URL error:nil];
+        [outbox appendDocument:[self messageWithBody:@"1"] deadline:deadline priority:XMPPStanzaPriorityInteractive];
+    }
+
+    // Corrupt the first byte of the document (behind the file header and
+    // the record header), as if the page has not been written.
+    NSFileHandle *fileHandle = [NSFileHandle fileHandleForUpdatingURL:self.URL error:nil];
+    [fileHandle seekToFileOffset:16 + 32];
+    [fileHandle writeData:[NSData dataWithBytes:"\0" length:1]];
+    [fileHandle closeFile];
+
+    XMPPDispatcherOutbox *outbox = [[XMPPDispatcherOutbox alloc] initWithURL:self.URL error:nil];
+    assertThatUnsignedInteger(outbox.numberOfDocuments, equalToUnsignedInteger(0));
+    assertThatUnsignedInteger(outbox.size, equalToUnsignedInteger(16));
+}
+
+- (void)testCompaction
+{
+    XMPPDispatcherOutbox *outbox = [[XMPPDispatcherOutbox alloc] initWithURL:self.URL error:nil];
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:60.0];
+
+    NSMutableArray *tokens = [[NSMutableArray alloc] init];
+    for (NSUInteger i = 0; i < 2000; i++) {
+        uint64_t token = [outbox appendDocument:[self messageWithBody:[NSString stringWithFormat:@"%lu", (unsigned long)i]]
+                                       deadline:deadline
+                                       priority:XMPPStanzaPriorityInteractive];
+        [tokens addObject:@(token)];
+    }
+    NSUInteger size = outbox.size;
+
+    // Acknowledge all but the last document
+    for (NSUInteger i = 0; i < 1999; i++) {
+        [outbox removeDocumentWithToken:[tokens[i] unsignedLongLongValue]];
+    }
+
+    assertThatUnsignedInteger(outbox.numberOfDocuments, equalToUnsignedInteger(1));
+    assertThatUnsignedInteger(outbox.size, lessThan(@(size / 2)));
+    assertThat([[outbox documentWithToken:[[tokens lastObject] unsignedLongLongValue]].root stringValue], equalTo(@"1999"));
+}
+
+#pragma mark Helper
+
+- (PXDocument *)messageWithBody:(NSString *)body
+{
+    PXDocument *document = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+    [document.root setValue:@"romeo@localhost" forAttribute:@"from"];
+    [document.root setValue:@"juliet@example.com" forAttribute:@"to"];
+    [document.root addElementWithName:@"body" namespace:@"jabber:client" content:body];
+    return document;
+}
+
+@end
@@ -37,6 +37,39 @@
 
 #import "XMPPTestCase.h"
 
+// Message handler, which keeps the completions of the received messages.
+@interface XMPPDispatcherTestsDeferringHandler : NSObject <XMPPMessageHandler>
+@property (nonatomic, readonly) NSMutableArray<NSString *> *messageIDs;
+@property (nonatomic, readonly) NSMutableArray<void (^)(NSError *)> *completions;
+@property (nonatomic, copy) void (^onMessage)(void);
+@end
+
+@implementation XMPPDispatcherTestsDeferringHandler
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        _messageIDs = [[NSMutableArray alloc] init];
+        _completions = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (void)handleMessage:(XMPPMessageStanza *)stanza completion:(void (^)(NSError *))completion
+{
+    void (^onMessage)(void) = nil;
+    @synchronized(self)
+    {
+        [_messageIDs addObject:[stanza valueForAttribute:@"id"]];
+        [_completions addObject:completion];
+        onMessage = self.onMessage;
+    }
+    if (onMessage) {
+        onMessage();
+    }
+}
+@end
+
 @interface XMPPDispatcherTests : XMPPTestCase
 
 @end
@@ -75,6 +108,37 @@
     [self waitForExpectationsWithTimeout:1.0 handler:nil];
 }
 
+- (void)testAccessorsFromHandler
+{
+    XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] init];
+    XMPPModuleStub *handler = [[XMPPModuleStub alloc] init];
+    XMPPConnectionStub *connection = [[XMPPConnectionStub alloc] init];
+
+    [dispatcher addHandler:handler];
+    [dispatcher setConnection:connection forJID:JID(@"romeo@localhost")];
+    assertThat(dispatcher.connectionsByJID, equalTo(@{JID(@"romeo@localhost") : connection}));
+
+    // The accessors are called on the queue of the shard processing the
+    // message and must not block.
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Expect Message"];
+    [handler onMessage:^(XMPPMessageStanza *stanza) {
+        assertThat(dispatcher.connectionsByJID, equalTo(@{JID(@"romeo@localhost") : connection}));
+        assertThat(dispatcher.messageHandlers, contains(handler, nil));
+        [expectation fulfill];
+    }];
+
+    PXDocument *doc = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+    [doc.root setValue:@"juliet@example.com" forAttribute:@"from"];
+    [doc.root setValue:@"romeo@localhost" forAttribute:@"to"];
+    [connection.connectionDelegate handleDocument:doc completion:nil];
+
+    [self waitForExpectationsWithTimeout:1.0 handler:nil];
+
+    [dispatcher removeConnection:connection];
+    assertThat(dispatcher.connectionsByJID, equalTo(@{}));
+}
+
 #pragma mark Message Handling
 
 - (void)testManagingMessageHandler
@@ -89,6 +153,35 @@
     assertThat(dispatcher.messageHandlers, isNot(contains(handler, nil)));
 }
 
+- (void)testDeallocatedHandler
+{
+    XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] init];
+
+    XMPPModuleStub *handler = [[XMPPModuleStub alloc] init];
+    [dispatcher addHandler:handler];
+
+    @autoreleasepool {
+        XMPPModuleStub *deallocatedHandler = [[XMPPModuleStub alloc] init];
+        [dispatcher addHandler:deallocatedHandler];
+        assertThat(dispatcher.messageHandlers, hasCountOf(2));
+        deallocatedHandler = nil;
+    }
+
+    assertThat(dispatcher.messageHandlers, contains(handler, nil));
+    assertThat(dispatcher.presenceHandlers, contains(handler, nil));
+    assertThat(dispatcher.dispatcherHandlers, contains(handler, nil));
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Expect Message"];
+    [handler onMessage:^(XMPPMessageStanza *stanza) {
+        [expectation fulfill];
+    }];
+
+    PXDocument *doc = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+    [dispatcher handleDocument:doc completion:nil];
+
+    [self waitForExpectationsWithTimeout:1.0 handler:nil];
+}
+
 - (void)testIncomingMessage
 {
     XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] init];
@@ -119,6 +212,201 @@
     [self waitForExpectationsWithTimeout:1.0 handler:nil];
 }
 
+- (void)testIncomingMessageWithFilter
+{
+    XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] init];
+    XMPPModuleStub *handler = [[XMPPModuleStub alloc] init];
+    XMPPModuleStub *receiptsHandler = [[XMPPModuleStub alloc] init];
+
+    XMPPDispatcherStanzaFilter *filter = [[XMPPDispatcherStanzaFilter alloc] initWithPayloadQNames:@[ PXQN(@"urn:xmpp:receipts", @"received") ]
+                                                                                              types:@[ @"chat", @"normal" ]];
+    [dispatcher addHandler:handler];
+    [dispatcher addHandler:receiptsHandler withMessageFilter:filter presenceFilter:nil];
+
+    assertThatInteger([dispatcher.messageHandlers count], equalToInteger(2));
+
+    XCTestExpectation *bodyExpectation = [self expectationWithDescription:@"Expect Message"];
+    [handler onMessage:^(XMPPMessageStanza *stanza) {
+        assertThat([stanza valueForAttribute:@"id"], equalTo(@"1"));
+        [bodyExpectation fulfill];
+    }];
+
+    XCTestExpectation *receiptExpectation = [self expectationWithDescription:@"Expect Receipt"];
+    [handler onMessage:^(XMPPMessageStanza *stanza) {
+        assertThat([stanza valueForAttribute:@"id"], equalTo(@"2"));
+        [receiptExpectation fulfill];
+    }];
+
+    // The receipts handler does not receive the first message.
+    XCTestExpectation *filteredReceiptExpectation = [self expectationWithDescription:@"Expect Filtered Receipt"];
+    [receiptsHandler onMessage:^(XMPPMessageStanza *stanza) {
+        assertThat([stanza valueForAttribute:@"id"], equalTo(@"2"));
+        [filteredReceiptExpectation fulfill];
+    }];
+
+    NSArray *payloads = @[ PXQN(@"jabber:client", @"body"), PXQN(@"urn:xmpp:receipts", @"received") ];
+    for (NSUInteger i = 0; i < [payloads count]; i++) {
+        PXQName *payload = payloads[i];
+        PXDocument *doc = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+        [doc.root setValue:@"juliet@example.com" forAttribute:@"from"];
+        [doc.root setValue:@"romeo@localhost" forAttribute:@"to"];
+        [doc.root setValue:[NSString stringWithFormat:@"%lu", (unsigned long)(i + 1)] forAttribute:@"id"];
+        [doc.root addElementWithName:payload.name namespace:payload.namespace content:nil];
+        [dispatcher handleDocument:doc completion:nil];
+    }
+
+    [self waitForExpectationsWithTimeout:1.0 handler:nil];
+}
+
+- (void)testIncomingMessageWithCredit
+{
+    XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] init];
+    XMPPDispatcherTestsDeferringHandler *handler = [[XMPPDispatcherTestsDeferringHandler alloc] init];
+
+    [dispatcher addHandler:handler];
+    [dispatcher setMaximumNumberOfOutstandingStanzas:1 forHandler:handler];
+
+    NSMutableArray<NSString *> *handledMessageIDs = [[NSMutableArray alloc] init];
+
+    for (NSUInteger i = 0; i < 3; i++) {
+        NSString *messageID = [NSString stringWithFormat:@"%lu", (unsigned long)(i + 1)];
+        XCTestExpectation *expectation = [self expectationWithDescription:[NSString stringWithFormat:@"Expect Message %@ Handled", messageID]];
+
+        PXDocument *doc = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+        [doc.root setValue:@"juliet@example.com" forAttribute:@"from"];
+        [doc.root setValue:@"romeo@localhost" forAttribute:@"to"];
+        [doc.root setValue:messageID forAttribute:@"id"];
+        [dispatcher handleDocument:doc
+                        completion:^(NSError *error) {
+                            assertThat(error, nilValue());
+                            @synchronized(handledMessageIDs)
+                            {
+                                [handledMessageIDs addObject:messageID];
+                            }
+                            [expectation fulfill];
+                        }];
+    }
+
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    [dispatcher processPendingDocuments:^(NSError *error) {
+        dispatch_semaphore_signal(semaphore);
+    }];
+    dispatch_semaphore_wait(semaphore, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(1.0 * NSEC_PER_SEC)));
+
+    // Only the first message is passed to the handler and none of the
+    // messages has been reported as handled.
+    @synchronized(handler)
+    {
+        assertThat(handler.messageIDs, equalTo(@[ @"1" ]));
+    }
+    @synchronized(handledMessageIDs)
+    {
+        assertThatInteger([handledMessageIDs count], equalToInteger(0));
+    }
+    assertThatInteger([dispatcher numberOfOutstandingStanzasForHandler:handler], equalToInteger(1));
+
+    // Completing a message passes the next one to the handler.
+    handler.onMessage = ^{
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            void (^completion)(NSError *) = nil;
+            @synchronized(handler)
+            {
+                completion = [handler.completions lastObject];
+            }
+            completion(nil);
+        });
+    };
+
+    void (^completion)(NSError *) = nil;
+    @synchronized(handler)
+    {
+        completion = [handler.completions firstObject];
+    }
+    completion(nil);
+
+    [self waitForExpectationsWithTimeout:1.0 handler:nil];
+
+    @synchronized(handler)
+    {
+        assertThat(handler.messageIDs, equalTo(@[ @"1", @"2", @"3" ]));
+    }
+    @synchronized(handledMessageIDs)
+    {
+        assertThat(handledMessageIDs, equalTo(@[ @"1", @"2", @"3" ]));
+    }
+    assertThatInteger([dispatcher numberOfOutstandingStanzasForHandler:handler], equalToInteger(0));
+}
+
+- (void)testIncomingCompletionsInOrder
+{
+    XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] init];
+    XMPPDispatcherTestsDeferringHandler *handler = [[XMPPDispatcherTestsDeferringHandler alloc] init];
+
+    [dispatcher addHandler:handler];
+    [dispatcher setMaximumNumberOfOutstandingStanzas:1 forHandler:handler];
+
+    NSMutableArray<NSString *> *completedStanzas = [[NSMutableArray alloc] init];
+
+    // The message is held by the handler with a credit, while the presence
+    // (without a handler) is handled immediately.
+
+    XCTestExpectation *waitForMessage = [self expectationWithDescription:@"Expect Message Completed"];
+    PXDocument *message = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+    [message.root setValue:@"juliet@example.com" forAttribute:@"from"];
+    [message.root setValue:@"romeo@localhost" forAttribute:@"to"];
+    [message.root setValue:@"1" forAttribute:@"id"];
+    [dispatcher handleDocument:message
+                    completion:^(NSError *error) {
+                        assertThat(error, equalTo([NSError errorWithDomain:@"XMPPDispatcherTests" code:1 userInfo:nil]));
+                        @synchronized(completedStanzas)
+                        {
+                            [completedStanzas addObject:@"message"];
+                        }
+                        [waitForMessage fulfill];
+                    }];
+
+    XCTestExpectation *waitForPresence = [self expectationWithDescription:@"Expect Presence Completed"];
+    PXDocument *presence = [[PXDocument alloc] initWithElementName:@"presence" namespace:@"jabber:client" prefix:nil];
+    [presence.root setValue:@"juliet@example.com" forAttribute:@"from"];
+    [presence.root setValue:@"romeo@localhost" forAttribute:@"to"];
+    [dispatcher handleDocument:presence
+                    completion:^(NSError *error) {
+                        assertThat(error, nilValue());
+                        @synchronized(completedStanzas)
+                        {
+                            [completedStanzas addObject:@"presence"];
+                        }
+                        [waitForPresence fulfill];
+                    }];
+
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    [dispatcher processPendingDocuments:^(NSError *error) {
+        dispatch_semaphore_signal(semaphore);
+    }];
+    dispatch_semaphore_wait(semaphore, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(1.0 * NSEC_PER_SEC)));
+
+    // The presence is not completed before the message.
+    @synchronized(completedStanzas)
+    {
+        assertThatInteger([completedStanzas count], equalToInteger(0));
+    }
+
+    // The error of the handler is passed to the completion of the message.
+    void (^completion)(NSError *) = nil;
+    @synchronized(handler)
+    {
+        completion = [handler.completions firstObject];
+    }
+    completion([NSError errorWithDomain:@"XMPPDispatcherTests" code:1 userInfo:nil]);
+
+    [self waitForExpectationsWithTimeout:1.0 handler:nil];
+
+    @synchronized(completedStanzas)
+    {
+        assertThat(completedStanzas, equalTo(@[ @"message", @"presence" ]));
+    }
+}
+
 - (void)testOutgoingMessage
 {
     XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] init];
@@ -155,6 +443,123 @@
     [self waitForExpectationsWithTimeout:1.0 handler:nil];
 }
 
+- (void)testOutgoingMessageWithBackpressure
+{
+    XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] init];
+    XMPPConnectionStub *connection = [[XMPPConnectionStub alloc] init];
+
+    [dispatcher setConnection:connection forJID:JID(@"romeo@localhost")];
+    [dispatcher connection:connection didConnectTo:JID(@"romeo@localhost") resumed:NO];
+    [dispatcher connection:connection didChangeWritable:NO forJID:JID(@"romeo@localhost")];
+
+    PXDocument *doc = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+    PXElement *message = doc.root;
+    [message setValue:@"romeo@localhost" forAttribute:@"from"];
+    [message setValue:@"juliet@example.com" forAttribute:@"to"];
+    [message setValue:[[NSUUID UUID] UUIDString] forAttribute:@"id"];
+
+    __block BOOL handled = NO;
+    [connection onHandleDocument:^(PXDocument *document, void (^completion)(NSError *), id<XMPPDocumentHandler> responseHandler) {
+        handled = YES;
+        if (completion)
+            completion(nil);
+    }];
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Expect Message"];
+    [dispatcher handleMessage:(XMPPMessageStanza *)doc.root
+                   completion:^(NSError *error) {
+                       assertThat(error, nilValue());
+                       [expectation fulfill];
+                   }];
+
+    // The message is held back until the connection becomes writable again.
+
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.2]];
+    assertThatBool(handled, isFalse());
+
+    [dispatcher connection:connection didChangeWritable:YES forJID:JID(@"romeo@localhost")];
+    [self waitForExpectationsWithTimeout:1.0 handler:nil];
+    assertThatBool(handled, isTrue());
+}
+
+- (void)testOutgoingMessageWithTimeout
+{
+    XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] init];
+    dispatcher.pendingSubmissionTimeouts = @{ @"message" : @(0.5) };
+
+    XMPPConnectionStub *connection = [[XMPPConnectionStub alloc] init];
+    [dispatcher setConnection:connection forJID:JID(@"romeo@localhost")];
+
+    PXDocument *doc = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+    PXElement *message = doc.root;
+    [message setValue:@"romeo@localhost" forAttribute:@"from"];
+    [message setValue:@"juliet@example.com" forAttribute:@"to"];
+    [message setValue:[[NSUUID UUID] UUIDString] forAttribute:@"id"];
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Expect Timeout"];
+    [dispatcher handleMessage:(XMPPMessageStanza *)doc.root
+                   completion:^(NSError *error) {
+                       assertThat(error.domain, equalTo(XMPPDispatcherErrorDomain));
+                       assertThatInteger(error.code, equalToInteger(XMPPDispatcherErrorCodeNoRoute));
+                       [expectation fulfill];
+                   }];
+    [self waitForExpectationsWithTimeout:2.0 handler:nil];
+}
+
+- (void)testOutgoingMessageWithOutbox
+{
+    NSURL *directoryURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]]];
+    [[NSFileManager defaultManager] createDirectoryAtURL:directoryURL withIntermediateDirectories:YES attributes:nil error:nil];
+
+    PXDocument *doc = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+    PXElement *message = doc.root;
+    [message setValue:@"romeo@localhost" forAttribute:@"from"];
+    [message setValue:@"juliet@example.com" forAttribute:@"to"];
+    [message setValue:@"123" forAttribute:@"id"];
+    [message addElementWithName:@"body" namespace:@"jabber:client" content:@"Hello!"];
+
+    // The message is held back, because the connection is not
+    // established, and written to the outbox.
+
+    @autoreleasepool {
+        XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] init];
+        dispatcher.outboxDirectoryURL = directoryURL;
+
+        XMPPConnectionStub *connection = [[XMPPConnectionStub alloc] init];
+        [dispatcher setConnection:connection forJID:JID(@"romeo@localhost")];
+
+        XCTestExpectation *expectation = [self expectationWithDescription:@"Expect Pending Message"];
+        [dispatcher handleMessage:(XMPPMessageStanza *)doc.root completion:nil];
+        [dispatcher processPendingDocuments:^(NSError *error) {
+            [expectation fulfill];
+        }];
+        [self waitForExpectationsWithTimeout:1.0 handler:nil];
+    }
+
+    // A new dispatcher (e.g., after a restart of the process) submits
+    // the message, as soon as the account is connected.
+
+    XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] init];
+    dispatcher.outboxDirectoryURL = directoryURL;
+
+    XMPPConnectionStub *connection = [[XMPPConnectionStub alloc] init];
+    [dispatcher setConnection:connection forJID:JID(@"romeo@localhost")];
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Expect Message"];
+    [connection onHandleDocument:^(PXDocument *document, void (^completion)(NSError *), id<XMPPDocumentHandler> responseHandler) {
+        assertThat(document.root, equalTo(PXQN(@"jabber:client", @"message")));
+        assertThat([document.root valueForAttribute:@"id"], equalTo(@"123"));
+        if (completion)
+            completion(nil);
+        [expectation fulfill];
+    }];
+
+    [dispatcher connection:connection didConnectTo:JID(@"romeo@localhost") resumed:NO];
+    [self waitForExpectationsWithTimeout:1.0 handler:nil];
+
+    [[NSFileManager defaultManager] removeItemAtURL:directoryURL error:nil];
+}
+
 - (void)testOutgoingMessageWithoutRoute
 {
     XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] init];
@@ -192,6 +597,45 @@
     [self waitForExpectationsWithTimeout:1.0 handler:nil];
 }
 
+- (void)testOutgoingMessagesInBatch
+{
+    XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] init];
+    XMPPConnectionStub *connection = [[XMPPConnectionStub alloc] init];
+
+    [dispatcher setConnection:connection forJID:JID(@"romeo@localhost")];
+    [dispatcher connection:connection didConnectTo:JID(@"romeo@localhost") resumed:NO];
+
+    NSMutableArray *stanzas = [[NSMutableArray alloc] init];
+    for (NSString *from in @[ @"romeo@localhost", @"romeo@localhost", @"romeo@example.com", @"romeo@localhost" ]) {
+        PXDocument *doc = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+        [doc.root setValue:from forAttribute:@"from"];
+        [doc.root setValue:@"juliet@example.com" forAttribute:@"to"];
+        [doc.root addElementWithName:@"body" namespace:@"jabber:client" content:@"Hello!"];
+        [stanzas addObject:doc.root];
+    }
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Expect Completions"];
+    NSMutableDictionary *errorsByIndex = [[NSMutableDictionary alloc] init];
+    [dispatcher sendStanzas:stanzas
+                 completion:^(NSUInteger index, NSError *error) {
+                     @synchronized(errorsByIndex) {
+                         errorsByIndex[@(index)] = error ?: [NSNull null];
+                         if ([errorsByIndex count] == [stanzas count]) {
+                             [expectation fulfill];
+                         }
+                     }
+                 }];
+    [self waitForExpectationsWithTimeout:1.0 handler:nil];
+
+    assertThat(errorsByIndex[@0], equalTo([NSNull null]));
+    assertThat(errorsByIndex[@1], equalTo([NSNull null]));
+    assertThatInteger([errorsByIndex[@2] code], equalToInteger(XMPPDispatcherErrorCodeNoRoute));
+    assertThat(errorsByIndex[@3], equalTo([NSNull null]));
+
+    // The stanzas of the connected account are passed in one batch.
+    assertThatUnsignedInteger(connection.numberOfHandledBatches, equalToUnsignedInteger(1));
+}
+
 - (void)testOutgoingMessageWithoutSender
 {
     XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] init];
@@ -558,6 +1002,204 @@
     assertThatInteger(dispatcher.numberOfPendingIQResponses, equalToInteger(0));
 }
 
+- (void)testOutgoingIQRequestsWithSameID
+{
+    XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] init];
+
+    XMPPConnectionStub *connection = [[XMPPConnectionStub alloc] init];
+    [dispatcher setConnection:connection forJID:JID(@"romeo@localhost")];
+    [dispatcher connection:connection didConnectTo:JID(@"romeo@localhost") resumed:NO];
+    connection.connectionDelegate = dispatcher;
+
+    // Only Benvolio responds (after the request to Juliet timed out).
+    [connection onHandleDocument:^(PXDocument *document, void (^completion)(NSError *), id<XMPPDocumentHandler> responseHandler) {
+
+        PXElement *stanza = document.root;
+
+        if (completion) {
+            completion(nil);
+        }
+
+        if ([[stanza valueForAttribute:@"to"] isEqualToString:@"benvolio@example.com"]) {
+            PXDocument *doc = [[PXDocument alloc] initWithElementName:@"iq" namespace:@"jabber:client" prefix:nil];
+            PXElement *response = doc.root;
+            [response setValue:[stanza valueForAttribute:@"to"] forAttribute:@"from"];
+            [response setValue:[stanza valueForAttribute:@"from"] forAttribute:@"to"];
+            [response setValue:@"result" forAttribute:@"type"];
+            [response setValue:[stanza valueForAttribute:@"id"] forAttribute:@"id"];
+
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(1.0 * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+                [responseHandler handleDocument:doc completion:nil];
+            });
+        }
+    }];
+
+    XMPPIQStanza * (^request)(NSString *) = ^(NSString *to) {
+        PXDocument *doc = [[PXDocument alloc] initWithElementName:@"iq" namespace:@"jabber:client" prefix:nil];
+        PXElement *request = doc.root;
+        [request setValue:@"romeo@localhost" forAttribute:@"from"];
+        [request setValue:to forAttribute:@"to"];
+        [request setValue:@"get" forAttribute:@"type"];
+        [request setValue:@"same" forAttribute:@"id"];
+        [request addElementWithName:@"query" namespace:@"foo:bar" content:nil];
+        return (XMPPIQStanza *)request;
+    };
+
+    XCTestExpectation *timeoutExpectation = [self expectationWithDescription:@"Expect Timeout"];
+    [dispatcher handleIQRequest:request(@"juliet@example.com")
+                        timeout:0.5
+                     completion:^(XMPPIQStanza *response, NSError *error) {
+                         assertThat(response, nilValue());
+                         assertThatInteger(error.code, equalToInteger(XMPPDispatcherErrorCodeTimeout));
+                         [timeoutExpectation fulfill];
+                     }];
+
+    XCTestExpectation *responseExpectation = [self expectationWithDescription:@"Expect Response"];
+    [dispatcher handleIQRequest:request(@"benvolio@example.com")
+                        timeout:5.0
+                     completion:^(XMPPIQStanza *response, NSError *error) {
+                         assertThat(error, nilValue());
+                         assertThat([response valueForAttribute:@"from"], equalTo(@"benvolio@example.com"));
+                         [responseExpectation fulfill];
+                     }];
+
+    [self waitForExpectationsWithTimeout:3.0 handler:nil];
+
+    assertThatInteger(dispatcher.numberOfPendingIQResponses, equalToInteger(0));
+}
+
+- (void)testOutgoingIQRequestCoalescing
+{
+    XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] init];
+    dispatcher.coalescesIQRequests = YES;
+    dispatcher.IQResultTimeToLives = @{ @"http://jabber.org/protocol/disco#info" : @(60) };
+
+    XMPPConnectionStub *connection = [[XMPPConnectionStub alloc] init];
+    [dispatcher setConnection:connection forJID:JID(@"romeo@localhost")];
+    [dispatcher connection:connection didConnectTo:JID(@"romeo@localhost") resumed:NO];
+    connection.connectionDelegate = dispatcher;
+
+    __block NSUInteger numberOfSentRequests = 0;
+    [connection onHandleDocument:^(PXDocument *document, void (^completion)(NSError *), id<XMPPDocumentHandler> responseHandler) {
+
+        numberOfSentRequests += 1;
+
+        PXElement *stanza = document.root;
+
+        PXDocument *doc = [[PXDocument alloc] initWithElementName:@"iq" namespace:@"jabber:client" prefix:nil];
+        PXElement *response = doc.root;
+        [response setValue:[stanza valueForAttribute:@"to"] forAttribute:@"from"];
+        [response setValue:[stanza valueForAttribute:@"from"] forAttribute:@"to"];
+        [response setValue:@"result" forAttribute:@"type"];
+        [response setValue:[stanza valueForAttribute:@"id"] forAttribute:@"id"];
+
+        if (completion) {
+            completion(nil);
+        }
+
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(0.1 * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+            [responseHandler handleDocument:doc completion:nil];
+        });
+    }];
+
+    XMPPIQStanza * (^request)(void) = ^{
+        PXDocument *doc = [[PXDocument alloc] initWithElementName:@"iq" namespace:@"jabber:client" prefix:nil];
+        PXElement *request = doc.root;
+        [request setValue:@"romeo@localhost" forAttribute:@"from"];
+        [request setValue:@"juliet@example.com" forAttribute:@"to"];
+        [request setValue:@"get" forAttribute:@"type"];
+        [request setValue:[[NSUUID UUID] UUIDString] forAttribute:@"id"];
+        [request addElementWithName:@"query" namespace:@"http://jabber.org/protocol/disco#info" content:nil];
+        return (XMPPIQStanza *)request;
+    };
+
+    // Pending Requests (each request receives a response with its own ID)
+
+    for (NSUInteger i = 0; i < 3; i++) {
+        XCTestExpectation *expectation = [self expectationWithDescription:@"Expect Response"];
+        XMPPIQStanza *stanza = request();
+        NSString *requestID = stanza.identifier;
+        [dispatcher handleIQRequest:stanza
+                            timeout:0
+                         completion:^(XMPPIQStanza *response, NSError *error) {
+                             assertThat(error, nilValue());
+                             assertThat(response, equalTo(PXQN(@"jabber:client", @"iq")));
+                             assertThat(response.identifier, equalTo(requestID));
+                             [expectation fulfill];
+                         }];
+    }
+    [self waitForExpectationsWithTimeout:1.0 handler:nil];
+
+    // Cached Result
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Expect Cached Response"];
+    XMPPIQStanza *stanza = request();
+    NSString *requestID = stanza.identifier;
+    [dispatcher handleIQRequest:stanza
+                        timeout:0
+                     completion:^(XMPPIQStanza *response, NSError *error) {
+                         assertThat(response, equalTo(PXQN(@"jabber:client", @"iq")));
+                         assertThat(response.identifier, equalTo(requestID));
+                         [expectation fulfill];
+                     }];
+    [self waitForExpectationsWithTimeout:1.0 handler:nil];
+
+    assertThatUnsignedInteger(numberOfSentRequests, equalToUnsignedInteger(1));
+    assertThatInteger(dispatcher.numberOfPendingIQResponses, equalToInteger(0));
+}
+
+- (void)testOutgoingIQRequestCoalescingWithTimeout
+{
+    XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] init];
+    dispatcher.coalescesIQRequests = YES;
+
+    XMPPConnectionStub *connection = [[XMPPConnectionStub alloc] init];
+    [dispatcher setConnection:connection forJID:JID(@"romeo@localhost")];
+    [dispatcher connection:connection didConnectTo:JID(@"romeo@localhost") resumed:NO];
+    connection.connectionDelegate = dispatcher;
+
+    // The requests are not answered.
+    __block NSUInteger numberOfSentRequests = 0;
+    [connection onHandleDocument:^(PXDocument *document, void (^completion)(NSError *), id<XMPPDocumentHandler> responseHandler) {
+        numberOfSentRequests += 1;
+        if (completion) {
+            completion(nil);
+        }
+    }];
+
+    XMPPIQStanza * (^request)(void) = ^{
+        PXDocument *doc = [[PXDocument alloc] initWithElementName:@"iq" namespace:@"jabber:client" prefix:nil];
+        PXElement *request = doc.root;
+        [request setValue:@"romeo@localhost" forAttribute:@"from"];
+        [request setValue:@"juliet@example.com" forAttribute:@"to"];
+        [request setValue:@"get" forAttribute:@"type"];
+        [request setValue:[[NSUUID UUID] UUIDString] forAttribute:@"id"];
+        [request addElementWithName:@"query" namespace:@"jabber:iq:version" content:nil];
+        return (XMPPIQStanza *)request;
+    };
+
+    __block BOOL firstRequestCompleted = NO;
+    [dispatcher handleIQRequest:request()
+                        timeout:5.0
+                     completion:^(XMPPIQStanza *response, NSError *error) {
+                         firstRequestCompleted = YES;
+                     }];
+
+    // The joining request times out on its own.
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Expect Timeout"];
+    [dispatcher handleIQRequest:request()
+                        timeout:0.5
+                     completion:^(XMPPIQStanza *response, NSError *error) {
+                         assertThat(response, nilValue());
+                         assertThatInteger(error.code, equalToInteger(XMPPDispatcherErrorCodeTimeout));
+                         [expectation fulfill];
+                     }];
+    [self waitForExpectationsWithTimeout:2.0 handler:nil];
+
+    assertThatBool(firstRequestCompleted, isFalse());
+    assertThatUnsignedInteger(numberOfSentRequests, equalToUnsignedInteger(1));
+}
+
 #pragma mark Connection Handling
 
 - (void)testManageConnection
@@ -685,4 +1327,258 @@
     [self waitForExpectationsWithTimeout:1.0 handler:nil];
 }
 
+#pragma mark Statistics
+
+- (void)testStatistics
+{
+    // With one shard, the stanzas are processed in order.
+    XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] initWithNumberOfShards:1];
+    XMPPModuleStub *handler = [[XMPPModuleStub alloc] init];
+    [dispatcher addHandler:handler];
+
+    XMPPConnectionStub *connection = [[XMPPConnectionStub alloc] init];
+    [dispatcher setConnection:connection forJID:JID(@"romeo@localhost")];
+
+    // Incoming Message
+
+    PXDocument *incoming = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+    [incoming.root setValue:@"juliet@example.com" forAttribute:@"from"];
+    [incoming.root setValue:@"romeo@localhost" forAttribute:@"to"];
+    [incoming.root addElementWithName:@"body" namespace:@"jabber:client" content:@"Hello!"];
+
+    XCTestExpectation *incomingExpectation = [self expectationWithDescription:@"Expect Incoming Message"];
+    [dispatcher handleDocument:incoming
+                    completion:^(NSError *error) {
+                        assertThat(error, nilValue());
+                        [incomingExpectation fulfill];
+                    }];
+
+    // Held back Message (the connection is not established)
+
+    PXDocument *pending = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+    [pending.root setValue:@"romeo@localhost" forAttribute:@"from"];
+    [pending.root setValue:@"juliet@example.com" forAttribute:@"to"];
+    [pending.root addElementWithName:@"body" namespace:@"jabber:client" content:@"Hello!"];
+    [dispatcher handleMessage:(XMPPMessageStanza *)pending.root completion:nil];
+
+    // Message without Route
+
+    PXDocument *unroutable = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+    [unroutable.root setValue:@"romeo@example.com" forAttribute:@"from"];
+    [unroutable.root setValue:@"juliet@example.com" forAttribute:@"to"];
+
+    XCTestExpectation *unroutableExpectation = [self expectationWithDescription:@"Expect Message without Route"];
+    [dispatcher handleMessage:(XMPPMessageStanza *)unroutable.root
+                   completion:^(NSError *error) {
+                       assertThatInteger(error.code, equalToInteger(XMPPDispatcherErrorCodeNoRoute));
+                       [unroutableExpectation fulfill];
+                   }];
+
+    [self waitForExpectationsWithTimeout:1.0 handler:nil];
+
+    XMPPDispatcherStatistics *statistics = [dispatcher statistics];
+    assertThatUnsignedLongLong(statistics.numberOfReceivedMessages, equalToUnsignedLongLong(1));
+    assertThatUnsignedLongLong(statistics.numberOfSentMessages, equalToUnsignedLongLong(1));
+    assertThatUnsignedLongLong(statistics.numberOfNoRouteErrors, equalToUnsignedLongLong(1));
+    assertThatUnsignedLongLong(statistics.numberOfTimeoutErrors, equalToUnsignedLongLong(0));
+    assertThatUnsignedInteger(statistics.numberOfPendingIQResponses, equalToUnsignedInteger(0));
+    assertThat(statistics.numberOfPendingSubmissionsByJID, equalTo(@{JID(@"romeo@localhost") : @(1)}));
+
+    assertThatUnsignedLongLong(statistics.handlerTime.count, equalToUnsignedLongLong(1));
+    assertThatUnsignedLongLong(statistics.queueWaitTime.count, equalToUnsignedLongLong(3));
+    assertThatDouble([statistics.queueWaitTime valueAtPercentile:100], greaterThanOrEqualTo(@(statistics.queueWaitTime.minimum)));
+}
+
+#pragma mark Observers
+
+- (void)testObserver
+{
+    XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] init];
+
+    XMPPConnectionStub *connection = [[XMPPConnectionStub alloc] init];
+    [dispatcher setConnection:connection forJID:JID(@"romeo@localhost")];
+    [dispatcher connection:connection didConnectTo:JID(@"romeo@localhost") resumed:NO];
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Expect Observations"];
+    XMPPDispatcherObserver *observer = [dispatcher addObserverForDirections:XMPPDispatcherObservationDirectionOutbound
+                                                                stanzaKinds:XMPPDispatcherObservationStanzaKindMessage
+                                                                 namespaces:[NSSet setWithObject:@"urn:xmpp:receipts"]
+                                                                   interval:0.2
+                                                                      queue:nil
+                                                                      block:^(NSArray<XMPPDispatcherObservation *> *observations) {
+                                                                          assertThatUnsignedInteger([observations count], equalToUnsignedInteger(1));
+                                                                          XMPPDispatcherObservation *observation = [observations firstObject];
+                                                                          assertThatUnsignedInteger(observation.direction, equalToUnsignedInteger(XMPPDispatcherObservationDirectionOutbound));
+                                                                          assertThat([observation.document.root valueForAttribute:@"id"], equalTo(@"2"));
+                                                                          [expectation fulfill];
+                                                                      }];
+
+    __block NSUInteger numberOfSentDocuments = 0;
+    for (NSUInteger i = 0; i < 2; i++) {
+        [connection onHandleDocument:^(PXDocument *document, void (^completion)(NSError *), id<XMPPDocumentHandler> responseHandler) {
+            numberOfSentDocuments += 1;
+            if (completion)
+                completion(nil);
+        }];
+    }
+
+    PXDocument *doc = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+    [doc.root setValue:@"romeo@localhost" forAttribute:@"from"];
+    [doc.root setValue:@"juliet@example.com" forAttribute:@"to"];
+    [doc.root setValue:@"1" forAttribute:@"id"];
+    [doc.root addElementWithName:@"body" namespace:@"jabber:client" content:@"Hello!"];
+    [dispatcher handleMessage:(XMPPMessageStanza *)doc.root completion:nil];
+
+    doc = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+    [doc.root setValue:@"romeo@localhost" forAttribute:@"from"];
+    [doc.root setValue:@"juliet@example.com" forAttribute:@"to"];
+    [doc.root setValue:@"2" forAttribute:@"id"];
+    [doc.root addElementWithName:@"received" namespace:@"urn:xmpp:receipts" content:nil];
+    [dispatcher handleMessage:(XMPPMessageStanza *)doc.root completion:nil];
+
+    // Incoming stanzas are not observed.
+    doc = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+    [doc.root setValue:@"juliet@example.com" forAttribute:@"from"];
+    [doc.root setValue:@"romeo@localhost" forAttribute:@"to"];
+    [doc.root setValue:@"3" forAttribute:@"id"];
+    [doc.root addElementWithName:@"received" namespace:@"urn:xmpp:receipts" content:nil];
+    [dispatcher handleDocument:doc completion:nil];
+
+    [self waitForExpectationsWithTimeout:2.0 handler:nil];
+
+    assertThatUnsignedInteger(numberOfSentDocuments, equalToUnsignedInteger(2));
+
+    [dispatcher removeObserver:observer];
+}
+
+#pragma mark Performance
+
+- (void)testIncomingStanzasPerformance
+{
+    XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] init];
+
+    NSMutableArray *handlers = [[NSMutableArray alloc] init];
+    for (NSUInteger i = 0; i < 64; i++) {
+        XMPPModuleStub *handler = [[XMPPModuleStub alloc] init];
+        [handlers addObject:handler];
+        [dispatcher addHandler:handler];
+    }
+
+    NSMutableArray *documents = [[NSMutableArray alloc] init];
+    for (NSUInteger i = 0; i < 1000; i++) {
+        PXDocument *doc = [[PXDocument alloc] initWithElementName:(i % 2 ? @"message" : @"presence") namespace:@"jabber:client" prefix:nil];
+        [doc.root setValue:@"juliet@example.com" forAttribute:@"from"];
+        [doc.root setValue:@"romeo@localhost" forAttribute:@"to"];
+        [documents addObject:doc];
+    }
+
+    [self measureBlock:^{
+        XCTestExpectation *expectation = [self expectationWithDescription:@"Expect Completion"];
+        for (PXDocument *doc in documents) {
+            [dispatcher handleDocument:doc completion:nil];
+        }
+        [dispatcher processPendingDocuments:^(NSError *error) {
+            [expectation fulfill];
+        }];
+        [self waitForExpectationsWithTimeout:10.0 handler:nil];
+    }];
+}
+
+- (void)testIncomingStanzasWithFiltersPerformance
+{
+    // Each handler is only interested in one payload.
+
+    XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] init];
+
+    NSMutableArray *handlers = [[NSMutableArray alloc] init];
+    for (NSUInteger i = 0; i < 64; i++) {
+        XMPPModuleStub *handler = [[XMPPModuleStub alloc] init];
+        PXQName *payload = PXQN(([NSString stringWithFormat:@"urn:example:%lu", (unsigned long)i]), @"payload");
+        XMPPDispatcherStanzaFilter *filter = [[XMPPDispatcherStanzaFilter alloc] initWithPayloadQNames:@[ payload ] types:nil];
+        [handlers addObject:handler];
+        [dispatcher addHandler:handler withMessageFilter:filter presenceFilter:filter];
+    }
+
+    NSMutableArray *documents = [[NSMutableArray alloc] init];
+    for (NSUInteger i = 0; i < 1000; i++) {
+        PXDocument *doc = [[PXDocument alloc] initWithElementName:(i % 2 ? @"message" : @"presence") namespace:@"jabber:client" prefix:nil];
+        [doc.root setValue:@"juliet@example.com" forAttribute:@"from"];
+        [doc.root setValue:@"romeo@localhost" forAttribute:@"to"];
+        [doc.root addElementWithName:@"payload" namespace:[NSString stringWithFormat:@"urn:example:%lu", (unsigned long)(i % 64)] content:nil];
+        [documents addObject:doc];
+    }
+
+    [self measureBlock:^{
+        XCTestExpectation *expectation = [self expectationWithDescription:@"Expect Completion"];
+        for (PXDocument *doc in documents) {
+            [dispatcher handleDocument:doc completion:nil];
+        }
+        [dispatcher processPendingDocuments:^(NSError *error) {
+            [expectation fulfill];
+        }];
+        [self waitForExpectationsWithTimeout:10.0 handler:nil];
+    }];
+}
+
+- (void)testShardedRoutingPerformance
+{
+    NSUInteger numberOfShards = [[NSProcessInfo processInfo] activeProcessorCount];
+
+    NSTimeInterval serialDuration = [self durationOfRoutingStanzas:20000 forAccounts:64 numberOfShards:1];
+    NSTimeInterval shardedDuration = [self durationOfRoutingStanzas:20000 forAccounts:64 numberOfShards:numberOfShards];
+
+    NSLog(@"Routing 20000 stanzas for 64 accounts: %.3fs with 1 shard, %.3fs with %lu shards (speedup %.2f).",
+          serialDuration,
+          shardedDuration,
+          (unsigned long)numberOfShards,
+          serialDuration / shardedDuration);
+
+    [self measureBlock:^{
+        [self durationOfRoutingStanzas:20000 forAccounts:64 numberOfShards:numberOfShards];
+    }];
+}
+
+#pragma mark Helper
+
+- (NSTimeInterval)durationOfRoutingStanzas:(NSUInteger)numberOfStanzas
+                               forAccounts:(NSUInteger)numberOfAccounts
+                            numberOfShards:(NSUInteger)numberOfShards
+{
+    XMPPDispatcherImpl *dispatcher = [[XMPPDispatcherImpl alloc] initWithNumberOfShards:numberOfShards];
+
+    NSMutableArray *connections = [[NSMutableArray alloc] init];
+    NSMutableArray *stanzas = [[NSMutableArray alloc] init];
+    for (NSUInteger i = 0; i < numberOfAccounts; i++) {
+        XMPPJID *account = JID(([NSString stringWithFormat:@"romeo%lu@localhost", (unsigned long)i]));
+        XMPPConnectionStub *connection = [[XMPPConnectionStub alloc] init];
+        [connections addObject:connection];
+        [dispatcher setConnection:connection forJID:account];
+        [dispatcher connection:connection didConnectTo:account resumed:NO];
+
+        PXDocument *doc = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+        [doc.root setValue:[account stringValue] forAttribute:@"from"];
+        [doc.root setValue:@"juliet@example.com" forAttribute:@"to"];
+        [doc.root setValue:@"chat" forAttribute:@"type"];
+        [doc.root addElementWithName:@"body" namespace:@"jabber:client" content:@"Hello!"];
+        [stanzas addObject:doc.root];
+    }
+
+    dispatch_group_t group = dispatch_group_create();
+    NSDate *start = [NSDate date];
+
+    dispatch_apply(numberOfAccounts, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        XMPPMessageStanza *stanza = stanzas[i];
+        for (NSUInteger j = 0; j < numberOfStanzas / numberOfAccounts; j++) {
+            dispatch_group_enter(group);
+            [dispatcher handleMessage:stanza
+                           completion:^(NSError *error) {
+                               dispatch_group_leave(group);
+                           }];
+        }
+    });
+
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    return [[NSDate date] timeIntervalSinceDate:start];
+}
+
 @end
@@ -0,0 +1,227 @@
+//
+//  XMPPHostMetaCacheTests.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPTestCase.h"
+
+@interface XMPPHostMetaCacheTests : XMPPTestCase
+@property (nonatomic, strong) NSURL *storageURL;
+@property (nonatomic, assign) NSUInteger numberOfRequests;
+@property (nonatomic, assign) BOOL hostMetadataUnavailable;
+@property (nonatomic, strong) NSDictionary *responseHeaders;
+@end
+
+@implementation XMPPHostMetaCacheTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.storageURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    self.numberOfRequests = 0;
+    self.hostMetadataUnavailable = NO;
+    self.responseHeaders = @{};
+
+    __weak typeof(self) _self = self;
+    [OHHTTPStubs stubRequestsPassingTest:^BOOL(NSURLRequest *request) {
+        return [request.URL.host isEqualToString:@"example.com"] && [request.URL.path isEqualToString:@"/.well-known/host-meta"];
+    }
+        withStubResponse:^OHHTTPStubsResponse *_Nonnull(NSURLRequest *_Nonnull request) {
+            _self.numberOfRequests += 1;
+
+            if (_self.hostMetadataUnavailable) {
+                return [OHHTTPStubsResponse responseWithData:[NSData data] statusCode:503 headers:@{}];
+            }
+
+            PXDocument *hostMetadata = [[PXDocument alloc] initWithElementName:@"XRD"
+                                                                     namespace:@"http://docs.oasis-open.org/ns/xri/xrd-1.0"
+                                                                        prefix:nil];
+
+            PXElement *link = nil;
+            link = [hostMetadata.root addElementWithName:@"Link" namespace:@"http://docs.oasis-open.org/ns/xri/xrd-1.0" content:nil];
+            [link setValue:@"urn:xmpp:alt-connections:websocket" forAttribute:@"rel"];
+            [link setValue:@"wss://ws1.example.com/xmpp" forAttribute:@"href"];
+
+            link = [hostMetadata.root addElementWithName:@"Link" namespace:@"http://docs.oasis-open.org/ns/xri/xrd-1.0" content:nil];
+            [link setValue:@"urn:xmpp:alt-connections:websocket" forAttribute:@"rel"];
+            [link setValue:@"wss://ws2.example.com/xmpp" forAttribute:@"href"];
+
+            link = [hostMetadata.root addElementWithName:@"Link" namespace:@"http://docs.oasis-open.org/ns/xri/xrd-1.0" content:nil];
+            [link setValue:@"urn:xmpp:alt-connections:xbosh" forAttribute:@"rel"];
+            [link setValue:@"https://example.com/http-bind" forAttribute:@"href"];
+
+            return [OHHTTPStubsResponse responseWithData:[hostMetadata data]
+                                              statusCode:200
+                                                 headers:_self.responseHeaders];
+        }];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtURL:self.storageURL error:nil];
+    [super tearDown];
+}
+
+#pragma mark Helper
+
+- (NSDictionary *)linksForHost:(NSString *)hostname withCache:(XMPPHostMetaCache *)cache
+{
+    __block NSDictionary *result = nil;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Expect links"];
+    [cache linksForHost:hostname
+             completion:^(NSDictionary<NSString *, NSArray<NSURL *> *> *links, NSError *error) {
+                 result = links;
+                 [expectation fulfill];
+             }];
+    [self waitForExpectationsWithTimeout:2.0 handler:nil];
+    return result;
+}
+
+#pragma mark Tests
+
+- (void)testLookupLinks
+{
+    XMPPHostMetaCache *cache = [[XMPPHostMetaCache alloc] initWithStorageURL:nil];
+
+    NSDictionary *links = [self linksForHost:@"example.com" withCache:cache];
+    assertThat(links[XMPPHostMetaLinkRelationWebsocket], contains([NSURL URLWithString:@"wss://ws1.example.com/xmpp"],
+                                                                 [NSURL URLWithString:@"wss://ws2.example.com/xmpp"], nil));
+    assertThat(links[XMPPHostMetaLinkRelationBOSH], contains([NSURL URLWithString:@"https://example.com/http-bind"], nil));
+
+    links = [self linksForHost:@"example.com" withCache:cache];
+    assertThat(links[XMPPHostMetaLinkRelationWebsocket], hasCountOf(2));
+    assertThatUnsignedInteger(self.numberOfRequests, equalToUnsignedInteger(1));
+}
+
+- (void)testCoalesceConcurrentLookups
+{
+    XMPPHostMetaCache *cache = [[XMPPHostMetaCache alloc] initWithStorageURL:nil];
+
+    XCTestExpectation *expectation1 = [self expectationWithDescription:@"Expect links"];
+    [cache linksForHost:@"example.com"
+             completion:^(NSDictionary<NSString *, NSArray<NSURL *> *> *links, NSError *error) {
+                 [expectation1 fulfill];
+             }];
+
+    XCTestExpectation *expectation2 = [self expectationWithDescription:@"Expect links"];
+    [cache linksForHost:@"example.com"
+             completion:^(NSDictionary<NSString *, NSArray<NSURL *> *> *links, NSError *error) {
+                 [expectation2 fulfill];
+             }];
+
+    [self waitForExpectationsWithTimeout:2.0 handler:nil];
+    assertThatUnsignedInteger(self.numberOfRequests, equalToUnsignedInteger(1));
+}
+
+- (void)testHonourCacheHeaders
+{
+    XMPPHostMetaCache *cache = [[XMPPHostMetaCache alloc] initWithStorageURL:nil];
+
+    self.responseHeaders = @{ @"Cache-Control" : @"max-age=0" };
+    [self linksForHost:@"example.com" withCache:cache];
+    [self linksForHost:@"example.com" withCache:cache];
+    assertThatUnsignedInteger(self.numberOfRequests, equalToUnsignedInteger(2));
+}
+
+- (void)testFallbackToExpiredEntry
+{
+    XMPPHostMetaCache *cache = [[XMPPHostMetaCache alloc] initWithStorageURL:nil];
+    cache.defaultTimeToLive = 0;
+
+    [self linksForHost:@"example.com" withCache:cache];
+
+    self.hostMetadataUnavailable = YES;
+
+    NSDictionary *links = [self linksForHost:@"example.com" withCache:cache];
+    assertThatUnsignedInteger(self.numberOfRequests, equalToUnsignedInteger(2));
+    assertThat(links[XMPPHostMetaLinkRelationWebsocket], hasCountOf(2));
+}
+
+- (void)testFailWithoutEntry
+{
+    XMPPHostMetaCache *cache = [[XMPPHostMetaCache alloc] initWithStorageURL:nil];
+
+    self.hostMetadataUnavailable = YES;
+
+    __block NSError *error = nil;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Expect error"];
+    [cache linksForHost:@"example.com"
+             completion:^(NSDictionary<NSString *, NSArray<NSURL *> *> *links, NSError *e) {
+                 error = e;
+                 [expectation fulfill];
+             }];
+    [self waitForExpectationsWithTimeout:2.0 handler:nil];
+
+    assertThat(error.domain, equalTo(XMPPErrorDomain));
+    assertThatInteger(error.code, equalToInteger(XMPPErrorCodeDiscoveryError));
+}
+
+- (void)testPersistEntries
+{
+    XMPPHostMetaCache *cache = [[XMPPHostMetaCache alloc] initWithStorageURL:self.storageURL];
+    [self linksForHost:@"example.com" withCache:cache];
+
+    cache = [[XMPPHostMetaCache alloc] initWithStorageURL:self.storageURL];
+    NSDictionary *links = [self linksForHost:@"example.com" withCache:cache];
+
+    assertThatUnsignedInteger(self.numberOfRequests, equalToUnsignedInteger(1));
+    assertThat(links[XMPPHostMetaLinkRelationWebsocket], hasCountOf(2));
+}
+
+- (void)testPreferredLink
+{
+    XMPPHostMetaCache *cache = [[XMPPHostMetaCache alloc] initWithStorageURL:self.storageURL];
+    cache.defaultTimeToLive = 0;
+
+    [self linksForHost:@"example.com" withCache:cache];
+    [cache setPreferredLink:[NSURL URLWithString:@"wss://ws2.example.com/xmpp"]
+                forRelation:XMPPHostMetaLinkRelationWebsocket
+                       host:@"example.com"];
+
+    // The preferred link is kept after the entry has been refreshed
+    // and after the entries have been loaded from disk.
+
+    NSDictionary *links = [self linksForHost:@"example.com" withCache:cache];
+    assertThatUnsignedInteger(self.numberOfRequests, equalToUnsignedInteger(2));
+    assertThat(links[XMPPHostMetaLinkRelationWebsocket], contains([NSURL URLWithString:@"wss://ws2.example.com/xmpp"],
+                                                                 [NSURL URLWithString:@"wss://ws1.example.com/xmpp"], nil));
+
+    self.hostMetadataUnavailable = YES;
+    cache = [[XMPPHostMetaCache alloc] initWithStorageURL:self.storageURL];
+    links = [self linksForHost:@"example.com" withCache:cache];
+    assertThat(links[XMPPHostMetaLinkRelationWebsocket], contains([NSURL URLWithString:@"wss://ws2.example.com/xmpp"],
+                                                                 [NSURL URLWithString:@"wss://ws1.example.com/xmpp"], nil));
+}
+
+@end
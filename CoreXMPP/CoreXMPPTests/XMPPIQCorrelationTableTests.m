@@ -0,0 +1,185 @@
+//
+//  XMPPIQCorrelationTableTests.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPIQCorrelationTable.h"
+#import "XMPPTestCase.h"
+
+@interface XMPPIQCorrelationTableTests : XMPPTestCase
+
+@end
+
+@implementation XMPPIQCorrelationTableTests
+
+#pragma mark Tests
+
+- (void)testRequestIDs
+{
+    XMPPIQCorrelationTable *table = [[XMPPIQCorrelationTable alloc] init];
+    XMPPIQCorrelationTable *otherTable = [[XMPPIQCorrelationTable alloc] init];
+
+    NSString *first = [table nextRequestID];
+    NSString *second = [table nextRequestID];
+    NSString *other = [otherTable nextRequestID];
+
+    assertThat(first, isNot(equalTo(second)));
+    assertThat(first, isNot(equalTo(other)));
+
+    NSString *prefix = [first substringToIndex:[first rangeOfString:@"-"].location + 1];
+    assertThat(second, startsWith(prefix));
+    assertThat(other, isNot(startsWith(prefix)));
+
+    NSMutableSet *uniqueRequestIDs = [[NSMutableSet alloc] init];
+    for (NSUInteger i = 0; i < 1000; i++) {
+        [uniqueRequestIDs addObject:[XMPPIQCorrelationTable uniqueRequestID]];
+    }
+    assertThatUnsignedInteger([uniqueRequestIDs count], equalToUnsignedInteger(1000));
+}
+
+- (void)testMatchSender
+{
+    XMPPIQCorrelationTable *table = [[XMPPIQCorrelationTable alloc] init];
+
+    __block BOOL completed = NO;
+    [table addRequestWithID:@"1"
+                         to:JID(@"juliet@example.com/balcony")
+       acceptsMissingSender:NO
+                 completion:^(XMPPIQStanza *response, NSError *error) {
+                     completed = YES;
+                 }];
+    assertThatUnsignedInteger(table.numberOfPendingRequests, equalToUnsignedInteger(1));
+
+    assertThat([table removeRequestForResponseWithID:@"1" from:@"mallory@example.com"], nilValue());
+    assertThat([table removeRequestForResponseWithID:@"1" from:nil], nilValue());
+    assertThat([table removeRequestForResponseWithID:@"2" from:@"juliet@example.com/balcony"], nilValue());
+    assertThatUnsignedInteger(table.numberOfPendingRequests, equalToUnsignedInteger(1));
+
+    // Not normalized
+    XMPPIQCorrelationCompletion completion = [table removeRequestForResponseWithID:@"1" from:@"Juliet@Example.com/balcony"];
+    assertThat(completion, notNilValue());
+    completion(nil, nil);
+    assertThatBool(completed, isTrue());
+    assertThatUnsignedInteger(table.numberOfPendingRequests, equalToUnsignedInteger(0));
+}
+
+- (void)testMissingSender
+{
+    XMPPIQCorrelationTable *table = [[XMPPIQCorrelationTable alloc] init];
+
+    void (^completion)(XMPPIQStanza *, NSError *) = ^(XMPPIQStanza *response, NSError *error) {
+    };
+
+    [table addRequestWithID:@"1" to:JID(@"romeo@localhost") acceptsMissingSender:YES completion:completion];
+    [table addRequestWithID:@"2" to:nil acceptsMissingSender:NO completion:completion];
+
+    assertThat([table removeRequestForResponseWithID:@"1" from:nil], notNilValue());
+    assertThat([table removeRequestForResponseWithID:@"2" from:@"localhost"], notNilValue());
+
+    id request = [table addRequestWithID:@"3" to:JID(@"romeo@localhost") acceptsMissingSender:NO completion:completion];
+    [table addRequestWithID:@"4" to:JID(@"romeo@localhost") acceptsMissingSender:NO completion:completion];
+
+    assertThat([table removeRequest:request], notNilValue());
+    assertThat([table removeRequest:request], nilValue());
+    assertThatUnsignedInteger([[table removeAllRequests] count], equalToUnsignedInteger(1));
+    assertThatUnsignedInteger(table.numberOfPendingRequests, equalToUnsignedInteger(0));
+}
+
+- (void)testDuplicateRequestIDs
+{
+    XMPPIQCorrelationTable *table = [[XMPPIQCorrelationTable alloc] init];
+
+    NSMutableArray *completed = [[NSMutableArray alloc] init];
+    id romeo = [table addRequestWithID:@"1"
+                                    to:JID(@"romeo@localhost")
+                  acceptsMissingSender:NO
+                            completion:^(XMPPIQStanza *response, NSError *error) {
+                                [completed addObject:@"romeo"];
+                            }];
+    [table addRequestWithID:@"1"
+                         to:JID(@"juliet@localhost")
+       acceptsMissingSender:NO
+                 completion:^(XMPPIQStanza *response, NSError *error) {
+                     [completed addObject:@"juliet"];
+                 }];
+    [table addRequestWithID:@"1"
+                         to:JID(@"benvolio@localhost")
+       acceptsMissingSender:NO
+                 completion:^(XMPPIQStanza *response, NSError *error) {
+                     [completed addObject:@"benvolio"];
+                 }];
+    assertThatUnsignedInteger(table.numberOfPendingRequests, equalToUnsignedInteger(3));
+
+    [table removeRequestForResponseWithID:@"1" from:@"juliet@localhost"](nil, nil);
+    assertThat([table removeRequestForResponseWithID:@"1" from:@"juliet@localhost"], nilValue());
+
+    // Only the request of the token is removed.
+    [table removeRequest:romeo](nil, nil);
+    assertThat([table removeRequest:romeo], nilValue());
+
+    [table removeRequestForResponseWithID:@"1" from:@"benvolio@localhost"](nil, nil);
+
+    assertThat(completed, equalTo(@[ @"juliet", @"romeo", @"benvolio" ]));
+    assertThatUnsignedInteger(table.numberOfPendingRequests, equalToUnsignedInteger(0));
+}
+
+#pragma mark Performance
+
+- (void)testCorrelationPerformance
+{
+    // Correlate the responses of 10000 requests in flight, which are
+    // answered in reverse order.
+
+    NSUInteger numberOfRequests = 10000;
+    XMPPJID *to = JID(@"juliet@example.com/balcony");
+    NSString *from = [to stringValue];
+
+    void (^completion)(XMPPIQStanza *, NSError *) = ^(XMPPIQStanza *response, NSError *error) {
+    };
+
+    [self measureBlock:^{
+        XMPPIQCorrelationTable *table = [[XMPPIQCorrelationTable alloc] init];
+        NSMutableArray *requestIDs = [[NSMutableArray alloc] initWithCapacity:numberOfRequests];
+        for (NSUInteger i = 0; i < numberOfRequests; i++) {
+            NSString *requestID = [table nextRequestID];
+            [table addRequestWithID:requestID to:to acceptsMissingSender:NO completion:completion];
+            [requestIDs addObject:requestID];
+        }
+        for (NSString *requestID in [requestIDs reverseObjectEnumerator]) {
+            [table removeRequestForResponseWithID:requestID from:from];
+        }
+        XCTAssertEqual(table.numberOfPendingRequests, 0);
+    }];
+}
+
+@end
@@ -0,0 +1,162 @@
+//
+//  XMPPIQRequestCoalescerTests.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPIQRequestCoalescer.h"
+#import "XMPPTestCase.h"
+
+@interface XMPPIQRequestCoalescerTests : XMPPTestCase
+
+@end
+
+@implementation XMPPIQRequestCoalescerTests
+
+#pragma mark Tests
+
+- (void)testRequestKeys
+{
+    XMPPIQStanza *request = [self requestWithType:@"get" to:@"juliet@example.com" namespace:@"http://jabber.org/protocol/disco#info"];
+    XMPPIQStanza *identical = [self requestWithType:@"get" to:@"juliet@example.com" namespace:@"http://jabber.org/protocol/disco#info"];
+    XMPPIQStanza *otherRecipient = [self requestWithType:@"get" to:@"benvolio@example.com" namespace:@"http://jabber.org/protocol/disco#info"];
+    XMPPIQStanza *otherPayload = [self requestWithType:@"get" to:@"juliet@example.com" namespace:@"jabber:iq:version"];
+    XMPPIQStanza *set = [self requestWithType:@"set" to:@"juliet@example.com" namespace:@"http://jabber.org/protocol/disco#info"];
+
+    NSString *identifier = request.identifier;
+    NSData *key = [XMPPIQRequestCoalescer keyForRequest:request];
+    assertThat(request.identifier, equalTo(identifier));
+    assertThat(key, notNilValue());
+    assertThat([XMPPIQRequestCoalescer keyForRequest:identical], equalTo(key));
+    assertThat([XMPPIQRequestCoalescer keyForRequest:otherRecipient], isNot(equalTo(key)));
+    assertThat([XMPPIQRequestCoalescer keyForRequest:otherPayload], isNot(equalTo(key)));
+    assertThat([XMPPIQRequestCoalescer keyForRequest:set], nilValue());
+
+    // The ID of the request is kept.
+    assertThat(request.identifier, equalTo(identifier));
+}
+
+- (void)testCoalesceRequests
+{
+    XMPPIQRequestCoalescer *coalescer = [[XMPPIQRequestCoalescer alloc] init];
+    NSData *key = [XMPPIQRequestCoalescer keyForRequest:[self requestWithType:@"get" to:@"juliet@example.com" namespace:@"jabber:iq:version"]];
+
+    __block NSUInteger numberOfCompletions = 0;
+    XMPPIQCorrelationCompletion completion = ^(XMPPIQStanza *response, NSError *error) {
+        numberOfCompletions += 1;
+    };
+    XMPPIQCorrelationCompletion timedOutCompletion = ^(XMPPIQStanza *response, NSError *error) {
+        numberOfCompletions += 1;
+    };
+
+    assertThat([coalescer joinRequestForKey:key deadline:10 completion:completion], nilValue());
+
+    id request = [coalescer beginRequestForKey:key deadline:10];
+    assertThat([coalescer joinRequestForKey:key deadline:10 completion:completion], sameInstance(request));
+    assertThat([coalescer joinRequestForKey:key deadline:5 completion:timedOutCompletion], sameInstance(request));
+
+    // The pending request times out before the joining one.
+    assertThat([coalescer joinRequestForKey:key deadline:20 completion:completion], nilValue());
+
+    assertThatBool([coalescer removeCompletion:timedOutCompletion fromRequest:request], isTrue());
+    assertThatBool([coalescer removeCompletion:timedOutCompletion fromRequest:request], isFalse());
+
+    for (XMPPIQCorrelationCompletion completion in [coalescer finishRequest:request]) {
+        completion(nil, nil);
+    }
+    assertThatUnsignedInteger(numberOfCompletions, equalToUnsignedInteger(1));
+    assertThat([coalescer finishRequest:request], isEmpty());
+
+    assertThat([coalescer joinRequestForKey:key deadline:10 completion:completion], nilValue());
+}
+
+- (void)testCacheEviction
+{
+    XMPPIQRequestCoalescer *coalescer = [[XMPPIQRequestCoalescer alloc] init];
+    coalescer.maximumNumberOfCachedResults = 2;
+
+    NSData *first = [@"first" dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *second = [@"second" dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *third = [@"third" dataUsingEncoding:NSUTF8StringEncoding];
+    XMPPIQStanza *result = [self requestWithType:@"result" to:@"romeo@localhost" namespace:@"jabber:iq:version"];
+
+    [coalescer cacheResult:result forKey:first timeToLive:60];
+    [coalescer cacheResult:result forKey:second timeToLive:60];
+
+    // The first result is used more recently than the second one.
+    assertThat([coalescer cachedResultForKey:first], equalTo(result));
+
+    [coalescer cacheResult:result forKey:third timeToLive:60];
+    assertThatUnsignedInteger(coalescer.numberOfCachedResults, equalToUnsignedInteger(2));
+    assertThat([coalescer cachedResultForKey:first], equalTo(result));
+    assertThat([coalescer cachedResultForKey:second], nilValue());
+    assertThat([coalescer cachedResultForKey:third], equalTo(result));
+
+    coalescer.maximumNumberOfCachedResults = 1;
+    assertThatUnsignedInteger(coalescer.numberOfCachedResults, equalToUnsignedInteger(1));
+    assertThat([coalescer cachedResultForKey:third], equalTo(result));
+
+    [coalescer removeAllCachedResults];
+    assertThatUnsignedInteger(coalescer.numberOfCachedResults, equalToUnsignedInteger(0));
+}
+
+- (void)testCacheExpiration
+{
+    XMPPIQRequestCoalescer *coalescer = [[XMPPIQRequestCoalescer alloc] init];
+
+    NSData *key = [@"key" dataUsingEncoding:NSUTF8StringEncoding];
+    XMPPIQStanza *result = [self requestWithType:@"result" to:@"romeo@localhost" namespace:@"jabber:iq:version"];
+
+    [coalescer cacheResult:result forKey:key timeToLive:0.05];
+    assertThat([coalescer cachedResultForKey:key], equalTo(result));
+
+    [NSThread sleepForTimeInterval:0.1];
+
+    assertThat([coalescer cachedResultForKey:key], nilValue());
+    assertThatUnsignedInteger(coalescer.numberOfCachedResults, equalToUnsignedInteger(0));
+}
+
+#pragma mark Helper
+
+- (XMPPIQStanza *)requestWithType:(NSString *)type to:(NSString *)to namespace:(NSString *)namespace
+{
+    PXDocument *doc = [[PXDocument alloc] initWithElementName:@"iq" namespace:@"jabber:client" prefix:nil];
+    PXElement *request = doc.root;
+    [request setValue:@"romeo@localhost" forAttribute:@"from"];
+    [request setValue:to forAttribute:@"to"];
+    [request setValue:type forAttribute:@"type"];
+    [request setValue:[[NSUUID UUID] UUIDString] forAttribute:@"id"];
+    [request addElementWithName:@"query" namespace:namespace content:nil];
+    return (XMPPIQStanza *)request;
+}
+
+@end
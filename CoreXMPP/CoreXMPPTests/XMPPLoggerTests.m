@@ -0,0 +1,98 @@
+//
+//  XMPPLoggerTests.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPLogger.h"
+#import "XMPPTestCase.h"
+
+@interface XMPPLoggerTests : XMPPTestCase
+@property (nonatomic, assign) NSUInteger numberOfEvaluations;
+@end
+
+@implementation XMPPLoggerTests
+
+- (void)tearDown
+{
+    [XMPPLogger setHandler:nil];
+    [XMPPLogger setLevel:XMPPLogLevelInfo];
+    [super tearDown];
+}
+
+- (NSString *)evaluate
+{
+    self.numberOfEvaluations += 1;
+    return @"evaluated";
+}
+
+#pragma mark Tests
+
+- (void)testLogLevels
+{
+    [XMPPLogger setLevel:XMPPLogLevelInfo];
+    [XMPPLogger setLevel:XMPPLogLevelDebug forCategory:XMPPLogCategoryStreamManagement];
+
+    assertThatUnsignedInteger([XMPPLogger levelForCategory:XMPPLogCategoryStream], equalToUnsignedInteger(XMPPLogLevelInfo));
+    assertThatUnsignedInteger([XMPPLogger levelForCategory:XMPPLogCategoryStreamManagement], equalToUnsignedInteger(XMPPLogLevelDebug));
+
+    NSMutableArray *messages = [[NSMutableArray alloc] init];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Expect messages"];
+    [XMPPLogger setHandler:^(XMPPLogLevel level, XMPPLogCategory category, NSString *message) {
+        [messages addObject:message];
+        if ([message isEqualToString:@"done"]) {
+            [expectation fulfill];
+        }
+    }];
+
+    XMPPLogDebug(XMPPLogCategoryStream, @"stream %@", [self evaluate]);
+    XMPPLogDebug(XMPPLogCategoryStreamManagement, @"sm %@", [self evaluate]);
+    XMPPLogTrace(XMPPLogCategoryStreamManagement, @"trace %@", [self evaluate]);
+    XMPPLogInfo(XMPPLogCategoryClient, @"client %d", 42);
+    XMPPLogError(XMPPLogCategoryClient, @"done");
+
+    [self waitForExpectationsWithTimeout:1.0 handler:nil];
+
+    assertThat(messages, contains(@"sm evaluated", @"client 42", @"done", nil));
+
+    // The arguments of disabled messages are not evaluated.
+    assertThatUnsignedInteger(self.numberOfEvaluations, equalToUnsignedInteger(1));
+}
+
+- (void)testLogOff
+{
+    [XMPPLogger setLevel:XMPPLogLevelOff];
+    XMPPLogError(XMPPLogCategoryClient, @"%@", [self evaluate]);
+    assertThatUnsignedInteger(self.numberOfEvaluations, equalToUnsignedInteger(0));
+}
+
+@end
@@ -0,0 +1,238 @@
+//
+//  XMPPStanzaSchedulerTests.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+
+#import "XMPPStanzaScheduler.h"
+#import "XMPPTestCase.h"
+
+@interface XMPPStanzaSchedulerTests : XMPPTestCase
+
+@end
+
+@implementation XMPPStanzaSchedulerTests
+
+#pragma mark Tests
+
+- (void)testWeightedScheduling
+{
+    XMPPStanzaScheduler *scheduler = [[XMPPStanzaScheduler alloc] initWithWeights:@[ @2, @1, @1 ] maximumDelay:60.0];
+
+    for (NSUInteger i = 0; i < 4; i++) {
+        [scheduler enqueueObject:[NSString stringWithFormat:@"b%lu", (unsigned long)i] withPriority:XMPPStanzaPriorityBulk];
+    }
+    for (NSUInteger i = 0; i < 4; i++) {
+        [scheduler enqueueObject:[NSString stringWithFormat:@"c%lu", (unsigned long)i] withPriority:XMPPStanzaPriorityControl];
+    }
+    [scheduler enqueueObject:@"i0" withPriority:XMPPStanzaPriorityInteractive];
+
+    assertThatUnsignedInteger(scheduler.count, equalToUnsignedInteger(9));
+    assertThatUnsignedInteger([scheduler countForPriority:XMPPStanzaPriorityBulk], equalToUnsignedInteger(4));
+
+    NSMutableArray *objects = [[NSMutableArray alloc] init];
+    id object = nil;
+    while ((object = [scheduler dequeueObject])) {
+        [objects addObject:object];
+    }
+
+    assertThat(objects, equalTo(@[ @"c0", @"c1", @"i0", @"b0", @"c2", @"c3", @"b1", @"b2", @"b3" ]));
+    assertThatUnsignedInteger(scheduler.count, equalToUnsignedInteger(0));
+}
+
+- (void)testStarvationProtection
+{
+    XMPPStanzaScheduler *scheduler = [[XMPPStanzaScheduler alloc] initWithWeights:@[ @100, @1, @1 ] maximumDelay:0.05];
+
+    [scheduler enqueueObject:@"b0" withPriority:XMPPStanzaPriorityBulk];
+    [NSThread sleepForTimeInterval:0.1];
+    for (NSUInteger i = 0; i < 10; i++) {
+        [scheduler enqueueObject:[NSString stringWithFormat:@"c%lu", (unsigned long)i] withPriority:XMPPStanzaPriorityControl];
+    }
+
+    // The bulk object waited longer than the maximum delay.
+    assertThat([scheduler dequeueObject], equalTo(@"b0"));
+    assertThat([scheduler dequeueObject], equalTo(@"c0"));
+}
+
+- (void)testOrderingKeys
+{
+    XMPPStanzaScheduler *scheduler = [[XMPPStanzaScheduler alloc] initWithWeights:@[ @8, @4, @1 ] maximumDelay:60.0];
+
+    // A join presence (bulk) followed by a groupchat message (interactive)
+    // and an IQ request (control) to the same room must not overtake it.
+    for (NSUInteger i = 0; i < 4; i++) {
+        [scheduler enqueueObject:[NSString stringWithFormat:@"b%lu", (unsigned long)i] withPriority:XMPPStanzaPriorityBulk];
+    }
+    [scheduler enqueueObject:@"join" withPriority:XMPPStanzaPriorityBulk orderingKey:@"room@muc.localhost"];
+    [scheduler enqueueObject:@"groupchat" withPriority:XMPPStanzaPriorityInteractive orderingKey:@"room@muc.localhost"];
+    [scheduler enqueueObject:@"iq" withPriority:XMPPStanzaPriorityControl orderingKey:@"room@muc.localhost"];
+    [scheduler enqueueObject:@"chat" withPriority:XMPPStanzaPriorityInteractive orderingKey:@"juliet@localhost"];
+
+    NSMutableArray *objects = [[NSMutableArray alloc] init];
+    id object = nil;
+    while ((object = [scheduler dequeueObject])) {
+        [objects addObject:object];
+    }
+
+    assertThat(objects, equalTo(@[ @"chat", @"b0", @"b1", @"b2", @"b3", @"join", @"groupchat", @"iq" ]));
+
+    // After the queued objects with the key have been dequeued, the
+    // priority applies again.
+    [scheduler enqueueObject:@"b4" withPriority:XMPPStanzaPriorityBulk];
+    [scheduler enqueueObject:@"groupchat" withPriority:XMPPStanzaPriorityInteractive orderingKey:@"room@muc.localhost"];
+    assertThat([scheduler dequeueObject], equalTo(@"groupchat"));
+}
+
+- (void)testRemoveObjects
+{
+    XMPPStanzaScheduler *scheduler = [[XMPPStanzaScheduler alloc] init];
+
+    NSString *first = @"1";
+    NSString *second = @"2";
+    [scheduler enqueueObject:first withPriority:XMPPStanzaPriorityInteractive];
+    [scheduler enqueueObject:second withPriority:XMPPStanzaPriorityInteractive];
+    [scheduler enqueueObject:@"3" withPriority:XMPPStanzaPriorityBulk];
+
+    [scheduler removeObject:second];
+    assertThatUnsignedInteger(scheduler.count, equalToUnsignedInteger(2));
+
+    assertThat([scheduler removeAllObjects], equalTo(@[ @"1", @"3" ]));
+    assertThatUnsignedInteger(scheduler.count, equalToUnsignedInteger(0));
+    assertThat([scheduler dequeueObject], nilValue());
+}
+
+- (void)testDiscardObjects
+{
+    XMPPStanzaScheduler *scheduler = [[XMPPStanzaScheduler alloc] init];
+
+    NSString *first = @"1";
+    NSString *second = @"2";
+    NSString *third = @"3";
+    [scheduler enqueueObject:first withPriority:XMPPStanzaPriorityInteractive orderingKey:@"juliet@localhost"];
+    [scheduler enqueueObject:second withPriority:XMPPStanzaPriorityInteractive orderingKey:@"juliet@localhost"];
+    [scheduler enqueueObject:third withPriority:XMPPStanzaPriorityBulk];
+
+    [scheduler discardObject:first];
+    [scheduler discardObject:first];
+    assertThatUnsignedInteger(scheduler.count, equalToUnsignedInteger(2));
+
+    assertThat([scheduler dequeueObject], equalTo(@"2"));
+    assertThatUnsignedInteger(scheduler.count, equalToUnsignedInteger(1));
+
+    // Once only discarded objects are left, the scheduler is empty.
+    [scheduler discardObject:third];
+    assertThatUnsignedInteger(scheduler.count, equalToUnsignedInteger(0));
+    assertThatUnsignedInteger([scheduler countForPriority:XMPPStanzaPriorityBulk], equalToUnsignedInteger(0));
+    assertThat([scheduler dequeueObject], nilValue());
+
+    [scheduler enqueueObject:first withPriority:XMPPStanzaPriorityInteractive];
+    [scheduler enqueueObject:second withPriority:XMPPStanzaPriorityBulk];
+    [scheduler discardObject:second];
+    assertThat([scheduler removeAllObjects], equalTo(@[ @"1" ]));
+}
+
+- (void)testPriorityOfElement
+{
+    PXDocument *result = [[PXDocument alloc] initWithElementName:@"iq" namespace:@"jabber:client" prefix:nil];
+    [result.root setValue:@"result" forAttribute:@"type"];
+    assertThatUnsignedInteger(XMPPStanzaPriorityOfElement(result.root), equalToUnsignedInteger(XMPPStanzaPriorityControl));
+
+    PXDocument *publish = [[PXDocument alloc] initWithElementName:@"iq" namespace:@"jabber:client" prefix:nil];
+    [publish.root setValue:@"set" forAttribute:@"type"];
+    [publish.root addElementWithName:@"pubsub" namespace:@"http://jabber.org/protocol/pubsub" content:nil];
+    assertThatUnsignedInteger(XMPPStanzaPriorityOfElement(publish.root), equalToUnsignedInteger(XMPPStanzaPriorityBulk));
+
+    PXDocument *chat = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+    [chat.root addElementWithName:@"body" namespace:@"jabber:client" content:@"Hello!"];
+    assertThatUnsignedInteger(XMPPStanzaPriorityOfElement(chat.root), equalToUnsignedInteger(XMPPStanzaPriorityInteractive));
+
+    PXDocument *headline = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+    [headline.root setValue:@"headline" forAttribute:@"type"];
+    assertThatUnsignedInteger(XMPPStanzaPriorityOfElement(headline.root), equalToUnsignedInteger(XMPPStanzaPriorityBulk));
+
+    PXDocument *presence = [[PXDocument alloc] initWithElementName:@"presence" namespace:@"jabber:client" prefix:nil];
+    assertThatUnsignedInteger(XMPPStanzaPriorityOfElement(presence.root), equalToUnsignedInteger(XMPPStanzaPriorityBulk));
+
+    PXDocument *join = [[PXDocument alloc] initWithElementName:@"presence" namespace:@"jabber:client" prefix:nil];
+    [join.root setValue:@"room@muc.localhost/romeo" forAttribute:@"to"];
+    assertThatUnsignedInteger(XMPPStanzaPriorityOfElement(join.root), equalToUnsignedInteger(XMPPStanzaPriorityInteractive));
+
+    PXDocument *request = [[PXDocument alloc] initWithElementName:@"r" namespace:@"urn:xmpp:sm:3" prefix:nil];
+    assertThatUnsignedInteger(XMPPStanzaPriorityOfElement(request.root), equalToUnsignedInteger(XMPPStanzaPriorityControl));
+}
+
+- (void)testOrderingKeyOfElement
+{
+    PXDocument *join = [[PXDocument alloc] initWithElementName:@"presence" namespace:@"jabber:client" prefix:nil];
+    [join.root setValue:@"Room@muc.localhost/romeo" forAttribute:@"to"];
+    assertThat(XMPPStanzaOrderingKeyOfElement(join.root), equalTo(@"room@muc.localhost"));
+
+    PXDocument *groupchat = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+    [groupchat.root setValue:@"room@muc.localhost" forAttribute:@"to"];
+    assertThat(XMPPStanzaOrderingKeyOfElement(groupchat.root), equalTo(@"room@muc.localhost"));
+
+    PXDocument *presence = [[PXDocument alloc] initWithElementName:@"presence" namespace:@"jabber:client" prefix:nil];
+    assertThat(XMPPStanzaOrderingKeyOfElement(presence.root), equalTo(@""));
+
+    PXDocument *request = [[PXDocument alloc] initWithElementName:@"r" namespace:@"urn:xmpp:sm:3" prefix:nil];
+    assertThat(XMPPStanzaOrderingKeyOfElement(request.root), nilValue());
+}
+
+#pragma mark Performance
+
+- (void)testSchedulingPerformance
+{
+    // Interactive objects queued behind a bulk backlog are dequeued within
+    // the first rounds, independent of the size of the backlog.
+
+    NSUInteger numberOfObjects = 100000;
+
+    [self measureBlock:^{
+        XMPPStanzaScheduler *scheduler = [[XMPPStanzaScheduler alloc] init];
+        for (NSUInteger i = 0; i < numberOfObjects; i++) {
+            [scheduler enqueueObject:@(i) withPriority:XMPPStanzaPriorityBulk];
+        }
+        [scheduler enqueueObject:@"i0" withPriority:XMPPStanzaPriorityInteractive];
+
+        NSUInteger position = NSNotFound;
+        for (NSUInteger i = 0; i <= numberOfObjects; i++) {
+            if ([[scheduler dequeueObject] isEqual:@"i0"]) {
+                position = i;
+            }
+        }
+        assertThatUnsignedInteger(position, lessThan(@(2)));
+    }];
+}
+
+@end
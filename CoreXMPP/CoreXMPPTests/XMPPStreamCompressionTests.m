@@ -0,0 +1,139 @@
+//
+//  XMPPStreamCompressionTests.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPStreamCompression.h"
+#import "XMPPTestCase.h"
+
+@interface XMPPStreamCompressionTests : XMPPTestCase
+
+@end
+
+@implementation XMPPStreamCompressionTests
+
+#pragma mark Tests
+
+- (void)testUnsupportedMethod
+{
+    assertThat([[XMPPStreamCompression alloc] initWithMethod:@"lzw"], nilValue());
+}
+
+- (void)testCompressAndDecompress
+{
+    XMPPStreamCompression *sender = [[XMPPStreamCompression alloc] initWithMethod:@"zlib"];
+    XMPPStreamCompression *receiver = [[XMPPStreamCompression alloc] initWithMethod:@"zlib"];
+
+    for (NSData *stanza in [self stanzas]) {
+        NSData *compressed = [sender compressData:stanza];
+        assertThat(compressed, notNilValue());
+
+        // Every stanza must be decodable on its own (sync flush).
+        NSError *error = nil;
+        NSData *decompressed = [receiver decompressBytes:[compressed bytes] length:[compressed length] error:&error];
+        assertThat(error, nilValue());
+        assertThat(decompressed, equalTo(stanza));
+    }
+}
+
+- (void)testInvalidInput
+{
+    XMPPStreamCompression *receiver = [[XMPPStreamCompression alloc] initWithMethod:@"zlib"];
+
+    const char *bytes = "<message/>";
+    NSError *error = nil;
+    NSData *data = [receiver decompressBytes:bytes length:strlen(bytes) error:&error];
+    assertThat(data, nilValue());
+    assertThat(error, notNilValue());
+}
+
+#pragma mark Performance
+
+- (void)testPerformanceWithoutCompression
+{
+    NSArray<NSData *> *stanzas = [self stanzas];
+
+    __block NSUInteger bytesOnWire = 0;
+    [self measureBlock:^{
+        bytesOnWire = 0;
+        for (NSData *stanza in stanzas) {
+            bytesOnWire += [stanza length];
+        }
+    }];
+
+    NSLog(@"Without compression: %lu stanzas, %lu bytes on the wire (%.1f bytes per stanza).",
+          (unsigned long)[stanzas count], (unsigned long)bytesOnWire, (double)bytesOnWire / [stanzas count]);
+}
+
+- (void)testPerformanceWithCompression
+{
+    NSArray<NSData *> *stanzas = [self stanzas];
+
+    __block NSUInteger bytesOnWire = 0;
+    __block NSUInteger bytesInStanzas = 0;
+    [self measureBlock:^{
+        XMPPStreamCompression *sender = [[XMPPStreamCompression alloc] initWithMethod:@"zlib"];
+        XMPPStreamCompression *receiver = [[XMPPStreamCompression alloc] initWithMethod:@"zlib"];
+        bytesOnWire = 0;
+        bytesInStanzas = 0;
+        for (NSData *stanza in stanzas) {
+            NSData *compressed = [sender compressData:stanza];
+            [receiver decompressBytes:[compressed bytes] length:[compressed length] error:nil];
+            bytesOnWire += [compressed length];
+            bytesInStanzas += [stanza length];
+        }
+    }];
+
+    NSLog(@"With compression: %lu stanzas, %lu bytes on the wire (%.1f bytes per stanza, ratio %.2f).",
+          (unsigned long)[stanzas count], (unsigned long)bytesOnWire, (double)bytesOnWire / [stanzas count], (double)bytesOnWire / bytesInStanzas);
+}
+
+#pragma mark -
+
+- (NSArray<NSData *> *)stanzas
+{
+    NSMutableArray *stanzas = [[NSMutableArray alloc] init];
+    for (NSUInteger i = 0; i < 10000; i++) {
+        PXDocument *document = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+        [document.root setValue:@"romeo@example.com/orchard" forAttribute:@"from"];
+        [document.root setValue:@"juliet@example.com" forAttribute:@"to"];
+        [document.root setValue:@"chat" forAttribute:@"type"];
+        [document.root setValue:[[NSUUID UUID] UUIDString] forAttribute:@"id"];
+        [document.root addElementWithName:@"body" namespace:@"jabber:client" content:[NSString stringWithFormat:@"Message number %lu", (unsigned long)i]];
+        [document.root addElementWithName:@"request" namespace:@"urn:xmpp:receipts" content:nil];
+        [stanzas addObject:[document xmpp_wireData]];
+    }
+    return stanzas;
+}
+
+@end
@@ -0,0 +1,137 @@
+//
+//  XMPPStreamFeatureCompressionTests.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPTestCase.h"
+
+@interface XMPPStreamFeatureCompressionTests : XMPPTestCase
+
+@end
+
+@implementation XMPPStreamFeatureCompressionTests
+
+- (void)testNameAndNamespace
+{
+    assertThat([XMPPStreamFeatureCompression name], equalTo(@"compression"));
+    assertThat([XMPPStreamFeatureCompression namespace], equalTo(XMPPStreamFeatureCompressionNamespace));
+}
+
+- (void)testMethods
+{
+    XMPPStreamFeatureCompression *feature = [[XMPPStreamFeatureCompression alloc] initWithConfiguration:[self featureDocument]];
+    assertThat(feature.methods, equalTo(@[ @"zlib", @"lzw" ]));
+    assertThatBool(feature.needsRestart, isTrue());
+    assertThatBool(feature.mandatory, isFalse());
+}
+
+- (void)testNegotiateCompression
+{
+    //
+    // Prepare the Feature and the Delegate
+    //
+
+    XMPPStreamFeatureCompression *feature = [[XMPPStreamFeatureCompression alloc] initWithConfiguration:[self featureDocument]];
+
+    id<XMPPStreamFeatureDelegateCompression> delegate = mockProtocol(@protocol(XMPPStreamFeatureDelegateCompression));
+    feature.delegate = delegate;
+
+    [given([delegate compressionMethodsForStreamFeature:feature]) willReturn:@[ @"zlib" ]];
+
+    //
+    // Prepare Negotiation
+    //
+
+    [givenVoid([delegate streamFeature:feature handleDocument:anything()]) willDo:^id(NSInvocation *invocation) {
+
+        PXDocument *document = [[invocation mkt_arguments] lastObject];
+
+        PXElement *compress = document.root;
+        assertThat(compress.name, equalTo(@"compress"));
+        assertThat(compress.namespace, equalTo(XMPPStreamFeatureCompressionProtocolNamespace));
+        assertThatInteger(compress.numberOfElements, equalToInteger(1));
+        assertThat([[compress elementAtIndex:0] stringValue], equalTo(@"zlib"));
+
+        dispatch_async(dispatch_get_main_queue(), ^{
+            PXDocument *response = [[PXDocument alloc] initWithElementName:@"compressed"
+                                                                 namespace:XMPPStreamFeatureCompressionProtocolNamespace
+                                                                    prefix:nil];
+            [feature handleDocument:response error:nil];
+        });
+
+        return nil;
+    }];
+
+    //
+    // Begin Negotiation
+    //
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Expecting successfull negotiation"];
+    [givenVoid([delegate streamFeatureDidSucceedNegotiation:feature]) willDo:^id(NSInvocation *invocation) {
+        [expectation fulfill];
+        return nil;
+    }];
+    [feature beginNegotiationWithHostname:@"localhost" options:nil];
+    [self waitForExpectationsWithTimeout:1.0 handler:nil];
+
+    [verify(delegate) streamFeature:feature didNegotiateCompressionMethod:@"zlib"];
+}
+
+- (void)testNegotiateUnsupportedMethod
+{
+    XMPPStreamFeatureCompression *feature = [[XMPPStreamFeatureCompression alloc] initWithConfiguration:[self featureDocument]];
+
+    id<XMPPStreamFeatureDelegateCompression> delegate = mockProtocol(@protocol(XMPPStreamFeatureDelegateCompression));
+    feature.delegate = delegate;
+
+    [given([delegate compressionMethodsForStreamFeature:feature]) willReturn:@[ @"exi" ]];
+
+    [feature beginNegotiationWithHostname:@"localhost" options:nil];
+
+    [verify(delegate) streamFeature:feature didFailNegotiationWithError:notNilValue()];
+    [verifyCount(delegate, never()) streamFeature:feature handleDocument:anything()];
+}
+
+#pragma mark -
+
+- (PXDocument *)featureDocument
+{
+    PXDocument *document = [[PXDocument alloc] initWithElementName:@"compression"
+                                                         namespace:XMPPStreamFeatureCompressionNamespace
+                                                            prefix:nil];
+    [document.root addElementWithName:@"method" namespace:XMPPStreamFeatureCompressionNamespace content:@"zlib"];
+    [document.root addElementWithName:@"method" namespace:XMPPStreamFeatureCompressionNamespace content:@"lzw"];
+    return document;
+}
+
+@end
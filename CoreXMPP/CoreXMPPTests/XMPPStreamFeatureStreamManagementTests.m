@@ -242,6 +242,56 @@
     [self waitForExpectationsWithTimeout:1.0 handler:nil];
 }
 
+- (void)testReceiveAcknowledgement
+{
+    PXDocument *configuration = [[PXDocument alloc] initWithElementName:@"sm" namespace:@"urn:xmpp:sm:3" prefix:nil];
+    XMPPStreamFeature *feature = [XMPPStreamFeature streamFeatureWithConfiguration:configuration];
+
+    id<XMPPStreamFeatureDelegate> delegate = mockProtocol(@protocol(XMPPStreamFeatureDelegate));
+    feature.delegate = delegate;
+
+    [givenVoid([delegate streamFeature:feature handleDocument:anything()]) willDo:^id(NSInvocation *invocation) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            PXDocument *response = [[PXDocument alloc] initWithElementName:@"enabled" namespace:@"urn:xmpp:sm:3" prefix:nil];
+            [response.root setValue:@"a" forAttribute:@"id"];
+            [feature handleDocument:response error:nil];
+        });
+        return nil;
+    }];
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Expecting successfull negotiation"];
+    [givenVoid([feature.delegate streamFeatureDidSucceedNegotiation:feature]) willDo:^id(NSInvocation *invocation) {
+        [expectation fulfill];
+        return nil;
+    }];
+    [feature beginNegotiationWithHostname:@"localhost" options:nil];
+    [self waitForExpectationsWithTimeout:1.0 handler:nil];
+
+    id<XMPPClientStreamManagement> sm = (id<XMPPClientStreamManagement>)feature;
+
+    PXDocument *stanza_1 = [[PXDocument alloc] initWithElementName:@"foo" namespace:@"bar:baz" prefix:nil];
+    PXDocument *stanza_2 = [[PXDocument alloc] initWithElementName:@"foo" namespace:@"bar:baz" prefix:nil];
+
+    __block BOOL ack_1 = NO;
+    __block BOOL ack_2 = NO;
+
+    [sm didSentDocument:stanza_1
+        acknowledgement:^(NSError *error) {
+            ack_1 = YES;
+        }];
+    [sm didSentDocument:stanza_2
+        acknowledgement:^(NSError *error) {
+            ack_2 = YES;
+        }];
+
+    [sm didReceiveAcknowledgement:1];
+
+    assertThatInteger(sm.numberOfAcknowledgedDocuments, equalToInteger(1));
+    assertThat(sm.unacknowledgedDocuments, equalTo(@[ stanza_2 ]));
+    assertThatBool(ack_1, isTrue());
+    assertThatBool(ack_2, isFalse());
+}
+
 - (void)testAcknowledgeSentStanzasAndResume
 {
     PXDocument *configuration = [[PXDocument alloc] initWithElementName:@"sm" namespace:@"urn:xmpp:sm:3" prefix:nil];
@@ -333,6 +383,7 @@
 
     assertThatInteger(sm.numberOfAcknowledgedDocuments, equalToInteger(2));
     assertThat(sm.unacknowledgedDocuments, equalTo(@[ stanza_3 ]));
+    assertThatUnsignedInteger(sm.numberOfUnacknowledgedDocuments, equalToUnsignedInteger(1));
 
     assertThatBool(ack_1, isTrue());
     assertThatBool(ack_2, isTrue());
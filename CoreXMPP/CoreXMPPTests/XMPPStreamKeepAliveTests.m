@@ -0,0 +1,164 @@
+//
+//  XMPPStreamKeepAliveTests.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPStreamKeepAlive.h"
+#import "XMPPTestCase.h"
+
+@interface XMPPStreamKeepAliveTests : XMPPTestCase
+
+@end
+
+@implementation XMPPStreamKeepAliveTests
+
+#pragma mark Tests
+
+- (void)testPingAfterInterval
+{
+    XMPPStreamKeepAlive *keepAlive = [[XMPPStreamKeepAlive alloc] initWithOptions:@{XMPPStreamKeepAliveIntervalKey : @(20)}];
+    [keepAlive resetAtTime:100];
+
+    assertThatDouble([keepAlive delayAtTime:105], closeTo(15, 0.001));
+    assertThat([keepAlive pingPayloadAtTime:105], nilValue());
+
+    NSData *payload = [keepAlive pingPayloadAtTime:120];
+    assertThat(payload, notNilValue());
+    assertThatDouble([keepAlive delayAtTime:120], closeTo(keepAlive.pongTimeout, 0.001));
+
+    assertThatBool([keepAlive handlePongWithPayload:payload atTime:120.2], isTrue());
+    assertThatDouble(keepAlive.roundTripTime, closeTo(0.2, 0.001));
+    assertThatDouble(keepAlive.smoothedRoundTripTime, closeTo(0.2, 0.001));
+    assertThatDouble(keepAlive.roundTripTimeVariation, closeTo(0.1, 0.001));
+    assertThatDouble([keepAlive delayAtTime:120.2], closeTo(19.8, 0.001));
+}
+
+- (void)testIgnoreOtherPongs
+{
+    XMPPStreamKeepAlive *keepAlive = [[XMPPStreamKeepAlive alloc] initWithOptions:nil];
+    [keepAlive resetAtTime:0];
+
+    uint64_t position = 0;
+    assertThatBool([keepAlive handlePongWithPayload:[NSData dataWithBytes:&position length:sizeof(position)] atTime:1], isFalse());
+    assertThatBool([keepAlive handlePongWithPayload:nil atTime:1], isFalse());
+}
+
+- (void)testSmoothRoundTripTime
+{
+    XMPPStreamKeepAlive *keepAlive = [[XMPPStreamKeepAlive alloc] initWithOptions:@{XMPPStreamKeepAliveIntervalKey : @(10)}];
+    [keepAlive resetAtTime:0];
+
+    NSData *payload = [keepAlive pingPayloadAtTime:10];
+    [keepAlive handlePongWithPayload:payload atTime:10.1];
+
+    payload = [keepAlive pingPayloadAtTime:20];
+    [keepAlive handlePongWithPayload:payload atTime:20.5];
+
+    assertThatDouble(keepAlive.roundTripTime, closeTo(0.5, 0.001));
+    assertThatDouble(keepAlive.roundTripTimeVariation, closeTo(0.75 * 0.05 + 0.25 * 0.4, 0.001));
+    assertThatDouble(keepAlive.smoothedRoundTripTime, closeTo(0.875 * 0.1 + 0.125 * 0.5, 0.001));
+}
+
+- (void)testDetectDeadPeer
+{
+    XMPPStreamKeepAlive *keepAlive = [[XMPPStreamKeepAlive alloc] initWithOptions:@{XMPPStreamKeepAliveIntervalKey : @(20),
+                                                                                    XMPPStreamKeepAliveMaximumMissedPongsKey : @(2)}];
+    [keepAlive resetAtTime:0];
+
+    NSTimeInterval now = 20;
+    assertThat([keepAlive pingPayloadAtTime:now], notNilValue());
+
+    // The ping is retried after the pong timeout.
+    now += keepAlive.pongTimeout;
+    assertThat([keepAlive pingPayloadAtTime:now], notNilValue());
+    assertThatUnsignedInteger(keepAlive.numberOfMissedPongs, equalToUnsignedInteger(1));
+    assertThatBool(keepAlive.peerDead, isFalse());
+
+    now += keepAlive.pongTimeout;
+    assertThat([keepAlive pingPayloadAtTime:now], nilValue());
+    assertThatUnsignedInteger(keepAlive.numberOfMissedPongs, equalToUnsignedInteger(2));
+    assertThatBool(keepAlive.peerDead, isTrue());
+}
+
+- (void)testLatePongKeepsPeerAlive
+{
+    XMPPStreamKeepAlive *keepAlive = [[XMPPStreamKeepAlive alloc] initWithOptions:@{XMPPStreamKeepAliveIntervalKey : @(20),
+                                                                                    XMPPStreamKeepAliveMaximumMissedPongsKey : @(2)}];
+    [keepAlive resetAtTime:0];
+
+    NSData *payload = [keepAlive pingPayloadAtTime:20];
+    [keepAlive pingPayloadAtTime:20 + keepAlive.pongTimeout];
+    assertThatUnsignedInteger(keepAlive.numberOfMissedPongs, equalToUnsignedInteger(1));
+
+    assertThatBool([keepAlive handlePongWithPayload:payload atTime:31], isTrue());
+    assertThatUnsignedInteger(keepAlive.numberOfMissedPongs, equalToUnsignedInteger(0));
+}
+
+- (void)testAdaptInterval
+{
+    XMPPStreamKeepAlive *keepAlive = [[XMPPStreamKeepAlive alloc] initWithOptions:@{XMPPStreamKeepAliveIntervalKey : @(20),
+                                                                                    XMPPStreamKeepAliveMinimumIntervalKey : @(10),
+                                                                                    XMPPStreamKeepAliveMaximumIntervalKey : @(60),
+                                                                                    XMPPStreamKeepAliveMaximumMissedPongsKey : @(3)}];
+    [keepAlive resetAtTime:0];
+
+    // Widen the interval after three pongs.
+
+    NSTimeInterval now = 0;
+    for (NSUInteger i = 0; i < 3; i++) {
+        now += keepAlive.interval;
+        NSData *payload = [keepAlive pingPayloadAtTime:now];
+        [keepAlive handlePongWithPayload:payload atTime:now];
+    }
+    assertThatDouble(keepAlive.interval, closeTo(30, 0.001));
+
+    // A missed pong narrows the interval again.
+
+    now += keepAlive.interval;
+    [keepAlive pingPayloadAtTime:now];
+    now += keepAlive.pongTimeout;
+    NSData *payload = [keepAlive pingPayloadAtTime:now];
+    [keepAlive handlePongWithPayload:payload atTime:now];
+    assertThatDouble(keepAlive.interval, closeTo(20, 0.001));
+
+    // ... and the interval is not widened beyond that anymore.
+
+    for (NSUInteger i = 0; i < 6; i++) {
+        now += keepAlive.interval;
+        payload = [keepAlive pingPayloadAtTime:now];
+        [keepAlive handlePongWithPayload:payload atTime:now];
+    }
+    assertThatDouble(keepAlive.interval, closeTo(20, 0.001));
+}
+
+@end
@@ -0,0 +1,113 @@
+//
+//  XMPPStreamOutboundQueueTests.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPStreamOutboundQueue.h"
+#import "XMPPTestCase.h"
+
+@interface XMPPStreamOutboundQueueTests : XMPPTestCase
+
+@end
+
+@implementation XMPPStreamOutboundQueueTests
+
+#pragma mark Tests
+
+- (void)testByteWaterMarks
+{
+    NSDictionary *options = @{XMPPStreamOutboundHighWaterMarkBytesKey : @(100),
+                              XMPPStreamOutboundLowWaterMarkBytesKey : @(50)};
+    XMPPStreamOutboundQueue *queue = [[XMPPStreamOutboundQueue alloc] initWithOptions:options];
+
+    NSMutableArray *changes = [[NSMutableArray alloc] init];
+    queue.writabilityHandler = ^(BOOL writable) {
+        [changes addObject:@(writable)];
+    };
+
+    [queue enqueueStanzaWithLength:60];
+    [queue enqueueStanzaWithLength:60];
+    assertThatBool(queue.writable, isFalse());
+    assertThatInteger(queue.numberOfPendingBytes, equalToInteger(120));
+    assertThatInteger(queue.numberOfPendingStanzas, equalToInteger(2));
+
+    // Below the high-water mark, but above the low-water mark.
+    [queue dequeueBytesWithLength:30];
+    assertThatBool(queue.writable, isFalse());
+    assertThatInteger(queue.numberOfPendingStanzas, equalToInteger(2));
+
+    [queue dequeueBytesWithLength:30];
+    assertThatBool(queue.writable, isFalse());
+    assertThatInteger(queue.numberOfPendingStanzas, equalToInteger(1));
+
+    [queue dequeueBytesWithLength:10];
+    assertThatBool(queue.writable, isTrue());
+
+    assertThat(changes, equalTo(@[ @NO, @YES ]));
+}
+
+- (void)testStanzaWaterMarks
+{
+    NSDictionary *options = @{XMPPStreamOutboundHighWaterMarkStanzasKey : @(2),
+                              XMPPStreamOutboundLowWaterMarkStanzasKey : @(0)};
+    XMPPStreamOutboundQueue *queue = [[XMPPStreamOutboundQueue alloc] initWithOptions:options];
+
+    [queue enqueueStanzaWithLength:10];
+    [queue enqueueStanzaWithLength:10];
+    assertThatBool(queue.writable, isTrue());
+
+    [queue enqueueStanzaWithLength:10];
+    assertThatBool(queue.writable, isFalse());
+
+    [queue dequeueBytesUpToPosition:20];
+    assertThatBool(queue.writable, isFalse());
+
+    [queue dequeueBytesUpToPosition:queue.position];
+    assertThatBool(queue.writable, isTrue());
+}
+
+- (void)testReset
+{
+    NSDictionary *options = @{XMPPStreamOutboundHighWaterMarkBytesKey : @(10),
+                              XMPPStreamOutboundLowWaterMarkBytesKey : @(0)};
+    XMPPStreamOutboundQueue *queue = [[XMPPStreamOutboundQueue alloc] initWithOptions:options];
+
+    [queue enqueueBytesWithLength:20];
+    assertThatBool(queue.writable, isFalse());
+
+    [queue reset];
+    assertThatBool(queue.writable, isTrue());
+    assertThatInteger(queue.numberOfPendingBytes, equalToInteger(0));
+}
+
+@end
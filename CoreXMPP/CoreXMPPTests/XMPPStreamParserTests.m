@@ -0,0 +1,225 @@
+//
+//  XMPPStreamParserTests.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPStreamParser.h"
+#import "XMPPTestCase.h"
+
+@interface XMPPStreamParserTests : XMPPTestCase
+
+@end
+
+@implementation XMPPStreamParserTests
+
+#pragma mark Tests
+
+- (void)testParseStream
+{
+    XMPPStreamParser *parser = [[XMPPStreamParser alloc] init];
+
+    id<XMPPStreamParserDelegate> delegate = mockProtocol(@protocol(XMPPStreamParserDelegate));
+    parser.delegate = delegate;
+
+    NSMutableArray *documents = [[NSMutableArray alloc] init];
+    [givenVoid([delegate parser:parser didParseDocument:anything()]) willDo:^id(NSInvocation *invocation) {
+        [documents addObject:[[invocation mkt_arguments] lastObject]];
+        return nil;
+    }];
+
+    NSString *stream = @"<?xml version='1.0'?>"
+                       @"<stream:stream from='localhost' id='123' version='1.0' xmlns='jabber:client' xmlns:stream='http://etherx.jabber.org/streams'>"
+                       @"<stream:features><bind xmlns='urn:ietf:params:xml:ns:xmpp-bind'/></stream:features>"
+                       @"<message from='romeo@localhost' to='juliet@localhost'><body>Hello &amp; good bye!</body></message>"
+                       @"</stream:stream>";
+
+    // Feed the stream byte by byte to ensure that elements
+    // spanning multiple chunks are handled correctly.
+
+    NSData *data = [stream dataUsingEncoding:NSUTF8StringEncoding];
+    const uint8_t *bytes = [data bytes];
+    for (NSUInteger i = 0; i < [data length]; i++) {
+        [parser parseBytes:&bytes[i] length:1];
+    }
+
+    [verifyCount(delegate, times(1)) parser:parser didOpenStreamWithAttributes:allOf(hasEntry(@"from", @"localhost"), hasEntry(@"id", @"123"), nil)];
+    [verifyCount(delegate, times(1)) parserDidCloseStream:parser];
+    [verifyCount(delegate, never()) parser:parser didFailWithError:anything()];
+
+    assertThat(documents, hasCountOf(2));
+
+    PXElement *features = [[documents firstObject] root];
+    assertThat(features.name, equalTo(@"features"));
+    assertThat(features.namespace, equalTo(@"http://etherx.jabber.org/streams"));
+    assertThatInteger(features.numberOfElements, equalToInteger(1));
+
+    PXElement *message = [[documents lastObject] root];
+    assertThat(message.name, equalTo(@"message"));
+    assertThat(message.namespace, equalTo(@"jabber:client"));
+    assertThat([message valueForAttribute:@"from"], equalTo(@"romeo@localhost"));
+    assertThat([[message elementAtIndex:0] stringValue], equalTo(@"Hello & good bye!"));
+}
+
+- (void)testParseMixedContent
+{
+    XMPPStreamParser *parser = [[XMPPStreamParser alloc] init];
+
+    id<XMPPStreamParserDelegate> delegate = mockProtocol(@protocol(XMPPStreamParserDelegate));
+    parser.delegate = delegate;
+
+    NSMutableArray *documents = [[NSMutableArray alloc] init];
+    [givenVoid([delegate parser:parser didParseDocument:anything()]) willDo:^id(NSInvocation *invocation) {
+        [documents addObject:[[invocation mkt_arguments] lastObject]];
+        return nil;
+    }];
+
+    NSString *stream = @"<stream:stream version='1.0' xmlns='jabber:client' xmlns:stream='http://etherx.jabber.org/streams'>"
+                       @"<message from='romeo@localhost' to='juliet@localhost' xml:lang='en'>"
+                       @"<body>Hello world!</body>"
+                       @"<html xmlns='http://jabber.org/protocol/xhtml-im'><body xmlns='http://www.w3.org/1999/xhtml'>"
+                       @"<p>Hello <strong>world</strong> &amp; <em>good</em> bye!</p>"
+                       @"</body></html>"
+                       @"</message>";
+
+    NSData *data = [stream dataUsingEncoding:NSUTF8StringEncoding];
+    const uint8_t *bytes = [data bytes];
+    for (NSUInteger i = 0; i < [data length]; i++) {
+        [parser parseBytes:&bytes[i] length:1];
+    }
+
+    [verifyCount(delegate, never()) parser:parser didFailWithError:anything()];
+    assertThat(documents, hasCountOf(1));
+
+    PXElement *message = [[documents firstObject] root];
+    assertThat(message, equalTo(PXQN(@"jabber:client", @"message")));
+    assertThat([message valueForAttribute:@"from"], equalTo(@"romeo@localhost"));
+    assertThat([[message elementAtIndex:0] stringValue], equalTo(@"Hello world!"));
+
+    PXElement *html = [message elementAtIndex:1];
+    assertThat(html, equalTo(PXQN(@"http://jabber.org/protocol/xhtml-im", @"html")));
+
+    PXElement *paragraph = [[html elementAtIndex:0] elementAtIndex:0];
+    assertThat(paragraph, equalTo(PXQN(@"http://www.w3.org/1999/xhtml", @"p")));
+    assertThat([paragraph stringValue], equalTo(@"Hello world & good bye!"));
+    assertThatInteger(paragraph.numberOfElements, equalToInteger(2));
+}
+
+- (void)testParseAttributeReferences
+{
+    XMPPStreamParser *parser = [[XMPPStreamParser alloc] init];
+
+    id<XMPPStreamParserDelegate> delegate = mockProtocol(@protocol(XMPPStreamParserDelegate));
+    parser.delegate = delegate;
+
+    NSMutableArray *documents = [[NSMutableArray alloc] init];
+    [givenVoid([delegate parser:parser didParseDocument:anything()]) willDo:^id(NSInvocation *invocation) {
+        [documents addObject:[[invocation mkt_arguments] lastObject]];
+        return nil;
+    }];
+
+    NSString *stream = @"<stream:stream version='1.0' xmlns='jabber:client' xmlns:stream='http://etherx.jabber.org/streams'>"
+                       @"<message from='romeo@localhost' to='juliet@localhost'>"
+                       @"<x xmlns='jabber:x:oob' url='http://example.com/?a=1&amp;b=2'/>"
+                       @"</message>"
+                       @"<message from='romeo@localhost' to='juliet@localhost'>"
+                       @"<html xmlns='http://jabber.org/protocol/xhtml-im'><body xmlns='http://www.w3.org/1999/xhtml'>"
+                       @"<p>See <a href='http://example.com/?a=1&amp;b=2' title='&lt;&quot;&#x41;&quot;&gt;'>this</a>!</p>"
+                       @"</body></html>"
+                       @"</message>";
+
+    NSData *data = [stream dataUsingEncoding:NSUTF8StringEncoding];
+    const uint8_t *bytes = [data bytes];
+    for (NSUInteger i = 0; i < [data length]; i++) {
+        [parser parseBytes:&bytes[i] length:1];
+    }
+
+    [verifyCount(delegate, never()) parser:parser didFailWithError:anything()];
+    assertThat(documents, hasCountOf(2));
+
+    PXElement *oob = [[[documents firstObject] root] elementAtIndex:0];
+    assertThat([oob valueForAttribute:@"url"], equalTo(@"http://example.com/?a=1&b=2"));
+
+    PXElement *paragraph = [[[[[documents lastObject] root] elementAtIndex:0] elementAtIndex:0] elementAtIndex:0];
+    assertThat([paragraph stringValue], equalTo(@"See this!"));
+
+    PXElement *link = [paragraph elementAtIndex:0];
+    assertThat([link valueForAttribute:@"href"], equalTo(@"http://example.com/?a=1&b=2"));
+    assertThat([link valueForAttribute:@"title"], equalTo(@"<\"A\">"));
+}
+
+- (void)testResetStream
+{
+    XMPPStreamParser *parser = [[XMPPStreamParser alloc] init];
+
+    id<XMPPStreamParserDelegate> delegate = mockProtocol(@protocol(XMPPStreamParserDelegate));
+    parser.delegate = delegate;
+
+    NSString *header = @"<stream:stream version='1.0' xmlns='jabber:client' xmlns:stream='http://etherx.jabber.org/streams'>";
+
+    [parser parseData:[header dataUsingEncoding:NSUTF8StringEncoding]];
+    [parser reset];
+    [parser parseData:[header dataUsingEncoding:NSUTF8StringEncoding]];
+
+    [verifyCount(delegate, times(2)) parser:parser didOpenStreamWithAttributes:anything()];
+    [verifyCount(delegate, never()) parser:parser didFailWithError:anything()];
+}
+
+- (void)testRejectInvalidStreamHeader
+{
+    XMPPStreamParser *parser = [[XMPPStreamParser alloc] init];
+
+    id<XMPPStreamParserDelegate> delegate = mockProtocol(@protocol(XMPPStreamParserDelegate));
+    parser.delegate = delegate;
+
+    [parser parseData:[@"<foo xmlns='bar'>" dataUsingEncoding:NSUTF8StringEncoding]];
+
+    [verifyCount(delegate, never()) parser:parser didOpenStreamWithAttributes:anything()];
+    [verifyCount(delegate, times(1)) parser:parser didFailWithError:anything()];
+}
+
+- (void)testRejectDocumentTypeDeclaration
+{
+    XMPPStreamParser *parser = [[XMPPStreamParser alloc] init];
+
+    id<XMPPStreamParserDelegate> delegate = mockProtocol(@protocol(XMPPStreamParserDelegate));
+    parser.delegate = delegate;
+
+    NSString *stream = @"<?xml version='1.0'?><!DOCTYPE foo [<!ENTITY bar 'baz'>]>"
+                       @"<stream:stream version='1.0' xmlns='jabber:client' xmlns:stream='http://etherx.jabber.org/streams'>";
+    [parser parseData:[stream dataUsingEncoding:NSUTF8StringEncoding]];
+
+    [verifyCount(delegate, never()) parser:parser didOpenStreamWithAttributes:anything()];
+    [verifyCount(delegate, times(1)) parser:parser didFailWithError:anything()];
+}
+
+@end
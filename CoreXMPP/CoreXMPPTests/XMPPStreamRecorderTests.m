@@ -0,0 +1,302 @@
+//
+//  XMPPStreamRecorderTests.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPStreamReplay.h"
+#import "XMPPTestCase.h"
+
+@interface XMPPStreamRecorderTests : XMPPTestCase
+
+@end
+
+@implementation XMPPStreamRecorderTests
+
+#pragma mark Tests
+
+- (void)testRecordAndEnumerate
+{
+    XMPPStreamRecorder *recorder = [[XMPPStreamRecorder alloc] init];
+    assertThatUnsignedInteger(recorder.capacity, equalToUnsignedInteger(4 * 1024 * 1024));
+
+    [recorder recordData:[@"<open/>" dataUsingEncoding:NSUTF8StringEncoding] direction:XMPPStreamRecordDirectionOutbound];
+    [recorder recordData:[@"<open/>" dataUsingEncoding:NSUTF8StringEncoding] direction:XMPPStreamRecordDirectionInbound];
+    [recorder recordData:[@"<message/>" dataUsingEncoding:NSUTF8StringEncoding] direction:XMPPStreamRecordDirectionInbound];
+
+    assertThatUnsignedInteger(recorder.numberOfRecords, equalToUnsignedInteger(3));
+
+    NSMutableArray *directions = [[NSMutableArray alloc] init];
+    NSMutableArray *payloads = [[NSMutableArray alloc] init];
+    __block uint64_t lastTimestamp = 0;
+
+    BOOL valid = [XMPPStreamRecorder enumerateRecordsInCapture:[recorder capture]
+                                                    usingBlock:^(XMPPStreamRecordDirection direction, uint64_t timestamp, NSData *payload, BOOL *stop) {
+                                                        XCTAssertGreaterThanOrEqual(timestamp, lastTimestamp);
+                                                        lastTimestamp = timestamp;
+                                                        [directions addObject:@(direction)];
+                                                        [payloads addObject:[[NSString alloc] initWithData:payload encoding:NSUTF8StringEncoding]];
+                                                    }];
+
+    assertThatBool(valid, isTrue());
+    assertThat(directions, contains(@(XMPPStreamRecordDirectionOutbound), @(XMPPStreamRecordDirectionInbound), @(XMPPStreamRecordDirectionInbound), nil));
+    assertThat(payloads, contains(@"<open/>", @"<open/>", @"<message/>", nil));
+}
+
+- (void)testOverwriteOldestRecords
+{
+    XMPPStreamRecorder *recorder = [[XMPPStreamRecorder alloc] initWithCapacity:200];
+    assertThatUnsignedInteger(recorder.capacity, equalToUnsignedInteger(256));
+
+    // Each record needs 48 bytes (16 bytes header and 32 bytes payload).
+    for (NSUInteger i = 0; i < 20; i++) {
+        NSString *payload = [NSString stringWithFormat:@"%032lu", (unsigned long)i];
+        [recorder recordData:[payload dataUsingEncoding:NSUTF8StringEncoding] direction:XMPPStreamRecordDirectionInbound];
+    }
+
+    assertThatUnsignedInteger(recorder.numberOfRecords, equalToUnsignedInteger(5));
+    assertThatUnsignedInteger(recorder.numberOfOverwrittenRecords, equalToUnsignedInteger(15));
+
+    NSMutableArray *payloads = [[NSMutableArray alloc] init];
+    BOOL valid = [XMPPStreamRecorder enumerateRecordsInCapture:[recorder capture]
+                                                    usingBlock:^(XMPPStreamRecordDirection direction, uint64_t timestamp, NSData *payload, BOOL *stop) {
+                                                        [payloads addObject:@([[[NSString alloc] initWithData:payload encoding:NSUTF8StringEncoding] integerValue])];
+                                                    }];
+
+    assertThatBool(valid, isTrue());
+    assertThat(payloads, contains(@15, @16, @17, @18, @19, nil));
+}
+
+- (void)testDropOversizedRecords
+{
+    XMPPStreamRecorder *recorder = [[XMPPStreamRecorder alloc] initWithCapacity:256];
+
+    NSMutableData *payload = [[NSMutableData alloc] initWithLength:256];
+    [recorder recordData:payload direction:XMPPStreamRecordDirectionInbound];
+
+    assertThatUnsignedInteger(recorder.numberOfRecords, equalToUnsignedInteger(0));
+    assertThatUnsignedInteger(recorder.numberOfDroppedRecords, equalToUnsignedInteger(1));
+}
+
+- (void)testInvalidCapture
+{
+    NSData *capture = [@"<stream:stream>" dataUsingEncoding:NSUTF8StringEncoding];
+    BOOL valid = [XMPPStreamRecorder enumerateRecordsInCapture:capture
+                                                    usingBlock:^(XMPPStreamRecordDirection direction, uint64_t timestamp, NSData *payload, BOOL *stop){
+                                                    }];
+    assertThatBool(valid, isFalse());
+
+    XMPPStreamRecorder *recorder = [[XMPPStreamRecorder alloc] init];
+    [recorder recordData:[@"<message/>" dataUsingEncoding:NSUTF8StringEncoding] direction:XMPPStreamRecordDirectionInbound];
+    NSData *truncatedCapture = [[recorder capture] subdataWithRange:NSMakeRange(0, 36)];
+    valid = [XMPPStreamRecorder enumerateRecordsInCapture:truncatedCapture
+                                               usingBlock:^(XMPPStreamRecordDirection direction, uint64_t timestamp, NSData *payload, BOOL *stop){
+                                               }];
+    assertThatBool(valid, isFalse());
+}
+
+- (void)testCaptureWhileRecording
+{
+    XMPPStreamRecorder *recorder = [[XMPPStreamRecorder alloc] initWithCapacity:64 * 1024];
+    dispatch_queue_t queue = dispatch_queue_create("XMPPStreamRecorderTests", DISPATCH_QUEUE_SERIAL);
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Recorded"];
+    dispatch_async(queue, ^{
+        for (NSUInteger i = 0; i < 100000; i++) {
+            NSString *payload = [NSString stringWithFormat:@"<message id='%lu'/>", (unsigned long)i];
+            [recorder recordData:[payload dataUsingEncoding:NSUTF8StringEncoding] direction:XMPPStreamRecordDirectionInbound];
+        }
+        [expectation fulfill];
+    });
+
+    for (NSUInteger i = 0; i < 100; i++) {
+        __block NSInteger lastIdentifier = -1;
+        BOOL valid = [XMPPStreamRecorder enumerateRecordsInCapture:[recorder capture]
+                                                        usingBlock:^(XMPPStreamRecordDirection direction, uint64_t timestamp, NSData *payload, BOOL *stop) {
+                                                            NSString *message = [[NSString alloc] initWithData:payload encoding:NSUTF8StringEncoding];
+                                                            NSScanner *scanner = [NSScanner scannerWithString:message];
+                                                            NSInteger identifier = 0;
+                                                            [scanner scanString:@"<message id='" intoString:nil];
+                                                            XCTAssertTrue([scanner scanInteger:&identifier]);
+                                                            XCTAssertTrue(lastIdentifier == -1 || identifier == lastIdentifier + 1);
+                                                            lastIdentifier = identifier;
+                                                        }];
+        assertThatBool(valid, isTrue());
+    }
+
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+    assertThatUnsignedInteger(recorder.numberOfRecords + recorder.numberOfOverwrittenRecords, equalToUnsignedInteger(100000));
+}
+
+- (void)testWriteCaptureToURL
+{
+    XMPPStreamRecorder *recorder = [[XMPPStreamRecorder alloc] init];
+    [recorder recordData:[@"<message/>" dataUsingEncoding:NSUTF8StringEncoding] direction:XMPPStreamRecordDirectionInbound];
+
+    NSURL *URL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]]];
+
+    NSError *error = nil;
+    BOOL success = [recorder writeCaptureToURL:URL error:&error];
+    assertThatBool(success, isTrue());
+    assertThat(error, nilValue());
+
+    NSData *capture = [NSData dataWithContentsOfURL:URL];
+    assertThat(capture, equalTo([recorder capture]));
+    assertThat([[NSString alloc] initWithData:[capture subdataWithRange:NSMakeRange(0, 8)] encoding:NSUTF8StringEncoding], equalTo(@"XMPPREC1"));
+
+    [[NSFileManager defaultManager] removeItemAtURL:URL error:nil];
+}
+
+#pragma mark Replay
+
+- (void)testDecodeWebsocketCapture
+{
+    XMPPStreamRecorder *recorder = [[XMPPStreamRecorder alloc] init];
+    [self recordFrames:@[ @"<open xmlns='urn:ietf:params:xml:ns:xmpp-framing' version='1.0' id='1' from='localhost'/>",
+                          @"<stream:features xmlns:stream='http://etherx.jabber.org/streams'/>",
+                          @"<message xmlns='jabber:client' id='1'><body>Hello</body></message>",
+                          @"<r xmlns='urn:xmpp:sm:3'/>",
+                          @"<presence xmlns='jabber:client'/>" ]
+            direction:XMPPStreamRecordDirectionInbound
+           toRecorder:recorder];
+    [self recordFrames:@[ @"<message xmlns='jabber:client' id='2'/>" ]
+            direction:XMPPStreamRecordDirectionOutbound
+           toRecorder:recorder];
+
+    XMPPStreamReplay *replay = [[XMPPStreamReplay alloc] initWithCapture:[recorder capture]];
+    assertThat(replay.documents, hasCountOf(2));
+    assertThat([replay.documents valueForKeyPath:@"root.name"], contains(@"message", @"presence", nil));
+}
+
+- (void)testDecodeTCPCapture
+{
+    XMPPStreamRecorder *recorder = [[XMPPStreamRecorder alloc] init];
+    [self recordFrames:@[ @"<?xml version='1.0'?><stream:stream xmlns='jabber:client' xmlns:stream='http://etherx.jabber.org/streams' id='1' from='localhost' version='1.0'>",
+                          @"<stream:features/>",
+                          @"<?xml version='1.0'?><stream:stream xmlns='jabber:client' xmlns:stream='http://etherx.jabber.org/streams' id='2' from='localhost' version='1.0'><stream:features/>",
+                          @"<message id='1'><body>Hel",
+                          @"lo</body></message><presence/><iq type='get' id='2'><ping xmlns='urn:xmpp:ping'/></iq>" ]
+            direction:XMPPStreamRecordDirectionInbound
+           toRecorder:recorder];
+
+    XMPPStreamReplay *replay = [[XMPPStreamReplay alloc] initWithCapture:[recorder capture]];
+    assertThat(replay.documents, hasCountOf(3));
+    assertThat([replay.documents valueForKeyPath:@"root.name"], contains(@"message", @"presence", @"iq", nil));
+}
+
+- (void)testDecodeBOSHCapture
+{
+    XMPPStreamRecorder *recorder = [[XMPPStreamRecorder alloc] init];
+    [self recordFrames:@[ @"<body xmlns='http://jabber.org/protocol/httpbind' sid='1'><stream:features xmlns:stream='http://etherx.jabber.org/streams'/></body>",
+                          @"<body xmlns='http://jabber.org/protocol/httpbind'/>",
+                          @"<body xmlns='http://jabber.org/protocol/httpbind'><message xmlns='jabber:client' id='1'/><presence xmlns='jabber:client'/></body>" ]
+            direction:XMPPStreamRecordDirectionInbound
+           toRecorder:recorder];
+
+    XMPPStreamReplay *replay = [[XMPPStreamReplay alloc] initWithCapture:[recorder capture]];
+    assertThat(replay.documents, hasCountOf(2));
+    assertThat([replay.documents valueForKeyPath:@"root.name"], contains(@"message", @"presence", nil));
+}
+
+- (void)testReplay
+{
+    NSData *capture = [self captureWithNumberOfStanzas:100];
+    XMPPStreamReplay *replay = [[XMPPStreamReplay alloc] initWithCapture:capture];
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Replay"];
+    [replay replayWithCompletion:^(XMPPStreamReplayResult *result) {
+        assertThatUnsignedInteger(result.numberOfStanzas, equalToUnsignedInteger(100));
+        assertThatUnsignedInteger(result.numberOfHandledStanzas, equalToUnsignedInteger(100));
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+}
+
+- (void)testReplayPerformance
+{
+    // A capture recorded in production can be replayed by setting the
+    // environment variable XMPP_REPLAY_CAPTURE to the path of the capture.
+
+    NSString *path = [[[NSProcessInfo processInfo] environment] objectForKey:@"XMPP_REPLAY_CAPTURE"];
+    NSData *capture = path ? [NSData dataWithContentsOfFile:path] : [self captureWithNumberOfStanzas:10000];
+
+    [self measureBlock:^{
+        XMPPStreamReplay *replay = [[XMPPStreamReplay alloc] initWithCapture:capture];
+
+        XCTestExpectation *expectation = [self expectationWithDescription:@"Replay"];
+        [replay replayWithCompletion:^(XMPPStreamReplayResult *result) {
+            NSLog(@"Replay: %@", result);
+            [expectation fulfill];
+        }];
+        [self waitForExpectationsWithTimeout:60.0 handler:nil];
+    }];
+}
+
+#pragma mark Helper
+
+- (void)recordFrames:(NSArray<NSString *> *)frames direction:(XMPPStreamRecordDirection)direction toRecorder:(XMPPStreamRecorder *)recorder
+{
+    for (NSString *frame in frames) {
+        [recorder recordData:[frame dataUsingEncoding:NSUTF8StringEncoding] direction:direction];
+    }
+}
+
+- (NSData *)captureWithNumberOfStanzas:(NSUInteger)numberOfStanzas
+{
+    XMPPStreamRecorder *recorder = [[XMPPStreamRecorder alloc] initWithCapacity:16 * 1024 * 1024];
+
+    [self recordFrames:@[ @"<open xmlns='urn:ietf:params:xml:ns:xmpp-framing' version='1.0' id='1' from='localhost'/>",
+                          @"<stream:features xmlns:stream='http://etherx.jabber.org/streams'/>" ]
+            direction:XMPPStreamRecordDirectionInbound
+           toRecorder:recorder];
+
+    for (NSUInteger i = 0; i < numberOfStanzas; i++) {
+        NSString *frame = nil;
+        switch (i % 10) {
+        case 0:
+        case 1:
+            frame = [NSString stringWithFormat:@"<presence xmlns='jabber:client' from='juliet%lu@example.com/balcony' to='romeo@localhost'><show>away</show></presence>", (unsigned long)i];
+            break;
+        case 2:
+            frame = [NSString stringWithFormat:@"<iq xmlns='jabber:client' type='get' id='%lu' from='localhost' to='romeo@localhost'><ping xmlns='urn:xmpp:ping'/></iq>", (unsigned long)i];
+            break;
+        default:
+            frame = [NSString stringWithFormat:@"<message xmlns='jabber:client' type='chat' id='%lu' from='juliet@example.com/balcony' to='romeo@localhost'><body>Message %lu</body></message>", (unsigned long)i, (unsigned long)i];
+            break;
+        }
+        [recorder recordData:[frame dataUsingEncoding:NSUTF8StringEncoding] direction:XMPPStreamRecordDirectionInbound];
+    }
+
+    return [recorder capture];
+}
+
+@end
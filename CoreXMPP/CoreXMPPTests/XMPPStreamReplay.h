@@ -0,0 +1,69 @@
+//
+//  XMPPStreamReplay.h
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import <CoreXMPP/CoreXMPP.h>
+
+@interface XMPPStreamReplayResult : NSObject
+@property (nonatomic, readonly) NSUInteger numberOfStanzas;
+@property (nonatomic, readonly) NSUInteger numberOfHandledStanzas;
+@property (nonatomic, readonly) NSTimeInterval parseDuration;
+@property (nonatomic, readonly) NSTimeInterval dispatchDuration;
+@property (nonatomic, readonly) double stanzasPerSecond;
+@property (nonatomic, readonly) NSTimeInterval averageLatency;
+@property (nonatomic, readonly) NSTimeInterval medianLatency;
+@property (nonatomic, readonly) NSTimeInterval latency99;
+@end
+
+// Feeds the inbound stanzas of a capture (see XMPPStreamRecorder) through a
+// client (with a stub stream) and a dispatcher as fast as possible.
+//
+// The capture is decoded depending on the transport it has been recorded
+// with (websocket frames, BOSH bodies or the bytes of a TCP stream). Stream
+// negotiation and control elements are skipped. The latency is measured from
+// passing a message or presence stanza to the stream until the handler of
+// the dispatcher has been called.
+
+@interface XMPPStreamReplay : NSObject
+
+- (instancetype)initWithCapture:(NSData *)capture;
+
+@property (nonatomic, readonly) NSData *capture;
+
+// Decoded inbound stanzas (nil, if the capture is not valid).
+@property (nonatomic, readonly) NSArray<PXDocument *> *documents;
+
+- (void)replayWithCompletion:(void (^)(XMPPStreamReplayResult *result))completion;
+
+@end
@@ -0,0 +1,370 @@
+//
+//  XMPPStreamReplay.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import <mach/mach_time.h>
+
+#import "XMPPStreamParser.h"
+#import "XMPPStreamReplay.h"
+#import "XMPPStreamStub.h"
+
+static NSTimeInterval XMPPStreamReplayTimeInterval(uint64_t start, uint64_t end)
+{
+    static mach_timebase_info_data_t timebase;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        mach_timebase_info(&timebase);
+    });
+    return (double)((end - start) * timebase.numer / timebase.denom) / NSEC_PER_SEC;
+}
+
+@interface XMPPStreamReplayResult ()
+@property (nonatomic, readwrite) NSUInteger numberOfStanzas;
+@property (nonatomic, readwrite) NSUInteger numberOfHandledStanzas;
+@property (nonatomic, readwrite) NSTimeInterval parseDuration;
+@property (nonatomic, readwrite) NSTimeInterval dispatchDuration;
+@property (nonatomic, readwrite) NSTimeInterval averageLatency;
+@property (nonatomic, readwrite) NSTimeInterval medianLatency;
+@property (nonatomic, readwrite) NSTimeInterval latency99;
+@end
+
+@interface XMPPStreamReplayHandler : NSObject <XMPPMessageHandler, XMPPPresenceHandler>
+@property (nonatomic, copy) void (^onStanza)(XMPPStanza *stanza);
+@end
+
+@interface XMPPStreamReplay () <XMPPStreamParserDelegate> {
+    NSMutableArray<PXDocument *> *_parsedDocuments;
+    NSTimeInterval _parseDuration;
+
+    XMPPStreamStub *_stream;
+    XMPPClient *_client;
+    XMPPDispatcherImpl *_dispatcher;
+    XMPPStreamReplayHandler *_handler;
+}
+
+@end
+
+@implementation XMPPStreamReplay
+
+#pragma mark Life-cycle
+
+- (instancetype)initWithCapture:(NSData *)capture
+{
+    self = [super init];
+    if (self) {
+        _capture = capture;
+
+        uint64_t start = mach_absolute_time();
+        _documents = [self xmpp_decodeCapture];
+        _parseDuration = XMPPStreamReplayTimeInterval(start, mach_absolute_time());
+    }
+    return self;
+}
+
+#pragma mark Replay
+
+- (void)replayWithCompletion:(void (^)(XMPPStreamReplayResult *))completion
+{
+    NSArray<PXDocument *> *documents = self.documents ?: @[];
+
+    NSMutableArray<PXDocument *> *measuredDocuments = [[NSMutableArray alloc] init];
+    for (PXDocument *document in documents) {
+        if ([document.root isKindOfClass:[XMPPMessageStanza class]] ||
+            [document.root isKindOfClass:[XMPPPresenceStanza class]]) {
+            [measuredDocuments addObject:document];
+        }
+    }
+
+    // The sentinel is fed after the documents of the capture. The
+    // dispatcher handles the stanzas in order. Therefore all stanzas have
+    // been handled, if the sentinel arrives at the handler.
+    PXDocument *sentinel = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+    [sentinel.root setValue:@"replay-sentinel" forAttribute:@"id"];
+
+    NSUInteger numberOfMeasuredDocuments = [measuredDocuments count];
+    uint64_t *fedTimes = calloc(numberOfMeasuredDocuments + 1, sizeof(uint64_t));
+    uint64_t *handledTimes = calloc(numberOfMeasuredDocuments + 1, sizeof(uint64_t));
+
+    _stream = [[XMPPStreamStub alloc] initWithHostname:@"localhost" options:nil];
+    _client = [[XMPPClient alloc] initWithHostname:@"localhost" options:@{} stream:_stream];
+    _dispatcher = [[XMPPDispatcherImpl alloc] init];
+    [_dispatcher setConnection:_client forJID:JID(@"romeo@localhost")];
+
+    _handler = [[XMPPStreamReplayHandler alloc] init];
+    [_dispatcher addHandler:_handler];
+
+    __block NSUInteger numberOfHandledStanzas = 0;
+    __block uint64_t start = 0;
+
+    _handler.onStanza = ^(XMPPStanza *stanza) {
+        uint64_t now = mach_absolute_time();
+        if (stanza != sentinel.root) {
+            if (numberOfHandledStanzas < numberOfMeasuredDocuments) {
+                handledTimes[numberOfHandledStanzas] = now;
+            }
+            numberOfHandledStanzas++;
+            return;
+        }
+
+        XMPPStreamReplayResult *result = [[XMPPStreamReplayResult alloc] init];
+        result.numberOfStanzas = [documents count];
+        result.numberOfHandledStanzas = numberOfHandledStanzas;
+        result.parseDuration = _parseDuration;
+        result.dispatchDuration = XMPPStreamReplayTimeInterval(start, now);
+
+        NSUInteger numberOfLatencies = MIN(numberOfHandledStanzas, numberOfMeasuredDocuments);
+        if (numberOfLatencies > 0) {
+            NSTimeInterval *latencies = calloc(numberOfLatencies, sizeof(NSTimeInterval));
+            NSTimeInterval sum = 0;
+            for (NSUInteger i = 0; i < numberOfLatencies; i++) {
+                latencies[i] = XMPPStreamReplayTimeInterval(fedTimes[i], handledTimes[i]);
+                sum += latencies[i];
+            }
+            qsort_b(latencies, numberOfLatencies, sizeof(NSTimeInterval), ^int(const void *a, const void *b) {
+                NSTimeInterval x = *(const NSTimeInterval *)a;
+                NSTimeInterval y = *(const NSTimeInterval *)b;
+                return x < y ? -1 : (x > y ? 1 : 0);
+            });
+            result.averageLatency = sum / numberOfLatencies;
+            result.medianLatency = latencies[numberOfLatencies / 2];
+            result.latency99 = latencies[MIN(numberOfLatencies - 1, (NSUInteger)(numberOfLatencies * 0.99))];
+            free(latencies);
+        }
+
+        free(fedTimes);
+        free(handledTimes);
+
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self xmpp_tearDown];
+            completion(result);
+        });
+    };
+
+    [_stream onDidOpen:^(XMPPStreamStub *stream) {
+        PXDocument *features = [[PXDocument alloc] initWithElementName:@"features"
+                                                             namespace:@"http://etherx.jabber.org/streams"
+                                                                prefix:@"stream"];
+        [stream receiveDocument:features];
+
+        // The stub stream passes the documents asynchronously on the queue
+        // of the client. Feeding the stanzas in this block (on that queue)
+        // ensures that they are received after the stream features.
+
+        start = mach_absolute_time();
+
+        NSUInteger index = 0;
+        for (PXDocument *document in documents) {
+            if (index < numberOfMeasuredDocuments && document == measuredDocuments[index]) {
+                fedTimes[index] = mach_absolute_time();
+                index++;
+            }
+            [stream receiveDocument:document];
+        }
+        [stream receiveDocument:sentinel];
+    }];
+
+    [_client connect];
+}
+
+- (void)xmpp_tearDown
+{
+    [_dispatcher removeHandler:_handler];
+    [_dispatcher removeConnection:_client];
+    [_client disconnect];
+
+    _handler.onStanza = nil;
+    _handler = nil;
+    _dispatcher = nil;
+    _client = nil;
+    _stream = nil;
+}
+
+#pragma mark Decoding
+
+- (NSArray<PXDocument *> *)xmpp_decodeCapture
+{
+    NSMutableArray<NSData *> *payloads = [[NSMutableArray alloc] init];
+    BOOL valid = [XMPPStreamRecorder enumerateRecordsInCapture:self.capture
+                                                    usingBlock:^(XMPPStreamRecordDirection direction, uint64_t timestamp, NSData *payload, BOOL *stop) {
+                                                        if (direction == XMPPStreamRecordDirectionInbound) {
+                                                            [payloads addObject:payload];
+                                                        }
+                                                    }];
+    if (!valid) {
+        return nil;
+    }
+
+    NSMutableArray<PXDocument *> *documents = [[NSMutableArray alloc] init];
+
+    if ([payloads count] > 0 && [self xmpp_payload:[payloads firstObject] hasPrefix:@"<body"]) {
+
+        // BOSH: The stanzas are the children of each body.
+
+        for (NSData *payload in payloads) {
+            PXDocument *body = [PXDocument documentWithData:payload];
+            [body.root enumerateElementsUsingBlock:^(PXElement *element, BOOL *stop) {
+                [documents addObject:[[PXDocument alloc] initWithElement:element]];
+            }];
+        }
+
+    } else if ([self xmpp_payloadsContainStreamHeader:payloads]) {
+
+        // TCP: The bytes are parsed as a stream, which is restarted after
+        // each stream header (the server responds to a restart with a new
+        // header at the beginning of a read).
+
+        _parsedDocuments = documents;
+        XMPPStreamParser *parser = [[XMPPStreamParser alloc] init];
+        parser.delegate = self;
+        for (NSData *payload in payloads) {
+            if ([self xmpp_payload:payload hasPrefix:@"<?xml"] ||
+                [self xmpp_payload:payload hasPrefix:@"<stream:stream"]) {
+                [parser reset];
+            }
+            [parser parseData:payload];
+        }
+        _parsedDocuments = nil;
+
+    } else {
+
+        // Websocket: One document per frame.
+
+        for (NSData *payload in payloads) {
+            PXDocument *document = [PXDocument documentWithData:payload];
+            if (document) {
+                [documents addObject:document];
+            }
+        }
+    }
+
+    NSMutableArray<PXDocument *> *stanzas = [[NSMutableArray alloc] init];
+    for (PXDocument *document in documents) {
+        if ([document.root.namespace isEqualToString:@"jabber:client"]) {
+            [stanzas addObject:document];
+        }
+    }
+    return stanzas;
+}
+
+- (BOOL)xmpp_payload:(NSData *)payload hasPrefix:(NSString *)prefix
+{
+    const char *bytes = [payload bytes];
+    NSUInteger length = [payload length];
+    NSUInteger offset = 0;
+    while (offset < length && isspace(bytes[offset])) {
+        offset++;
+    }
+    const char *prefixBytes = [prefix UTF8String];
+    size_t prefixLength = strlen(prefixBytes);
+    return length - offset >= prefixLength && strncmp(bytes + offset, prefixBytes, prefixLength) == 0;
+}
+
+- (BOOL)xmpp_payloadsContainStreamHeader:(NSArray<NSData *> *)payloads
+{
+    NSData *header = [@"<stream:stream" dataUsingEncoding:NSUTF8StringEncoding];
+    for (NSData *payload in payloads) {
+        if ([payload rangeOfData:header options:0 range:NSMakeRange(0, [payload length])].location != NSNotFound) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+#pragma mark XMPPStreamParserDelegate
+
+- (void)parser:(XMPPStreamParser *)parser didOpenStreamWithAttributes:(NSDictionary<NSString *, NSString *> *)attributes
+{
+}
+
+- (void)parser:(XMPPStreamParser *)parser didParseDocument:(PXDocument *)document
+{
+    [_parsedDocuments addObject:document];
+}
+
+- (void)parserDidCloseStream:(XMPPStreamParser *)parser
+{
+}
+
+- (void)parser:(XMPPStreamParser *)parser didFailWithError:(NSError *)error
+{
+}
+
+@end
+
+@implementation XMPPStreamReplayResult
+
+- (double)stanzasPerSecond
+{
+    return self.dispatchDuration > 0 ? self.numberOfStanzas / self.dispatchDuration : 0;
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<XMPPStreamReplayResult %p stanzas: %lu (handled: %lu), parse: %.3fs, dispatch: %.3fs (%.0f stanzas/s), latency: avg %.3fms, p50 %.3fms, p99 %.3fms>",
+                                      self,
+                                      (unsigned long)self.numberOfStanzas,
+                                      (unsigned long)self.numberOfHandledStanzas,
+                                      self.parseDuration,
+                                      self.dispatchDuration,
+                                      self.stanzasPerSecond,
+                                      self.averageLatency * 1000.0,
+                                      self.medianLatency * 1000.0,
+                                      self.latency99 * 1000.0];
+}
+
+@end
+
+@implementation XMPPStreamReplayHandler
+
+- (void)handleMessage:(XMPPMessageStanza *)stanza completion:(void (^)(NSError *))completion
+{
+    if (self.onStanza) {
+        self.onStanza(stanza);
+    }
+    if (completion) {
+        completion(nil);
+    }
+}
+
+- (void)handlePresence:(XMPPPresenceStanza *)stanza completion:(void (^)(NSError *))completion
+{
+    if (self.onStanza) {
+        self.onStanza(stanza);
+    }
+    if (completion) {
+        completion(nil);
+    }
+}
+
+@end
@@ -0,0 +1,125 @@
+//
+//  XMPPTCPStreamTests.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPTestCase.h"
+
+@interface XMPPTCPStreamTests : XMPPTestCase
+
+@end
+
+@implementation XMPPTCPStreamTests
+
+#pragma mark Tests
+
+- (void)testOpenAndCloseStream
+{
+    //
+    // Create stream
+    //
+
+    // The test server does not offer STARTTLS (see server/config/ejabberd.yml).
+    NSDictionary *options = @{ XMPPTCPStreamAllowsPlaintextKey : @YES };
+    XMPPTCPStream *stream = [[XMPPTCPStream alloc] initWithHostname:@"localhost"
+                                                            options:options];
+    XCTAssertNotNil(stream);
+
+    //
+    // Set delegate
+    //
+
+    id<XMPPStreamDelegate> delegate = mockProtocol(@protocol(XMPPStreamDelegate));
+    stream.delegate = delegate;
+
+    //
+    // Open stream and wait until the stream has opened and the features are received
+    //
+
+    XCTestExpectation *waitForOpen = [self expectationWithDescription:@"Open"];
+    [givenVoid([delegate stream:stream didReceiveDocument:anything()]) willDo:^id(NSInvocation *invocation) {
+        PXDocument *document = [[invocation mkt_arguments] lastObject];
+        assertThat(document.root.name, equalTo(@"features"));
+        [waitForOpen fulfill];
+        return nil;
+    }];
+    [stream open];
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+
+    //
+    // Close stream and wait until the stream has closed
+    //
+
+    XCTestExpectation *waitForClose = [self expectationWithDescription:@"Close"];
+    [givenVoid([delegate streamDidClose:stream]) willDo:^id(NSInvocation *invocation) {
+        [waitForClose fulfill];
+        return nil;
+    }];
+    [stream close];
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+
+    //
+    // Verify delegate calles
+    //
+
+    [verifyCount(delegate, times(1)) stream:stream
+                              didOpenToHost:equalTo(@"localhost")
+                               withStreamId:notNilValue()];
+
+    [verifyCount(delegate, times(1)) streamDidClose:stream];
+}
+
+- (void)testRequireTLS
+{
+    // Without allowing plaintext, the stream must fail, if the
+    // host does not offer STARTTLS.
+
+    XMPPTCPStream *stream = [[XMPPTCPStream alloc] initWithHostname:@"localhost"
+                                                            options:@{}];
+
+    id<XMPPStreamDelegate> delegate = mockProtocol(@protocol(XMPPStreamDelegate));
+    stream.delegate = delegate;
+
+    XCTestExpectation *waitForFailure = [self expectationWithDescription:@"Failure"];
+    [givenVoid([delegate stream:stream didFailWithError:anything()]) willDo:^id(NSInvocation *invocation) {
+        [waitForFailure fulfill];
+        return nil;
+    }];
+    [stream open];
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+
+    [verifyCount(delegate, never()) stream:stream didOpenToHost:anything() withStreamId:anything()];
+    assertThatInteger(stream.state, equalToInteger(XMPPStreamStateClosed));
+}
+
+@end
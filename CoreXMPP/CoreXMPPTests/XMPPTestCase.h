@@ -44,6 +44,7 @@
 #import <OHHTTPStubs/OHHTTPStubs.h>
 
 #import "XMPPStreamFeatureBind.h"
+#import "XMPPStreamFeatureCompression.h"
 #import "XMPPStreamFeatureSASL.h"
 #import "XMPPStreamFeatureSession.h"
 #import "XMPPStreamFeatureStreamManagement.h"
@@ -0,0 +1,171 @@
+//
+//  XMPPTimerWheelTests.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPTestCase.h"
+#import "XMPPTimerWheel.h"
+
+@interface XMPPTimerWheelTests : XMPPTestCase
+
+@end
+
+@implementation XMPPTimerWheelTests
+
+#pragma mark Tests
+
+- (void)testExpireTimers
+{
+    XMPPTimerWheel *timerWheel = [[XMPPTimerWheel alloc] initWithQueue:dispatch_get_main_queue()
+                                                            resolution:1.0
+                                                         numberOfSlots:8];
+    assertThatUnsignedInteger(timerWheel.numberOfSlots, equalToUnsignedInteger(8));
+
+    NSTimeInterval now = [[NSProcessInfo processInfo] systemUptime];
+
+    NSMutableArray *expired = [[NSMutableArray alloc] init];
+    [timerWheel scheduleTimerWithTimeout:30.0
+                                 handler:^{
+                                     [expired addObject:@(30)];
+                                 }];
+    [timerWheel scheduleTimerWithTimeout:2.0
+                                 handler:^{
+                                     [expired addObject:@(2)];
+                                 }];
+    [timerWheel scheduleTimerWithTimeout:10.0
+                                 handler:^{
+                                     [expired addObject:@(10)];
+                                 }];
+
+    assertThatUnsignedInteger(timerWheel.numberOfTimers, equalToUnsignedInteger(3));
+
+    assertThatUnsignedInteger([timerWheel expireTimersUntil:now + 5.0], equalToUnsignedInteger(1));
+    assertThat(expired, contains(@(2), nil));
+
+    // More than one revolution of the wheel
+    assertThatUnsignedInteger([timerWheel expireTimersUntil:now + 20.0], equalToUnsignedInteger(1));
+    assertThat(expired, contains(@(2), @(10), nil));
+
+    assertThatUnsignedInteger([timerWheel expireTimersUntil:now + 40.0], equalToUnsignedInteger(1));
+    assertThat(expired, contains(@(2), @(10), @(30), nil));
+
+    assertThatUnsignedInteger(timerWheel.numberOfTimers, equalToUnsignedInteger(0));
+}
+
+- (void)testCancelTimer
+{
+    XMPPTimerWheel *timerWheel = [[XMPPTimerWheel alloc] initWithQueue:dispatch_get_main_queue()];
+
+    NSTimeInterval now = [[NSProcessInfo processInfo] systemUptime];
+
+    __block NSUInteger numberOfCalls = 0;
+    XMPPTimerWheelEntry *first = [timerWheel scheduleTimerWithTimeout:1.0
+                                                              handler:^{
+                                                                  numberOfCalls += 1;
+                                                              }];
+    XMPPTimerWheelEntry *second = [timerWheel scheduleTimerWithTimeout:1.0
+                                                               handler:^{
+                                                                   numberOfCalls += 1;
+                                                               }];
+
+    [timerWheel cancelTimer:first];
+    assertThatBool(first.scheduled, isFalse());
+    assertThatUnsignedInteger(timerWheel.numberOfTimers, equalToUnsignedInteger(1));
+
+    [timerWheel expireTimersUntil:now + 2.0];
+    assertThatUnsignedInteger(numberOfCalls, equalToUnsignedInteger(1));
+    assertThatBool(second.scheduled, isFalse());
+
+    // Cancelling an expired timer does nothing.
+    [timerWheel cancelTimer:second];
+    assertThatUnsignedInteger(timerWheel.numberOfTimers, equalToUnsignedInteger(0));
+}
+
+- (void)testTimerOnQueue
+{
+    dispatch_queue_t queue = dispatch_queue_create("XMPPTimerWheelTests", DISPATCH_QUEUE_SERIAL);
+    XMPPTimerWheel *timerWheel = [[XMPPTimerWheel alloc] initWithQueue:queue
+                                                            resolution:0.01
+                                                         numberOfSlots:64];
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Expect Timeout"];
+    dispatch_async(queue, ^{
+        [timerWheel scheduleTimerWithTimeout:0.1
+                                     handler:^{
+                                         [expectation fulfill];
+                                     }];
+    });
+    [self waitForExpectationsWithTimeout:2.0 handler:nil];
+
+    dispatch_sync(queue, ^{
+        assertThatUnsignedInteger(timerWheel.numberOfTimers, equalToUnsignedInteger(0));
+    });
+}
+
+#pragma mark Performance
+
+- (void)testTimeoutPerformance
+{
+    // 100000 outstanding timeouts. Every second timer is cancelled (e.g.,
+    // because the response has been received) and the remaining timers
+    // expire as one batch.
+
+    NSUInteger numberOfTimers = 100000;
+
+    [self measureBlock:^{
+        XMPPTimerWheel *timerWheel = [[XMPPTimerWheel alloc] initWithQueue:dispatch_get_main_queue()];
+        NSTimeInterval now = [[NSProcessInfo processInfo] systemUptime];
+
+        __block NSUInteger numberOfExpiredTimers = 0;
+        void (^handler)(void) = ^{
+            numberOfExpiredTimers += 1;
+        };
+
+        NSMutableArray *timers = [[NSMutableArray alloc] initWithCapacity:numberOfTimers];
+        for (NSUInteger i = 0; i < numberOfTimers; i++) {
+            NSTimeInterval timeout = 60.0 + (i % 600) * 0.1;
+            [timers addObject:[timerWheel scheduleTimerWithTimeout:timeout handler:handler]];
+        }
+
+        for (NSUInteger i = 0; i < numberOfTimers; i += 2) {
+            [timerWheel cancelTimer:timers[i]];
+        }
+
+        [timerWheel expireTimersUntil:now + 200.0];
+
+        XCTAssertEqual(numberOfExpiredTimers, numberOfTimers / 2);
+        XCTAssertEqual(timerWheel.numberOfTimers, 0);
+    }];
+}
+
+@end
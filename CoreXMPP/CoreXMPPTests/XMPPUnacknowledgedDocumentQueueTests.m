@@ -0,0 +1,198 @@
+//
+//  XMPPUnacknowledgedDocumentQueueTests.m
+//  CoreXMPP
+//
+//  Created by Tobias Kräntzer on 17.10.26.
+//  Copyright © 2015, 2016, 2017 Tobias Kräntzer. 
+//
+//  This file is part of CoreXMPP.
+//
+//  CoreXMPP is free software: you can redistribute it and/or modify it
+//  under the terms of the GNU General Public License as published by the Free
+//  Software Foundation, either version 3 of the License, or (at your option)
+//  any later version.
+//
+//  CoreXMPP is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+//  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  CoreXMPP. If not, see <http://www.gnu.org/licenses/>.
+//
+//  Linking this library statically or dynamically with other modules is making
+//  a combined work based on this library. Thus, the terms and conditions of the
+//  GNU General Public License cover the whole combination.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules,
+//  and to copy and distribute the resulting executable under terms of your
+//  choice, provided that you also meet, for each linked independent module, the
+//  terms and conditions of the license of that module. An independent module is
+//  a module which is not derived from or based on this library. If you modify
+//  this library, you must extend this exception to your version of the library.
+//
+
+#import "XMPPTestCase.h"
+#import "XMPPUnacknowledgedDocumentQueue.h"
+
+@interface XMPPUnacknowledgedDocumentQueueTests : XMPPTestCase
+
+@end
+
+@implementation XMPPUnacknowledgedDocumentQueueTests
+
+#pragma mark Tests
+
+- (void)testAcknowledgeDocuments
+{
+    XMPPUnacknowledgedDocumentQueue *queue = [[XMPPUnacknowledgedDocumentQueue alloc] init];
+
+    NSMutableArray *documents = [[NSMutableArray alloc] init];
+    NSMutableArray *acknowledged = [[NSMutableArray alloc] init];
+
+    // Enough documents to grow the buffer and to wrap around after the
+    // first acknowledgements.
+    for (NSUInteger i = 0; i < 40; i++) {
+        PXDocument *document = [self xmpp_documentWithIdentifier:i];
+        [documents addObject:document];
+        [queue appendDocument:document
+              acknowledgement:^(NSError *error) {
+                  assertThat(error, nilValue());
+                  [acknowledged addObject:document];
+              }];
+        if (i == 19) {
+            [queue acknowledgeDocuments:10];
+        }
+    }
+
+    assertThatUnsignedInteger(queue.count, equalToUnsignedInteger(30));
+    assertThat([queue documentAtIndex:0], is(documents[10]));
+    assertThat([queue allDocuments], equalTo([documents subarrayWithRange:NSMakeRange(10, 30)]));
+
+    [queue acknowledgeDocuments:25];
+    assertThatUnsignedInteger(queue.count, equalToUnsignedInteger(5));
+    assertThat([queue documentAtIndex:0], is(documents[35]));
+    assertThat(acknowledged, equalTo([documents subarrayWithRange:NSMakeRange(0, 35)]));
+
+    // Acknowledging more documents than queued acknowledges the remaining.
+    [queue acknowledgeDocuments:10];
+    assertThatUnsignedInteger(queue.count, equalToUnsignedInteger(0));
+    assertThat(acknowledged, equalTo(documents));
+}
+
+- (void)testAppendDocumentInAcknowledgement
+{
+    XMPPUnacknowledgedDocumentQueue *queue = [[XMPPUnacknowledgedDocumentQueue alloc] init];
+
+    PXDocument *first = [self xmpp_documentWithIdentifier:1];
+    PXDocument *second = [self xmpp_documentWithIdentifier:2];
+
+    __weak XMPPUnacknowledgedDocumentQueue *weakQueue = queue;
+    [queue appendDocument:first
+          acknowledgement:^(NSError *error) {
+              assertThatUnsignedInteger(weakQueue.count, equalToUnsignedInteger(0));
+              [weakQueue appendDocument:second acknowledgement:nil];
+          }];
+
+    [queue acknowledgeDocuments:1];
+    assertThat([queue allDocuments], equalTo(@[ second ]));
+}
+
+- (void)testCancelAllDocuments
+{
+    XMPPUnacknowledgedDocumentQueue *queue = [[XMPPUnacknowledgedDocumentQueue alloc] init];
+
+    NSError *error = [NSError errorWithDomain:@"XMPPUnacknowledgedDocumentQueueTests" code:1 userInfo:nil];
+
+    __block NSUInteger numberOfCanceledDocuments = 0;
+    for (NSUInteger i = 0; i < 20; i++) {
+        [queue appendDocument:[self xmpp_documentWithIdentifier:i]
+              acknowledgement:^(NSError *e) {
+                  assertThat(e, is(error));
+                  numberOfCanceledDocuments += 1;
+              }];
+    }
+    [queue appendDocument:[self xmpp_documentWithIdentifier:20] acknowledgement:nil];
+
+    [queue cancelAllDocumentsWithError:error];
+
+    assertThatUnsignedInteger(numberOfCanceledDocuments, equalToUnsignedInteger(20));
+    assertThatUnsignedInteger(queue.count, equalToUnsignedInteger(0));
+    assertThat([queue allDocuments], equalTo(@[]));
+}
+
+- (void)testEnumerateDocuments
+{
+    XMPPUnacknowledgedDocumentQueue *queue = [[XMPPUnacknowledgedDocumentQueue alloc] init];
+
+    NSMutableArray *documents = [[NSMutableArray alloc] init];
+    for (NSUInteger i = 0; i < 10; i++) {
+        PXDocument *document = [self xmpp_documentWithIdentifier:i];
+        [documents addObject:document];
+        [queue appendDocument:document acknowledgement:nil];
+    }
+
+    NSMutableArray *enumerated = [[NSMutableArray alloc] init];
+    [queue enumerateDocumentsUsingBlock:^(PXDocument *document, NSUInteger index, BOOL *stop) {
+        assertThat(document, is(documents[index]));
+        [enumerated addObject:document];
+        *stop = index == 4;
+    }];
+
+    assertThat(enumerated, equalTo([documents subarrayWithRange:NSMakeRange(0, 5)]));
+}
+
+#pragma mark Performance
+
+- (void)testQueuePerformance10k
+{
+    [self xmpp_measureQueueWithNumberOfDocuments:10000];
+}
+
+- (void)testQueuePerformance100k
+{
+    [self xmpp_measureQueueWithNumberOfDocuments:100000];
+}
+
+- (void)testQueuePerformance1M
+{
+    [self xmpp_measureQueueWithNumberOfDocuments:1000000];
+}
+
+#pragma mark -
+
+- (void)xmpp_measureQueueWithNumberOfDocuments:(NSUInteger)numberOfDocuments
+{
+    // The documents are acknowledged in chunks (like an <a/> for a batch of
+    // stanzas), while the queue is long.
+
+    PXDocument *document = [self xmpp_documentWithIdentifier:0];
+
+    [self measureBlock:^{
+        XMPPUnacknowledgedDocumentQueue *queue = [[XMPPUnacknowledgedDocumentQueue alloc] init];
+
+        __block NSUInteger numberOfAcknowledgedDocuments = 0;
+        void (^acknowledgement)(NSError *) = ^(NSError *error) {
+            numberOfAcknowledgedDocuments += 1;
+        };
+
+        for (NSUInteger i = 0; i < numberOfDocuments; i++) {
+            [queue appendDocument:document acknowledgement:acknowledgement];
+        }
+        while (queue.count > 0) {
+            [queue acknowledgeDocuments:100];
+        }
+
+        assertThatUnsignedInteger(numberOfAcknowledgedDocuments, equalToUnsignedInteger(numberOfDocuments));
+    }];
+}
+
+- (PXDocument *)xmpp_documentWithIdentifier:(NSUInteger)identifier
+{
+    PXDocument *document = [[PXDocument alloc] initWithElementName:@"message" namespace:@"jabber:client" prefix:nil];
+    [document.root setValue:[@(identifier) stringValue] forAttribute:@"id"];
+    return document;
+}
+
+@end
@@ -33,8 +33,15 @@
 //  this library, you must extend this exception to your version of the library.
 //
 
+#import <netinet/in.h>
+#import <sys/socket.h>
+
 #import "XMPPTestCase.h"
 
+@interface XMPPWebsocketStream (Tests)
+- (BOOL)xmpp_handleControlElementWithBytes:(const char *)bytes length:(NSUInteger)length;
+@end
+
 @interface XMPPWebsocketStreamTests : XMPPTestCase
 
 @end
@@ -145,4 +152,287 @@
     [verifyCount(delegate, times(1)) streamDidClose:stream];
 }
 
+- (void)testRaceDiscoveredEndpoints
+{
+    // Listen on a local port without ever answering the handshake. The
+    // stream should use the second endpoint, which is the actual server.
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {0};
+    address.sin_len = sizeof(address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    bind(listener, (struct sockaddr *)&address, sizeof(address));
+    listen(listener, 8);
+    socklen_t addressLength = sizeof(address);
+    getsockname(listener, (struct sockaddr *)&address, &addressLength);
+
+    NSURL *deadURL = [NSURL URLWithString:[NSString stringWithFormat:@"ws://localhost:%d/xmpp", ntohs(address.sin_port)]];
+    NSURL *liveURL = [NSURL URLWithString:@"ws://localhost:5280/xmpp"];
+
+    [OHHTTPStubs stubRequestsPassingTest:^BOOL(NSURLRequest *request) {
+        return [request.URL.host isEqualToString:@"localhost"] && [request.URL.path isEqualToString:@"/.well-known/host-meta"];
+    }
+        withStubResponse:^OHHTTPStubsResponse *_Nonnull(NSURLRequest *_Nonnull request) {
+            PXDocument *hostMetadata = [[PXDocument alloc] initWithElementName:@"XRD"
+                                                                     namespace:@"http://docs.oasis-open.org/ns/xri/xrd-1.0"
+                                                                        prefix:nil];
+            for (NSURL *URL in @[ deadURL, liveURL ]) {
+                PXElement *link = [hostMetadata.root addElementWithName:@"Link"
+                                                              namespace:@"http://docs.oasis-open.org/ns/xri/xrd-1.0"
+                                                                content:nil];
+                [link setValue:@"urn:xmpp:alt-connections:websocket" forAttribute:@"rel"];
+                [link setValue:[URL absoluteString] forAttribute:@"href"];
+            }
+            return [OHHTTPStubsResponse responseWithData:[hostMetadata data]
+                                              statusCode:200
+                                                 headers:@{}];
+        }];
+
+    XMPPHostMetaCache *cache = [[XMPPHostMetaCache alloc] initWithStorageURL:nil];
+    NSDictionary *options = @{ XMPPWebsocketStreamHostMetaCacheKey : cache };
+    XMPPWebsocketStream *stream = [[XMPPWebsocketStream alloc] initWithHostname:@"localhost"
+                                                                        options:options];
+
+    id<XMPPStreamDelegate> delegate = mockProtocol(@protocol(XMPPStreamDelegate));
+    stream.delegate = delegate;
+
+    XCTestExpectation *waitForOpen = [self expectationWithDescription:@"Open"];
+    [givenVoid([delegate stream:stream didOpenToHost:equalTo(@"localhost") withStreamId:notNilValue()]) willDo:^id(NSInvocation *invocation) {
+        [waitForOpen fulfill];
+        return nil;
+    }];
+    [stream open];
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+
+    //
+    // The winning endpoint is preferred for the next connection
+    //
+
+    XCTestExpectation *waitForLinks = [self expectationWithDescription:@"Links"];
+    [cache linksForHost:@"localhost"
+             completion:^(NSDictionary<NSString *, NSArray<NSURL *> *> *links, NSError *error) {
+                 assertThat(links[XMPPHostMetaLinkRelationWebsocket], contains(liveURL, deadURL, nil));
+                 [waitForLinks fulfill];
+             }];
+    [self waitForExpectationsWithTimeout:2.0 handler:nil];
+
+    XCTestExpectation *waitForClose = [self expectationWithDescription:@"Close"];
+    [givenVoid([delegate streamDidClose:stream]) willDo:^id(NSInvocation *invocation) {
+        [waitForClose fulfill];
+        return nil;
+    }];
+    [stream close];
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+
+    close(listener);
+}
+
+#pragma mark Control Elements
+
+- (XMPPWebsocketStream *)streamInState:(XMPPStreamState)state delegate:(id<XMPPStreamDelegate>)delegate
+{
+    XMPPWebsocketStream *stream = [[XMPPWebsocketStream alloc] initWithHostname:@"example.com"
+                                                                        options:@{}];
+    stream.delegate = delegate;
+    [stream setValue:@(state) forKey:@"state"];
+    return stream;
+}
+
+- (BOOL)stream:(XMPPWebsocketStream *)stream handleControlElement:(NSString *)string
+{
+    NSData *data = [string dataUsingEncoding:NSUTF8StringEncoding];
+    return [stream xmpp_handleControlElementWithBytes:[data bytes] length:[data length]];
+}
+
+- (void)testHandleOpenAndCloseFrames
+{
+    for (NSString *quote in @[ @"'", @"\"" ]) {
+        id<XMPPStreamDelegate> delegate = mockProtocol(@protocol(XMPPStreamDelegate));
+        XMPPWebsocketStream *stream = [self streamInState:XMPPStreamStateOpening delegate:delegate];
+
+        NSString *open = @"<open xmlns='urn:ietf:params:xml:ns:xmpp-framing' from='example.com' id='123' version='1.0' xml:lang='en'/>";
+        assertThatBool([self stream:stream handleControlElement:[open stringByReplacingOccurrencesOfString:@"'" withString:quote]], isTrue());
+        assertThatInteger(stream.state, equalToInteger(XMPPStreamStateOpen));
+        [verify(delegate) stream:stream didOpenToHost:@"example.com" withStreamId:@"123"];
+
+        NSString *close = @"<close xmlns='urn:ietf:params:xml:ns:xmpp-framing'/>";
+        assertThatBool([self stream:stream handleControlElement:[close stringByReplacingOccurrencesOfString:@"'" withString:quote]], isTrue());
+        assertThatInteger(stream.state, equalToInteger(XMPPStreamStateDisconnecting));
+    }
+}
+
+- (void)testHandleAcknowledgementElements
+{
+    for (NSString *quote in @[ @"'", @"\"" ]) {
+        id<XMPPStreamDelegate> delegate = mockProtocol(@protocol(XMPPStreamDelegate));
+        XMPPWebsocketStream *stream = [self streamInState:XMPPStreamStateOpen delegate:delegate];
+
+        NSString *request = @"<r xmlns='urn:xmpp:sm:3'/>";
+        assertThatBool([self stream:stream handleControlElement:[request stringByReplacingOccurrencesOfString:@"'" withString:quote]], isTrue());
+        [verifyCount(delegate, times(1)) streamDidReceiveAcknowledgementRequest:stream];
+
+        NSString *acknowledgement = @" <a xmlns='urn:xmpp:sm:3' h = '42' />\n";
+        assertThatBool([self stream:stream handleControlElement:[acknowledgement stringByReplacingOccurrencesOfString:@"'" withString:quote]], isTrue());
+        [verifyCount(delegate, times(1)) stream:stream didReceiveAcknowledgement:42];
+    }
+}
+
+- (void)testAcknowledgementWithInvalidCount
+{
+    id<XMPPStreamDelegate> delegate = mockProtocol(@protocol(XMPPStreamDelegate));
+    XMPPWebsocketStream *stream = [self streamInState:XMPPStreamStateOpen delegate:delegate];
+
+    // Counts, which are not a plain decimal number or which do not fit
+    // into NSUInteger, are left to the DOM parser.
+
+    NSArray<NSString *> *elements = @[ @"<a xmlns='urn:xmpp:sm:3'/>",
+                                       @"<a xmlns='urn:xmpp:sm:3' h=''/>",
+                                       @"<a xmlns='urn:xmpp:sm:3' h='4a'/>",
+                                       @"<a xmlns='urn:xmpp:sm:3' h='-1'/>",
+                                       @"<a xmlns='urn:xmpp:sm:3' h=' 1'/>",
+                                       @"<a xmlns='urn:xmpp:sm:3' h='18446744073709551616'/>",
+                                       @"<a xmlns='urn:xmpp:sm:3' h='100000000000000000000000000000'/>" ];
+    for (NSString *element in elements) {
+        assertThatBool([self stream:stream handleControlElement:element], isFalse());
+        PXDocument *document = [PXDocument documentWithData:[element dataUsingEncoding:NSUTF8StringEncoding]];
+        assertThat(document.root, equalTo(PXQN(@"urn:xmpp:sm:3", @"a")));
+    }
+
+    [[verifyCount(delegate, never()) withMatcher:anything() forArgument:1] stream:stream didReceiveAcknowledgement:0];
+}
+
+- (void)testControlElementsHandledByDOMParser
+{
+    id<XMPPStreamDelegate> delegate = mockProtocol(@protocol(XMPPStreamDelegate));
+    XMPPWebsocketStream *stream = [self streamInState:XMPPStreamStateOpen delegate:delegate];
+
+    NSArray<NSString *> *requests = @[ @"<sm:r xmlns:sm='urn:xmpp:sm:3'/>",
+                                       @"<r xmlns='urn:xmpp:sm:3'></r>",
+                                       @"<r xmlns='urn:xmpp:sm:3'><foo xmlns='urn:example'/></r>",
+                                       @"<r xmlns='urn:xmpp:sm:3' foo='&amp;'/>",
+                                       @"<r xmlns='urn:xmpp:sm:3' xmlns:foo='urn:example' foo:bar='baz'/>" ];
+    for (NSString *element in requests) {
+        assertThatBool([self stream:stream handleControlElement:element], isFalse());
+        PXDocument *document = [PXDocument documentWithData:[element dataUsingEncoding:NSUTF8StringEncoding]];
+        assertThat(document.root, equalTo(PXQN(@"urn:xmpp:sm:3", @"r")));
+    }
+
+    NSArray<NSString *> *acknowledgements = @[ @"<sm:a xmlns:sm='urn:xmpp:sm:3' h='1'/>",
+                                               @"<a xmlns='urn:xmpp:sm:3' h='&#49;'/>",
+                                               @"<a xmlns='urn:xmpp:sm:3' h='1'><foo xmlns='urn:example'/></a>" ];
+    for (NSString *element in acknowledgements) {
+        assertThatBool([self stream:stream handleControlElement:element], isFalse());
+        PXDocument *document = [PXDocument documentWithData:[element dataUsingEncoding:NSUTF8StringEncoding]];
+        assertThat(document.root, equalTo(PXQN(@"urn:xmpp:sm:3", @"a")));
+    }
+
+    [verifyCount(delegate, never()) streamDidReceiveAcknowledgementRequest:stream];
+    [[verifyCount(delegate, never()) withMatcher:anything() forArgument:1] stream:stream didReceiveAcknowledgement:0];
+    assertThatInteger(stream.state, equalToInteger(XMPPStreamStateOpen));
+}
+
+- (void)testAcknowledgementElementsBeforeOpen
+{
+    for (NSNumber *state in @[ @(XMPPStreamStateClosed), @(XMPPStreamStateOpening) ]) {
+        id<XMPPStreamDelegate> delegate = mockProtocol(@protocol(XMPPStreamDelegate));
+        XMPPWebsocketStream *stream = [self streamInState:[state integerValue] delegate:delegate];
+
+        assertThatBool([self stream:stream handleControlElement:@"<r xmlns='urn:xmpp:sm:3'/>"], isFalse());
+        assertThatBool([self stream:stream handleControlElement:@"<a xmlns='urn:xmpp:sm:3' h='1'/>"], isFalse());
+
+        [verifyCount(delegate, never()) streamDidReceiveAcknowledgementRequest:stream];
+        [[verifyCount(delegate, never()) withMatcher:anything() forArgument:1] stream:stream didReceiveAcknowledgement:0];
+    }
+}
+
+#pragma mark Benchmark
+
+- (void)testOpenAndClosePerformance
+{
+    // Compare with -[XMPPBOSHStreamTests testOpenAndClosePerformance]
+
+    NSDictionary *options = @{ XMPPWebsocketStreamURLKey : [NSURL URLWithString:@"ws://localhost:5280/xmpp"] };
+
+    [self measureBlock:^{
+        XMPPWebsocketStream *stream = [[XMPPWebsocketStream alloc] initWithHostname:@"localhost"
+                                                                            options:options];
+        id<XMPPStreamDelegate> delegate = mockProtocol(@protocol(XMPPStreamDelegate));
+        stream.delegate = delegate;
+
+        XCTestExpectation *waitForOpen = [self expectationWithDescription:@"Open"];
+        [givenVoid([delegate stream:stream didOpenToHost:anything() withStreamId:anything()]) willDo:^id(NSInvocation *invocation) {
+            [waitForOpen fulfill];
+            return nil;
+        }];
+        [stream open];
+        [self waitForExpectationsWithTimeout:10.0 handler:nil];
+
+        XCTestExpectation *waitForClose = [self expectationWithDescription:@"Close"];
+        [givenVoid([delegate streamDidClose:stream]) willDo:^id(NSInvocation *invocation) {
+            [waitForClose fulfill];
+            return nil;
+        }];
+        [stream close];
+        [self waitForExpectationsWithTimeout:10.0 handler:nil];
+    }];
+}
+
+- (void)testStanzaRoundTripPerformance
+{
+    // Compare with -[XMPPBOSHStreamTests testStanzaRoundTripPerformance]
+    //
+    // The in-band registration form can be requested before the stream is
+    // authenticated. Each request is answered by the server.
+
+    NSDictionary *options = @{ XMPPWebsocketStreamURLKey : [NSURL URLWithString:@"ws://localhost:5280/xmpp"] };
+    XMPPWebsocketStream *stream = [[XMPPWebsocketStream alloc] initWithHostname:@"localhost"
+                                                                        options:options];
+    id<XMPPStreamDelegate> delegate = mockProtocol(@protocol(XMPPStreamDelegate));
+    stream.delegate = delegate;
+
+    __block XCTestExpectation *waitForResponses = nil;
+    __block NSUInteger numberOfPendingResponses = 0;
+    [givenVoid([delegate stream:stream didReceiveDocument:anything()]) willDo:^id(NSInvocation *invocation) {
+        PXDocument *document = [[invocation mkt_arguments] lastObject];
+        if ([document.root isEqual:PXQN(@"jabber:client", @"iq")] && numberOfPendingResponses > 0) {
+            numberOfPendingResponses--;
+            if (numberOfPendingResponses == 0) {
+                [waitForResponses fulfill];
+            }
+        }
+        return nil;
+    }];
+
+    XCTestExpectation *waitForOpen = [self expectationWithDescription:@"Open"];
+    [givenVoid([delegate stream:stream didOpenToHost:anything() withStreamId:anything()]) willDo:^id(NSInvocation *invocation) {
+        [waitForOpen fulfill];
+        return nil;
+    }];
+    [stream open];
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+
+    [self measureBlock:^{
+        waitForResponses = [self expectationWithDescription:@"Responses"];
+        numberOfPendingResponses = 100;
+        for (NSUInteger i = 0; i < 100; i++) {
+            PXDocument *request = [[PXDocument alloc] initWithElementName:@"iq" namespace:@"jabber:client" prefix:nil];
+            [request.root setValue:@"get" forAttribute:@"type"];
+            [request.root setValue:[NSString stringWithFormat:@"%lu", (unsigned long)i] forAttribute:@"id"];
+            [request.root addElementWithName:@"query" namespace:@"jabber:iq:register" content:nil];
+            [stream sendDocument:request];
+        }
+        [self waitForExpectationsWithTimeout:10.0 handler:nil];
+    }];
+
+    XCTestExpectation *waitForClose = [self expectationWithDescription:@"Close"];
+    [givenVoid([delegate streamDidClose:stream]) willDo:^id(NSInvocation *invocation) {
+        [waitForClose fulfill];
+        return nil;
+    }];
+    [stream close];
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+}
+
 @end